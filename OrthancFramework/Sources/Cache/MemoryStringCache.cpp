@@ -24,32 +24,43 @@
 #include "../PrecompiledHeaders.h"
 #include "MemoryStringCache.h"
 
+#include "../OrthancException.h"
+
 namespace Orthanc
 {
   class MemoryStringCache::StringValue : public ICacheable
   {
   private:
-    std::string  content_;
+    boost::shared_ptr<const std::string>  content_;
 
   public:
     explicit StringValue(const std::string& content) :
-      content_(content)
+      content_(new std::string(content))
     {
     }
 
     explicit StringValue(const char* buffer, size_t size) :
-      content_(buffer, size)
+      content_(new std::string(buffer, size))
     {
     }
 
-    const std::string& GetContent() const
+    explicit StringValue(const boost::shared_ptr<const std::string>& content) :
+      content_(content)
+    {
+      if (content.get() == NULL)
+      {
+        throw OrthancException(ErrorCode_NullPointer);
+      }
+    }
+
+    const boost::shared_ptr<const std::string>& GetContent() const
     {
       return content_;
     }
 
     virtual size_t GetMemoryUsage() const
     {
-      return content_.size();
+      return content_->size();
     }      
   };
 
@@ -76,6 +87,12 @@ namespace Orthanc
     cache_.Acquire(key, new StringValue(reinterpret_cast<const char*>(buffer), size));
   }
 
+  void MemoryStringCache::Add(const std::string& key,
+                              const boost::shared_ptr<const std::string>& value)
+  {
+    cache_.Acquire(key, new StringValue(value));
+  }
+
   void MemoryStringCache::Invalidate(const std::string &key)
   {
     cache_.Invalidate(key);
@@ -86,6 +103,22 @@ namespace Orthanc
   {
     MemoryObjectCache::Accessor reader(cache_, key, false /* multiple readers are allowed */);
 
+    if (reader.IsValid())
+    {
+      value = *dynamic_cast<StringValue&>(reader.GetValue()).GetContent();
+      return true;
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+  bool MemoryStringCache::Fetch(boost::shared_ptr<const std::string>& value,
+                                const std::string& key)
+  {
+    MemoryObjectCache::Accessor reader(cache_, key, false /* multiple readers are allowed */);
+
     if (reader.IsValid())
     {
       value = dynamic_cast<StringValue&>(reader.GetValue()).GetContent();
@@ -25,6 +25,8 @@
 
 #include "MemoryObjectCache.h"
 
+#include <boost/shared_ptr.hpp>
+
 namespace Orthanc
 {
   /**
@@ -52,9 +54,21 @@ namespace Orthanc
              const void* buffer,
              size_t size);
 
+    // New in Orthanc 1.11.0: The cache shares "value" (no copy)
+    void Add(const std::string& key,
+             const boost::shared_ptr<const std::string>& value);
+
     void Invalidate(const std::string& key);
 
     bool Fetch(std::string& value,
                const std::string& key);
+
+    /**
+     * New in Orthanc 1.11.0: Share the cached value instead of
+     * copying it. The value remains valid as long as "value" is
+     * alive, even if it is removed from the cache in the meantime.
+     **/
+    bool Fetch(boost::shared_ptr<const std::string>& value,
+               const std::string& key);
   };
 }
@@ -27,6 +27,7 @@
 #include "../Endianness.h"
 #include "../OrthancException.h"
 #include "../Logging.h"
+#include "../Toolbox.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -106,6 +107,92 @@ namespace Orthanc
   }
 
 
+#if ORTHANC_ENABLE_MD5 == 1
+  void ZlibCompressor::CompressWithMD5(std::string& compressed,
+                                       std::string& uncompressedMD5,
+                                       std::string& compressedMD5,
+                                       const void* uncompressed,
+                                       size_t uncompressedSize)
+  {
+    // Size of the chunks, small enough to fit in the L2 cache
+    static const size_t CHUNK_SIZE = 64 * 1024;
+
+    Toolbox::MD5Context uncompressedContext;
+    Toolbox::MD5Context compressedContext;
+
+    if (uncompressedSize == 0)
+    {
+      compressed.clear();
+      uncompressedContext.Export(uncompressedMD5);
+      compressedContext.Export(compressedMD5);
+      return;
+    }
+
+    const size_t prefix = (HasPrefixWithUncompressedSize() ? sizeof(uint64_t) : 0);
+
+    uLong bound = compressBound(static_cast<uLong>(uncompressedSize)) + 1024 /* security margin */;
+    compressed.resize(prefix + bound);
+
+    if (HasPrefixWithUncompressedSize())
+    {
+      // Explicitly use litte-endian encoding in size prefix
+      uint64_t s = htole64(static_cast<uint64_t>(uncompressedSize));
+      memcpy(&compressed[0], &s, sizeof(uint64_t));
+      compressedContext.Append(&compressed[0], sizeof(uint64_t));
+    }
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+
+    if (deflateInit(&stream, GetCompressionLevel()) != Z_OK)
+    {
+      throw OrthancException(ErrorCode_InternalError);
+    }
+
+    stream.next_out = reinterpret_cast<Bytef*>(&compressed[prefix]);
+    stream.avail_out = static_cast<uInt>(bound);
+
+    const uint8_t* source = reinterpret_cast<const uint8_t*>(uncompressed);
+    size_t remaining = uncompressedSize;
+    int error;
+
+    do
+    {
+      const size_t chunk = std::min(remaining, CHUNK_SIZE);
+      uncompressedContext.Append(source, chunk);
+
+      Bytef* const start = stream.next_out;
+
+      stream.next_in = const_cast<Bytef*>(source);
+      stream.avail_in = static_cast<uInt>(chunk);
+      source += chunk;
+      remaining -= chunk;
+
+      error = deflate(&stream, remaining == 0 ? Z_FINISH : Z_NO_FLUSH);
+
+      compressedContext.Append(start, stream.next_out - start);
+    }
+    while (error == Z_OK &&
+           stream.avail_in == 0 &&
+           remaining > 0);
+
+    const uLong compressedSize = stream.total_out;
+    deflateEnd(&stream);
+
+    if (error != Z_STREAM_END)
+    {
+      compressed.clear();
+      throw OrthancException(ErrorCode_InternalError, "Error in zlib while compressing");
+    }
+
+    compressed.resize(prefix + compressedSize);
+
+    uncompressedContext.Export(uncompressedMD5);
+    compressedContext.Export(compressedMD5);
+  }
+#endif
+
+
   void ZlibCompressor::Uncompress(std::string& uncompressed,
                                   const void* compressed,
                                   size_t compressedSize)
@@ -40,5 +40,20 @@ namespace Orthanc
     virtual void Uncompress(std::string& uncompressed,
                             const void* compressed,
                             size_t compressedSize) ORTHANC_OVERRIDE;
+
+#if ORTHANC_ENABLE_MD5 == 1
+    /**
+     * New in Orthanc 1.11.0: Compress the buffer by chunks, and
+     * compute the MD5 hashes of both the uncompressed and the
+     * compressed data during the same pass, while the chunks are
+     * still in the CPU cache. The output is a valid zlib stream, but
+     * is not necessarily byte-identical to the one of "Compress()".
+     **/
+    void CompressWithMD5(std::string& compressed,
+                         std::string& uncompressedMD5,
+                         std::string& compressedMD5,
+                         const void* uncompressed,
+                         size_t uncompressedSize);
+#endif
   };
 }
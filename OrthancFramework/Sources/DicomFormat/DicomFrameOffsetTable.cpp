@@ -0,0 +1,505 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "../PrecompiledHeaders.h"
+#include "DicomFrameOffsetTable.h"
+
+#include "../OrthancException.h"
+#include "../SerializationToolbox.h"
+#include "../Toolbox.h"
+
+#include <boost/lexical_cast.hpp>
+#include <cassert>
+
+
+namespace Orthanc
+{
+  static const uint32_t UNDEFINED_LENGTH = 0xffffffffu;
+  static const size_t ITEM_HEADER_SIZE = 8;  // Tag of the item + 32bit length
+
+
+  static uint16_t ReadLittleEndian16(const uint8_t* p)
+  {
+    return (static_cast<uint16_t>(p[0]) |
+            (static_cast<uint16_t>(p[1]) << 8));
+  }
+
+
+  static uint32_t ReadLittleEndian32(const uint8_t* p)
+  {
+    return (static_cast<uint32_t>(p[0]) |
+            (static_cast<uint32_t>(p[1]) << 8) |
+            (static_cast<uint32_t>(p[2]) << 16) |
+            (static_cast<uint32_t>(p[3]) << 24));
+  }
+
+
+  static bool IsTag(const uint8_t* p,
+                    uint16_t group,
+                    uint16_t element)
+  {
+    return (ReadLittleEndian16(p) == group &&
+            ReadLittleEndian16(p + 2) == element);
+  }
+
+
+  static bool IsItem(const uint8_t* p)
+  {
+    return IsTag(p, 0xfffe, 0xe000);
+  }
+
+
+  static bool IsSequenceDelimitation(const uint8_t* p)
+  {
+    return IsTag(p, 0xfffe, 0xe0dd);
+  }
+
+
+  void DicomFrameOffsetTable::AddFrame(uint64_t offset,
+                                       uint64_t size)
+  {
+    offsets_.push_back(offset);
+    sizes_.push_back(size);
+  }
+
+
+  bool DicomFrameOffsetTable::ComputeUncompressed(size_t size,
+                                                  uint64_t position,
+                                                  uint32_t length,
+                                                  unsigned int countFrames,
+                                                  size_t frameSize)
+  {
+    if (frameSize == 0 ||
+        static_cast<uint64_t>(frameSize) * static_cast<uint64_t>(countFrames) > length ||
+        position + length > size)
+    {
+      return false;
+    }
+
+    encapsulated_ = false;
+
+    for (unsigned int i = 0; i < countFrames; i++)
+    {
+      AddFrame(position + static_cast<uint64_t>(i) * frameSize, frameSize);
+    }
+
+    return true;
+  }
+
+
+  bool DicomFrameOffsetTable::ComputeEncapsulated(const uint8_t* dicom,
+                                                  size_t size,
+                                                  uint64_t position,
+                                                  unsigned int countFrames)
+  {
+    // The first item is the basic offset table
+    if (position + ITEM_HEADER_SIZE > size ||
+        !IsItem(dicom + position))
+    {
+      return false;
+    }
+
+    const uint32_t tableLength = ReadLittleEndian32(dicom + position + 4);
+    const uint64_t tablePosition = position + ITEM_HEADER_SIZE;
+
+    if (tableLength == UNDEFINED_LENGTH ||
+        tablePosition + tableLength > size)
+    {
+      return false;
+    }
+
+    // Loop over the fragments, until the sequence delimitation item
+    std::vector<uint64_t> fragmentStart;
+    std::vector<uint64_t> fragmentEnd;
+
+    position = tablePosition + tableLength;
+
+    for (;;)
+    {
+      if (position + ITEM_HEADER_SIZE > size)
+      {
+        return false;  // Truncated file
+      }
+      else if (IsSequenceDelimitation(dicom + position))
+      {
+        break;
+      }
+      else if (!IsItem(dicom + position))
+      {
+        return false;
+      }
+
+      const uint32_t length = ReadLittleEndian32(dicom + position + 4);
+      if (length == UNDEFINED_LENGTH ||
+          position + ITEM_HEADER_SIZE + length > size)
+      {
+        return false;
+      }
+
+      fragmentStart.push_back(position);
+      position += ITEM_HEADER_SIZE + length;
+      fragmentEnd.push_back(position);
+    }
+
+    const size_t countFragments = fragmentStart.size();
+
+    if (countFragments == 0 ||
+        countFragments < countFrames)
+    {
+      return false;
+    }
+
+    encapsulated_ = true;
+
+    if (countFragments == countFrames)
+    {
+      // Simple case: There is one fragment per frame
+      for (size_t i = 0; i < countFragments; i++)
+      {
+        AddFrame(fragmentStart[i], fragmentEnd[i] - fragmentStart[i]);
+      }
+
+      return true;
+    }
+    else if (countFrames == 1)
+    {
+      // One single frame that overlaps all the fragments
+      AddFrame(fragmentStart[0], fragmentEnd[countFragments - 1] - fragmentStart[0]);
+      return true;
+    }
+
+    // Several fragments per frame: Use the basic offset table, whose
+    // offsets are relative to the first byte of the first fragment
+    if (tableLength != 4u * countFrames)
+    {
+      return false;
+    }
+
+    std::vector<uint64_t> frameStart;
+    frameStart.reserve(countFrames);
+    frameStart.push_back(fragmentStart[0]);
+
+    if (ReadLittleEndian32(dicom + tablePosition) != 0)
+    {
+      return false;
+    }
+
+    for (size_t i = 1; i < countFragments && frameStart.size() < countFrames; i++)
+    {
+      const uint32_t expected = ReadLittleEndian32(dicom + tablePosition + 4u * frameStart.size());
+      if (fragmentStart[i] - fragmentStart[0] == expected)
+      {
+        frameStart.push_back(fragmentStart[i]);
+      }
+    }
+
+    if (frameStart.size() != countFrames)
+    {
+      return false;
+    }
+
+    for (size_t i = 0; i < countFrames; i++)
+    {
+      const uint64_t end = (i + 1 < countFrames ? frameStart[i + 1] : fragmentEnd[countFragments - 1]);
+      AddFrame(frameStart[i], end - frameStart[i]);
+    }
+
+    return true;
+  }
+
+
+  DicomFrameOffsetTable::DicomFrameOffsetTable() :
+    encapsulated_(false)
+  {
+  }
+
+
+  void DicomFrameOffsetTable::Clear()
+  {
+    encapsulated_ = false;
+    offsets_.clear();
+    sizes_.clear();
+  }
+
+
+  uint64_t DicomFrameOffsetTable::GetFrameStart(size_t frame) const
+  {
+    if (frame >= offsets_.size())
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+    else
+    {
+      return offsets_[frame];
+    }
+  }
+
+
+  uint64_t DicomFrameOffsetTable::GetFrameEnd(size_t frame) const
+  {
+    return GetFrameStart(frame) + sizes_[frame];
+  }
+
+
+  void DicomFrameOffsetTable::ExtractFrame(std::string& target,
+                                           size_t frame,
+                                           const void* range,
+                                           size_t rangeSize) const
+  {
+    if (frame >= sizes_.size())
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+    else if (rangeSize != sizes_[frame] ||
+             (rangeSize != 0 && range == NULL))
+    {
+      throw OrthancException(ErrorCode_BadFileFormat, "Outdated frame offset table");
+    }
+
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(range);
+
+    if (!encapsulated_)
+    {
+      target.assign(reinterpret_cast<const char*>(p), rangeSize);
+      return;
+    }
+
+    target.clear();
+    target.reserve(rangeSize);
+
+    size_t position = 0;
+    while (position < rangeSize)
+    {
+      if (position + ITEM_HEADER_SIZE > rangeSize ||
+          !IsItem(p + position))
+      {
+        throw OrthancException(ErrorCode_BadFileFormat, "Outdated frame offset table");
+      }
+
+      const uint32_t length = ReadLittleEndian32(p + position + 4);
+      position += ITEM_HEADER_SIZE;
+
+      if (length == UNDEFINED_LENGTH ||
+          position + length > rangeSize)
+      {
+        throw OrthancException(ErrorCode_BadFileFormat, "Outdated frame offset table");
+      }
+
+      target.append(reinterpret_cast<const char*>(p + position), length);
+      position += length;
+    }
+  }
+
+
+  void DicomFrameOffsetTable::Format(std::string& target) const
+  {
+    if (offsets_.empty())
+    {
+      target.clear();
+    }
+    else if (encapsulated_)
+    {
+      target = "E";
+
+      for (size_t i = 0; i < offsets_.size(); i++)
+      {
+        target += (";" + boost::lexical_cast<std::string>(offsets_[i]) +
+                   "," + boost::lexical_cast<std::string>(sizes_[i]));
+      }
+    }
+    else
+    {
+      // All the uncompressed frames have the same size and are
+      // contiguous: Only store the position of the first frame
+      target = ("U;" + boost::lexical_cast<std::string>(offsets_[0]) +
+                ";" + boost::lexical_cast<std::string>(sizes_[0]) +
+                ";" + boost::lexical_cast<std::string>(offsets_.size()));
+    }
+  }
+
+
+  static bool IsInsideFile(uint64_t offset,
+                           uint64_t size,
+                           uint64_t fileSize)
+  {
+    return (size <= fileSize &&
+            offset <= fileSize - size);
+  }
+
+
+  bool DicomFrameOffsetTable::Parse(const std::string& source,
+                                    uint64_t fileSize)
+  {
+    Clear();
+
+    std::vector<std::string> tokens;
+    Toolbox::TokenizeString(tokens, source, ';');
+
+    if (tokens.size() == 4 &&
+        tokens[0] == "U")
+    {
+      uint64_t start, frameSize;
+      uint32_t count;
+      if (!SerializationToolbox::ParseUnsignedInteger64(start, tokens[1]) ||
+          !SerializationToolbox::ParseUnsignedInteger64(frameSize, tokens[2]) ||
+          !SerializationToolbox::ParseUnsignedInteger32(count, tokens[3]) ||
+          count == 0 ||
+          frameSize == 0 ||
+          count > fileSize / frameSize ||
+          !IsInsideFile(start, frameSize * count, fileSize))
+      {
+        return false;
+      }
+
+      for (uint32_t i = 0; i < count; i++)
+      {
+        AddFrame(start + static_cast<uint64_t>(i) * frameSize, frameSize);
+      }
+
+      return true;
+    }
+    else if (tokens.size() >= 2 &&
+             tokens[0] == "E")
+    {
+      encapsulated_ = true;
+
+      for (size_t i = 1; i < tokens.size(); i++)
+      {
+        std::vector<std::string> range;
+        Toolbox::TokenizeString(range, tokens[i], ',');
+
+        uint64_t offset, size;
+        if (range.size() != 2 ||
+            !SerializationToolbox::ParseUnsignedInteger64(offset, range[0]) ||
+            !SerializationToolbox::ParseUnsignedInteger64(size, range[1]) ||
+            !IsInsideFile(offset, size, fileSize))
+        {
+          Clear();
+          return false;
+        }
+
+        AddFrame(offset, size);
+      }
+
+      return true;
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+
+  bool DicomFrameOffsetTable::Compute(const void* dicom,
+                                      size_t size,
+                                      uint64_t pixelDataOffset,
+                                      DicomTransferSyntax transferSyntax,
+                                      unsigned int countFrames,
+                                      size_t uncompressedFrameSize)
+  {
+    Clear();
+
+    if (dicom == NULL ||
+        countFrames == 0 ||
+        pixelDataOffset + 12 > size ||
+        transferSyntax == DicomTransferSyntax_BigEndianExplicit ||
+        transferSyntax == DicomTransferSyntax_DeflatedLittleEndianExplicit)
+    {
+      return false;
+    }
+
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(dicom);
+    const uint64_t pos = pixelDataOffset;
+
+    if (!IsTag(p + pos, 0x7fe0, 0x0010))
+    {
+      return false;
+    }
+
+    uint32_t length;
+    uint64_t position;
+
+    if (transferSyntax == DicomTransferSyntax_LittleEndianImplicit)
+    {
+      length = ReadLittleEndian32(p + pos + 4);
+      position = pos + 8;
+    }
+    else if ((p[pos + 4] == 'O' && (p[pos + 5] == 'B' || p[pos + 5] == 'W')) ||
+             (p[pos + 4] == 'U' && p[pos + 5] == 'N'))
+    {
+      // Explicit VR, with 2 reserved bytes and a 32bit length
+      length = ReadLittleEndian32(p + pos + 8);
+      position = pos + 12;
+    }
+    else
+    {
+      return false;
+    }
+
+    const bool isUncompressed = (transferSyntax == DicomTransferSyntax_LittleEndianImplicit ||
+                                 transferSyntax == DicomTransferSyntax_LittleEndianExplicit);
+
+    bool success;
+
+    if (length == UNDEFINED_LENGTH)
+    {
+      success = (!isUncompressed &&
+                 ComputeEncapsulated(p, size, position, countFrames));
+    }
+    else
+    {
+      success = (isUncompressed &&
+                 ComputeUncompressed(size, position, length, countFrames, uncompressedFrameSize));
+    }
+
+    if (success)
+    {
+      assert(offsets_.size() == countFrames &&
+             sizes_.size() == countFrames);
+      return true;
+    }
+    else
+    {
+      Clear();
+      return false;
+    }
+  }
+
+
+  MimeType DicomFrameOffsetTable::GetRawFrameMimeType(DicomTransferSyntax transferSyntax)
+  {
+    // Same behavior as "ParsedDicomFile::GetRawFrame()"
+    switch (transferSyntax)
+    {
+      case DicomTransferSyntax_JPEGProcess1:
+        return MimeType_Jpeg;
+
+      case DicomTransferSyntax_JPEG2000LosslessOnly:
+      case DicomTransferSyntax_JPEG2000:
+        return MimeType_Jpeg2000;
+
+      default:
+        return MimeType_Binary;
+    }
+  }
+}
@@ -0,0 +1,124 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "../Enumerations.h"
+
+#include <boost/noncopyable.hpp>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+namespace Orthanc
+{
+  /**
+   * This class stores the location of each frame inside the raw
+   * bytes of a DICOM file. It is computed once by walking the pixel
+   * data element (without DCMTK), which makes it possible to
+   * retrieve one single frame of a large multi-frame instance by
+   * reading a range of the file. For encapsulated transfer syntaxes,
+   * the range of a frame includes the headers of its fragments,
+   * which are removed (and checked) by "ExtractFrame()".
+   **/
+  class ORTHANC_PUBLIC DicomFrameOffsetTable : public boost::noncopyable
+  {
+  private:
+    bool                   encapsulated_;
+    std::vector<uint64_t>  offsets_;
+    std::vector<uint64_t>  sizes_;
+
+    void AddFrame(uint64_t offset,
+                  uint64_t size);
+
+    bool ComputeUncompressed(size_t size,
+                             uint64_t position,
+                             uint32_t length,
+                             unsigned int countFrames,
+                             size_t frameSize);
+
+    bool ComputeEncapsulated(const uint8_t* dicom,
+                             size_t size,
+                             uint64_t position,
+                             unsigned int countFrames);
+
+  public:
+    DicomFrameOffsetTable();
+
+    void Clear();
+
+    bool IsEncapsulated() const
+    {
+      return encapsulated_;
+    }
+
+    size_t GetFramesCount() const
+    {
+      return offsets_.size();
+    }
+
+    // Offset of the first byte of the range to be read (inclusive)
+    uint64_t GetFrameStart(size_t frame) const;
+
+    // Offset of the last byte of the range to be read (exclusive)
+    uint64_t GetFrameEnd(size_t frame) const;
+
+    /**
+     * Convert the range of bytes "[GetFrameStart(frame),
+     * GetFrameEnd(frame)[" that was read from the DICOM file, into
+     * the raw content of the frame. Throws "ErrorCode_BadFileFormat"
+     * if the range doesn't correspond to the table (which indicates
+     * that the table is outdated).
+     **/
+    void ExtractFrame(std::string& target,
+                      size_t frame,
+                      const void* range,
+                      size_t rangeSize) const;
+
+    void Format(std::string& target) const;
+
+    // Returns "false" if the serialized table is corrupted, or if
+    // some frame lies beyond the end of the DICOM file, whose size is
+    // "fileSize" (this bounds the number of frames to be allocated)
+    bool Parse(const std::string& source,
+               uint64_t fileSize);
+
+    /**
+     * Compute the table, given the offset of the pixel data element,
+     * as returned by "DicomStreamReader::LookupPixelDataOffset()".
+     * The "uncompressedFrameSize" is only used for uncompressed
+     * transfer syntaxes. Returns "false" if the layout of the pixel
+     * data is not supported (e.g. big endian, or missing basic
+     * offset table).
+     **/
+    bool Compute(const void* dicom,
+                 size_t size,
+                 uint64_t pixelDataOffset,
+                 DicomTransferSyntax transferSyntax,
+                 unsigned int countFrames,
+                 size_t uncompressedFrameSize);
+
+    static MimeType GetRawFrameMimeType(DicomTransferSyntax transferSyntax);
+  };
+}
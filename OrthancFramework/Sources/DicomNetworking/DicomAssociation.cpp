@@ -424,6 +424,22 @@ namespace Orthanc
     }
   }
 
+
+  bool DicomAssociation::IsHealthy() const
+  {
+    if (isOpen_)
+    {
+      assert(assoc_ != NULL);
+
+      // An idle SCU association should not receive any data
+      return !ASC_dataWaiting(assoc_, 0 /* don't wait */);
+    }
+    else
+    {
+      return true;  // The association will be opened on the next command
+    }
+  }
+
     
   bool DicomAssociation::LookupAcceptedPresentationContext(std::map<DicomTransferSyntax, uint8_t>& target,
                                                            const std::string& abstractSyntax) const
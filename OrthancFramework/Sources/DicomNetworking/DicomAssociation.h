@@ -102,6 +102,14 @@ namespace Orthanc
     
     void Close();
 
+    /**
+     * New in Orthanc 1.11.0: Returns "false" if the association is
+     * open, but if the remote modality has sent data (typically an
+     * A-ABORT) or has closed the TCP connection while no DIMSE command
+     * was pending. This check does not send anything over the network.
+     **/
+    bool IsHealthy() const;
+
     bool LookupAcceptedPresentationContext(
       std::map<DicomTransferSyntax, uint8_t>& target,
       const std::string& abstractSyntax) const;
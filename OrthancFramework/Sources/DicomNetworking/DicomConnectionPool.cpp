@@ -0,0 +1,361 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "../PrecompiledHeaders.h"
+#include "DicomConnectionPool.h"
+
+#include "../Logging.h"
+#include "../OrthancException.h"
+#include "../Toolbox.h"
+
+#include <boost/lexical_cast.hpp>
+
+namespace Orthanc
+{
+  static boost::posix_time::ptime GetNow()
+  {
+    return boost::posix_time::microsec_clock::universal_time();
+  }
+
+
+  namespace
+  {
+    // Closes the connections that were removed from the pool, once
+    // the mutex of the pool is unlocked (i.e. the object must be
+    // declared before the "scoped_lock")
+    class UnlinkedConnections : public boost::noncopyable
+    {
+    private:
+      std::list<DicomStoreUserConnection*>  connections_;
+
+    public:
+      ~UnlinkedConnections()
+      {
+        for (std::list<DicomStoreUserConnection*>::iterator
+               it = connections_.begin(); it != connections_.end(); ++it)
+        {
+          assert(*it != NULL);
+          delete *it;
+        }
+      }
+
+      void Add(DicomStoreUserConnection* connection)
+      {
+        assert(connection != NULL);
+        connections_.push_back(connection);
+      }
+    };
+  }
+
+
+  std::string DicomConnectionPool::GetKey(const DicomAssociationParameters& parameters)
+  {
+    // All the parameters must match for a connection to be reused
+    // (including e.g. DICOM TLS or the permission to transcode, in
+    // the case the modality was modified in the meantime)
+    Json::Value serialized = Json::objectValue;
+    parameters.SerializeJob(serialized);
+
+    std::string key;
+    Toolbox::WriteFastJson(key, serialized);
+    return key;
+  }
+
+
+  std::string DicomConnectionPool::GetRemote(const DicomAssociationParameters& parameters)
+  {
+    const RemoteModalityParameters& remote = parameters.GetRemoteModality();
+    return (remote.GetApplicationEntityTitle() + "@" + remote.GetHost() + ":" +
+            boost::lexical_cast<std::string>(remote.GetPortNumber()));
+  }
+
+
+  // Mutex must be locked
+  DicomStoreUserConnection* DicomConnectionPool::UnlinkInternal(IdleConnections::iterator connection)
+  {
+    assert(connection->connection_ != NULL);
+
+    CLOG(INFO, DICOM) << "Closing pooled DICOM association with modality: " << connection->remote_;
+
+    DicomStoreUserConnection* unlinked = connection->connection_;
+
+    CountPerRemote::iterator count = countPerRemote_.find(connection->remote_);
+    assert(count != countPerRemote_.end() && count->second > 0);
+
+    if (count->second <= 1)
+    {
+      countPerRemote_.erase(count);
+    }
+    else
+    {
+      count->second--;
+    }
+
+    idle_.erase(connection);
+    released_.notify_all();
+
+    return unlinked;
+  }
+
+
+  // Mutex must be locked
+  DicomStoreUserConnection* DicomConnectionPool::AcquireInternal(boost::mutex::scoped_lock& lock,
+                                                                 const std::string& key,
+                                                                 const std::string& remote,
+                                                                 const DicomAssociationParameters& parameters)
+  {
+    for (;;)
+    {
+      std::unique_ptr<DicomStoreUserConnection> unlinked;
+
+      // 1. Reuse the most recent idle connection with the same
+      // parameters, after checking that the remote modality has not
+      // closed it in the meantime
+      IdleConnections::iterator it = idle_.begin();
+      while (it != idle_.end() &&
+             unlinked.get() == NULL)
+      {
+        if (it->key_ != key)
+        {
+          ++it;
+        }
+        else if (it->connection_->IsHealthy())
+        {
+          DicomStoreUserConnection* connection = it->connection_;
+          idle_.erase(it);
+          countReused_++;
+          return connection;
+        }
+        else
+        {
+          CLOG(INFO, DICOM) << "The pooled DICOM association with modality "
+                            << remote << " was closed by the remote side";
+          countUnhealthy_++;
+          unlinked.reset(UnlinkInternal(it));
+        }
+      }
+
+      if (unlinked.get() == NULL)
+      {
+        // 2. Create a new connection, if the limit is not reached
+        CountPerRemote::iterator count = countPerRemote_.find(remote);
+        if (maxPerRemote_ == 0 ||
+            count == countPerRemote_.end() ||
+            count->second < maxPerRemote_)
+        {
+          std::unique_ptr<DicomStoreUserConnection> connection(new DicomStoreUserConnection(parameters));
+          countPerRemote_[remote]++;
+          countCreated_++;
+          return connection.release();
+        }
+
+        // 3. Make room by closing the least recently used idle
+        // connection to the same modality, but with other parameters
+        for (IdleConnections::reverse_iterator oldest = idle_.rbegin(); oldest != idle_.rend(); ++oldest)
+        {
+          if (oldest->remote_ == remote)
+          {
+            IdleConnections::iterator victim = oldest.base();
+            --victim;
+            unlinked.reset(UnlinkInternal(victim));
+            break;
+          }
+        }
+      }
+
+      if (unlinked.get() != NULL)
+      {
+        // Close the association without blocking the other callers,
+        // then scan the pool again, as it may have changed meanwhile
+        lock.unlock();
+        unlinked.reset(NULL);
+        lock.lock();
+      }
+      else
+      {
+        // 4. Wait for another caller to release its connection
+        CLOG(INFO, DICOM) << "Waiting for a DICOM association with modality " << remote
+                          << " to be released (limit of " << maxPerRemote_ << " associations)";
+        released_.wait(lock);
+      }
+    }
+  }
+
+
+  void DicomConnectionPool::Release(const std::string& key,
+                                    const std::string& remote,
+                                    DicomStoreUserConnection* connection,
+                                    bool reusable)
+  {
+    assert(connection != NULL);
+
+    UnlinkedConnections unlinked;
+    boost::mutex::scoped_lock lock(mutex_);
+
+    IdleConnection idle;
+    idle.key_ = key;
+    idle.remote_ = remote;
+    idle.connection_ = connection;
+    idle.lastUse_ = GetNow();
+    idle_.push_front(idle);
+
+    if (!reusable ||
+        timeout_.total_milliseconds() == 0)
+    {
+      unlinked.Add(UnlinkInternal(idle_.begin()));
+    }
+    else
+    {
+      released_.notify_all();
+    }
+  }
+
+
+  DicomConnectionPool::Accessor::Accessor(DicomConnectionPool& pool,
+                                          const DicomAssociationParameters& parameters) :
+    pool_(pool),
+    key_(GetKey(parameters)),
+    remote_(GetRemote(parameters)),
+    connection_(NULL),
+    reusable_(true)
+  {
+    boost::mutex::scoped_lock lock(pool_.mutex_);
+    connection_ = pool_.AcquireInternal(lock, key_, remote_, parameters);
+  }
+
+
+  DicomConnectionPool::Accessor::~Accessor()
+  {
+    try
+    {
+      pool_.Release(key_, remote_, connection_, reusable_);
+    }
+    catch (OrthancException& e)
+    {
+      LOG(ERROR) << "Cannot release a DICOM association: " << e.What();
+    }
+  }
+
+
+  DicomStoreUserConnection& DicomConnectionPool::Accessor::GetConnection()
+  {
+    assert(connection_ != NULL);
+    return *connection_;
+  }
+
+
+  DicomConnectionPool::DicomConnectionPool() :
+    timeout_(boost::posix_time::milliseconds(1000)),
+    maxPerRemote_(0),
+    countCreated_(0),
+    countReused_(0),
+    countUnhealthy_(0)
+  {
+  }
+
+
+  DicomConnectionPool::~DicomConnectionPool()
+  {
+    Close();
+  }
+
+
+  void DicomConnectionPool::SetInactivityTimeout(unsigned int milliseconds)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    timeout_ = boost::posix_time::milliseconds(milliseconds);
+  }
+
+
+  unsigned int DicomConnectionPool::GetInactivityTimeout()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return static_cast<unsigned int>(timeout_.total_milliseconds());
+  }
+
+
+  void DicomConnectionPool::SetMaxConnectionsPerRemote(unsigned int count)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    maxPerRemote_ = count;
+    released_.notify_all();
+  }
+
+
+  unsigned int DicomConnectionPool::GetMaxConnectionsPerRemote()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return maxPerRemote_;
+  }
+
+
+  void DicomConnectionPool::Close()
+  {
+    UnlinkedConnections unlinked;
+    boost::mutex::scoped_lock lock(mutex_);
+
+    while (!idle_.empty())
+    {
+      unlinked.Add(UnlinkInternal(idle_.begin()));
+    }
+  }
+
+
+  void DicomConnectionPool::CloseIfInactive()
+  {
+    UnlinkedConnections unlinked;
+    boost::mutex::scoped_lock lock(mutex_);
+
+    const boost::posix_time::ptime now = GetNow();
+
+    IdleConnections::iterator it = idle_.begin();
+    while (it != idle_.end())
+    {
+      if ((now - it->lastUse_) >= timeout_ ||
+          !it->connection_->IsHealthy())
+      {
+        IdleConnections::iterator next = it;
+        ++next;
+        unlinked.Add(UnlinkInternal(it));
+        it = next;
+      }
+      else
+      {
+        ++it;
+      }
+    }
+  }
+
+
+  void DicomConnectionPool::GetStatistics(uint64_t& countCreated,
+                                          uint64_t& countReused,
+                                          uint64_t& countUnhealthy,
+                                          unsigned int& countIdle)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    countCreated = countCreated_;
+    countReused = countReused_;
+    countUnhealthy = countUnhealthy_;
+    countIdle = static_cast<unsigned int>(idle_.size());
+  }
+}
@@ -0,0 +1,150 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#if !defined(ORTHANC_ENABLE_DCMTK_NETWORKING)
+#  error The macro ORTHANC_ENABLE_DCMTK_NETWORKING must be defined
+#endif
+
+#if ORTHANC_ENABLE_DCMTK_NETWORKING != 1
+#  error The macro ORTHANC_ENABLE_DCMTK_NETWORKING must be 1 to use this file
+#endif
+
+
+#include "../Compatibility.h"
+#include "DicomStoreUserConnection.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <list>
+
+namespace Orthanc
+{
+  /**
+   * New in Orthanc 1.11.0: Process-wide pool of the DICOM SCU
+   * connections that are used to send C-STORE requests. Once
+   * released, a connection is kept open (together with the
+   * presentation contexts that were negotiated with the remote
+   * modality) during the inactivity timeout, so that it can be reused
+   * by the next caller using the same association parameters.
+   **/
+  class ORTHANC_PUBLIC DicomConnectionPool : public boost::noncopyable
+  {
+  private:
+    struct IdleConnection
+    {
+      std::string                 key_;
+      std::string                 remote_;
+      DicomStoreUserConnection*   connection_;
+      boost::posix_time::ptime    lastUse_;
+    };
+
+    typedef std::list<IdleConnection>            IdleConnections;  // The most recent first
+    typedef std::map<std::string, unsigned int>  CountPerRemote;
+
+    boost::mutex                      mutex_;
+    boost::condition_variable         released_;
+    IdleConnections                   idle_;
+    CountPerRemote                    countPerRemote_;  // Both active and idle connections
+    boost::posix_time::time_duration  timeout_;
+    unsigned int                      maxPerRemote_;
+    uint64_t                          countCreated_;
+    uint64_t                          countReused_;
+    uint64_t                          countUnhealthy_;
+
+    static std::string GetKey(const DicomAssociationParameters& parameters);
+
+    static std::string GetRemote(const DicomAssociationParameters& parameters);
+
+    // Mutex must be locked. The connection is removed from the pool,
+    // and must be deleted by the caller after the mutex is unlocked,
+    // as releasing the association is a network round-trip.
+    DicomStoreUserConnection* UnlinkInternal(IdleConnections::iterator connection);
+
+    // Mutex must be locked, but it is temporarily unlocked to close
+    // the connections that are not reusable
+    DicomStoreUserConnection* AcquireInternal(boost::mutex::scoped_lock& lock,
+                                              const std::string& key,
+                                              const std::string& remote,
+                                              const DicomAssociationParameters& parameters);
+
+    void Release(const std::string& key,
+                 const std::string& remote,
+                 DicomStoreUserConnection* connection,
+                 bool reusable);
+
+  public:
+    class ORTHANC_PUBLIC Accessor : public boost::noncopyable
+    {
+    private:
+      DicomConnectionPool&       pool_;
+      std::string                key_;
+      std::string                remote_;
+      DicomStoreUserConnection*  connection_;
+      bool                       reusable_;
+
+    public:
+      // Blocks if the maximum number of connections to the remote
+      // modality is reached
+      Accessor(DicomConnectionPool& pool,
+               const DicomAssociationParameters& parameters);
+
+      ~Accessor();
+
+      DicomStoreUserConnection& GetConnection();
+
+      // The connection will be closed instead of being given back to
+      // the pool (e.g. after an error, or if the remote modality
+      // expects the association to be released)
+      void Discard()
+      {
+        reusable_ = false;
+      }
+    };
+
+    DicomConnectionPool();
+
+    ~DicomConnectionPool();
+
+    void SetInactivityTimeout(unsigned int milliseconds);
+
+    unsigned int GetInactivityTimeout();  // In milliseconds
+
+    // Maximum number of simultaneous associations to one remote
+    // modality (both active and idle), "0" means no limit
+    void SetMaxConnectionsPerRemote(unsigned int count);
+
+    unsigned int GetMaxConnectionsPerRemote();
+
+    void Close();
+
+    void CloseIfInactive();
+
+    void GetStatistics(uint64_t& countCreated,
+                       uint64_t& countReused,
+                       uint64_t& countUnhealthy,
+                       unsigned int& countIdle);
+  };
+}
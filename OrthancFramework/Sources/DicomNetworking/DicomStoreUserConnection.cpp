@@ -169,6 +169,11 @@ namespace Orthanc
     return parameters_;
   }
 
+  bool DicomStoreUserConnection::IsHealthy() const
+  {
+    return association_->IsHealthy();
+  }
+
   void DicomStoreUserConnection::SetCommonClassesProposed(bool proposed)
   {
     proposeCommonClasses_ = proposed;
@@ -107,6 +107,9 @@ namespace Orthanc
     
     const DicomAssociationParameters& GetParameters() const;
 
+    // New in Orthanc 1.11.0
+    bool IsHealthy() const;
+
     void SetCommonClassesProposed(bool proposed);
 
     bool IsCommonClassesProposed() const;
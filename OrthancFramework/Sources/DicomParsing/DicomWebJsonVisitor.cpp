@@ -301,6 +301,22 @@ namespace Orthanc
     }
   }
 
+
+  void DicomWebJsonVisitor::AddNode(const std::vector<DicomTag>& parentTags,
+                                    const std::vector<size_t>& parentIndexes,
+                                    const DicomTag& tag,
+                                    Json::Value& node)
+  {
+    if (sink_ == NULL)
+    {
+      CreateNode(parentTags, parentIndexes, tag).swap(node);
+    }
+    else
+    {
+      sink_->AddAttribute(parentTags, parentIndexes, tag, node);
+    }
+  }
+
     
   Json::Value DicomWebJsonVisitor::FormatInteger(int64_t value)
   {
@@ -341,7 +357,8 @@ namespace Orthanc
   }
 
   DicomWebJsonVisitor::DicomWebJsonVisitor() :
-    formatter_(NULL)
+    formatter_(NULL),
+    sink_(NULL)
   {
     Clear();
   }
@@ -351,6 +368,11 @@ namespace Orthanc
     formatter_ = &formatter;
   }
 
+  void DicomWebJsonVisitor::SetSink(ISink& sink)
+  {
+    sink_ = &sink;
+  }
+
   void DicomWebJsonVisitor::Clear()
   {
     result_ = Json::objectValue;
@@ -391,8 +413,9 @@ namespace Orthanc
     if (countItems == 0 &&
         tag.GetElement() != 0x0000)
     {
-      Json::Value& node = CreateNode(parentTags, parentIndexes, tag);
+      Json::Value node = Json::objectValue;
       node[KEY_VR] = EnumerationToString(ValueRepresentation_Sequence);
+      AddNode(parentTags, parentIndexes, tag, node);
     }
 
     return Action_None;
@@ -430,7 +453,7 @@ namespace Orthanc
 
       if (mode != BinaryMode_Ignore)
       {
-        Json::Value& node = CreateNode(parentTags, parentIndexes, tag);
+        Json::Value node = Json::objectValue;
         node[KEY_VR] = EnumerationToString(vr);
 
         /**
@@ -463,6 +486,8 @@ namespace Orthanc
               throw OrthancException(ErrorCode_ParameterOutOfRange);
           }
         }
+
+        AddNode(parentTags, parentIndexes, tag, node);
       }
     }
 
@@ -480,7 +505,7 @@ namespace Orthanc
     if (tag.GetElement() != 0x0000 &&
         vr != ValueRepresentation_NotSupported)
     {
-      Json::Value& node = CreateNode(parentTags, parentIndexes, tag);
+      Json::Value node = Json::objectValue;
       node[KEY_VR] = EnumerationToString(vr);
 
       if (!values.empty())
@@ -493,6 +518,8 @@ namespace Orthanc
 
         node[KEY_VALUE] = content;
       }
+
+      AddNode(parentTags, parentIndexes, tag, node);
     }
 
     return Action_None;
@@ -508,7 +535,7 @@ namespace Orthanc
     if (tag.GetElement() != 0x0000 &&
         vr != ValueRepresentation_NotSupported)
     {
-      Json::Value& node = CreateNode(parentTags, parentIndexes, tag);
+      Json::Value node = Json::objectValue;
       node[KEY_VR] = EnumerationToString(vr);
 
       if (!values.empty())
@@ -521,6 +548,8 @@ namespace Orthanc
           
         node[KEY_VALUE] = content;
       }
+
+      AddNode(parentTags, parentIndexes, tag, node);
     }
 
     return Action_None;
@@ -535,7 +564,7 @@ namespace Orthanc
   {
     if (tag.GetElement() != 0x0000)
     {
-      Json::Value& node = CreateNode(parentTags, parentIndexes, tag);
+      Json::Value node = Json::objectValue;
       node[KEY_VR] = EnumerationToString(ValueRepresentation_AttributeTag);
 
       if (!values.empty())
@@ -548,6 +577,8 @@ namespace Orthanc
           
         node[KEY_VALUE] = content;
       }
+
+      AddNode(parentTags, parentIndexes, tag, node);
     }
 
     return Action_None;
@@ -569,7 +600,7 @@ namespace Orthanc
     }
     else
     {
-      Json::Value& node = CreateNode(parentTags, parentIndexes, tag);
+      Json::Value node = Json::objectValue;
       node[KEY_VR] = EnumerationToString(vr);
 
 #if 0
@@ -717,6 +748,8 @@ namespace Orthanc
           }
         }
       }
+
+      AddNode(parentTags, parentIndexes, tag, node);
     }
       
     return Action_None;
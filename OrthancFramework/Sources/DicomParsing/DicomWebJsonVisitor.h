@@ -58,17 +58,43 @@ namespace Orthanc
                                 const DicomTag& tag,
                                 ValueRepresentation vr) = 0;
     };
+
+    /**
+     * New in Orthanc 1.11.0: Receives the attributes that are
+     * encoded by the visitor, instead of the "Json::Value" tree of
+     * "GetResult()". The "node" corresponds to one single attribute
+     * (with its "vr", and possibly its "Value", "BulkDataURI" or
+     * "InlineBinary"). The sequences are implicitly described by the
+     * parent tags and indexes, and the attributes are received in the
+     * order of their tags, as they are visited by DCMTK.
+     **/
+    class ISink : public boost::noncopyable
+    {
+    public:
+      virtual ~ISink()
+      {
+      }
+
+      virtual void AddAttribute(const std::vector<DicomTag>& parentTags,
+                                const std::vector<size_t>& parentIndexes,
+                                const DicomTag& tag,
+                                const Json::Value& node) = 0;
+    };
     
   private:
     Json::Value        result_;
     IBinaryFormatter  *formatter_;
+    ISink             *sink_;
 
-    static std::string FormatTag(const DicomTag& tag);
-    
     Json::Value& CreateNode(const std::vector<DicomTag>& parentTags,
                             const std::vector<size_t>& parentIndexes,
                             const DicomTag& tag);
 
+    void AddNode(const std::vector<DicomTag>& parentTags,
+                 const std::vector<size_t>& parentIndexes,
+                 const DicomTag& tag,
+                 Json::Value& node);
+
     static Json::Value FormatInteger(int64_t value);
 
     static Json::Value FormatDouble(double value);
@@ -76,7 +102,12 @@ namespace Orthanc
   public:
     DicomWebJsonVisitor();
 
+    static std::string FormatTag(const DicomTag& tag);
+
     void SetFormatter(IBinaryFormatter& formatter);
+
+    // If a sink is set, "GetResult()" and "FormatXml()" are empty
+    void SetSink(ISink& sink);
     
     void Clear();
 
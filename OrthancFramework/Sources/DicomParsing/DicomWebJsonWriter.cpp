@@ -0,0 +1,421 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "../PrecompiledHeaders.h"
+#include "DicomWebJsonWriter.h"
+
+#include "../OrthancException.h"
+
+#include <cassert>
+
+
+static const char* const KEY_VALUE = "Value";
+static const char* const KEY_VR = "vr";
+
+
+namespace Orthanc
+{
+  namespace
+  {
+    /**
+     * Layout of "Json::Value::toStyledString()", that depends on the
+     * version of JsonCpp: Either the legacy "Json::StyledWriter" (3
+     * spaces, objects and arrays start on the line of their key), or
+     * "Json::StreamWriterBuilder" with its default settings
+     * (tabulations, objects and arrays start on a new line). The
+     * layout of the individual attributes is left to JsonCpp.
+     **/
+    class JsonLayout : public boost::noncopyable
+    {
+    private:
+      bool         isRecognized_;
+      std::string  indentation_;
+      bool         isContainerOnNewLine_;
+
+    public:
+      JsonLayout() :
+        isRecognized_(false),
+        isContainerOnNewLine_(false)
+      {
+        Json::Value probe = Json::objectValue;
+        probe["a"] = Json::objectValue;
+        probe["a"]["b"] = 1;
+
+        const std::string s = probe.toStyledString();
+        const size_t quote = s.find('"');
+
+        if (quote != std::string::npos &&
+            quote > 2 &&
+            s.compare(0, 2, "{\n") == 0)
+        {
+          indentation_ = s.substr(2, quote - 2);
+          isContainerOnNewLine_ = (s.find("\"a\" : {") == std::string::npos);
+
+          const std::string expected = ("{\n" + indentation_ + "\"a\" : " +
+                                        (isContainerOnNewLine_ ? "\n" + indentation_ : "") +
+                                        "{\n" + indentation_ + indentation_ + "\"b\" : 1\n" +
+                                        indentation_ + "}\n}\n");
+          isRecognized_ = (s == expected);
+        }
+      }
+
+      bool IsRecognized() const
+      {
+        return isRecognized_;
+      }
+
+      const std::string& GetIndentation() const
+      {
+        return indentation_;
+      }
+
+      bool IsContainerOnNewLine() const
+      {
+        return isContainerOnNewLine_;
+      }
+    };
+  }
+
+
+  static const JsonLayout& GetJsonLayout()
+  {
+    static const JsonLayout layout;
+    return layout;
+  }
+
+
+  void DicomWebJsonWriter::WriteNewLine()
+  {
+    const std::string& indentation = GetJsonLayout().GetIndentation();
+
+    output_.push_back('\n');
+    for (size_t i = 0; i < level_; i++)
+    {
+      output_.append(indentation);
+    }
+  }
+
+
+  void DicomWebJsonWriter::BeginMember(const std::string& key,
+                                       bool isContainer)
+  {
+    if (isFirstMember_)
+    {
+      isFirstMember_ = false;
+    }
+    else
+    {
+      output_.push_back(',');
+    }
+
+    // The keys are either DICOM tags, or DICOMweb keywords: They
+    // don't need to be escaped
+    WriteNewLine();
+    output_.push_back('"');
+    output_.append(key);
+    output_.append("\" : ");
+
+    if (isContainer &&
+        GetJsonLayout().IsContainerOnNewLine())
+    {
+      WriteNewLine();
+    }
+  }
+
+
+  void DicomWebJsonWriter::OpenItem()
+  {
+    assert(!sequences_.empty());
+    Sequence& sequence = sequences_.back();
+
+    if (sequence.countItems_ > 0)
+    {
+      output_.push_back(',');
+    }
+
+    WriteNewLine();
+    output_.push_back('{');
+    level_++;
+    isFirstMember_ = true;
+
+    sequence.countItems_++;
+  }
+
+
+  void DicomWebJsonWriter::CloseItem()
+  {
+    assert(level_ > 0);
+    level_--;
+    WriteNewLine();
+    output_.push_back('}');
+  }
+
+
+  void DicomWebJsonWriter::CloseSequences(size_t level)
+  {
+    while (sequences_.size() > level)
+    {
+      CloseItem();
+
+      // Close the "Value" array, then add the "vr" of the sequence
+      assert(level_ >= 2);
+      level_--;
+      WriteNewLine();
+      output_.append("],");
+      WriteNewLine();
+      output_.append("\"" + std::string(KEY_VR) + "\" : \"" +
+                     EnumerationToString(ValueRepresentation_Sequence) + "\"");
+
+      level_--;
+      WriteNewLine();
+      output_.push_back('}');
+      isFirstMember_ = false;
+
+      sequences_.pop_back();
+    }
+  }
+
+
+  void DicomWebJsonWriter::OpenParents(const std::vector<DicomTag>& parentTags,
+                                       const std::vector<size_t>& parentIndexes)
+  {
+    /**
+     * This method reproduces the behavior of
+     * "DicomWebJsonVisitor::CreateNode()". As the tags are visited
+     * in increasing order, only the last sequence of each level can
+     * receive new nodes, which makes it possible to write the
+     * sequences as they are visited.
+     **/
+    assert(parentTags.size() == parentIndexes.size());
+
+    if (!isStarted_)
+    {
+      isStarted_ = true;
+      output_.push_back('{');
+      level_ = 1;
+      isFirstMember_ = true;
+    }
+
+    for (size_t level = 0; level < parentTags.size(); level++)
+    {
+      if (level < sequences_.size() &&
+          sequences_[level].tag_ == parentTags[level])
+      {
+        const size_t countItems = sequences_[level].countItems_;
+
+        if (parentIndexes[level] + 1 == countItems)
+        {
+          // The item is the one being written
+        }
+        else if (parentIndexes[level] == countItems)
+        {
+          CloseSequences(level + 1);
+          CloseItem();
+          OpenItem();
+        }
+        else
+        {
+          throw OrthancException(ErrorCode_InternalError);
+        }
+      }
+      else
+      {
+        CloseSequences(level);
+
+        // Create the sequence, together with its first item
+        BeginMember(DicomWebJsonVisitor::FormatTag(parentTags[level]), true);
+        output_.push_back('{');
+        level_++;
+        isFirstMember_ = true;
+        BeginMember(KEY_VALUE, true);
+        output_.push_back('[');
+        level_++;
+
+        sequences_.push_back(Sequence(parentTags[level]));
+        OpenItem();
+      }
+    }
+
+    CloseSequences(parentTags.size());
+  }
+
+
+  DicomWebJsonWriter::DicomWebJsonWriter() :
+    level_(0),
+    isStarted_(false),
+    isFirstMember_(true)
+  {
+    if (!GetJsonLayout().IsRecognized())
+    {
+      throw OrthancException(ErrorCode_NotImplemented,
+                             "Unsupported layout for this version of JsonCpp");
+    }
+  }
+
+
+  bool DicomWebJsonWriter::IsSupported()
+  {
+    class Checker : public boost::noncopyable
+    {
+    private:
+      bool  isSupported_;
+
+      static void AddString(Json::Value& node,
+                            const std::string& vr,
+                            const std::string& value)
+      {
+        node = Json::objectValue;
+        node[KEY_VR] = vr;
+        node[KEY_VALUE] = Json::arrayValue;
+        node[KEY_VALUE].append(value);
+      }
+
+    public:
+      Checker() :
+        isSupported_(false)
+      {
+        if (!GetJsonLayout().IsRecognized())
+        {
+          return;
+        }
+
+        // Compare the output of the writer with "toStyledString()"
+        // on a dataset with nested sequences
+        const DicomTag sequence1(0x0008, 0x1115);
+        const DicomTag sequence2(0x0008, 0x1199);
+
+        Json::Value a, b, c, d, e;
+        AddString(a, "CS", "ISO_IR 100");
+        AddString(b, "UI", "1.2.3");
+        AddString(c, "UI", "1.2.4");
+        AddString(d, "UI", "1.2.5");
+        AddString(e, "LO", "Hello");
+
+        Json::Value expected = Json::objectValue;
+        expected["00080005"] = a;
+        expected["00081115"][KEY_VR] = "SQ";
+        expected["00081115"][KEY_VALUE][0]["00081199"][KEY_VR] = "SQ";
+        expected["00081115"][KEY_VALUE][0]["00081199"][KEY_VALUE][0]["00081155"] = b;
+        expected["00081115"][KEY_VALUE][0]["0020000E"] = c;
+        expected["00081115"][KEY_VALUE][1]["0020000E"] = d;
+        expected["00100020"] = e;
+
+        std::vector<DicomTag> parentTags;
+        std::vector<size_t> parentIndexes;
+
+        DicomWebJsonWriter writer;
+        writer.AddAttribute(parentTags, parentIndexes, DicomTag(0x0008, 0x0005), a);
+
+        parentTags.push_back(sequence1);
+        parentIndexes.push_back(0);
+        parentTags.push_back(sequence2);
+        parentIndexes.push_back(0);
+        writer.AddAttribute(parentTags, parentIndexes, DicomTag(0x0008, 0x1155), b);
+
+        parentTags.pop_back();
+        parentIndexes.pop_back();
+        writer.AddAttribute(parentTags, parentIndexes, DicomTag(0x0020, 0x000e), c);
+
+        parentIndexes[0] = 1;
+        writer.AddAttribute(parentTags, parentIndexes, DicomTag(0x0020, 0x000e), d);
+
+        parentTags.clear();
+        parentIndexes.clear();
+        writer.AddAttribute(parentTags, parentIndexes, DicomTag(0x0010, 0x0020), e);
+
+        std::string s;
+        writer.Flatten(s);
+        isSupported_ = (s == expected.toStyledString());
+      }
+
+      bool IsSupported() const
+      {
+        return isSupported_;
+      }
+    };
+
+    static const Checker checker;
+    return checker.IsSupported();
+  }
+
+
+  void DicomWebJsonWriter::AddAttribute(const std::vector<DicomTag>& parentTags,
+                                        const std::vector<size_t>& parentIndexes,
+                                        const DicomTag& tag,
+                                        const Json::Value& node)
+  {
+    if (node.type() != Json::objectValue ||
+        node.empty())
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+
+    OpenParents(parentTags, parentIndexes);
+
+    // The members are sorted in alphabetical order, as in
+    // "Json::Value", because the tags are visited in increasing order
+    BeginMember(DicomWebJsonVisitor::FormatTag(tag), true);
+
+    const std::string s = node.toStyledString();
+    assert(!s.empty() &&
+           s[s.size() - 1] == '\n');
+
+    for (size_t i = 0; i + 1 < s.size(); i++)
+    {
+      if (s[i] == '\n')
+      {
+        WriteNewLine();
+      }
+      else
+      {
+        output_.push_back(s[i]);
+      }
+    }
+  }
+
+
+  void DicomWebJsonWriter::Flatten(std::string& target)
+  {
+    CloseSequences(0);
+
+    if (isStarted_)
+    {
+      level_ = 0;
+      WriteNewLine();
+      output_.push_back('}');
+    }
+    else
+    {
+      output_.append("{}");
+    }
+
+    output_.push_back('\n');
+
+    target.swap(output_);
+
+    output_.clear();
+    level_ = 0;
+    isStarted_ = false;
+    isFirstMember_ = true;
+  }
+}
@@ -0,0 +1,91 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "DicomWebJsonVisitor.h"
+
+
+namespace Orthanc
+{
+  /**
+   * New in Orthanc 1.11.0: Sink for "DicomWebJsonVisitor" that writes
+   * the DICOMweb JSON document while the tags are visited, instead of
+   * building the "Json::Value" tree of the full dataset. Each
+   * attribute is formatted by JsonCpp, and the output is the same as
+   * "DicomWebJsonVisitor::GetResult().toStyledString()". If the
+   * layout of the installed version of JsonCpp is not recognized,
+   * "IsSupported()" returns "false", and "toStyledString()" must be
+   * used instead.
+   **/
+  class ORTHANC_PUBLIC DicomWebJsonWriter : public DicomWebJsonVisitor::ISink
+  {
+  private:
+    // Sequence whose items are currently being written
+    struct Sequence
+    {
+      DicomTag  tag_;
+      size_t    countItems_;
+
+      explicit Sequence(const DicomTag& tag) :
+        tag_(tag),
+        countItems_(0)
+      {
+      }
+    };
+
+    std::string            output_;
+    size_t                 level_;
+    std::vector<Sequence>  sequences_;
+    bool                   isStarted_;
+    bool                   isFirstMember_;
+
+    void WriteNewLine();
+
+    void BeginMember(const std::string& key,
+                     bool isContainer);
+
+    void OpenItem();
+
+    void CloseItem();
+
+    void CloseSequences(size_t level);
+
+    void OpenParents(const std::vector<DicomTag>& parentTags,
+                     const std::vector<size_t>& parentIndexes);
+
+  public:
+    DicomWebJsonWriter();
+
+    static bool IsSupported();
+
+    virtual void AddAttribute(const std::vector<DicomTag>& parentTags,
+                              const std::vector<size_t>& parentIndexes,
+                              const DicomTag& tag,
+                              const Json::Value& node) ORTHANC_OVERRIDE;
+
+    // Terminates the document and moves it into "target". The writer
+    // can then receive another dataset.
+    void Flatten(std::string& target);
+  };
+}
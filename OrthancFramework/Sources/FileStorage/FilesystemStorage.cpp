@@ -28,6 +28,7 @@
 // http://stackoverflow.com/questions/446358/storing-a-large-number-of-images
 
 #include "../Logging.h"
+#include "MemoryMappedBuffer.h"
 #include "../OrthancException.h"
 #include "../StringMemoryBuffer.h"
 #include "../SystemToolbox.h"
@@ -36,6 +37,10 @@
 #include <boost/filesystem/fstream.hpp>
 
 
+// Below this size, copying the file is cheaper than mapping it into memory
+static const uint64_t MEMORY_MAPPING_THRESHOLD = 1024 * 1024;  // 1MB
+
+
 static std::string ToString(const boost::filesystem::path& p)
 {
 #if BOOST_HAS_FILESYSTEM_V3 == 1
@@ -79,14 +84,16 @@ namespace Orthanc
   }
 
   FilesystemStorage::FilesystemStorage(const std::string &root) :
-    fsyncOnWrite_(false)
+    fsyncOnWrite_(false),
+    memoryMapping_(false)
   {
     Setup(root);
   }
 
   FilesystemStorage::FilesystemStorage(const std::string &root,
                                        bool fsyncOnWrite) :
-    fsyncOnWrite_(fsyncOnWrite)
+    fsyncOnWrite_(fsyncOnWrite),
+    memoryMapping_(false)
   {
     Setup(root);
   }
@@ -161,8 +168,19 @@ namespace Orthanc
     LOG(INFO) << "Reading attachment \"" << uuid << "\" of \"" << GetDescriptionInternal(type) 
               << "\" content type";
 
+    const std::string path = GetPath(uuid).string();
+
+    if (memoryMapping_)
+    {
+      const uint64_t size = SystemToolbox::GetFileSize(path);
+      if (size >= MEMORY_MAPPING_THRESHOLD)
+      {
+        return new MemoryMappedBuffer(path, 0, size, MemoryMappedBuffer::Access_Sequential);
+      }
+    }
+
     std::string content;
-    SystemToolbox::ReadFile(content, GetPath(uuid).string());
+    SystemToolbox::ReadFile(content, path);
 
     return StringMemoryBuffer::CreateFromSwap(content);
   }
@@ -176,9 +194,18 @@ namespace Orthanc
     LOG(INFO) << "Reading attachment \"" << uuid << "\" of \"" << GetDescriptionInternal(type) 
               << "\" content type (range from " << start << " to " << end << ")";
 
+    const std::string path = GetPath(uuid).string();
+
+    if (memoryMapping_ &&
+        start <= end &&
+        end - start >= MEMORY_MAPPING_THRESHOLD)
+    {
+      return new MemoryMappedBuffer(path, start, end, MemoryMappedBuffer::Access_Random);
+    }
+
     std::string content;
     SystemToolbox::ReadFileRange(
-      content, GetPath(uuid).string(), start, end, true /* throw if overflow */);
+      content, path, start, end, true /* throw if overflow */);
 
     return StringMemoryBuffer::CreateFromSwap(content);
   }
@@ -190,6 +217,18 @@ namespace Orthanc
   }
 
 
+  void FilesystemStorage::SetMemoryMapping(bool enabled)
+  {
+    if (enabled &&
+        !MemoryMappedBuffer::IsSupported())
+    {
+      throw OrthancException(ErrorCode_NotImplemented, "Memory mapping is not available on this platform");
+    }
+
+    memoryMapping_ = enabled;
+  }
+
+
   uintmax_t FilesystemStorage::GetSize(const std::string& uuid) const
   {
     boost::filesystem::path path = GetPath(uuid);
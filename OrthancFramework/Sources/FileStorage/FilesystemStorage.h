@@ -51,8 +51,7 @@ namespace Orthanc
   private:
     boost::filesystem::path root_;
     bool                    fsyncOnWrite_;
-
-    boost::filesystem::path GetPath(const std::string& uuid) const;
+    bool                    memoryMapping_;
 
     void Setup(const std::string& root);
     
@@ -89,6 +88,15 @@ namespace Orthanc
 
     virtual bool HasReadRange() const ORTHANC_OVERRIDE;
 
+    // New in Orthanc 1.11.0: If enabled, large files are read using
+    // memory mapping instead of being copied into memory
+    void SetMemoryMapping(bool enabled);
+
+    bool IsMemoryMapping() const
+    {
+      return memoryMapping_;
+    }
+
     virtual void Remove(const std::string& uuid,
                         FileContentType type) ORTHANC_OVERRIDE;
 
@@ -96,6 +104,9 @@ namespace Orthanc
 
     uintmax_t GetSize(const std::string& uuid) const;
 
+    // Public since Orthanc 1.11.0 (notably for "TieredFilesystemStorage")
+    boost::filesystem::path GetPath(const std::string& uuid) const;
+
     void Clear();
 
     uintmax_t GetCapacity() const;
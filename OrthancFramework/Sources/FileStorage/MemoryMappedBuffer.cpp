@@ -0,0 +1,159 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+#include "../PrecompiledHeaders.h"
+#include "MemoryMappedBuffer.h"
+
+#include "../OrthancException.h"
+
+#if !defined(_WIN32)
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+
+namespace Orthanc
+{
+  void MemoryMappedBuffer::Unmap()
+  {
+#if !defined(_WIN32)
+    if (mapping_ != NULL)
+    {
+      munmap(mapping_, mappingSize_);
+    }
+#endif
+
+    mapping_ = NULL;
+    mappingSize_ = 0;
+    data_ = NULL;
+    size_ = 0;
+  }
+
+
+  MemoryMappedBuffer::MemoryMappedBuffer(const std::string& path,
+                                         uint64_t start,
+                                         uint64_t end,
+                                         Access access) :
+    mapping_(NULL),
+    mappingSize_(0),
+    data_(NULL),
+    size_(0)
+  {
+    if (start > end)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+
+#if defined(_WIN32)
+    throw OrthancException(ErrorCode_NotImplemented, "Memory mapping is not available on this platform");
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+      throw OrthancException(ErrorCode_InexistentFile, "File not found: " + path);
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 ||
+        !S_ISREG(info.st_mode))
+    {
+      close(fd);
+      throw OrthancException(ErrorCode_RegularFileExpected,
+                             "The path does not point to a regular file: " + path);
+    }
+
+    if (end > static_cast<uint64_t>(info.st_size))
+    {
+      close(fd);
+      throw OrthancException(ErrorCode_ParameterOutOfRange,
+                             "Reading beyond the end of a file");
+    }
+
+    if (static_cast<uint64_t>(static_cast<size_t>(end - start)) != end - start)
+    {
+      close(fd);
+      throw OrthancException(ErrorCode_InternalError,
+                             "Mapping a file that is too large for a 32bit architecture");
+    }
+
+    if (start == end)
+    {
+      close(fd);
+      return;  // Empty range, "mmap()" doesn't accept a zero length
+    }
+
+    // The offset given to "mmap()" must be a multiple of the page size
+    const uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    const uint64_t alignedStart = start - (start % pageSize);
+
+    mappingSize_ = static_cast<size_t>(end - alignedStart);
+    mapping_ = mmap(NULL, mappingSize_, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(alignedStart));
+
+    // The mapping stays valid after the file descriptor is closed
+    close(fd);
+
+    if (mapping_ == MAP_FAILED)
+    {
+      mapping_ = NULL;
+      mappingSize_ = 0;
+      throw OrthancException(ErrorCode_InternalError,
+                             "Cannot map file into memory: " + path);
+    }
+
+    // This is only a hint to the kernel, errors can be ignored
+    posix_madvise(mapping_, mappingSize_,
+                  access == Access_Sequential ? POSIX_MADV_SEQUENTIAL : POSIX_MADV_RANDOM);
+
+    data_ = reinterpret_cast<const uint8_t*>(mapping_) + (start - alignedStart);
+    size_ = static_cast<size_t>(end - start);
+#endif
+  }
+
+
+  void MemoryMappedBuffer::MoveToString(std::string& target)
+  {
+    if (size_ == 0)
+    {
+      target.clear();
+    }
+    else
+    {
+      target.assign(reinterpret_cast<const char*>(data_), size_);
+    }
+
+    Unmap();
+  }
+
+
+  bool MemoryMappedBuffer::IsSupported()
+  {
+#if defined(_WIN32)
+    return false;
+#else
+    return true;
+#endif
+  }
+}
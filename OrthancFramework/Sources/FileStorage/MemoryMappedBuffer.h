@@ -0,0 +1,92 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+#pragma once
+
+#include "../OrthancFramework.h"
+
+#if !defined(ORTHANC_SANDBOXED)
+#  error The macro ORTHANC_SANDBOXED must be defined
+#endif
+
+#if ORTHANC_SANDBOXED == 1
+#  error The class MemoryMappedBuffer cannot be used in sandboxed environments
+#endif
+
+#include "../Compatibility.h"  // For ORTHANC_OVERRIDE
+#include "../IMemoryBuffer.h"
+
+#include <stdint.h>
+
+namespace Orthanc
+{
+  /**
+   * Memory buffer whose content is a range of a file that is mapped
+   * into memory (New in Orthanc 1.11.0). This avoids copying the
+   * content of the file if the consumer directly accesses
+   * "GetData()". Memory mapping is only available on POSIX systems.
+   **/
+  class ORTHANC_PUBLIC MemoryMappedBuffer : public IMemoryBuffer
+  {
+  public:
+    enum Access
+    {
+      Access_Sequential,
+      Access_Random
+    };
+
+  private:
+    void*           mapping_;
+    size_t          mappingSize_;
+    const uint8_t*  data_;
+    size_t          size_;
+
+    void Unmap();
+
+  public:
+    MemoryMappedBuffer(const std::string& path,
+                       uint64_t start /* inclusive */,
+                       uint64_t end /* exclusive */,
+                       Access access);
+
+    virtual ~MemoryMappedBuffer()
+    {
+      Unmap();
+    }
+
+    virtual void MoveToString(std::string& target) ORTHANC_OVERRIDE;
+
+    virtual const void* GetData() const ORTHANC_OVERRIDE
+    {
+      return data_;
+    }
+
+    virtual size_t GetSize() const ORTHANC_OVERRIDE
+    {
+      return size_;
+    }
+
+    static bool IsSupported();
+  };
+}
@@ -26,12 +26,17 @@
 #include "StorageCache.h"
 
 #include "../Logging.h"
-#include "../StringMemoryBuffer.h"
 #include "../Compatibility.h"
 #include "../Compression/ZlibCompressor.h"
 #include "../MetricsRegistry.h"
+#include "../MultiThreading/BufferArena.h"
 #include "../OrthancException.h"
+#include "../StringMemoryBuffer.h"
 #include "../Toolbox.h"
+#include "MemoryMappedBuffer.h"
+
+#include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
 
 #if ORTHANC_ENABLE_CIVETWEB == 1 || ORTHANC_ENABLE_MONGOOSE == 1
 #  include "../HttpServer/HttpStreamTranscoder.h"
@@ -89,15 +94,15 @@ namespace Orthanc
 
     std::string md5;
 
-    if (storeMd5)
-    {
-      Toolbox::ComputeMD5(md5, data, size);
-    }
-
     switch (compression)
     {
       case CompressionType_None:
       {
+        if (storeMd5)
+        {
+          Toolbox::ComputeMD5(md5, data, size);
+        }
+
         MetricsTimer timer(*this, METRICS_CREATE);
 
         area_.Create(uuid, data, size, type);
@@ -111,13 +116,16 @@ namespace Orthanc
         ZlibCompressor zlib;
 
         std::string compressed;
-        zlib.Compress(compressed, data, size);
-
         std::string compressedMD5;
       
         if (storeMd5)
         {
-          Toolbox::ComputeMD5(compressedMD5, compressed);
+          // New in Orthanc 1.11.0: Single pass over the data
+          zlib.CompressWithMD5(compressed, md5, compressedMD5, data, size);
+        }
+        else
+        {
+          zlib.Compress(compressed, data, size);
         }
 
         {
@@ -153,8 +161,8 @@ namespace Orthanc
   }
 
 
-  void StorageAccessor::Read(std::string& content,
-                             const FileInfo& info)
+  void StorageAccessor::ReadUncollapsed(std::string& content,
+                                        const FileInfo& info)
   {
     switch (info.GetCompressionType())
     {
@@ -174,10 +182,11 @@ namespace Orthanc
       {
         ZlibCompressor zlib;
 
-        std::string cached;
+        // Share the compressed content with the cache, without copying it
+        boost::shared_ptr<const std::string> cached;
         if (cache_.Fetch(cached, info.GetUuid(), info.GetContentType()))
         {
-          zlib.Uncompress(content, cached.empty() ? NULL : cached.c_str(), cached.size());
+          zlib.Uncompress(content, cached->empty() ? NULL : cached->c_str(), cached->size());
         }
         else
         {
@@ -204,6 +213,291 @@ namespace Orthanc
   }
 
 
+  namespace
+  {
+    // New in Orthanc 1.11.0: Read-only view on a string that is
+    // shared with the storage cache. The reference to the string is
+    // released when this object is destroyed.
+    class SharedStringMemoryBuffer : public IMemoryBuffer
+    {
+    private:
+      boost::shared_ptr<const std::string>  content_;
+
+    public:
+      explicit SharedStringMemoryBuffer(const boost::shared_ptr<const std::string>& content) :
+        content_(content)
+      {
+        if (content.get() == NULL)
+        {
+          throw OrthancException(ErrorCode_NullPointer);
+        }
+      }
+
+      virtual void MoveToString(std::string& target) ORTHANC_OVERRIDE
+      {
+        // The content is shared, so it cannot be moved
+        target = *content_;
+        content_.reset(new std::string);
+      }
+
+      virtual const void* GetData() const ORTHANC_OVERRIDE
+      {
+        return content_->empty() ? NULL : content_->c_str();
+      }
+
+      virtual size_t GetSize() const ORTHANC_OVERRIDE
+      {
+        return content_->size();
+      }
+    };
+  }
+
+
+  namespace
+  {
+    // New in Orthanc 1.11.0: Memory buffer whose content is given
+    // back to the buffer arena once it is destroyed
+    class ArenaMemoryBuffer : public IMemoryBuffer
+    {
+    private:
+      BufferArena::Buffer  buffer_;
+
+    public:
+      std::string& GetContent()
+      {
+        return buffer_.GetContent();
+      }
+
+      virtual void MoveToString(std::string& target) ORTHANC_OVERRIDE
+      {
+        target.swap(buffer_.GetContent());
+        buffer_.GetContent().clear();
+      }
+
+      virtual const void* GetData() const ORTHANC_OVERRIDE
+      {
+        const std::string& content = buffer_.GetContent();
+        return content.empty() ? NULL : content.c_str();
+      }
+
+      virtual size_t GetSize() const ORTHANC_OVERRIDE
+      {
+        return buffer_.GetContent().size();
+      }
+    };
+  }
+
+
+  IMemoryBuffer* StorageAccessor::ReadUncollapsed(const FileInfo& info)
+  {
+    if (info.GetCompressionType() == CompressionType_None)
+    {
+      boost::shared_ptr<const std::string> content;
+      if (cache_.Fetch(content, info.GetUuid(), info.GetContentType()))
+      {
+        return new SharedStringMemoryBuffer(content);
+      }
+      else
+      {
+        MetricsTimer timer(*this, METRICS_READ);
+        return area_.Read(info.GetUuid(), info.GetContentType());
+      }
+    }
+    else
+    {
+      // New in Orthanc 1.11.0: Uncompress into a buffer of the arena
+      // of the current thread, that is reused once the caller releases it
+      std::unique_ptr<ArenaMemoryBuffer> buffer(new ArenaMemoryBuffer);
+      ReadUncollapsed(buffer->GetContent(), info);
+      return buffer.release();
+    }
+  }
+
+
+  namespace
+  {
+    // New in Orthanc 1.11.0: Read-only view on a memory buffer that is
+    // shared between the concurrent reads of the same attachment
+    class SharedMemoryBuffer : public IMemoryBuffer
+    {
+    private:
+      boost::shared_ptr<IMemoryBuffer>  buffer_;
+      bool                              moved_;
+
+    public:
+      explicit SharedMemoryBuffer(const boost::shared_ptr<IMemoryBuffer>& buffer) :
+        buffer_(buffer),
+        moved_(false)
+      {
+        if (buffer.get() == NULL)
+        {
+          throw OrthancException(ErrorCode_NullPointer);
+        }
+      }
+
+      virtual void MoveToString(std::string& target) ORTHANC_OVERRIDE
+      {
+        if (moved_)
+        {
+          target.clear();
+        }
+        else if (buffer_.unique())
+        {
+          buffer_->MoveToString(target);
+        }
+        else if (buffer_->GetSize() == 0)
+        {
+          target.clear();
+        }
+        else
+        {
+          // The buffer is still used by another reader, so it cannot be moved
+          target.assign(reinterpret_cast<const char*>(buffer_->GetData()), buffer_->GetSize());
+        }
+
+        moved_ = true;
+      }
+
+      virtual const void* GetData() const ORTHANC_OVERRIDE
+      {
+        return moved_ ? NULL : buffer_->GetData();
+      }
+
+      virtual size_t GetSize() const ORTHANC_OVERRIDE
+      {
+        return moved_ ? 0 : buffer_->GetSize();
+      }
+    };
+
+    typedef SingleValueObject< boost::shared_ptr<IMemoryBuffer> >  SharedMemoryBufferObject;
+  }
+
+
+  static std::string GetPendingReadKey(const FileInfo& info)
+  {
+    return info.GetUuid() + ":" + boost::lexical_cast<std::string>(info.GetContentType());
+  }
+
+
+  static bool IsMemoryMapped(const IMemoryBuffer& buffer)
+  {
+    /**
+     * If the file is mapped into memory, the page cache of the
+     * system already plays the role of the storage cache, and adding
+     * the file to the storage cache would copy it.
+     **/
+    return dynamic_cast<const MemoryMappedBuffer*>(&buffer) != NULL;
+  }
+
+
+  void StorageAccessor::Read(std::string& content,
+                             const FileInfo& info)
+  {
+    SingleFlight::Accessor flight(cache_.GetPendingReads(), GetPendingReadKey(info));
+
+    boost::shared_ptr<IDynamicObject> shared;
+
+    if (!flight.IsLeader() &&
+        flight.WaitForLeader(shared) &&
+        shared.get() != NULL)
+    {
+      // Another thread has just read the same attachment
+      const IMemoryBuffer& buffer = *dynamic_cast<const SharedMemoryBufferObject&>(*shared).GetValue();
+
+      if (buffer.GetSize() == 0)
+      {
+        content.clear();
+      }
+      else
+      {
+        content.assign(reinterpret_cast<const char*>(buffer.GetData()), buffer.GetSize());
+      }
+    }
+    else
+    {
+      ReadUncollapsed(content, info);
+
+      if (flight.IsLeader() &&
+          flight.GetFollowersCount() > 0)
+      {
+        boost::shared_ptr<IMemoryBuffer> copy(StringMemoryBuffer::CreateFromCopy(content));
+        flight.Publish(new SharedMemoryBufferObject(copy));
+      }
+    }
+  }
+
+
+  IMemoryBuffer* StorageAccessor::Read(const FileInfo& info)
+  {
+    SingleFlight::Accessor flight(cache_.GetPendingReads(), GetPendingReadKey(info));
+
+    boost::shared_ptr<IDynamicObject> shared;
+
+    if (!flight.IsLeader() &&
+        flight.WaitForLeader(shared) &&
+        shared.get() != NULL)
+    {
+      // Another thread has just read the same attachment
+      return new SharedMemoryBuffer(dynamic_cast<const SharedMemoryBufferObject&>(*shared).GetValue());
+    }
+    else
+    {
+      std::unique_ptr<IMemoryBuffer> buffer(ReadUncollapsed(info));
+
+      if (flight.IsLeader() &&
+          flight.GetFollowersCount() > 0)
+      {
+        boost::shared_ptr<IMemoryBuffer> tmp(buffer.release());
+        flight.Publish(new SharedMemoryBufferObject(tmp));
+        return new SharedMemoryBuffer(tmp);
+      }
+      else
+      {
+        return buffer.release();
+      }
+    }
+  }
+
+
+  IMemoryBuffer* StorageAccessor::ReadAndCache(const FileInfo& info)
+  {
+    if (info.GetCompressionType() == CompressionType_None)
+    {
+      boost::shared_ptr<const std::string> content;
+      if (!cache_.Fetch(content, info.GetUuid(), info.GetContentType()))
+      {
+        std::unique_ptr<IMemoryBuffer> buffer;
+
+        {
+          MetricsTimer timer(*this, METRICS_READ);
+          buffer.reset(area_.Read(info.GetUuid(), info.GetContentType()));
+        }
+
+        if (IsMemoryMapped(*buffer))
+        {
+          return buffer.release();
+        }
+        else
+        {
+          std::unique_ptr<std::string> s(new std::string);
+          buffer->MoveToString(*s);
+
+          content.reset(s.release());
+          cache_.Add(info.GetUuid(), info.GetContentType(), content);
+        }
+      }
+
+      return new SharedStringMemoryBuffer(content);
+    }
+    else
+    {
+      // The storage cache contains the compressed attachments, so
+      // the uncompressed content cannot be shared
+      return Read(info);
+    }
+  }
+
+
   void StorageAccessor::ReadRaw(std::string& content,
                                 const FileInfo& info)
   {
@@ -216,6 +510,73 @@ namespace Orthanc
   }
 
 
+  bool StorageAccessor::Verify(const FileInfo& info)
+  {
+    std::unique_ptr<IMemoryBuffer> buffer;
+
+    try
+    {
+      MetricsTimer timer(*this, METRICS_READ);
+      buffer.reset(area_.Read(info.GetUuid(), info.GetContentType()));
+    }
+    catch (OrthancException& e)
+    {
+      LOG(ERROR) << "Cannot read attachment " << info.GetUuid() << " during verification: " << e.What();
+      return false;
+    }
+
+    if (buffer.get() == NULL ||
+        buffer->GetSize() != info.GetCompressedSize())
+    {
+      LOG(ERROR) << "Bad size of attachment " << info.GetUuid() << " during verification";
+      return false;
+    }
+
+    if (!info.GetCompressedMD5().empty())
+    {
+      std::string md5;
+      Toolbox::ComputeMD5(md5, buffer->GetData(), buffer->GetSize());
+
+      if (md5 != info.GetCompressedMD5())
+      {
+        LOG(ERROR) << "Bad MD5 of attachment " << info.GetUuid() << " during verification";
+        return false;
+      }
+    }
+
+    if (info.GetCompressionType() != CompressionType_None &&
+        !info.GetUncompressedMD5().empty())
+    {
+      // The uncompressed content is only needed to compute its MD5
+      BufferArena::Buffer arenaBuffer;
+      std::string& uncompressed = arenaBuffer.GetContent();
+
+      try
+      {
+        ZlibCompressor zlib;
+        zlib.Uncompress(uncompressed, buffer->GetData(), buffer->GetSize());
+      }
+      catch (OrthancException& e)
+      {
+        LOG(ERROR) << "Cannot uncompress attachment " << info.GetUuid() << " during verification: " << e.What();
+        return false;
+      }
+
+      std::string md5;
+      Toolbox::ComputeMD5(md5, uncompressed);
+
+      if (uncompressed.size() != info.GetUncompressedSize() ||
+          md5 != info.GetUncompressedMD5())
+      {
+        LOG(ERROR) << "Bad uncompressed MD5 of attachment " << info.GetUuid() << " during verification";
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+
   void StorageAccessor::Remove(const std::string& fileUuid,
                                FileContentType type)
   {
@@ -251,18 +612,57 @@ namespace Orthanc
   }
 
 
+  IMemoryBuffer* StorageAccessor::ReadRange(const std::string& fileUuid,
+                                            FileContentType contentType,
+                                            uint64_t start /* inclusive */,
+                                            uint64_t end /* exclusive */)
+  {
+    if (start > end)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+
+    MetricsTimer timer(*this, METRICS_READ);
+    std::unique_ptr<IMemoryBuffer> buffer(area_.ReadRange(fileUuid, contentType, start, end));
+    assert(buffer->GetSize() == end - start);
+    return buffer.release();
+  }
+
+
 #if ORTHANC_ENABLE_CIVETWEB == 1 || ORTHANC_ENABLE_MONGOOSE == 1
   void StorageAccessor::SetupSender(BufferHttpSender& sender,
                                     const FileInfo& info,
                                     const std::string& mime)
   {
-    if (!cache_.Fetch(sender.GetBuffer(), info.GetUuid(), info.GetContentType()))
+    // New in Orthanc 1.11.0: The sender directly uses the buffer of
+    // the storage cache or of the storage area, without copying it
+    boost::shared_ptr<const std::string> content;
+    if (cache_.Fetch(content, info.GetUuid(), info.GetContentType()))
     {
-      MetricsTimer timer(*this, METRICS_READ);
-      std::unique_ptr<IMemoryBuffer> buffer(area_.Read(info.GetUuid(), info.GetContentType()));
-      buffer->MoveToString(sender.GetBuffer());
+      sender.SetBuffer(new SharedStringMemoryBuffer(content));
+    }
+    else
+    {
+      std::unique_ptr<IMemoryBuffer> buffer;
 
-      cache_.Add(info.GetUuid(), info.GetContentType(), sender.GetBuffer());
+      {
+        MetricsTimer timer(*this, METRICS_READ);
+        buffer.reset(area_.Read(info.GetUuid(), info.GetContentType()));
+      }
+
+      if (IsMemoryMapped(*buffer))
+      {
+        sender.SetBuffer(buffer.release());
+      }
+      else
+      {
+        std::unique_ptr<std::string> s(new std::string);
+        buffer->MoveToString(*s);
+
+        content.reset(s.release());
+        cache_.Add(info.GetUuid(), info.GetContentType(), content);
+        sender.SetBuffer(new SharedStringMemoryBuffer(content));
+      }
     }
 
     sender.SetContentType(mime);
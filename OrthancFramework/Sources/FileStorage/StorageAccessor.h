@@ -71,6 +71,11 @@ namespace Orthanc
     StorageCache&     cache_;
     MetricsRegistry*  metrics_;
 
+    void ReadUncollapsed(std::string& content,
+                         const FileInfo& info);
+
+    IMemoryBuffer* ReadUncollapsed(const FileInfo& info);
+
 #if ORTHANC_ENABLE_CIVETWEB == 1 || ORTHANC_ENABLE_MONGOOSE == 1
     void SetupSender(BufferHttpSender& sender,
                      const FileInfo& info,
@@ -96,17 +101,53 @@ namespace Orthanc
                    CompressionType compression,
                    bool storeMd5);
 
+    /**
+     * Since Orthanc 1.11.0, the concurrent reads of the same attachment
+     * are collapsed: Only the first one reads the storage area (and
+     * uncompresses the attachment), and the others share its result.
+     **/
     void Read(std::string& content,
               const FileInfo& info);
 
+    // New in Orthanc 1.11.0: If the attachment is not compressed, the
+    // buffer of the storage area is returned as such, which avoids a
+    // copy if the storage area uses memory mapping
+    IMemoryBuffer* Read(const FileInfo& info);
+
+    /**
+     * New in Orthanc 1.11.0: Same as "Read()", but an uncompressed
+     * attachment that is read from the storage area is added to the
+     * storage cache. The returned buffer shares its bytes with the
+     * cache, and holds a reference to them until it is destroyed. The
+     * files that are mapped into memory by the storage area are not
+     * added to the cache, as this would copy them.
+     **/
+    IMemoryBuffer* ReadAndCache(const FileInfo& info);
+
     void ReadRaw(std::string& content,
                  const FileInfo& info);
 
+    /**
+     * New in Orthanc 1.11.0: Read the attachment directly from the
+     * storage area (bypassing the storage cache), and check it
+     * against the MD5 hashes of "info". Returns "false" if the file
+     * cannot be read or if it is corrupted. Attachments without MD5
+     * are only checked to be readable.
+     **/
+    bool Verify(const FileInfo& info);
+
     void ReadStartRange(std::string& target,
                         const std::string& fileUuid,
                         FileContentType fullFileContentType,
                         uint64_t end /* exclusive */);
 
+    // New in Orthanc 1.11.0: The storage cache is not used, as only
+    // a small part of a (possibly large) file is read
+    IMemoryBuffer* ReadRange(const std::string& fileUuid,
+                             FileContentType contentType,
+                             uint64_t start /* inclusive */,
+                             uint64_t end /* exclusive */);
+
     void Remove(const std::string& fileUuid,
                 FileContentType type);
 
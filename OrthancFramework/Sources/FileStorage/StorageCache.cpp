@@ -70,6 +70,15 @@ namespace Orthanc
   }
 
 
+  void StorageCache::Add(const std::string& uuid, 
+                         FileContentType contentType,
+                         const boost::shared_ptr<const std::string>& value)
+  {
+    const std::string key = GetCacheKeyFullFile(uuid, contentType);
+    cache_.Add(key, value);
+  }
+
+
   void StorageCache::AddStartRange(const std::string& uuid, 
                                    FileContentType contentType,
                                    const std::string& value)
@@ -108,6 +117,23 @@ namespace Orthanc
     }
   }
 
+  bool StorageCache::Fetch(boost::shared_ptr<const std::string>& value, 
+                           const std::string& uuid,
+                           FileContentType contentType)
+  {
+    const std::string key = GetCacheKeyFullFile(uuid, contentType);
+    if (cache_.Fetch(value, key))
+    {
+      LOG(INFO) << "Read attachment \"" << uuid << "\" with content type "
+                << boost::lexical_cast<std::string>(contentType) << " from cache (shared)";
+      return true;
+    }
+    else
+    {
+      return false;
+    }
+  }
+
   bool StorageCache::FetchStartRange(std::string& value, 
                                      const std::string& uuid,
                                      FileContentType contentType,
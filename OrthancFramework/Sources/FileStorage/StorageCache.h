@@ -24,6 +24,7 @@
 #pragma once
 
 #include "../Cache/MemoryStringCache.h"
+#include "../MultiThreading/SingleFlight.h"
 
 #include "../Compatibility.h"  // For ORTHANC_OVERRIDE
 
@@ -39,6 +40,7 @@ namespace Orthanc
     {
     private:
       MemoryStringCache   cache_;
+      SingleFlight        pendingReads_;
       
     public:
       void SetMaximumSize(size_t size);
@@ -56,6 +58,11 @@ namespace Orthanc
                const void* buffer,
                size_t size);
 
+      // New in Orthanc 1.11.0: The cache shares "value" (no copy)
+      void Add(const std::string& uuid, 
+               FileContentType contentType,
+               const boost::shared_ptr<const std::string>& value);
+
       void Invalidate(const std::string& uuid,
                       FileContentType contentType);
 
@@ -63,10 +70,23 @@ namespace Orthanc
                  const std::string& uuid,
                  FileContentType contentType);
 
+      // New in Orthanc 1.11.0: Share the bytes of the cache (no copy)
+      bool Fetch(boost::shared_ptr<const std::string>& value, 
+                 const std::string& uuid,
+                 FileContentType contentType);
+
       bool FetchStartRange(std::string& value, 
                            const std::string& uuid,
                            FileContentType contentType,
                            uint64_t end /* exclusive */);
 
+      // New in Orthanc 1.11.0: The reads of the storage area that are
+      // in progress, so that "StorageAccessor" can collapse the
+      // concurrent reads of the same attachment
+      SingleFlight& GetPendingReads()
+      {
+        return pendingReads_;
+      }
+
     };
 }
@@ -0,0 +1,280 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+#include "../PrecompiledHeaders.h"
+#include "TieredFilesystemStorage.h"
+
+#include "../Logging.h"
+#include "../OrthancException.h"
+#include "../SystemToolbox.h"
+
+#include <ctime>
+
+
+namespace Orthanc
+{
+  void TieredFilesystemStorage::MigrationThread(TieredFilesystemStorage* that,
+                                                unsigned int interval)
+  {
+    static const unsigned int SLEEP = 100;  // In milliseconds
+
+    uint64_t elapsed = 0;
+
+    while (!that->done_)
+    {
+      if (elapsed >= static_cast<uint64_t>(interval) * 1000)
+      {
+        elapsed = 0;
+
+        try
+        {
+          unsigned int count = that->MigrateColdFiles();
+          if (count > 0)
+          {
+            LOG(INFO) << "Number of files migrated to the cold storage tier: " << count;
+          }
+        }
+        catch (OrthancException& e)
+        {
+          LOG(ERROR) << "Error while migrating files to the cold storage tier: " << e.What();
+        }
+      }
+
+      SystemToolbox::USleep(SLEEP * 1000);
+      elapsed += SLEEP;
+    }
+  }
+
+
+  bool TieredFilesystemStorage::IsHot(const std::string& uuid) const
+  {
+    return boost::filesystem::exists(hot_.GetPath(uuid));
+  }
+
+
+  void TieredFilesystemStorage::Touch(const std::string& uuid)
+  {
+    try
+    {
+      boost::filesystem::last_write_time(hot_.GetPath(uuid), std::time(NULL));
+    }
+    catch (boost::filesystem::filesystem_error&)
+    {
+      // The file was migrated or removed meanwhile
+    }
+  }
+
+
+  void TieredFilesystemStorage::MigrateFile(const std::string& uuid)
+  {
+    boost::mutex::scoped_lock lock(migrationMutex_);  // Prevent concurrent removals
+
+    if (!IsHot(uuid))
+    {
+      return;  // Removed meanwhile
+    }
+
+    std::unique_ptr<IMemoryBuffer> content(hot_.Read(uuid, FileContentType_Unknown));
+
+    // Discard the partial copy that might result from a crash during
+    // a previous migration, as the copy in the hot tier is authoritative
+    cold_.Remove(uuid, FileContentType_Unknown);
+    cold_.Create(uuid, content->GetData(), content->GetSize(), FileContentType_Unknown);
+
+    hot_.Remove(uuid, FileContentType_Unknown);
+  }
+
+
+  TieredFilesystemStorage::TieredFilesystemStorage(const std::string& hotRoot,
+                                                   const std::string& coldRoot,
+                                                   bool fsyncOnWrite) :
+    hot_(hotRoot, fsyncOnWrite),
+    cold_(coldRoot, true /* the hot copy is removed after the migration, so always sync */),
+    coldDelay_(7 * 24 * 3600),  // 1 week
+    done_(true)
+  {
+  }
+
+
+  TieredFilesystemStorage::~TieredFilesystemStorage()
+  {
+    StopMigration();
+  }
+
+
+  void TieredFilesystemStorage::SetColdDelay(unsigned int seconds)
+  {
+    coldDelay_ = seconds;
+  }
+
+
+  void TieredFilesystemStorage::SetMemoryMapping(bool enabled)
+  {
+    hot_.SetMemoryMapping(enabled);
+    cold_.SetMemoryMapping(enabled);
+  }
+
+
+  void TieredFilesystemStorage::StartMigration(unsigned int interval)
+  {
+    if (!done_)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+
+    if (interval == 0)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+
+    done_ = false;
+    migrationThread_ = boost::thread(MigrationThread, this, interval);
+  }
+
+
+  void TieredFilesystemStorage::StopMigration()
+  {
+    done_ = true;
+
+    if (migrationThread_.joinable())
+    {
+      migrationThread_.join();
+    }
+  }
+
+
+  unsigned int TieredFilesystemStorage::MigrateColdFiles()
+  {
+    std::set<std::string> files;
+    hot_.ListAllFiles(files);
+
+    const std::time_t now = std::time(NULL);
+    unsigned int count = 0;
+
+    for (std::set<std::string>::const_iterator it = files.begin(); it != files.end(); ++it)
+    {
+      if (migrationThread_.joinable() && done_)
+      {
+        break;  // Stopping
+      }
+
+      try
+      {
+        std::time_t lastAccess = boost::filesystem::last_write_time(hot_.GetPath(*it));
+
+        if (now - lastAccess >= static_cast<std::time_t>(coldDelay_))
+        {
+          MigrateFile(*it);
+          count++;
+        }
+      }
+      catch (boost::filesystem::filesystem_error&)
+      {
+        // The file was removed meanwhile
+      }
+      catch (OrthancException& e)
+      {
+        LOG(ERROR) << "Cannot migrate file " << *it << " to the cold storage tier: " << e.What();
+      }
+    }
+
+    return count;
+  }
+
+
+  void TieredFilesystemStorage::Create(const std::string& uuid,
+                                       const void* content,
+                                       size_t size,
+                                       FileContentType type)
+  {
+    hot_.Create(uuid, content, size, type);
+  }
+
+
+  IMemoryBuffer* TieredFilesystemStorage::Read(const std::string& uuid,
+                                               FileContentType type)
+  {
+    if (IsHot(uuid))
+    {
+      try
+      {
+        std::unique_ptr<IMemoryBuffer> buffer(hot_.Read(uuid, type));
+        Touch(uuid);
+        return buffer.release();
+      }
+      catch (OrthancException&)
+      {
+        if (IsHot(uuid))
+        {
+          throw;
+        }
+
+        // Otherwise, the file was migrated meanwhile
+      }
+    }
+
+    return cold_.Read(uuid, type);
+  }
+
+
+  IMemoryBuffer* TieredFilesystemStorage::ReadRange(const std::string& uuid,
+                                                    FileContentType type,
+                                                    uint64_t start /* inclusive */,
+                                                    uint64_t end /* exclusive */)
+  {
+    if (IsHot(uuid))
+    {
+      try
+      {
+        std::unique_ptr<IMemoryBuffer> buffer(hot_.ReadRange(uuid, type, start, end));
+        Touch(uuid);
+        return buffer.release();
+      }
+      catch (OrthancException&)
+      {
+        if (IsHot(uuid))
+        {
+          throw;
+        }
+      }
+    }
+
+    return cold_.ReadRange(uuid, type, start, end);
+  }
+
+
+  bool TieredFilesystemStorage::HasReadRange() const
+  {
+    return true;
+  }
+
+
+  void TieredFilesystemStorage::Remove(const std::string& uuid,
+                                       FileContentType type)
+  {
+    boost::mutex::scoped_lock lock(migrationMutex_);
+    hot_.Remove(uuid, type);
+    cold_.Remove(uuid, type);
+  }
+}
@@ -0,0 +1,117 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+#pragma once
+
+#include "../OrthancFramework.h"
+
+#if !defined(ORTHANC_SANDBOXED)
+#  error The macro ORTHANC_SANDBOXED must be defined
+#endif
+
+#if ORTHANC_SANDBOXED == 1
+#  error The class TieredFilesystemStorage cannot be used in sandboxed environments
+#endif
+
+#include "FilesystemStorage.h"
+
+#include <boost/thread.hpp>
+
+namespace Orthanc
+{
+  /**
+   * Storage area made of two filesystem storages (New in Orthanc
+   * 1.11.0): A "hot" tier (e.g. SSD) that receives the new files,
+   * and a "cold" tier (e.g. HDD) to which the files that have not
+   * been accessed for a given delay are migrated in the background.
+   *
+   * The tier of each file is given by its location: If a file is
+   * present in the hot tier, this copy is authoritative. A migration
+   * first writes the file to the cold tier, then removes it from the
+   * hot tier, which makes it safe against crashes. The last access to
+   * a file of the hot tier is recorded as its modification time.
+   **/
+  class ORTHANC_PUBLIC TieredFilesystemStorage : public IStorageArea
+  {
+  private:
+    FilesystemStorage  hot_;
+    FilesystemStorage  cold_;
+    unsigned int       coldDelay_;  // In seconds
+    boost::mutex       migrationMutex_;
+    bool               done_;
+    boost::thread      migrationThread_;
+
+    static void MigrationThread(TieredFilesystemStorage* that,
+                                unsigned int interval);
+
+    bool IsHot(const std::string& uuid) const;
+
+    void Touch(const std::string& uuid);
+
+    void MigrateFile(const std::string& uuid);
+
+  public:
+    TieredFilesystemStorage(const std::string& hotRoot,
+                            const std::string& coldRoot,
+                            bool fsyncOnWrite);
+
+    virtual ~TieredFilesystemStorage();
+
+    void SetColdDelay(unsigned int seconds);
+
+    unsigned int GetColdDelay() const
+    {
+      return coldDelay_;
+    }
+
+    void SetMemoryMapping(bool enabled);
+
+    // Start the background migration, invoking "MigrateColdFiles()"
+    // every "interval" seconds
+    void StartMigration(unsigned int interval);
+
+    void StopMigration();
+
+    // Returns the number of migrated files
+    unsigned int MigrateColdFiles();
+
+    virtual void Create(const std::string& uuid,
+                        const void* content, 
+                        size_t size,
+                        FileContentType type) ORTHANC_OVERRIDE;
+
+    virtual IMemoryBuffer* Read(const std::string& uuid,
+                                FileContentType type) ORTHANC_OVERRIDE;
+
+    virtual IMemoryBuffer* ReadRange(const std::string& uuid,
+                                     FileContentType type,
+                                     uint64_t start /* inclusive */,
+                                     uint64_t end /* exclusive */) ORTHANC_OVERRIDE;
+
+    virtual bool HasReadRange() const ORTHANC_OVERRIDE;
+
+    virtual void Remove(const std::string& uuid,
+                        FileContentType type) ORTHANC_OVERRIDE;
+  };
+}
@@ -36,14 +36,64 @@ namespace Orthanc
   {
   }
 
+  const char* BufferHttpSender::GetData() const
+  {
+    if (memoryBuffer_.get() != NULL)
+    {
+      return reinterpret_cast<const char*>(memoryBuffer_->GetData());
+    }
+    else
+    {
+      return buffer_.c_str();
+    }
+  }
+
+  size_t BufferHttpSender::GetSize() const
+  {
+    if (memoryBuffer_.get() != NULL)
+    {
+      return memoryBuffer_->GetSize();
+    }
+    else
+    {
+      return buffer_.size();
+    }
+  }
+
   std::string &BufferHttpSender::GetBuffer()
   {
+    if (memoryBuffer_.get() != NULL)
+    {
+      memoryBuffer_->MoveToString(buffer_);
+      memoryBuffer_.reset(NULL);
+    }
+
     return buffer_;
   }
 
   const std::string &BufferHttpSender::GetBuffer() const
   {
-    return buffer_;
+    if (memoryBuffer_.get() != NULL)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+    else
+    {
+      return buffer_;
+    }
+  }
+
+  void BufferHttpSender::SetBuffer(IMemoryBuffer* buffer)
+  {
+    if (buffer == NULL)
+    {
+      throw OrthancException(ErrorCode_NullPointer);
+    }
+    else
+    {
+      memoryBuffer_.reset(buffer);
+      buffer_.clear();
+    }
   }
 
   void BufferHttpSender::SetChunkSize(size_t chunkSize)
@@ -53,23 +103,24 @@ namespace Orthanc
 
   uint64_t BufferHttpSender::GetContentLength()
   {
-    return buffer_.size();
+    return GetSize();
   }
 
 
   bool BufferHttpSender::ReadNextChunk()
   {
-    assert(position_ + currentChunkSize_ <= buffer_.size());
+    const size_t size = GetSize();
+    assert(position_ + currentChunkSize_ <= size);
 
     position_ += currentChunkSize_;
 
-    if (position_ == buffer_.size())
+    if (position_ == size)
     {
       return false;
     }
     else
     {
-      currentChunkSize_ = buffer_.size() - position_;
+      currentChunkSize_ = size - position_;
 
       if (chunkSize_ != 0 &&
           currentChunkSize_ > chunkSize_)
@@ -84,7 +135,7 @@ namespace Orthanc
 
   const char* BufferHttpSender::GetChunkContent()
   {
-    return buffer_.c_str() + position_;
+    return GetData() + position_;
   }
 
 
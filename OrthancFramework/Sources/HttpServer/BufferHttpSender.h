@@ -23,24 +23,36 @@
 #pragma once
 
 #include "HttpFileSender.h"
+#include "../IMemoryBuffer.h"
 
 namespace Orthanc
 {
   class ORTHANC_PUBLIC BufferHttpSender : public HttpFileSender
   {
   private:
-    std::string  buffer_;
-    size_t       position_;
-    size_t       chunkSize_;
-    size_t       currentChunkSize_;
+    std::string                     buffer_;
+    std::unique_ptr<IMemoryBuffer>  memoryBuffer_;
+    size_t                          position_;
+    size_t                          chunkSize_;
+    size_t                          currentChunkSize_;
+
+    const char* GetData() const;
+
+    size_t GetSize() const;
 
   public:
     BufferHttpSender();
 
+    // If a memory buffer was set, its content is first moved into
+    // the string
     std::string& GetBuffer();
 
     const std::string& GetBuffer() const;
 
+    // New in Orthanc 1.11.0: The content of "buffer" (whose ownership
+    // is taken) is sent as such, without being copied into a string
+    void SetBuffer(IMemoryBuffer* buffer);
+
     // This is for test purpose. If "chunkSize" is set to "0" (the
     // default), the entire buffer is consumed at once.
     void SetChunkSize(size_t chunkSize);
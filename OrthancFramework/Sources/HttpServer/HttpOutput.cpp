@@ -31,10 +31,13 @@
 #include "../OrthancException.h"
 #include "../Toolbox.h"
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <stdio.h>
+#include <string.h>
 #include <boost/lexical_cast.hpp>
+#include <zlib.h>
 
 
 #if ORTHANC_ENABLE_CIVETWEB == 1
@@ -128,6 +131,13 @@ namespace Orthanc
     }
 
     headers_.push_back(header + ": " + value + "\r\n");
+
+    std::string lower;
+    Toolbox::ToLowerCase(lower, header);
+    if (lower == "content-type")
+    {
+      contentType_ = value;
+    }
   }
 
   void HttpOutput::StateMachine::ClearHeaders()
@@ -138,8 +148,50 @@ namespace Orthanc
     }
 
     headers_.clear();
+    contentType_.clear();
+  }
+
+  std::string HttpOutput::StateMachine::FormatHeader() const
+  {
+    std::string s = "HTTP/1.1 " + 
+      boost::lexical_cast<std::string>(status_) +
+      " " + std::string(EnumerationToString(status_)) +
+      "\r\n";
+
+    if (keepAlive_)
+    {
+      s += "Connection: keep-alive\r\n";
+
+      /**
+       * [LIFY-2311] The "Keep-Alive" HTTP header was missing in
+       * Orthanc <= 1.8.0, which notably caused failures if
+       * uploading DICOM instances by applying Java's
+       * "org.apache.http.client.methods.HttpPost()" on "/instances"
+       * URI, if "PoolingHttpClientConnectionManager" was in used. A
+       * workaround was to manually set a timeout for the keep-alive
+       * client to, say, 200 milliseconds, by using
+       * "HttpClients.custom().setKeepAliveStrategy((httpResponse,httpContext)->200)".
+       * Note that the "timeout" value can only be integer in the
+       * HTTP header, so we can't use the milliseconds granularity.
+       **/
+      s += ("Keep-Alive: timeout=" +
+            boost::lexical_cast<std::string>(CIVETWEB_KEEP_ALIVE_TIMEOUT_SECONDS) + "\r\n");
+    }
+    else
+    {
+      s += "Connection: close\r\n";
+    }
+
+    for (std::list<std::string>::const_iterator
+           it = headers_.begin(); it != headers_.end(); ++it)
+    {
+      s += *it;
+    }
+
+    return s;
   }
 
+
   void HttpOutput::StateMachine::SendBody(const void* buffer, size_t length)
   {
     if (state_ == State_Done)
@@ -156,7 +208,8 @@ namespace Orthanc
       }
     }
 
-    if (state_ == State_WritingMultipart)
+    if (state_ == State_WritingMultipart ||
+        state_ == State_WritingChunked)
     {
       throw OrthancException(ErrorCode_InternalError);
     }
@@ -167,40 +220,7 @@ namespace Orthanc
 
       stream_.OnHttpStatusReceived(status_);
 
-      std::string s = "HTTP/1.1 " + 
-        boost::lexical_cast<std::string>(status_) +
-        " " + std::string(EnumerationToString(status_)) +
-        "\r\n";
-
-      if (keepAlive_)
-      {
-        s += "Connection: keep-alive\r\n";
-
-        /**
-         * [LIFY-2311] The "Keep-Alive" HTTP header was missing in
-         * Orthanc <= 1.8.0, which notably caused failures if
-         * uploading DICOM instances by applying Java's
-         * "org.apache.http.client.methods.HttpPost()" on "/instances"
-         * URI, if "PoolingHttpClientConnectionManager" was in used. A
-         * workaround was to manually set a timeout for the keep-alive
-         * client to, say, 200 milliseconds, by using
-         * "HttpClients.custom().setKeepAliveStrategy((httpResponse,httpContext)->200)".
-         * Note that the "timeout" value can only be integer in the
-         * HTTP header, so we can't use the milliseconds granularity.
-         **/
-        s += ("Keep-Alive: timeout=" +
-              boost::lexical_cast<std::string>(CIVETWEB_KEEP_ALIVE_TIMEOUT_SECONDS) + "\r\n");
-      }
-      else
-      {
-        s += "Connection: close\r\n";
-      }
-
-      for (std::list<std::string>::const_iterator
-             it = headers_.begin(); it != headers_.end(); ++it)
-      {
-        s += *it;
-      }
+      std::string s = FormatHeader();
 
       if (status_ != HttpStatus_200_Ok)
       {
@@ -271,15 +291,138 @@ namespace Orthanc
   }
 
 
-  HttpCompression HttpOutput::GetPreferredCompression(size_t bodySize) const
+  static bool IsUncompressedDicom(const void* body,
+                                  size_t bodySize)
+  {
+    // Lookup the transfer syntax (0002,0010) in the meta-header of
+    // the DICOM file, which is always encoded as little endian
+    // explicit. If it cannot be found, the DICOM file is considered
+    // as uncompressed.
+
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(body);
+
+    if (bodySize < 132 ||
+        memcmp(p + 128, "DICM", 4) != 0)
+    {
+      return true;
+    }
+
+    size_t pos = 132;
+    while (pos + 8 <= bodySize)
+    {
+      const uint16_t group = static_cast<uint16_t>(p[pos] | (p[pos + 1] << 8));
+      const uint16_t element = static_cast<uint16_t>(p[pos + 2] | (p[pos + 3] << 8));
+
+      if (group != 0x0002)
+      {
+        return true;
+      }
+
+      const std::string vr(reinterpret_cast<const char*>(p + pos + 4), 2);
+
+      size_t headerSize, length;
+      if (vr == "OB" || vr == "OD" || vr == "OF" || vr == "OL" || vr == "OV" ||
+          vr == "OW" || vr == "SQ" || vr == "UC" || vr == "UN" || vr == "UR" || vr == "UT")
+      {
+        if (pos + 12 > bodySize)
+        {
+          return true;
+        }
+
+        headerSize = 12;
+        length = (static_cast<size_t>(p[pos + 8]) |
+                  (static_cast<size_t>(p[pos + 9]) << 8) |
+                  (static_cast<size_t>(p[pos + 10]) << 16) |
+                  (static_cast<size_t>(p[pos + 11]) << 24));
+      }
+      else
+      {
+        headerSize = 8;
+        length = static_cast<size_t>(p[pos + 6] | (p[pos + 7] << 8));
+      }
+
+      if (element == 0x0010)
+      {
+        if (pos + headerSize + length > bodySize)
+        {
+          return true;
+        }
+
+        std::string uid(reinterpret_cast<const char*>(p + pos + headerSize), length);
+        while (!uid.empty() &&
+               (uid[uid.size() - 1] == '\0' ||
+                uid[uid.size() - 1] == ' '))
+        {
+          uid.resize(uid.size() - 1);
+        }
+
+        return (uid == "1.2.840.10008.1.2" ||     // Little endian implicit
+                uid == "1.2.840.10008.1.2.1" ||   // Little endian explicit
+                uid == "1.2.840.10008.1.2.2");    // Big endian explicit
+      }
+
+      pos += headerSize + length;
+    }
+
+    return true;
+  }
+
+
+  bool HttpOutput::IsCompressibleContent(const std::string& contentType,
+                                         const void* body,
+                                         size_t bodySize)
+  {
+    std::string mime = contentType.substr(0, contentType.find(';'));
+    Toolbox::ToLowerCase(mime);
+    mime = Toolbox::StripSpaces(mime);
+
+    if (Toolbox::StartsWith(mime, "video/") ||
+        Toolbox::StartsWith(mime, "audio/"))
+    {
+      return false;
+    }
+    else if (mime == EnumerationToString(MimeType_Jpeg) ||
+             mime == EnumerationToString(MimeType_Jpeg2000) ||
+             mime == EnumerationToString(MimeType_Png) ||
+             mime == EnumerationToString(MimeType_Gif) ||
+             mime == EnumerationToString(MimeType_Gzip) ||
+             mime == EnumerationToString(MimeType_Zip) ||
+             mime == EnumerationToString(MimeType_Woff2) ||
+             mime == "image/jls" ||
+             mime == "image/jpx" ||
+             mime == "image/webp" ||
+             mime == "application/x-gzip" ||
+             mime == "application/x-7z-compressed" ||
+             mime == "application/x-bzip2" ||
+             mime == "application/x-xz")
+    {
+      // These formats are already compressed
+      return false;
+    }
+    else if (mime == EnumerationToString(MimeType_Dicom))
+    {
+      // Don't compress DICOM files whose pixel data is compressed
+      return (body == NULL ||
+              IsUncompressedDicom(body, bodySize));
+    }
+    else
+    {
+      return true;
+    }
+  }
+
+
+  HttpCompression HttpOutput::GetPreferredCompression(const void* body,
+                                                      size_t bodySize,
+                                                      uint64_t totalSize) const
   {
-#if 0
-    // TODO Do not compress small files?
-    if (bodySize < 512)
+    if ((!isGzipAllowed_ && !isDeflateAllowed_) ||
+        compressionLevel_ == 0 ||
+        totalSize < compressionMinimumSize_ ||  // Do not compress small files
+        !IsCompressibleContent(stateMachine_.GetContentType(), body, bodySize))
     {
       return HttpCompression_None;
     }
-#endif
 
     // Prefer "gzip" over "deflate" if the choice is offered
 
@@ -287,13 +430,9 @@ namespace Orthanc
     {
       return HttpCompression_Gzip;
     }
-    else if (isDeflateAllowed_)
-    {
-      return HttpCompression_Deflate;
-    }
     else
     {
-      return HttpCompression_None;
+      return HttpCompression_Deflate;
     }
   }
 
@@ -302,7 +441,10 @@ namespace Orthanc
                          bool isKeepAlive) :
     stateMachine_(stream, isKeepAlive),
     isDeflateAllowed_(false),
-    isGzipAllowed_(false)
+    isGzipAllowed_(false),
+    compressionMinimumSize_(0),
+    compressionLevel_(6),
+    compressionStreamingThreshold_(0)
   {
   }
 
@@ -326,6 +468,43 @@ namespace Orthanc
     return isGzipAllowed_;
   }
 
+  void HttpOutput::SetCompressionMinimumSize(size_t size)
+  {
+    compressionMinimumSize_ = size;
+  }
+
+  size_t HttpOutput::GetCompressionMinimumSize() const
+  {
+    return compressionMinimumSize_;
+  }
+
+  void HttpOutput::SetCompressionLevel(uint8_t level)
+  {
+    if (level > 9)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+    else
+    {
+      compressionLevel_ = level;
+    }
+  }
+
+  uint8_t HttpOutput::GetCompressionLevel() const
+  {
+    return compressionLevel_;
+  }
+
+  void HttpOutput::SetCompressionStreamingThreshold(uint64_t threshold)
+  {
+    compressionStreamingThreshold_ = threshold;
+  }
+
+  uint64_t HttpOutput::GetCompressionStreamingThreshold() const
+  {
+    return compressionStreamingThreshold_;
+  }
+
 
   void HttpOutput::SendMethodNotAllowed(const std::string& allowed)
   {
@@ -336,6 +515,78 @@ namespace Orthanc
   }
 
 
+  static void RemoveWeakPrefix(std::string& etag)
+  {
+    if (etag.size() >= 2 &&
+        etag[0] == 'W' &&
+        etag[1] == '/')
+    {
+      etag = etag.substr(2);
+    }
+  }
+
+
+  bool HttpOutput::IsETagMatching(const std::string& ifNoneMatch,
+                                  const std::string& etag)
+  {
+    std::string target = Toolbox::StripSpaces(etag);
+    RemoveWeakPrefix(target);
+
+    if (target.empty())
+    {
+      return false;
+    }
+
+    std::vector<std::string> tokens;
+    Toolbox::TokenizeString(tokens, ifNoneMatch, ',');
+
+    for (size_t i = 0; i < tokens.size(); i++)
+    {
+      std::string token = Toolbox::StripSpaces(tokens[i]);
+      if (token == "*")
+      {
+        return true;
+      }
+
+      RemoveWeakPrefix(token);
+      if (token == target)
+      {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+
+  bool HttpOutput::AnswerNotModified(const HttpToolbox::Arguments& requestHeaders,
+                                     const std::string& etag,
+                                     const std::string& cacheControl)
+  {
+    AddHeader("ETag", etag);
+
+    if (!cacheControl.empty())
+    {
+      AddHeader("Cache-Control", cacheControl);
+    }
+
+    // The keys of "requestHeaders" are in lower case. "If-None-Match"
+    // is the only validator that is considered, as Orthanc doesn't
+    // emit "Last-Modified" headers (RFC 7232, Section 3.3).
+    HttpToolbox::Arguments::const_iterator found = requestHeaders.find("if-none-match");
+    if (found != requestHeaders.end() &&
+        IsETagMatching(found->second, etag))
+    {
+      SendStatus(HttpStatus_304_NotModified);
+      return true;
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+
   void HttpOutput::SendStatus(HttpStatus status,
 			      const char* message,
 			      size_t messageSize)
@@ -437,7 +688,7 @@ namespace Orthanc
       return;
     }
 
-    HttpCompression compression = GetPreferredCompression(length);
+    HttpCompression compression = GetPreferredCompression(buffer, length, length);
 
     if (compression == HttpCompression_None)
     {
@@ -446,6 +697,13 @@ namespace Orthanc
       return;
     }
 
+    if (compressionStreamingThreshold_ != 0 &&
+        length >= compressionStreamingThreshold_)
+    {
+      AnswerWithStreamingCompression(compression, buffer, length, NULL);
+      return;
+    }
+
     std::string compressed, encoding;
 
     switch (compression)
@@ -456,6 +714,7 @@ namespace Orthanc
         ZlibCompressor compressor;
         // Do not prefix the buffer with its uncompressed size, to be compatible with "deflate"
         compressor.SetPrefixWithUncompressedSize(false);  
+        compressor.SetCompressionLevel(compressionLevel_);
         compressor.Compress(compressed, buffer, length);
         break;
       }
@@ -464,6 +723,7 @@ namespace Orthanc
       {
         encoding = "gzip";
         GzipCompressor compressor;
+        compressor.SetCompressionLevel(compressionLevel_);
         compressor.Compress(compressed, buffer, length);
         break;
       }
@@ -781,31 +1041,288 @@ namespace Orthanc
   }
 
 
+  void HttpOutput::StateMachine::StartChunkedTransfer()
+  {
+    if (state_ != State_WritingHeader ||
+        hasContentLength_ ||
+        status_ != HttpStatus_200_Ok)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+
+    stream_.OnHttpStatusReceived(status_);
+
+    std::string header = FormatHeader();
+    header += "Transfer-Encoding: chunked\r\n\r\n";
+
+    stream_.Send(true, header.c_str(), header.size());
+    state_ = State_WritingChunked;
+  }
+
+
+  void HttpOutput::StateMachine::SendChunk(const void* data,
+                                           size_t size)
+  {
+    if (state_ != State_WritingChunked)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+    else if (size > 0)  // An empty chunk would mark the end of the body
+    {
+      char header[32];
+      sprintf(header, "%lx\r\n", static_cast<unsigned long>(size));
+      stream_.Send(false, header, strlen(header));
+      stream_.Send(false, data, size);
+      stream_.Send(false, "\r\n", 2);
+    }
+  }
+
+
+  void HttpOutput::StateMachine::CloseChunkedTransfer()
+  {
+    if (state_ != State_WritingChunked)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+    else
+    {
+      stream_.Send(false, "0\r\n\r\n", 5);
+      state_ = State_Done;
+    }
+  }
+
+
   static void AnswerStreamAsBuffer(HttpOutput& output,
                                    IHttpStreamAnswer& stream)
   {
-    ChunkedBuffer buffer;
+    const uint64_t length = stream.GetContentLength();
 
-    while (stream.ReadNextChunk())
+    output.SetContentType(stream.GetContentType());
+    
+    std::string filename;
+    if (stream.HasContentFilename(filename))
+    {
+      output.SetContentFilename(filename.c_str());
+    }
+
+    if (!stream.ReadNextChunk())
     {
-      if (stream.GetChunkSize() > 0)
+      output.AnswerEmpty();
+    }
+    else if (stream.GetChunkSize() == length)
+    {
+      // New in Orthanc 1.11.0: The stream is made of one single chunk
+      // (e.g. an attachment of the storage area), that is directly
+      // answered without being copied
+      output.Answer(stream.GetChunkContent(), stream.GetChunkSize());
+    }
+    else
+    {
+      ChunkedBuffer buffer;
+
+      do
       {
-        buffer.AddChunk(stream.GetChunkContent(), stream.GetChunkSize());
+        if (stream.GetChunkSize() > 0)
+        {
+          buffer.AddChunk(stream.GetChunkContent(), stream.GetChunkSize());
+        }
       }
+      while (stream.ReadNextChunk());
+
+      std::string s;
+      buffer.Flatten(s);
+
+      output.Answer(s);
     }
+  }
 
-    std::string s;
-    buffer.Flatten(s);
 
-    output.SetContentType(stream.GetContentType());
-    
+  namespace
+  {
+    // On-the-fly compression of a HTTP body (new in Orthanc 1.11.0)
+    class StreamingCompressor : public boost::noncopyable
+    {
+    private:
+      z_stream  stream_;
+
+    public:
+      StreamingCompressor(HttpCompression compression,
+                          uint8_t level)
+      {
+        int windowBits;
+
+        switch (compression)
+        {
+          case HttpCompression_Gzip:
+            windowBits = MAX_WBITS + 16;  // ask for gzip output
+            break;
+
+          case HttpCompression_Deflate:
+            windowBits = MAX_WBITS;  // zlib output, as in "ZlibCompressor"
+            break;
+
+          default:
+            throw OrthancException(ErrorCode_ParameterOutOfRange);
+        }
+
+        memset(&stream_, 0, sizeof(stream_));
+
+        if (deflateInit2(&stream_, level, Z_DEFLATED, windowBits,
+                         8 /* default memory level */, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+          throw OrthancException(ErrorCode_InternalError, "Cannot initialize zlib");
+        }
+      }
+
+      ~StreamingCompressor()
+      {
+        deflateEnd(&stream_);
+      }
+
+      // Returns the compressed bytes that are available
+      void Compress(std::string& target,
+                    const void* data,
+                    size_t size,
+                    bool finish)
+      {
+        static const size_t BLOCK_SIZE = 64 * 1024;
+
+        target.clear();
+
+        stream_.next_in = const_cast<Bytef*>(reinterpret_cast<const Bytef*>(data));
+        stream_.avail_in = static_cast<uInt>(size);
+
+        if (static_cast<size_t>(stream_.avail_in) != size)
+        {
+          throw OrthancException(ErrorCode_NotEnoughMemory);
+        }
+
+        for (;;)
+        {
+          const size_t pos = target.size();
+          target.resize(pos + BLOCK_SIZE);
+
+          stream_.next_out = reinterpret_cast<Bytef*>(&target[pos]);
+          stream_.avail_out = static_cast<uInt>(BLOCK_SIZE);
+
+          int error = deflate(&stream_, finish ? Z_FINISH : Z_NO_FLUSH);
+          target.resize(pos + BLOCK_SIZE - stream_.avail_out);
+
+          if (error == Z_STREAM_END ||
+              (error == Z_BUF_ERROR && !finish))
+          {
+            return;
+          }
+          else if (error != Z_OK)
+          {
+            throw OrthancException(ErrorCode_InternalError, "Error in zlib");
+          }
+          else if (!finish &&
+                   stream_.avail_in == 0 &&
+                   stream_.avail_out != 0)
+          {
+            return;
+          }
+        }
+      }
+    };
+  }
+
+
+  void HttpOutput::AnswerWithStreamingCompression(HttpCompression compression,
+                                                  const void* firstChunk,
+                                                  size_t firstChunkSize,
+                                                  IHttpStreamAnswer* remainingChunks)
+  {
+    // The first chunk is split into blocks, so that the first bytes
+    // are sent as soon as possible
+    static const size_t BLOCK_SIZE = 256 * 1024;
+
+    const char* encoding = (compression == HttpCompression_Gzip ? "gzip" : "deflate");
+    LOG(TRACE) << "Compressing a HTTP answer on-the-fly using " << encoding;
+
+    StreamingCompressor compressor(compression, compressionLevel_);
+
+    stateMachine_.AddHeader("Content-Encoding", encoding);
+    stateMachine_.StartChunkedTransfer();
+
+    std::string compressed;
+
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(firstChunk);
+    for (size_t pos = 0; pos < firstChunkSize; pos += BLOCK_SIZE)
+    {
+      compressor.Compress(compressed, p + pos, std::min(BLOCK_SIZE, firstChunkSize - pos), false);
+      stateMachine_.SendChunk(compressed.empty() ? NULL : compressed.c_str(), compressed.size());
+    }
+
+    if (remainingChunks != NULL)
+    {
+      while (remainingChunks->ReadNextChunk())
+      {
+        compressor.Compress(compressed, remainingChunks->GetChunkContent(), remainingChunks->GetChunkSize(), false);
+        stateMachine_.SendChunk(compressed.empty() ? NULL : compressed.c_str(), compressed.size());
+      }
+    }
+
+    compressor.Compress(compressed, NULL, 0, true);
+    stateMachine_.SendChunk(compressed.empty() ? NULL : compressed.c_str(), compressed.size());
+
+    stateMachine_.CloseChunkedTransfer();
+  }
+
+
+  void HttpOutput::AnswerStreamWithCompression(IHttpStreamAnswer& stream)
+  {
+    const uint64_t length = stream.GetContentLength();
+
+    if (compressionStreamingThreshold_ == 0 ||
+        length < compressionStreamingThreshold_)
+    {
+      AnswerStreamAsBuffer(*this, stream);
+      return;
+    }
+
+    std::string contentType = stream.GetContentType();
+    if (contentType.empty())
+    {
+      contentType = MIME_BINARY;
+    }
+
+    stateMachine_.SetContentType(contentType.c_str());
+
     std::string filename;
     if (stream.HasContentFilename(filename))
     {
-      output.SetContentFilename(filename.c_str());
+      SetContentFilename(filename.c_str());
     }
 
-    output.Answer(s);
+    if (!stream.ReadNextChunk())
+    {
+      AnswerEmpty();
+      return;
+    }
+
+    // The first chunk is used to decide whether compression is
+    // worth it (e.g. to detect DICOM files with compressed pixel data)
+    HttpCompression compression = GetPreferredCompression(stream.GetChunkContent(), stream.GetChunkSize(), length);
+
+    if (compression == HttpCompression_None)
+    {
+      stateMachine_.SetContentLength(length);
+
+      do
+      {
+        stateMachine_.SendBody(stream.GetChunkContent(),
+                               stream.GetChunkSize());
+      }
+      while (stream.ReadNextChunk());
+
+      stateMachine_.CloseBody();
+    }
+    else
+    {
+      AnswerWithStreamingCompression(compression, stream.GetChunkContent(), stream.GetChunkSize(), &stream);
+    }
   }
 
 
@@ -822,7 +1339,7 @@ namespace Orthanc
           // New in Orthanc 1.5.7: Compress streams without built-in
           // compression, if requested by the "Accept-Encoding" HTTP
           // header
-          AnswerStreamAsBuffer(*this, stream);
+          AnswerStreamWithCompression(stream);
           return;
         }
         
@@ -24,6 +24,7 @@
 #pragma once
 
 #include "../Enumerations.h"
+#include "HttpToolbox.h"
 #include "IHttpOutputStream.h"
 #include "IHttpStreamAnswer.h"
 
@@ -49,7 +50,8 @@ namespace Orthanc
         State_WritingBody,
         State_WritingMultipart,
         State_Done,
-        State_WritingStream
+        State_WritingStream,
+        State_WritingChunked      // New in Orthanc 1.11.0
       };
 
     private:
@@ -62,12 +64,15 @@ namespace Orthanc
       uint64_t contentPosition_;
       bool keepAlive_;
       std::list<std::string> headers_;
+      std::string contentType_;
 
       std::string multipartBoundary_;
       std::string multipartContentType_;
 
       void StartStreamInternal(const std::string& contentType);
 
+      std::string FormatHeader() const;
+
     public:
       StateMachine(IHttpOutputStream& stream,
                    bool isKeepAlive);
@@ -116,13 +121,39 @@ namespace Orthanc
                           size_t size);
 
       void CloseStream();
+
+      // New in Orthanc 1.11.0: "Transfer-Encoding: chunked", which
+      // preserves keep-alive (only for HTTP/1.1 clients)
+      void StartChunkedTransfer();
+
+      void SendChunk(const void* data,
+                     size_t size);
+
+      void CloseChunkedTransfer();
+
+      const std::string& GetContentType() const
+      {
+        return contentType_;
+      }
     };
 
     StateMachine stateMachine_;
     bool         isDeflateAllowed_;
     bool         isGzipAllowed_;
+    size_t       compressionMinimumSize_;
+    uint8_t      compressionLevel_;
+    uint64_t     compressionStreamingThreshold_;
 
-    HttpCompression GetPreferredCompression(size_t bodySize) const;
+    HttpCompression GetPreferredCompression(const void* body,
+                                            size_t bodySize,
+                                            uint64_t totalSize) const;
+
+    void AnswerWithStreamingCompression(HttpCompression compression,
+                                        const void* firstChunk,
+                                        size_t firstChunkSize,
+                                        IHttpStreamAnswer* remainingChunks);
+
+    void AnswerStreamWithCompression(IHttpStreamAnswer& stream);
 
   public:
     HttpOutput(IHttpOutputStream& stream,
@@ -136,6 +167,54 @@ namespace Orthanc
 
     bool IsGzipAllowed() const;
 
+    /**
+     * New in Orthanc 1.11.0: The bodies that are smaller than
+     * "size" bytes are not compressed, as the gain is lower than
+     * the cost of compression.
+     **/
+    void SetCompressionMinimumSize(size_t size);
+
+    size_t GetCompressionMinimumSize() const;
+
+    // New in Orthanc 1.11.0: Between 0 (no compression) and 9
+    void SetCompressionLevel(uint8_t level);
+
+    uint8_t GetCompressionLevel() const;
+
+    /**
+     * New in Orthanc 1.11.0: The bodies that are larger than
+     * "threshold" bytes are compressed on-the-fly and sent using
+     * chunked transfer, so that the first bytes are sent before the
+     * whole body is compressed. A value of "0" disables this
+     * feature. Must only be enabled for HTTP/1.1 clients.
+     **/
+    void SetCompressionStreamingThreshold(uint64_t threshold);
+
+    uint64_t GetCompressionStreamingThreshold() const;
+
+    // New in Orthanc 1.11.0
+    static bool IsCompressibleContent(const std::string& contentType,
+                                      const void* body,
+                                      size_t bodySize);
+
+    /**
+     * New in Orthanc 1.11.0: Conditional GET (RFC 7232). Check
+     * whether "etag" matches the "If-None-Match" header of the
+     * request, which uses the weak comparison of entity-tags.
+     **/
+    static bool IsETagMatching(const std::string& ifNoneMatch,
+                               const std::string& etag);
+
+    /**
+     * New in Orthanc 1.11.0: Add the "ETag" and "Cache-Control"
+     * (if not empty) headers to the answer. If the client already
+     * owns this version of the resource, "304 Not Modified" is sent
+     * and "true" is returned: The caller must not answer anymore.
+     **/
+    bool AnswerNotModified(const HttpToolbox::Arguments& requestHeaders,
+                           const std::string& etag,
+                           const std::string& cacheControl);
+
     void SendStatus(HttpStatus status,
 		    const char* message,
 		    size_t messageSize);
@@ -756,8 +756,20 @@ namespace Orthanc
 
 
   static void ConfigureHttpCompression(HttpOutput& output,
+                                       const HttpServer& server,
+                                       const struct mg_request_info* request,
                                        const HttpToolbox::Arguments& headers)
   {
+    output.SetCompressionMinimumSize(server.GetHttpCompressionMinimumSize());
+    output.SetCompressionLevel(server.GetHttpCompressionLevel());
+
+    // The chunked transfer encoding is only available since HTTP/1.1
+    if (request->http_version != NULL &&
+        strcmp(request->http_version, "1.1") == 0)
+    {
+      output.SetCompressionStreamingThreshold(server.GetHttpCompressionStreamingThreshold());
+    }
+
     // Look if the client wishes HTTP compression
     // https://en.wikipedia.org/wiki/HTTP_compression
     HttpToolbox::Arguments::const_iterator it = headers.find("accept-encoding");
@@ -1170,7 +1182,7 @@ namespace Orthanc
 
     if (server.IsHttpCompressionEnabled())
     {
-      ConfigureHttpCompression(output, headers);
+      ConfigureHttpCompression(output, server, request, headers);
     }
 
 
@@ -1571,6 +1583,9 @@ namespace Orthanc
     filter_(NULL),
     keepAlive_(false),
     httpCompression_(true),
+    httpCompressionMinimumSize_(1024),
+    httpCompressionLevel_(6),
+    httpCompressionStreamingThreshold_(1024 * 1024),
     exceptionFormatter_(NULL),
     realm_(ORTHANC_REALM),
     threadsCount_(50),  // Default value in mongoose/civetweb
@@ -1998,6 +2013,58 @@ namespace Orthanc
     CLOG(WARNING, HTTP) << "HTTP compression is " << (enabled ? "enabled" : "disabled");
   }
 
+  size_t HttpServer::GetHttpCompressionMinimumSize() const
+  {
+    return httpCompressionMinimumSize_;
+  }
+
+  void HttpServer::SetHttpCompressionMinimumSize(size_t size)
+  {
+    Stop();
+    httpCompressionMinimumSize_ = size;
+    CLOG(INFO, HTTP) << "HTTP compression is only applied to bodies of at least " << size << " bytes";
+  }
+
+  uint8_t HttpServer::GetHttpCompressionLevel() const
+  {
+    return httpCompressionLevel_;
+  }
+
+  void HttpServer::SetHttpCompressionLevel(unsigned int level)
+  {
+    if (level < 1 ||
+        level > 9)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange,
+                             "The HTTP compression level must be between 1 and 9, found: " +
+                             boost::lexical_cast<std::string>(level));
+    }
+
+    Stop();
+    httpCompressionLevel_ = static_cast<uint8_t>(level);
+    CLOG(INFO, HTTP) << "HTTP compression level: " << level;
+  }
+
+  uint64_t HttpServer::GetHttpCompressionStreamingThreshold() const
+  {
+    return httpCompressionStreamingThreshold_;
+  }
+
+  void HttpServer::SetHttpCompressionStreamingThreshold(uint64_t threshold)
+  {
+    Stop();
+    httpCompressionStreamingThreshold_ = threshold;
+
+    if (threshold == 0)
+    {
+      CLOG(INFO, HTTP) << "Streaming HTTP compression is disabled";
+    }
+    else
+    {
+      CLOG(INFO, HTTP) << "Streaming HTTP compression is applied to bodies of at least " << threshold << " bytes";
+    }
+  }
+
   IIncomingHttpRequestFilter *HttpServer::GetIncomingHttpRequestFilter() const
   {
     return filter_;
@@ -107,6 +107,9 @@ namespace Orthanc
     IIncomingHttpRequestFilter* filter_;
     bool keepAlive_;
     bool httpCompression_;
+    size_t httpCompressionMinimumSize_;           // New in Orthanc 1.11.0
+    uint8_t httpCompressionLevel_;                // New in Orthanc 1.11.0
+    uint64_t httpCompressionStreamingThreshold_;  // New in Orthanc 1.11.0
     IHttpExceptionFormatter* exceptionFormatter_;
     std::string realm_;
     unsigned int threadsCount_;
@@ -171,6 +174,26 @@ namespace Orthanc
 
     void SetHttpCompressionEnabled(bool enabled);
 
+    size_t GetHttpCompressionMinimumSize() const;
+
+    // New in Orthanc 1.11.0: Bodies below this size are never compressed
+    void SetHttpCompressionMinimumSize(size_t size);
+
+    uint8_t GetHttpCompressionLevel() const;
+
+    // New in Orthanc 1.11.0: Level of zlib, between 1 and 9
+    void SetHttpCompressionLevel(unsigned int level);
+
+    uint64_t GetHttpCompressionStreamingThreshold() const;
+
+    /**
+     * New in Orthanc 1.11.0: Bodies above this size are compressed
+     * on-the-fly using the chunked transfer encoding of HTTP/1.1,
+     * instead of being compressed as a whole in memory. "0" means
+     * that streaming compression is disabled.
+     **/
+    void SetHttpCompressionStreamingThreshold(uint64_t threshold);
+
     IIncomingHttpRequestFilter* GetIncomingHttpRequestFilter() const;
 
     void SetIncomingHttpRequestFilter(IIncomingHttpRequestFilter& filter);
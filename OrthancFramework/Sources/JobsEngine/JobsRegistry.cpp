@@ -110,6 +110,11 @@ namespace Orthanc
       return id_;
     }
 
+    const std::string& GetJobType() const
+    {
+      return jobType_;
+    }
+
     IJob& GetJob() const
     {
       assert(job_.get() != NULL);
@@ -344,7 +349,36 @@ namespace Orthanc
   bool JobsRegistry::PriorityComparator::operator() (JobHandler* const& a,
                                                      JobHandler* const& b) const
   {
-    return a->GetPriority() < b->GetPriority();
+    if (agingDelay_ == 0)
+    {
+      return a->GetPriority() < b->GetPriority();
+    }
+    else
+    {
+      /**
+       * With aging, the effective priority of a pending job is
+       * "priority + (now - pendingSince) / agingDelay". The difference
+       * between the effective priorities of two jobs doesn't depend on
+       * "now", which preserves the heap condition over time.
+       **/
+      const int64_t delta = (static_cast<int64_t>(a->GetPriority()) -
+                             static_cast<int64_t>(b->GetPriority()));
+      const int64_t age = (b->GetLastStateChangeTime() -
+                           a->GetLastStateChangeTime()).total_milliseconds();
+      return delta * static_cast<int64_t>(agingDelay_) * 1000 + age < 0;
+    }
+  }
+
+
+  JobsRegistry::JobType::JobType(unsigned int agingDelay) :
+    pending_(PriorityComparator(agingDelay)),
+    running_(0),
+    maxRunning_(0),
+    weight_(1),
+    countScheduled_(0),
+    totalWait_(0),
+    maxWait_(0)
+  {
   }
 
 
@@ -356,7 +390,13 @@ namespace Orthanc
 #else
   bool JobsRegistry::IsPendingJob(const JobHandler& job) const
   {
-    PendingJobs copy = pendingJobs_;
+    JobTypes::const_iterator found = jobTypes_.find(job.GetJobType());
+    if (found == jobTypes_.end())
+    {
+      return false;
+    }
+
+    PendingJobs copy = found->second->pending_;
     while (!copy.empty())
     {
       if (copy.top() == &job)
@@ -391,11 +431,13 @@ namespace Orthanc
 
   void JobsRegistry::CheckInvariants() const
   {
+    for (JobTypes::const_iterator it = jobTypes_.begin(); it != jobTypes_.end(); ++it)
     {
-      PendingJobs copy = pendingJobs_;
+      PendingJobs copy = it->second->pending_;
       while (!copy.empty())
       {
-        assert(copy.top()->GetState() == JobState_Pending);
+        assert(copy.top()->GetState() == JobState_Pending &&
+               copy.top()->GetJobType() == it->first);
         copy.pop();
       }
     }
@@ -450,6 +492,143 @@ namespace Orthanc
 #endif
 
 
+  JobsRegistry::JobType& JobsRegistry::GetJobType(const std::string& jobType)
+  {
+    JobTypes::iterator found = jobTypes_.find(jobType);
+    if (found == jobTypes_.end())
+    {
+      JobType* created = new JobType(agingDelay_);
+      jobTypes_[jobType] = created;
+      return *created;
+    }
+    else
+    {
+      assert(found->second != NULL);
+      return *found->second;
+    }
+  }
+
+
+  void JobsRegistry::PushPendingJob(JobHandler* handler)
+  {
+    assert(handler != NULL &&
+           handler->GetState() == JobState_Pending);
+
+    GetJobType(handler->GetJobType()).pending_.push(handler);
+
+    // Notify all the workers, as the ones that are waiting might
+    // have been blocked by the limit on the number of running jobs
+    pendingJobAvailable_.notify_all();
+  }
+
+
+  JobsRegistry::JobHandler* JobsRegistry::PopPendingJob()
+  {
+    JobType* best = NULL;
+    JobHandler* bestHandler = NULL;
+
+    const PriorityComparator comparator(agingDelay_);
+
+    for (JobTypes::iterator it = jobTypes_.begin(); it != jobTypes_.end(); ++it)
+    {
+      JobType& type = *it->second;
+
+      if (type.pending_.empty() ||
+          (type.maxRunning_ != 0 &&
+           type.running_ >= type.maxRunning_))
+      {
+        continue;  // This job type cannot be scheduled for now
+      }
+
+      JobHandler* candidate = type.pending_.top();
+
+      bool isBetter;
+      if (best == NULL)
+      {
+        isBetter = true;
+      }
+      else if (fairScheduling_ &&
+               type.running_ * best->weight_ != best->running_ * type.weight_)
+      {
+        // Favor the job type that uses the smallest share of the
+        // workers, relative to its weight: "running / weight"
+        isBetter = (type.running_ * best->weight_ < best->running_ * type.weight_);
+      }
+      else
+      {
+        isBetter = comparator(bestHandler, candidate);
+      }
+
+      if (isBetter)
+      {
+        best = &type;
+        bestHandler = candidate;
+      }
+    }
+
+    if (best == NULL)
+    {
+      return NULL;
+    }
+    else
+    {
+      best->pending_.pop();
+      best->running_ ++;
+
+      const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+      const int64_t wait = (now - bestHandler->GetLastStateChangeTime()).total_milliseconds();
+      if (wait > 0)
+      {
+        best->totalWait_ += static_cast<uint64_t>(wait);
+        best->maxWait_ = std::max(best->maxWait_, static_cast<uint64_t>(wait));
+      }
+
+      best->countScheduled_ ++;
+
+      return bestHandler;
+    }
+  }
+
+
+  void JobsRegistry::RebuildPendingJobs()
+  {
+    // The heap condition has changed (priority of one job, or aging
+    // delay), so the priority queues must be reconstructed
+    for (JobTypes::iterator it = jobTypes_.begin(); it != jobTypes_.end(); ++it)
+    {
+      PendingJobs copy;
+      std::swap(copy, it->second->pending_);
+
+      it->second->pending_ = PendingJobs(PriorityComparator(agingDelay_));
+
+      while (!copy.empty())
+      {
+        it->second->pending_.push(copy.top());
+        copy.pop();
+      }
+    }
+  }
+
+
+  void JobsRegistry::SignalRunningJobStopped(JobHandler& job)
+  {
+    JobType& type = GetJobType(job.GetJobType());
+    assert(type.running_ > 0);
+
+    if (type.running_ > 0)
+    {
+      type.running_ --;
+    }
+
+    if (type.maxRunning_ != 0 &&
+        !type.pending_.empty())
+    {
+      // Some worker might be waiting for this job type to be unlocked
+      pendingJobAvailable_.notify_all();
+    }
+  }
+
+
   void JobsRegistry::ForgetOldCompletedJobs()
   {
     while (completedJobs_.size() > maxCompletedJobs_)
@@ -586,6 +765,12 @@ namespace Orthanc
       assert(it->second != NULL);
       delete it->second;
     }
+
+    for (JobTypes::iterator it = jobTypes_.begin(); it != jobTypes_.end(); ++it)
+    {
+      assert(it->second != NULL);
+      delete it->second;
+    }
   }
 
 
@@ -705,8 +890,7 @@ namespace Orthanc
         case JobState_Retry:
         case JobState_Running:
           handler->SetState(JobState_Pending);
-          pendingJobs_.push(handler);
-          pendingJobAvailable_.notify_one();
+          PushPendingJob(handler);
           break;
 
         case JobState_Success:
@@ -743,7 +927,9 @@ namespace Orthanc
 
   JobsRegistry::JobsRegistry(size_t maxCompletedJobs) :
     maxCompletedJobs_(maxCompletedJobs),
-    observer_(NULL)
+    observer_(NULL),
+    fairScheduling_(false),
+    agingDelay_(0)
   {
   }
 
@@ -859,16 +1045,7 @@ namespace Orthanc
       {
         // If the job is pending, we need to reconstruct the
         // priority queue, as the heap condition has changed
-
-        PendingJobs copy;
-        std::swap(copy, pendingJobs_);
-
-        assert(pendingJobs_.empty());
-        while (!copy.empty())
-        {
-          pendingJobs_.push(copy.top());
-          copy.pop();
-        }
+        RebuildPendingJobs();
       }
 
       CheckInvariants();
@@ -881,18 +1058,22 @@ namespace Orthanc
   {
     // If the job is pending, we need to reconstruct the priority
     // queue to remove it
-    PendingJobs copy;
-    std::swap(copy, pendingJobs_);
-
-    assert(pendingJobs_.empty());
-    while (!copy.empty())
+    for (JobTypes::iterator it = jobTypes_.begin(); it != jobTypes_.end(); ++it)
     {
-      if (copy.top()->GetId() != id)
+      PendingJobs copy;
+      std::swap(copy, it->second->pending_);
+
+      it->second->pending_ = PendingJobs(PriorityComparator(agingDelay_));
+
+      while (!copy.empty())
       {
-        pendingJobs_.push(copy.top());
-      }
+        if (copy.top()->GetId() != id)
+        {
+          it->second->pending_.push(copy.top());
+        }
 
-      copy.pop();
+        copy.pop();
+      }
     }
   }
 
@@ -1032,8 +1213,7 @@ namespace Orthanc
     else
     {
       found->second->SetState(JobState_Pending);
-      pendingJobs_.push(found->second);
-      pendingJobAvailable_.notify_one();
+      PushPendingJob(found->second);
       CheckInvariants();
       return true;
     }
@@ -1080,8 +1260,7 @@ namespace Orthanc
 
       found->second->ResetRuntime();
       found->second->SetState(JobState_Pending);
-      pendingJobs_.push(found->second);
-      pendingJobAvailable_.notify_one();
+      PushPendingJob(found->second);
 
       CheckInvariants();
       return true;
@@ -1106,8 +1285,7 @@ namespace Orthanc
       {
         LOG(INFO) << "Retrying job: " << (*it)->GetId();
         (*it)->SetState(JobState_Pending);
-        pendingJobs_.push(*it);
-        pendingJobAvailable_.notify_one();
+        PushPendingJob(*it);
       }
       else
       {
@@ -1152,9 +1330,14 @@ namespace Orthanc
     {
       boost::mutex::scoped_lock lock(registry_.mutex_);
 
-      while (registry_.pendingJobs_.empty())
+      for (;;)
       {
-        if (timeout == 0)
+        handler_ = registry_.PopPendingJob();
+        if (handler_ != NULL)
+        {
+          break;
+        }
+        else if (timeout == 0)
         {
           registry_.pendingJobAvailable_.wait(lock);
         }
@@ -1170,9 +1353,7 @@ namespace Orthanc
         }
       }
 
-      handler_ = registry_.pendingJobs_.top();
-      registry_.pendingJobs_.pop();
-
+      assert(handler_ != NULL);
       assert(handler_->GetState() == JobState_Pending);
       handler_->SetState(JobState_Running);
       handler_->SetLastErrorCode(ErrorCode_Success);
@@ -1190,6 +1371,8 @@ namespace Orthanc
     {
       boost::mutex::scoped_lock lock(registry_.mutex_);
 
+      registry_.SignalRunningJobStopped(*handler_);
+
       switch (targetState_)
       {
         case JobState_Failure:
@@ -1409,7 +1592,9 @@ namespace Orthanc
                              const Json::Value& s,
                              size_t maxCompletedJobs) :
     maxCompletedJobs_(maxCompletedJobs),
-    observer_(NULL)
+    observer_(NULL),
+    fairScheduling_(false),
+    agingDelay_(0)
   {
     if (SerializationToolbox::ReadString(s, TYPE) != JOBS_REGISTRY ||
         !s.isMember(JOBS) ||
@@ -1498,4 +1683,108 @@ namespace Orthanc
       }
     }
   }
+
+
+  void JobsRegistry::SetFairScheduling(bool fair)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    CheckInvariants();
+
+    LOG(INFO) << "Fair scheduling across the job types is " << (fair ? "enabled" : "disabled");
+    fairScheduling_ = fair;
+  }
+
+
+  void JobsRegistry::SetAgingDelay(unsigned int seconds)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    CheckInvariants();
+
+    if (seconds == 0)
+    {
+      LOG(INFO) << "Aging of the pending jobs is disabled";
+    }
+    else
+    {
+      LOG(INFO) << "The priority of the pending jobs is increased by 1 every " << seconds << " second(s)";
+    }
+
+    agingDelay_ = seconds;
+    RebuildPendingJobs();
+
+    CheckInvariants();
+  }
+
+
+  void JobsRegistry::SetJobTypeMaxRunning(const std::string& jobType,
+                                          unsigned int maxRunning)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    CheckInvariants();
+
+    if (maxRunning == 0)
+    {
+      LOG(INFO) << "No limit on the number of simultaneous jobs of type: " << jobType;
+    }
+    else
+    {
+      LOG(INFO) << "At most " << maxRunning << " job(s) of type \"" << jobType
+                << "\" will run simultaneously";
+    }
+
+    GetJobType(jobType).maxRunning_ = maxRunning;
+    pendingJobAvailable_.notify_all();
+  }
+
+
+  void JobsRegistry::SetJobTypeWeight(const std::string& jobType,
+                                      unsigned int weight)
+  {
+    if (weight == 0)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange,
+                             "The weight of a job type must be strictly positive");
+    }
+
+    boost::mutex::scoped_lock lock(mutex_);
+    CheckInvariants();
+
+    GetJobType(jobType).weight_ = weight;
+  }
+
+
+  bool JobsRegistry::GetJobTypeWaitTime(uint64_t& average,
+                                        uint64_t& maximum,
+                                        const std::string& jobType)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    CheckInvariants();
+
+    JobTypes::const_iterator found = jobTypes_.find(jobType);
+    if (found == jobTypes_.end() ||
+        found->second->countScheduled_ == 0)
+    {
+      return false;
+    }
+    else
+    {
+      average = found->second->totalWait_ / found->second->countScheduled_;
+      maximum = found->second->maxWait_;
+      return true;
+    }
+  }
+
+
+  void JobsRegistry::ListJobTypes(std::set<std::string>& target)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    CheckInvariants();
+
+    target.clear();
+
+    for (JobTypes::const_iterator it = jobTypes_.begin(); it != jobTypes_.end(); ++it)
+    {
+      target.insert(it->first);
+    }
+  }
 }
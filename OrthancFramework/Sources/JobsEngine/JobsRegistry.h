@@ -70,8 +70,17 @@ namespace Orthanc
 
     class JobHandler;
 
-    struct PriorityComparator
+    class PriorityComparator
     {
+    private:
+      unsigned int  agingDelay_;  // In seconds, 0 means no aging
+
+    public:
+      explicit PriorityComparator(unsigned int agingDelay = 0) :
+        agingDelay_(agingDelay)
+      {
+      }
+
       bool operator() (JobHandler* const& a,
                        JobHandler* const& b) const;
     };
@@ -83,9 +92,26 @@ namespace Orthanc
                                 std::vector<JobHandler*>,   // Could be a "std::deque"
                                 PriorityComparator>         PendingJobs;
 
+    // New in Orthanc 1.11.0: The pending jobs are grouped by job
+    // type, in order to share the workers between the job types
+    struct JobType
+    {
+      PendingJobs   pending_;
+      unsigned int  running_;
+      unsigned int  maxRunning_;  // 0 means no limit
+      unsigned int  weight_;
+      uint64_t      countScheduled_;
+      uint64_t      totalWait_;   // In milliseconds
+      uint64_t      maxWait_;     // In milliseconds
+
+      explicit JobType(unsigned int agingDelay);
+    };
+
+    typedef std::map<std::string, JobType*>  JobTypes;
+
     boost::mutex               mutex_;
     JobsIndex                  jobsIndex_;
-    PendingJobs                pendingJobs_;
+    JobTypes                   jobTypes_;
     CompletedJobs              completedJobs_;
     RetryJobs                  retryJobs_;
 
@@ -95,6 +121,9 @@ namespace Orthanc
 
     IObserver*                 observer_;
 
+    bool                       fairScheduling_;
+    unsigned int               agingDelay_;
+
 
 #ifndef NDEBUG
     bool IsPendingJob(const JobHandler& job) const;
@@ -106,6 +135,16 @@ namespace Orthanc
 
     void CheckInvariants() const;
 
+    JobType& GetJobType(const std::string& jobType);
+
+    void PushPendingJob(JobHandler* handler);
+
+    JobHandler* PopPendingJob();
+
+    void RebuildPendingJobs();
+
+    void SignalRunningJobStopped(JobHandler& job);
+
     void ForgetOldCompletedJobs();
 
     void SetCompletedJob(JobHandler& job,
@@ -191,6 +230,36 @@ namespace Orthanc
                        unsigned int& success,
                        unsigned int& errors);
 
+    /**
+     * New in Orthanc 1.11.0: Configuration of the scheduling of the
+     * pending jobs. If fair scheduling is enabled, a worker that
+     * becomes available picks the job type that currently uses the
+     * smallest share of the workers (relative to its weight), then
+     * the job with the highest priority within this type. Otherwise,
+     * the job with the highest priority is picked regardless of its
+     * type. In both cases, the number of jobs of one type that run
+     * simultaneously can be bounded, and the priority of a pending
+     * job is increased by 1 every "agingDelay" seconds of waiting,
+     * which prevents starvation.
+     **/
+    void SetFairScheduling(bool fair);
+
+    void SetAgingDelay(unsigned int seconds);  // 0 to disable aging
+
+    void SetJobTypeMaxRunning(const std::string& jobType,
+                              unsigned int maxRunning);  // 0 for no limit
+
+    void SetJobTypeWeight(const std::string& jobType,
+                          unsigned int weight);
+
+    // Average and maximum time (in milliseconds) spent by the jobs
+    // of the given type in the pending state before being run
+    bool GetJobTypeWaitTime(uint64_t& average,
+                            uint64_t& maximum,
+                            const std::string& jobType);
+
+    void ListJobTypes(std::set<std::string>& target);
+
     class ORTHANC_PUBLIC RunningJob : public boost::noncopyable
     {
     private:
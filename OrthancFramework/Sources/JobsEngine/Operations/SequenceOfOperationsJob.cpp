@@ -116,26 +116,39 @@ namespace Orthanc
       return currentInput_ >= originalInputs_->GetSize() + workInputs_->GetSize();
     }
 
-    void Step()
+    // The mutex of the job must be locked
+    IJobOperationValue* CloneCurrentInput() const
     {
       if (IsDone())
       {
         throw OrthancException(ErrorCode_BadSequenceOfCalls);
       }
 
-      const IJobOperationValue* input;
-
       if (currentInput_ < originalInputs_->GetSize())
       {
-        input = &originalInputs_->GetValue(currentInput_);
+        return originalInputs_->GetValue(currentInput_).Clone();
       }
       else
       {
-        input = &workInputs_->GetValue(currentInput_ - originalInputs_->GetSize());
+        return workInputs_->GetValue(currentInput_ - originalInputs_->GetSize()).Clone();
       }
+    }
 
-      JobOperationValues outputs;
-      operation_->Apply(outputs, *input);
+    // The mutex of the job needs not to be locked, but the calls
+    // must be serialized by "applyMutex_"
+    void Apply(JobOperationValues& outputs,
+               const IJobOperationValue& input)
+    {
+      operation_->Apply(outputs, input);
+    }
+
+    // The mutex of the job must be locked
+    void Commit(JobOperationValues& outputs)
+    {
+      if (IsDone())
+      {
+        throw OrthancException(ErrorCode_BadSequenceOfCalls);
+      }
 
       if (!nextOperations_.empty())
       {
@@ -283,6 +296,19 @@ namespace Orthanc
     return that_.operations_.size();
   }
 
+  size_t SequenceOfOperationsJob::Lock::GetProcessedOperationsCount() const
+  {
+    size_t count = that_.current_;
+
+    while (count < that_.operations_.size() &&
+           that_.operations_[count]->IsDone())
+    {
+      count++;
+    }
+
+    return count;
+  }
+
 
   void SequenceOfOperationsJob::Lock::AddInput(size_t index,
                                                const IJobOperationValue& value)
@@ -332,47 +358,95 @@ namespace Orthanc
   }
 
 
+  void SequenceOfOperationsJob::NotifyDone() const
+  {
+    for (std::list<IObserver*>::const_iterator it = observers_.begin(); 
+         it != observers_.end(); ++it)
+    {
+      (*it)->SignalDone(*this);
+    }
+  }
+
+
   JobStepResult SequenceOfOperationsJob::Step(const std::string& jobId)
   {
-    boost::mutex::scoped_lock lock(mutex_);
+    Operation* operation = NULL;
+    std::unique_ptr<IJobOperationValue> input;
+    bool isOver = false;
 
-    if (current_ == operations_.size())
     {
-      LOG(INFO) << "Executing the trailing timeout in the sequence of operations";
-      operationAdded_.timed_wait(lock, trailingTimeout_);
-            
+      boost::mutex::scoped_lock lock(mutex_);
+
       if (current_ == operations_.size())
       {
-        // No operation was added during the trailing timeout: The
-        // job is over
-        LOG(INFO) << "The sequence of operations is over";
-        done_ = true;
+        LOG(INFO) << "Executing the trailing timeout in the sequence of operations";
+        operationAdded_.timed_wait(lock, trailingTimeout_);
+            
+        if (current_ == operations_.size())
+        {
+          // No operation was added during the trailing timeout: The
+          // job is over
+          LOG(INFO) << "The sequence of operations is over";
+          done_ = true;
+          isOver = true;
+        }
+        else
+        {
+          LOG(INFO) << "New operation were added to the sequence of operations";
+        }
+      }
+
+      if (!isOver)
+      {
+        assert(current_ < operations_.size());
+
+        while (current_ < operations_.size() &&
+               operations_[current_]->IsDone())
+        {
+          current_++;
+        }
 
-        for (std::list<IObserver*>::iterator it = observers_.begin(); 
-             it != observers_.end(); ++it)
+        if (current_ < operations_.size())
         {
-          (*it)->SignalDone(*this);
+          operation = operations_[current_];
+          input.reset(operation->CloneCurrentInput());
         }
+      }
+    }
 
+    if (operation == NULL)
+    {
+      if (isOver)
+      {
+        // The observers are notified after the mutex is unlocked, as
+        // they might try and add new operations to the job (which
+        // would result in a deadlock before Orthanc 1.11.0)
+        NotifyDone();
         return JobStepResult::Success();
       }
       else
       {
-        LOG(INFO) << "New operation were added to the sequence of operations";
+        return JobStepResult::Continue();
       }
     }
 
-    assert(current_ < operations_.size());
+    JobOperationValues outputs;
 
-    while (current_ < operations_.size() &&
-           operations_[current_]->IsDone())
     {
-      current_++;
+      /**
+       * New in Orthanc 1.11.0: The operation (that typically involves
+       * network or disk accesses) is applied without locking the job,
+       * so that the threads that add new operations to the job are
+       * not blocked in the meantime.
+       **/
+      boost::mutex::scoped_lock lock(applyMutex_);
+      assert(input.get() != NULL);
+      operation->Apply(outputs, *input);
     }
 
-    if (current_ < operations_.size())
     {
-      operations_[current_]->Step();
+      boost::mutex::scoped_lock lock(mutex_);
+      operation->Commit(outputs);
     }
 
     return JobStepResult::Continue();
@@ -422,6 +496,9 @@ namespace Orthanc
 
   bool SequenceOfOperationsJob::Serialize(Json::Value& value)
   {
+    // Wait for the operation that is possibly running to be applied,
+    // as it might modify its internal state
+    boost::mutex::scoped_lock applyLock(applyMutex_);
     boost::mutex::scoped_lock lock(mutex_);
 
     value = Json::objectValue;
@@ -54,6 +54,7 @@ namespace Orthanc
     std::string                       description_;
     bool                              done_;
     boost::mutex                      mutex_;
+    boost::mutex                      applyMutex_;  // New in Orthanc 1.11.0
     std::vector<Operation*>           operations_;
     size_t                            current_;
     boost::condition_variable         operationAdded_;
@@ -101,6 +102,10 @@ namespace Orthanc
 
       size_t GetOperationsCount() const;
 
+      // Number of operations at the beginning of the job, whose
+      // inputs have all been processed (new in Orthanc 1.11.0)
+      size_t GetProcessedOperationsCount() const;
+
       void AddInput(size_t index,
                     const IJobOperationValue& value);
       
@@ -0,0 +1,307 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+#include "../PrecompiledHeaders.h"
+#include "BufferArena.h"
+
+#include "../Compatibility.h"
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include <cassert>
+#include <set>
+#include <vector>
+
+
+namespace Orthanc
+{
+  namespace
+  {
+    // Maximum number of buffers that are retained by each thread
+    static const size_t MAX_BUFFERS_PER_THREAD = 4;
+
+    class Arena;
+
+    // Registry of the arenas of the running threads, together with
+    // the statistics of the threads that have exited
+    struct Registry
+    {
+      boost::mutex      mutex_;
+      std::set<Arena*>  arenas_;  // Not owned
+      size_t            maxRetainedSize_;
+      uint64_t          countAcquired_;
+      uint64_t          countReused_;
+
+      // Budget shared by all the arenas. It has its own mutex, that
+      // is only held while updating the counter.
+      boost::mutex      totalMutex_;
+      size_t            totalRetainedSize_;
+      size_t            maxTotalRetainedSize_;
+
+      Registry() :
+        maxRetainedSize_(0),  // Disabled by default
+        countAcquired_(0),
+        countReused_(0),
+        totalRetainedSize_(0),
+        maxTotalRetainedSize_(256 * 1024 * 1024)  // 256MB by default
+      {
+      }
+
+      bool Reserve(size_t size)
+      {
+        boost::mutex::scoped_lock lock(totalMutex_);
+
+        if (totalRetainedSize_ + size <= maxTotalRetainedSize_)
+        {
+          totalRetainedSize_ += size;
+          return true;
+        }
+        else
+        {
+          return false;
+        }
+      }
+
+      void Unreserve(size_t size)
+      {
+        boost::mutex::scoped_lock lock(totalMutex_);
+        assert(totalRetainedSize_ >= size);
+        totalRetainedSize_ -= size;
+      }
+    };
+
+    static Registry  registry_;
+
+    
+    class Arena : public boost::noncopyable
+    {
+    private:
+      // This mutex is only contended by "GetStatistics()" and
+      // "SetMaxRetainedSize()", as the arena is private to its thread
+      boost::mutex               mutex_;
+      std::vector<std::string*>  available_;
+      size_t                     retainedSize_;
+      size_t                     maxRetainedSize_;
+      uint64_t                   countAcquired_;
+      uint64_t                   countReused_;
+
+    public:
+      Arena() :
+        retainedSize_(0),
+        countAcquired_(0),
+        countReused_(0)
+      {
+        boost::mutex::scoped_lock lock(registry_.mutex_);
+        maxRetainedSize_ = registry_.maxRetainedSize_;
+        registry_.arenas_.insert(this);
+      }
+
+      // Invoked by "boost::thread_specific_ptr" when the thread exits
+      ~Arena()
+      {
+        {
+          boost::mutex::scoped_lock lock(registry_.mutex_);
+          registry_.arenas_.erase(this);
+          registry_.countAcquired_ += countAcquired_;
+          registry_.countReused_ += countReused_;
+        }
+
+        for (size_t i = 0; i < available_.size(); i++)
+        {
+          assert(available_[i] != NULL);
+          delete available_[i];
+        }
+
+        registry_.Unreserve(retainedSize_);
+      }
+
+      std::string* Acquire()
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+
+        countAcquired_++;
+
+        if (available_.empty())
+        {
+          return new std::string;
+        }
+        else
+        {
+          // LIFO order, as the most recently used buffer is the most
+          // likely to be in the CPU cache
+          std::string* content = available_.back();
+          available_.pop_back();
+
+          assert(content != NULL &&
+                 retainedSize_ >= content->capacity());
+          retainedSize_ -= content->capacity();
+          registry_.Unreserve(content->capacity());
+          countReused_++;
+
+          return content;
+        }
+      }
+
+      void Release(std::string* content)
+      {
+        assert(content != NULL);
+
+        // "clear()" keeps the capacity of the string
+        content->clear();
+
+        const size_t capacity = content->capacity();
+
+        {
+          boost::mutex::scoped_lock lock(mutex_);
+
+          if (available_.size() < MAX_BUFFERS_PER_THREAD &&
+              retainedSize_ + capacity <= maxRetainedSize_ &&
+              registry_.Reserve(capacity))
+          {
+            available_.push_back(content);
+            retainedSize_ += capacity;
+            return;
+          }
+        }
+
+        // Too large to be retained
+        delete content;
+      }
+
+      void SetMaxRetainedSize(size_t size)
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+
+        maxRetainedSize_ = size;
+
+        while (!available_.empty() &&
+               retainedSize_ > maxRetainedSize_)
+        {
+          // Free the oldest buffers first
+          std::string* content = available_.front();
+          available_.erase(available_.begin());
+          retainedSize_ -= content->capacity();
+          registry_.Unreserve(content->capacity());
+          delete content;
+        }
+      }
+
+      void GetStatistics(uint64_t& countAcquired,
+                         uint64_t& countReused,
+                         uint64_t& retainedSize)
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        countAcquired += countAcquired_;
+        countReused += countReused_;
+        retainedSize += retainedSize_;
+      }
+    };
+
+
+    static boost::thread_specific_ptr<Arena>  threadArena_;
+
+
+    static Arena& GetThreadArena()
+    {
+      Arena* arena = threadArena_.get();
+
+      if (arena == NULL)
+      {
+        arena = new Arena;
+        threadArena_.reset(arena);
+      }
+
+      return *arena;
+    }
+  }
+
+
+  BufferArena::Buffer::Buffer() :
+    content_(GetThreadArena().Acquire())
+  {
+  }
+
+
+  BufferArena::Buffer::~Buffer()
+  {
+    // If the buffer is released by another thread than the one that
+    // has acquired it, it simply moves to the arena of the other thread
+    GetThreadArena().Release(content_);
+  }
+
+
+  void BufferArena::SetMaxRetainedSizePerThread(size_t size)
+  {
+    boost::mutex::scoped_lock lock(registry_.mutex_);
+
+    registry_.maxRetainedSize_ = size;
+
+    for (std::set<Arena*>::iterator it = registry_.arenas_.begin(); it != registry_.arenas_.end(); ++it)
+    {
+      assert(*it != NULL);
+      (*it)->SetMaxRetainedSize(size);
+    }
+  }
+
+
+  size_t BufferArena::GetMaxRetainedSizePerThread()
+  {
+    boost::mutex::scoped_lock lock(registry_.mutex_);
+    return registry_.maxRetainedSize_;
+  }
+
+
+  void BufferArena::SetMaxRetainedSizeTotal(size_t size)
+  {
+    // The buffers that are already retained are kept: The new limit
+    // only applies to the buffers that are released from now on
+    boost::mutex::scoped_lock lock(registry_.totalMutex_);
+    registry_.maxTotalRetainedSize_ = size;
+  }
+
+
+  size_t BufferArena::GetMaxRetainedSizeTotal()
+  {
+    boost::mutex::scoped_lock lock(registry_.totalMutex_);
+    return registry_.maxTotalRetainedSize_;
+  }
+
+
+  void BufferArena::GetStatistics(uint64_t& countAcquired,
+                                  uint64_t& countReused,
+                                  uint64_t& retainedSize)
+  {
+    boost::mutex::scoped_lock lock(registry_.mutex_);
+
+    countAcquired = registry_.countAcquired_;
+    countReused = registry_.countReused_;
+    retainedSize = 0;
+
+    for (std::set<Arena*>::const_iterator it = registry_.arenas_.begin(); it != registry_.arenas_.end(); ++it)
+    {
+      assert(*it != NULL);
+      (*it)->GetStatistics(countAcquired, countReused, retainedSize);
+    }
+  }
+}
@@ -0,0 +1,89 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+#pragma once
+
+#include "../OrthancFramework.h"
+
+#include <boost/noncopyable.hpp>
+#include <stdint.h>
+#include <string>
+
+namespace Orthanc
+{
+  /**
+   * New in Orthanc 1.11.0: Per-thread pool of the temporary memory
+   * buffers that are used by the hot paths (decompression of the
+   * attachments, transcoding, image processing). Under sustained
+   * load, reusing the buffers that were previously released by the
+   * same thread avoids contention on the allocator and fragmentation
+   * of the heap. The buffers are retained up to a maximum size per
+   * thread and up to a maximum size for the whole process, and are
+   * freed when the thread exits. The reuse is disabled by default.
+   **/
+  class ORTHANC_PUBLIC BufferArena : public boost::noncopyable
+  {
+  public:
+    class ORTHANC_PUBLIC Buffer : public boost::noncopyable
+    {
+    private:
+      std::string*  content_;
+
+    public:
+      // Acquires an empty buffer from the arena of the current thread
+      Buffer();
+
+      // Gives the buffer back to the arena of the current thread
+      ~Buffer();
+
+      // The capacity of the string is preserved across the uses of
+      // the buffer, as long as the string is not swapped
+      std::string& GetContent()
+      {
+        return *content_;
+      }
+
+      const std::string& GetContent() const
+      {
+        return *content_;
+      }
+    };
+
+    // Maximum number of bytes that are retained by the arena of each
+    // thread ("0" disables the reuse of the buffers)
+    static void SetMaxRetainedSizePerThread(size_t size);
+
+    static size_t GetMaxRetainedSizePerThread();
+
+    // Maximum number of bytes that are retained by all the arenas
+    // together, whatever the number of threads
+    static void SetMaxRetainedSizeTotal(size_t size);
+
+    static size_t GetMaxRetainedSizeTotal();
+
+    static void GetStatistics(uint64_t& countAcquired,
+                              uint64_t& countReused,
+                              uint64_t& retainedSize);
+  };
+}
@@ -0,0 +1,196 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "../PrecompiledHeaders.h"
+#include "SingleFlight.h"
+
+#include "../Compatibility.h"
+#include "../OrthancException.h"
+
+#include <boost/thread/condition_variable.hpp>
+#include <cassert>
+
+
+namespace Orthanc
+{
+  class SingleFlight::Flight : public boost::noncopyable
+  {
+  public:
+    enum State
+    {
+      State_Loading,
+      State_Published,
+      State_Failed
+    };
+
+    // All the members are protected by the mutex of "SingleFlight"
+    State                              state_;
+    unsigned int                       followers_;
+    boost::shared_ptr<IDynamicObject>  result_;
+    boost::condition_variable          finished_;
+
+    Flight() :
+      state_(State_Loading),
+      followers_(0)
+    {
+    }
+  };
+
+
+  void SingleFlight::Finish(const std::string& key,
+                            Flight& flight,
+                            bool success,
+                            IDynamicObject* result)
+  {
+    std::unique_ptr<IDynamicObject> protection(result);
+
+    boost::mutex::scoped_lock lock(mutex_);
+
+    assert(flight.state_ == Flight::State_Loading);
+
+    // The next threads asking for this key will start a new load
+    Flights::iterator found = flights_.find(key);
+    if (found != flights_.end() &&
+        found->second.get() == &flight)
+    {
+      flights_.erase(found);
+    }
+
+    if (success)
+    {
+      flight.state_ = Flight::State_Published;
+      flight.result_.reset(protection.release());
+    }
+    else
+    {
+      flight.state_ = Flight::State_Failed;
+    }
+
+    flight.finished_.notify_all();
+  }
+
+
+  SingleFlight::Accessor::Accessor(SingleFlight& that,
+                                   const std::string& key) :
+    that_(that),
+    key_(key),
+    isLeader_(false),
+    isFinished_(false)
+  {
+    boost::mutex::scoped_lock lock(that_.mutex_);
+
+    Flights::iterator found = that_.flights_.find(key);
+    if (found == that_.flights_.end())
+    {
+      flight_.reset(new Flight);
+      that_.flights_[key] = flight_;
+      isLeader_ = true;
+    }
+    else
+    {
+      flight_ = found->second;
+      flight_->followers_++;
+    }
+  }
+
+
+  SingleFlight::Accessor::~Accessor()
+  {
+    if (isLeader_ &&
+        !isFinished_)
+    {
+      that_.Finish(key_, *flight_, false, NULL);
+    }
+  }
+
+
+  unsigned int SingleFlight::Accessor::GetFollowersCount()
+  {
+    if (!isLeader_)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+    else
+    {
+      boost::mutex::scoped_lock lock(that_.mutex_);
+      return flight_->followers_;
+    }
+  }
+
+
+  void SingleFlight::Accessor::Publish(IDynamicObject* result)
+  {
+    std::unique_ptr<IDynamicObject> protection(result);
+
+    if (!isLeader_ ||
+        isFinished_)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+    else
+    {
+      isFinished_ = true;
+      that_.Finish(key_, *flight_, true, protection.release());
+    }
+  }
+
+
+  bool SingleFlight::Accessor::WaitForLeader(boost::shared_ptr<IDynamicObject>& result)
+  {
+    if (isLeader_)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+
+    boost::mutex::scoped_lock lock(that_.mutex_);
+
+    while (flight_->state_ == Flight::State_Loading)
+    {
+      flight_->finished_.wait(lock);
+    }
+
+    if (flight_->state_ == Flight::State_Published)
+    {
+      result = flight_->result_;
+      that_.collapsedCount_++;
+      return true;
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+
+  SingleFlight::SingleFlight() :
+    collapsedCount_(0)
+  {
+  }
+
+
+  uint64_t SingleFlight::GetCollapsedCount()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return collapsedCount_;
+  }
+}
@@ -0,0 +1,105 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program. If not, see
+ * <http://www.gnu.org/licenses/>.
+ **/
+
+
+#pragma once
+
+#include "../IDynamicObject.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <map>
+#include <stdint.h>
+#include <string>
+
+namespace Orthanc
+{
+  /**
+   * New in Orthanc 1.11.0: Collapses the concurrent loads of the same
+   * item (identified by a string key). The first thread that asks for
+   * a key becomes the "leader" of the load, and the threads that ask
+   * for the same key while the load is in progress become its
+   * "followers": They wait for the leader and share its result,
+   * instead of loading the item once again.
+   *
+   * If the leader fails (or doesn't publish any result), the
+   * followers are woken up and must load the item by themselves.
+   **/
+  class ORTHANC_PUBLIC SingleFlight : public boost::noncopyable
+  {
+  private:
+    class Flight;
+
+    typedef std::map<std::string, boost::shared_ptr<Flight> >  Flights;
+
+    boost::mutex  mutex_;
+    Flights       flights_;
+    uint64_t      collapsedCount_;
+
+    void Finish(const std::string& key,
+                Flight& flight,
+                bool success,
+                IDynamicObject* result);
+
+  public:
+    class ORTHANC_PUBLIC Accessor : public boost::noncopyable
+    {
+    private:
+      SingleFlight&              that_;
+      std::string                key_;
+      boost::shared_ptr<Flight>  flight_;
+      bool                       isLeader_;
+      bool                       isFinished_;
+
+    public:
+      Accessor(SingleFlight& that,
+               const std::string& key);
+
+      // If the leader is destroyed without having published its
+      // result, its followers are told that the load has failed
+      ~Accessor();
+
+      bool IsLeader() const
+      {
+        return isLeader_;
+      }
+
+      // Only for the leader: Number of threads that are waiting for
+      // the result of this load
+      unsigned int GetFollowersCount();
+
+      // Only for the leader. Takes ownership of "result", that can be
+      // NULL if the result was shared by other means (e.g. a cache).
+      void Publish(IDynamicObject* result);
+
+      // Only for the followers: Returns "false" if the leader has
+      // failed, or "true" if it has published a result (which
+      // might be NULL)
+      bool WaitForLeader(boost::shared_ptr<IDynamicObject>& result);
+    };
+
+    SingleFlight();
+
+    // Number of loads that were avoided thanks to a leader
+    uint64_t GetCollapsedCount();
+  };
+}
@@ -57,6 +57,12 @@ namespace Orthanc
       return HttpToolbox::GetArgument(getArguments_, name, defaultValue);
     }
 
+    // New in Orthanc 1.11.0
+    const HttpToolbox::Arguments& GetArguments() const
+    {
+      return getArguments_;
+    }
+
     bool HasArgument(const std::string& name) const
     {
       return getArguments_.find(name) != getArguments_.end();
@@ -70,6 +70,24 @@ namespace Orthanc
   }
 
 
+  bool RestApiOutput::AnswerNotModified(const HttpToolbox::Arguments& requestHeaders,
+                                        const std::string& etag,
+                                        const std::string& cacheControl)
+  {
+    CheckStatus();
+
+    if (output_.AnswerNotModified(requestHeaders, etag, cacheControl))
+    {
+      alreadySent_ = true;
+      return true;
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+
   void RestApiOutput::AnswerStream(IHttpStreamAnswer& stream)
   {
     CheckStatus();
@@ -65,6 +65,12 @@ namespace Orthanc
       return output_;
     }
 
+    // New in Orthanc 1.11.0: Returns "true" iff "304 Not Modified"
+    // was sent, cf. "HttpOutput::AnswerNotModified()"
+    bool AnswerNotModified(const HttpToolbox::Arguments& requestHeaders,
+                           const std::string& etag,
+                           const std::string& cacheControl);
+
     void AnswerStream(IHttpStreamAnswer& stream);
 
     void AnswerWithoutBuffering(IHttpStreamAnswer& stream);
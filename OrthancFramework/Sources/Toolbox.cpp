@@ -445,24 +445,77 @@ namespace Orthanc
                            const void* data,
                            size_t size)
   {
-    md5_state_s state;
-    md5_init(&state);
+    MD5Context context;
+    context.Append(data, size);
+    context.Export(result);
+  }
 
-    if (size > 0)
+
+  class Toolbox::MD5Context::PImpl
+  {
+  public:
+    md5_state_s  state_;
+    bool         done_;
+  };
+
+
+  Toolbox::MD5Context::MD5Context() :
+    pimpl_(new PImpl)
+  {
+    md5_init(&pimpl_->state_);
+    pimpl_->done_ = false;
+  }
+
+
+  void Toolbox::MD5Context::Append(const void* data,
+                                   size_t size)
+  {
+    if (pimpl_->done_)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+
+    static const size_t MAX_SIZE = 128 * 1024 * 1024;
+
+    // Split the buffer, as "md5_append()" takes an "int" as its size
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+    
+    while (size > 0)
+    {
+      const size_t chunk = std::min(size, MAX_SIZE);
+      md5_append(&pimpl_->state_, reinterpret_cast<const md5_byte_t*>(p), static_cast<int>(chunk));
+      p += chunk;
+      size -= chunk;
+    }
+  }
+
+
+  void Toolbox::MD5Context::Append(const std::string& source)
+  {
+    if (!source.empty())
+    {
+      Append(source.c_str(), source.size());
+    }
+  }
+
+
+  void Toolbox::MD5Context::Export(std::string& target)
+  {
+    if (pimpl_->done_)
     {
-      md5_append(&state, 
-                 reinterpret_cast<const md5_byte_t*>(data), 
-                 static_cast<int>(size));
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
     }
 
+    pimpl_->done_ = true;
+
     md5_byte_t actualHash[16];
-    md5_finish(&state, actualHash);
+    md5_finish(&pimpl_->state_, actualHash);
 
-    result.resize(32);
+    target.resize(32);
     for (unsigned int i = 0; i < 16; i++)
     {
-      result[2 * i] = GetHexadecimalCharacter(static_cast<uint8_t>(actualHash[i] / 16));
-      result[2 * i + 1] = GetHexadecimalCharacter(static_cast<uint8_t>(actualHash[i] % 16));
+      target[2 * i] = GetHexadecimalCharacter(static_cast<uint8_t>(actualHash[i] / 16));
+      target[2 * i + 1] = GetHexadecimalCharacter(static_cast<uint8_t>(actualHash[i] % 16));
     }
   }
 #endif
@@ -29,6 +29,8 @@
 #include <stdint.h>
 #include <vector>
 #include <string>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
 #include <json/value.h>
 
 
@@ -95,6 +97,27 @@ namespace Orthanc
 
       void Next();
     };
+
+#if ORTHANC_ENABLE_MD5 == 1
+    // New in Orthanc 1.11.0: Computation of a MD5 hash by chunks
+    class ORTHANC_PUBLIC MD5Context : public boost::noncopyable
+    {
+    private:
+      class PImpl;
+      boost::shared_ptr<PImpl>  pimpl_;
+
+    public:
+      MD5Context();
+
+      void Append(const void* data,
+                  size_t size);
+
+      void Append(const std::string& source);
+
+      // Can only be called once
+      void Export(std::string& target);
+    };
+#endif
     
     static void ToUpperCase(std::string& s);  // Inplace version
 
@@ -34,6 +34,7 @@
 
 #include "../Sources/Compatibility.h"
 #include "../Sources/OrthancException.h"
+#include "../Sources/DicomFormat/DicomFrameOffsetTable.h"
 #include "../Sources/DicomFormat/DicomMap.h"
 #include "../Sources/DicomFormat/DicomStreamReader.h"
 #include "../Sources/DicomParsing/FromDcmtkBridge.h"
@@ -1225,3 +1226,130 @@ TEST(DicomStreamReader, DISABLED_Tutu3)
 }
 
 #endif
+
+
+static void AppendFrameOffsetTableTag(std::string& target,
+                                      uint16_t group,
+                                      uint16_t element,
+                                      uint32_t length)
+{
+  target.push_back(static_cast<char>(group & 0xff));
+  target.push_back(static_cast<char>(group >> 8));
+  target.push_back(static_cast<char>(element & 0xff));
+  target.push_back(static_cast<char>(element >> 8));
+  target.push_back(static_cast<char>(length & 0xff));
+  target.push_back(static_cast<char>((length >> 8) & 0xff));
+  target.push_back(static_cast<char>((length >> 16) & 0xff));
+  target.push_back(static_cast<char>((length >> 24) & 0xff));
+}
+
+
+TEST(DicomFrameOffsetTable, Uncompressed)
+{
+  std::string dicom(16, 'x');  // Fake DICOM header
+  AppendFrameOffsetTableTag(dicom, 0x7fe0, 0x0010, 12);  // Implicit VR
+  dicom += "abcdefghijkl";
+
+  DicomFrameOffsetTable table;
+  ASSERT_FALSE(table.Compute(dicom.c_str(), dicom.size(), 15, DicomTransferSyntax_LittleEndianImplicit, 3, 4));
+  ASSERT_FALSE(table.Compute(dicom.c_str(), dicom.size(), 16, DicomTransferSyntax_LittleEndianImplicit, 4, 4));
+  ASSERT_FALSE(table.Compute(dicom.c_str(), dicom.size(), 16, DicomTransferSyntax_BigEndianExplicit, 3, 4));
+  ASSERT_FALSE(table.Compute(dicom.c_str(), dicom.size(), 16, DicomTransferSyntax_JPEGProcess1, 3, 4));
+  ASSERT_TRUE(table.Compute(dicom.c_str(), dicom.size(), 16, DicomTransferSyntax_LittleEndianImplicit, 3, 4));
+  ASSERT_FALSE(table.IsEncapsulated());
+  ASSERT_EQ(3u, table.GetFramesCount());
+  ASSERT_EQ(24u, table.GetFrameStart(0));
+  ASSERT_EQ(28u, table.GetFrameEnd(0));
+  ASSERT_EQ(32u, table.GetFrameStart(2));
+  ASSERT_EQ(36u, table.GetFrameEnd(2));
+  ASSERT_THROW(table.GetFrameStart(3), OrthancException);
+
+  std::string s;
+  table.Format(s);
+  ASSERT_EQ("U;24;4;3", s);
+
+  DicomFrameOffsetTable parsed;
+  ASSERT_FALSE(parsed.Parse(s, dicom.size() - 1));  // Truncated file
+  ASSERT_TRUE(parsed.Parse(s, dicom.size()));
+  ASSERT_FALSE(parsed.IsEncapsulated());
+  ASSERT_EQ(3u, parsed.GetFramesCount());
+
+  std::string frame;
+  parsed.ExtractFrame(frame, 1, dicom.c_str() + parsed.GetFrameStart(1), parsed.GetFrameEnd(1) - parsed.GetFrameStart(1));
+  ASSERT_EQ("efgh", frame);
+  ASSERT_THROW(parsed.ExtractFrame(frame, 1, dicom.c_str(), 3), OrthancException);
+
+  ASSERT_FALSE(parsed.Parse("", dicom.size()));
+  ASSERT_FALSE(parsed.Parse("U;24;4", dicom.size()));
+  ASSERT_FALSE(parsed.Parse("U;24;4;nope", dicom.size()));
+  ASSERT_FALSE(parsed.Parse("U;24;0;3", dicom.size()));
+
+  // The number of frames is bounded by the size of the file
+  ASSERT_FALSE(parsed.Parse("U;0;1;4294967295", dicom.size()));
+  ASSERT_FALSE(parsed.Parse("U;18446744073709551615;4;3", dicom.size()));
+  ASSERT_EQ(0u, parsed.GetFramesCount());
+}
+
+
+TEST(DicomFrameOffsetTable, Encapsulated)
+{
+  std::string dicom(16, 'x');  // Fake DICOM header
+
+  dicom += std::string("\xe0\x7f\x10\x00" "OB\x00\x00\xff\xff\xff\xff", 12);
+  AppendFrameOffsetTableTag(dicom, 0xfffe, 0xe000, 8);  // Basic offset table
+  dicom += std::string("\x00\x00\x00\x00" "\x14\x00\x00\x00", 8);  // Offsets 0 and 20
+  AppendFrameOffsetTableTag(dicom, 0xfffe, 0xe000, 2);  // First frame, 2 fragments
+  dicom += "ab";
+  AppendFrameOffsetTableTag(dicom, 0xfffe, 0xe000, 2);
+  dicom += "cd";
+  AppendFrameOffsetTableTag(dicom, 0xfffe, 0xe000, 4);  // Second frame, 1 fragment
+  dicom += "efgh";
+  AppendFrameOffsetTableTag(dicom, 0xfffe, 0xe0dd, 0);  // Sequence delimitation
+
+  DicomFrameOffsetTable table;
+  ASSERT_FALSE(table.Compute(dicom.c_str(), dicom.size(), 16, DicomTransferSyntax_LittleEndianExplicit, 2, 4));
+  ASSERT_FALSE(table.Compute(dicom.c_str(), dicom.size(), 16, DicomTransferSyntax_JPEG2000, 4, 0));
+  ASSERT_FALSE(table.Compute(dicom.c_str(), dicom.size() - 8, 16, DicomTransferSyntax_JPEG2000, 2, 0));
+  ASSERT_TRUE(table.Compute(dicom.c_str(), dicom.size(), 16, DicomTransferSyntax_JPEG2000, 2, 0));
+  ASSERT_TRUE(table.IsEncapsulated());
+  ASSERT_EQ(2u, table.GetFramesCount());
+  ASSERT_EQ(44u, table.GetFrameStart(0));
+  ASSERT_EQ(64u, table.GetFrameEnd(0));
+  ASSERT_EQ(64u, table.GetFrameStart(1));
+  ASSERT_EQ(76u, table.GetFrameEnd(1));
+
+  std::string s;
+  table.Format(s);
+  ASSERT_EQ("E;44,20;64,12", s);
+
+  DicomFrameOffsetTable parsed;
+  ASSERT_FALSE(parsed.Parse(s, 75));  // Truncated file
+  ASSERT_FALSE(parsed.Parse("E;44,20;64,18446744073709551615", dicom.size()));
+  ASSERT_TRUE(parsed.Parse(s, dicom.size()));
+  ASSERT_TRUE(parsed.IsEncapsulated());
+
+  std::string frame;
+  parsed.ExtractFrame(frame, 0, dicom.c_str() + 44, 20);
+  ASSERT_EQ("abcd", frame);
+  parsed.ExtractFrame(frame, 1, dicom.c_str() + 64, 12);
+  ASSERT_EQ("efgh", frame);
+
+  // Outdated table: The range doesn't start with an item
+  ASSERT_THROW(parsed.ExtractFrame(frame, 1, dicom.c_str() + 60, 12), OrthancException);
+
+  // One single frame that overlaps all the fragments
+  ASSERT_TRUE(table.Compute(dicom.c_str(), dicom.size(), 16, DicomTransferSyntax_JPEG2000, 1, 0));
+  ASSERT_EQ(1u, table.GetFramesCount());
+  table.ExtractFrame(frame, 0, dicom.c_str() + 44, 32);
+  ASSERT_EQ("abcdefgh", frame);
+
+  // One fragment per frame
+  ASSERT_TRUE(table.Compute(dicom.c_str(), dicom.size(), 16, DicomTransferSyntax_JPEG2000, 3, 0));
+  ASSERT_EQ(3u, table.GetFramesCount());
+  table.ExtractFrame(frame, 2, dicom.c_str() + table.GetFrameStart(2), 12);
+  ASSERT_EQ("efgh", frame);
+
+  ASSERT_EQ(MimeType_Jpeg2000, DicomFrameOffsetTable::GetRawFrameMimeType(DicomTransferSyntax_JPEG2000));
+  ASSERT_EQ(MimeType_Jpeg, DicomFrameOffsetTable::GetRawFrameMimeType(DicomTransferSyntax_JPEGProcess1));
+  ASSERT_EQ(MimeType_Binary, DicomFrameOffsetTable::GetRawFrameMimeType(DicomTransferSyntax_LittleEndianExplicit));
+}
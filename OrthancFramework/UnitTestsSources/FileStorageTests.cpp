@@ -29,8 +29,10 @@
 #include <gtest/gtest.h>
 
 #include "../Sources/FileStorage/FilesystemStorage.h"
+#include "../Sources/FileStorage/MemoryMappedBuffer.h"
 #include "../Sources/FileStorage/StorageAccessor.h"
 #include "../Sources/FileStorage/StorageCache.h"
+#include "../Sources/FileStorage/TieredFilesystemStorage.h"
 #include "../Sources/HttpServer/BufferHttpSender.h"
 #include "../Sources/HttpServer/FilesystemHttpSender.h"
 #include "../Sources/Logging.h"
@@ -123,6 +125,122 @@ TEST(FilesystemStorage, EndToEnd)
 }
 
 
+TEST(FilesystemStorage, MemoryMapping)
+{
+  if (!MemoryMappedBuffer::IsSupported())
+  {
+    return;
+  }
+
+  FilesystemStorage s("UnitTestsStorage");
+  s.SetMemoryMapping(true);
+  ASSERT_TRUE(s.IsMemoryMapping());
+
+  // Large enough to be memory-mapped, and not aligned on pages
+  std::string data;
+  data.resize(3 * 1024 * 1024 + 17);
+  for (size_t i = 0; i < data.size(); i++)
+  {
+    data[i] = static_cast<char>(i % 251);
+  }
+
+  std::string uid = Toolbox::GenerateUuid();
+  s.Create(uid.c_str(), &data[0], data.size(), FileContentType_Unknown);
+
+  {
+    std::unique_ptr<IMemoryBuffer> buffer(s.Read(uid, FileContentType_Unknown));
+    ASSERT_TRUE(dynamic_cast<MemoryMappedBuffer*>(buffer.get()) != NULL);
+    ASSERT_EQ(data.size(), buffer->GetSize());
+    ASSERT_FALSE(memcmp(buffer->GetData(), &data[0], data.size()));
+
+    std::string d;
+    buffer->MoveToString(d);
+    ASSERT_EQ(data, d);
+    ASSERT_EQ(0u, buffer->GetSize());
+  }
+
+  {
+    const size_t start = 4097;
+    const size_t end = data.size() - 3;
+    std::unique_ptr<IMemoryBuffer> buffer(s.ReadRange(uid, FileContentType_Unknown, start, end));
+    ASSERT_TRUE(dynamic_cast<MemoryMappedBuffer*>(buffer.get()) != NULL);
+    ASSERT_EQ(end - start, buffer->GetSize());
+    ASSERT_FALSE(memcmp(buffer->GetData(), &data[start], end - start));
+  }
+
+  {
+    // Small ranges are copied into memory
+    std::unique_ptr<IMemoryBuffer> buffer(s.ReadRange(uid, FileContentType_Unknown, 10, 20));
+    ASSERT_TRUE(dynamic_cast<MemoryMappedBuffer*>(buffer.get()) == NULL);
+    ASSERT_EQ(10u, buffer->GetSize());
+    ASSERT_FALSE(memcmp(buffer->GetData(), &data[10], 10));
+  }
+
+  ASSERT_THROW(s.ReadRange(uid, FileContentType_Unknown, 0, data.size() + 1), OrthancException);
+
+  s.Remove(uid, FileContentType_Unknown);
+}
+
+
+TEST(TieredFilesystemStorage, Migration)
+{
+  FilesystemStorage hot("UnitTestsStorageHot");
+  FilesystemStorage cold("UnitTestsStorageCold");
+  hot.Clear();
+  cold.Clear();
+
+  TieredFilesystemStorage s("UnitTestsStorageHot", "UnitTestsStorageCold", false);
+  ASSERT_TRUE(s.HasReadRange());
+
+  const std::string data1 = "Hello";
+  const std::string data2 = "World";
+  const std::string uid1 = Toolbox::GenerateUuid();
+  const std::string uid2 = Toolbox::GenerateUuid();
+  s.Create(uid1, data1.c_str(), data1.size(), FileContentType_Unknown);
+  s.Create(uid2, data2.c_str(), data2.size(), FileContentType_Unknown);
+
+  // New files are stored in the hot tier
+  std::set<std::string> files;
+  hot.ListAllFiles(files);
+  ASSERT_EQ(2u, files.size());
+  cold.ListAllFiles(files);
+  ASSERT_EQ(0u, files.size());
+
+  // Recently accessed files are not migrated
+  ASSERT_EQ(0u, s.MigrateColdFiles());
+
+  // Simulate a crash during a previous migration of "uid1"
+  cold.Create(uid1, "Hel", 3, FileContentType_Unknown);
+
+  std::string d;
+  std::unique_ptr<IMemoryBuffer> buffer(s.Read(uid1, FileContentType_Unknown));
+  buffer->MoveToString(d);
+  ASSERT_EQ(data1, d);
+
+  s.SetColdDelay(0);
+  ASSERT_EQ(2u, s.MigrateColdFiles());
+
+  hot.ListAllFiles(files);
+  ASSERT_EQ(0u, files.size());
+  cold.ListAllFiles(files);
+  ASSERT_EQ(2u, files.size());
+
+  buffer.reset(s.Read(uid1, FileContentType_Unknown));
+  buffer->MoveToString(d);
+  ASSERT_EQ(data1, d);
+
+  buffer.reset(s.ReadRange(uid2, FileContentType_Unknown, 1, 3));
+  buffer->MoveToString(d);
+  ASSERT_EQ("or", d);
+
+  s.Remove(uid1, FileContentType_Unknown);
+  s.Remove(uid2, FileContentType_Unknown);
+  cold.ListAllFiles(files);
+  ASSERT_EQ(0u, files.size());
+  ASSERT_THROW(s.Read(uid1, FileContentType_Unknown), OrthancException);
+}
+
+
 TEST(StorageAccessor, NoCompression)
 {
   FilesystemStorage s("UnitTestsStorage");
@@ -166,6 +284,130 @@ TEST(StorageAccessor, Compression)
 }
 
 
+TEST(StorageAccessor, Verify)
+{
+  FilesystemStorage s("UnitTestsStorage");
+  StorageCache cache;
+  StorageAccessor accessor(s, cache);
+
+  std::string data = "Hello world";
+  FileInfo compressed = accessor.Write(data, FileContentType_Dicom, CompressionType_ZlibWithSize, true);
+  FileInfo uncompressed = accessor.Write(data, FileContentType_Dicom, CompressionType_None, true);
+  ASSERT_TRUE(accessor.Verify(compressed));
+  ASSERT_TRUE(accessor.Verify(uncompressed));
+
+  s.Remove(uncompressed.GetUuid(), FileContentType_Dicom);
+  s.Create(uncompressed.GetUuid(), "Hello World", 11, FileContentType_Dicom);
+  ASSERT_FALSE(accessor.Verify(uncompressed));
+
+  // Corrupted compressed attachment, with the same size
+  std::string corrupted;
+  {
+    std::unique_ptr<IMemoryBuffer> buffer(s.Read(compressed.GetUuid(), FileContentType_Dicom));
+    buffer->MoveToString(corrupted);
+  }
+  ASSERT_EQ(compressed.GetCompressedSize(), corrupted.size());
+  corrupted[corrupted.size() - 1] ^= 0x01;
+  s.Remove(compressed.GetUuid(), FileContentType_Dicom);
+  s.Create(compressed.GetUuid(), corrupted.c_str(), corrupted.size(), FileContentType_Dicom);
+  ASSERT_FALSE(accessor.Verify(compressed));
+
+  // Same corruption, if only the MD5 of the uncompressed content is
+  // known (it must be detected after decompression)
+  FileInfo withoutCompressedMD5(compressed.GetUuid(), FileContentType_Dicom,
+                                compressed.GetUncompressedSize(), compressed.GetUncompressedMD5(),
+                                CompressionType_ZlibWithSize, compressed.GetCompressedSize(), "");
+  ASSERT_FALSE(accessor.Verify(withoutCompressedMD5));
+
+  s.Remove(compressed.GetUuid(), FileContentType_Dicom);
+  ASSERT_FALSE(accessor.Verify(compressed));
+}
+
+
+TEST(StorageAccessor, ReadAndCache)
+{
+  FilesystemStorage s("UnitTestsStorage");
+  std::string data = "Hello world";
+
+  FileInfo compressed, uncompressed;
+
+  {
+    StorageCache cache;
+    StorageAccessor accessor(s, cache);
+    compressed = accessor.Write(data, FileContentType_Dicom, CompressionType_ZlibWithSize, false);
+    uncompressed = accessor.Write(data, FileContentType_Dicom, CompressionType_None, false);
+  }
+
+  StorageCache cache;
+  StorageAccessor accessor(s, cache);
+
+  std::string tmp;
+  ASSERT_FALSE(cache.Fetch(tmp, uncompressed.GetUuid(), FileContentType_Dicom));
+
+  std::unique_ptr<IMemoryBuffer> a(accessor.ReadAndCache(uncompressed));
+  ASSERT_EQ(data.size(), a->GetSize());
+  ASSERT_EQ(0, memcmp(data.c_str(), a->GetData(), data.size()));
+  ASSERT_TRUE(cache.Fetch(tmp, uncompressed.GetUuid(), FileContentType_Dicom));
+  ASSERT_EQ(data, tmp);
+
+  // The bytes are shared with the cache, and outlive the cache entry
+  std::unique_ptr<IMemoryBuffer> b(accessor.Read(uncompressed));
+  ASSERT_EQ(a->GetData(), b->GetData());
+  cache.Invalidate(uncompressed.GetUuid(), FileContentType_Dicom);
+  ASSERT_EQ(0, memcmp(data.c_str(), b->GetData(), data.size()));
+
+  b->MoveToString(tmp);
+  ASSERT_EQ(data, tmp);
+  ASSERT_EQ(0u, b->GetSize());
+  ASSERT_EQ(data.size(), a->GetSize());
+
+  std::unique_ptr<IMemoryBuffer> c(accessor.ReadAndCache(compressed));
+  c->MoveToString(tmp);
+  ASSERT_EQ(data, tmp);
+}
+
+
+TEST(StorageAccessor, ReadAndCacheMemoryMapping)
+{
+  if (!MemoryMappedBuffer::IsSupported())
+  {
+    return;
+  }
+
+  FilesystemStorage s("UnitTestsStorage");
+  s.SetMemoryMapping(true);
+
+  std::string data;
+  data.resize(2 * 1024 * 1024);
+  for (size_t i = 0; i < data.size(); i++)
+  {
+    data[i] = static_cast<char>(i % 251);
+  }
+
+  FileInfo info;
+
+  {
+    StorageCache cache;
+    StorageAccessor accessor(s, cache);
+    info = accessor.Write(data, FileContentType_Dicom, CompressionType_None, false);
+  }
+
+  StorageCache cache;
+  StorageAccessor accessor(s, cache);
+
+  // The mapped file is shared as such, without being copied into the cache
+  std::unique_ptr<IMemoryBuffer> a(accessor.ReadAndCache(info));
+  ASSERT_TRUE(dynamic_cast<MemoryMappedBuffer*>(a.get()) != NULL);
+  ASSERT_EQ(data.size(), a->GetSize());
+  ASSERT_EQ(0, memcmp(data.c_str(), a->GetData(), data.size()));
+
+  std::string tmp;
+  ASSERT_FALSE(cache.Fetch(tmp, info.GetUuid(), FileContentType_Dicom));
+
+  accessor.Remove(info);
+}
+
+
 TEST(StorageAccessor, Mix)
 {
   FilesystemStorage s("UnitTestsStorage");
@@ -379,6 +379,28 @@ TEST(Toolbox, ComputeMD5)
   ASSERT_EQ("d41d8cd98f00b204e9800998ecf8427e", s);
 }
 
+TEST(Toolbox, MD5Context)
+{
+  std::string s;
+
+  {
+    Toolbox::MD5Context context;
+    context.Export(s);
+    ASSERT_EQ("d41d8cd98f00b204e9800998ecf8427e", s);
+    ASSERT_THROW(context.Append("Hello"), OrthancException);
+    ASSERT_THROW(context.Export(s), OrthancException);
+  }
+
+  {
+    Toolbox::MD5Context context;
+    context.Append("He");
+    context.Append("");
+    context.Append("llo");
+    context.Export(s);
+    ASSERT_EQ("8b1a9953c4611296a827abf8c47804d7", s);
+  }
+}
+
 TEST(Toolbox, ComputeSHA1)
 {
   std::string s;
@@ -41,6 +41,7 @@
 #include "../Sources/DicomNetworking/DicomFindAnswers.h"
 #include "../Sources/DicomParsing/DicomModification.h"
 #include "../Sources/DicomParsing/DicomWebJsonVisitor.h"
+#include "../Sources/DicomParsing/DicomWebJsonWriter.h"
 #include "../Sources/DicomParsing/FromDcmtkBridge.h"
 #include "../Sources/DicomParsing/ParsedDicomCache.h"
 #include "../Sources/DicomParsing/ToDcmtkBridge.h"
@@ -2244,6 +2245,71 @@ TEST(DicomWebJson, Sequence)
 }
 
 
+TEST(DicomWebJsonWriter, SameAsJsonVisitor)
+{
+  ParsedDicomFile dicom(false);
+  dicom.ReplacePlainString(DicomTag(0x0008, 0x0052), "CS");
+  dicom.ReplacePlainString(DicomTag(0x0008, 0x0070), "Hello \"World\" <&>");
+  dicom.ReplacePlainString(DicomTag(0x0010, 0x0010), "Doe^John=\xe5\xb1\xb1\xe7\x94\xb0^\xe5\xa4\xaa\xe9\x83\x8e\\Smith^Jane");
+  dicom.ReplacePlainString(DicomTag(0x0010, 0x1020), "1.5\\-0.1\\42");  // DS
+  dicom.ReplacePlainString(DicomTag(0x0008, 0x1160), "45\\-3");  // IS
+  dicom.ReplacePlainString(DicomTag(0x0018, 0x6020), "-15");  // SL
+  dicom.ReplacePlainString(DicomTag(0x0028, 0x2000), "OB");
+  dicom.ReplacePlainString(DicomTag(0x0010, 0x4000), "");
+  SetTagKey(dicom, DicomTag(0x0020, 0x9165), DicomTag(0x0010, 0x0020));
+
+  {
+    std::unique_ptr<DcmSequenceOfItems> sequence(new DcmSequenceOfItems(DCM_ReferencedSeriesSequence));
+
+    for (unsigned int i = 0; i < 3; i++)
+    {
+      std::unique_ptr<DcmItem> item(new DcmItem);
+      std::string s = "item" + boost::lexical_cast<std::string>(i);
+      item->putAndInsertString(DCM_ReferencedSOPInstanceUID, s.c_str(), OFFalse);
+
+      std::unique_ptr<DcmSequenceOfItems> nested(new DcmSequenceOfItems(DCM_ReferencedImageSequence));
+      for (unsigned int j = 0; j < i; j++)
+      {
+        std::unique_ptr<DcmItem> nestedItem(new DcmItem);
+        nestedItem->putAndInsertString(DCM_ReferencedSOPClassUID, s.c_str(), OFFalse);
+        ASSERT_TRUE(nested->insert(nestedItem.release(), false, false).good());
+      }
+
+      ASSERT_TRUE(item->insert(nested.release(), false, false).good());
+      ASSERT_TRUE(sequence->insert(item.release(), false, false).good());
+    }
+
+    ASSERT_TRUE(dicom.GetDcmtkObject().getDataset()->insert(sequence.release(), false, false).good());
+  }
+
+  DicomWebJsonVisitor reference;
+  dicom.Apply(reference);
+
+  ASSERT_TRUE(DicomWebJsonWriter::IsSupported());
+
+  DicomWebJsonWriter writer;
+
+  DicomWebJsonVisitor visitor;
+  visitor.SetSink(writer);
+
+  for (unsigned int i = 0; i < 2; i++)  // The writer can be reused
+  {
+    dicom.Apply(visitor);
+
+    std::string s;
+    writer.Flatten(s);
+    ASSERT_EQ(reference.GetResult().toStyledString(), s);
+  }
+
+  // The tree of the visitor is not built if a sink is set
+  ASSERT_EQ(0u, visitor.GetResult().size());
+
+  std::string s;
+  writer.Flatten(s);
+  ASSERT_EQ(DicomWebJsonVisitor().GetResult().toStyledString(), s);
+}
+
+
 TEST(ParsedDicomCache, Basic)
 {
   ParsedDicomCache cache(10);
@@ -3319,3 +3385,121 @@ TEST(Toto, DISABLED_Transcode4)
 }
 
 #endif
+
+
+#if ORTHANC_ENABLE_DCMTK_NETWORKING == 1
+
+#include "../Sources/DicomNetworking/DicomConnectionPool.h"
+
+#include <boost/thread.hpp>
+
+static void AcquirePooledConnection(DicomConnectionPool* pool,
+                                    const DicomAssociationParameters* parameters,
+                                    bool* done)
+{
+  DicomConnectionPool::Accessor accessor(*pool, *parameters);
+  *done = true;
+}
+
+TEST(DicomConnectionPool, Basic)
+{
+  DicomAssociationParameters p1;
+  p1.SetRemotePort(2000);
+
+  DicomAssociationParameters p2;
+  p2.SetRemotePort(2000);
+  p2.SetLocalApplicationEntityTitle("OTHER");
+
+  DicomConnectionPool pool;
+  pool.SetInactivityTimeout(60000);
+  ASSERT_EQ(60000u, pool.GetInactivityTimeout());
+  ASSERT_EQ(0u, pool.GetMaxConnectionsPerRemote());
+
+  uint64_t created, reused, unhealthy;
+  unsigned int idle;
+
+  DicomStoreUserConnection* first = NULL;
+
+  {
+    DicomConnectionPool::Accessor a(pool, p1);
+    DicomConnectionPool::Accessor b(pool, p1);  // No limit by default
+    ASSERT_NE(&a.GetConnection(), &b.GetConnection());
+    ASSERT_TRUE(a.GetConnection().IsHealthy());  // Not opened yet
+    first = &a.GetConnection();
+    b.Discard();
+  }
+
+  pool.GetStatistics(created, reused, unhealthy, idle);
+  ASSERT_EQ(2u, created);
+  ASSERT_EQ(0u, reused);
+  ASSERT_EQ(1u, idle);  // The discarded connection was closed
+
+  {
+    DicomConnectionPool::Accessor a(pool, p1);
+    ASSERT_EQ(first, &a.GetConnection());  // Reused
+    ASSERT_TRUE(a.GetConnection().GetParameters().IsEqual(p1));
+
+    DicomConnectionPool::Accessor b(pool, p2);  // Other local AET
+    ASSERT_TRUE(b.GetConnection().GetParameters().IsEqual(p2));
+  }
+
+  pool.GetStatistics(created, reused, unhealthy, idle);
+  ASSERT_EQ(3u, created);
+  ASSERT_EQ(1u, reused);
+  ASSERT_EQ(0u, unhealthy);
+  ASSERT_EQ(2u, idle);
+
+  // With 1 association per remote modality, the idle association
+  // with other parameters is closed to make room
+  pool.Close();
+  pool.SetMaxConnectionsPerRemote(1);
+
+  {
+    DicomConnectionPool::Accessor a(pool, p1);
+  }
+
+  {
+    std::unique_ptr<DicomConnectionPool::Accessor> b(new DicomConnectionPool::Accessor(pool, p2));
+
+    pool.GetStatistics(created, reused, unhealthy, idle);
+    ASSERT_EQ(5u, created);
+    ASSERT_EQ(0u, idle);
+
+    // The limit is reached: The next caller must wait
+    bool done = false;
+    boost::thread t(AcquirePooledConnection, &pool, &p1, &done);
+    boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+    ASSERT_FALSE(done);
+
+    b.reset(NULL);
+    t.join();
+    ASSERT_TRUE(done);
+  }
+
+  pool.GetStatistics(created, reused, unhealthy, idle);
+  ASSERT_EQ(6u, created);
+  ASSERT_EQ(1u, idle);
+
+  pool.CloseIfInactive();
+  pool.GetStatistics(created, reused, unhealthy, idle);
+  ASSERT_EQ(1u, idle);
+
+  pool.SetInactivityTimeout(1);
+  boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+  pool.CloseIfInactive();
+  pool.GetStatistics(created, reused, unhealthy, idle);
+  ASSERT_EQ(0u, idle);
+
+  // No inactivity timeout: The connections are closed once released
+  pool.SetInactivityTimeout(0);
+
+  {
+    DicomConnectionPool::Accessor a(pool, p1);
+  }
+
+  pool.GetStatistics(created, reused, unhealthy, idle);
+  ASSERT_EQ(7u, created);
+  ASSERT_EQ(0u, idle);
+}
+
+#endif
@@ -42,9 +42,13 @@
 #include "../../OrthancFramework/Sources/JobsEngine/Operations/StringOperationValue.h"
 #include "../../OrthancFramework/Sources/JobsEngine/SetOfInstancesJob.h"
 #include "../../OrthancFramework/Sources/Logging.h"
+#include "../../OrthancFramework/Sources/MultiThreading/BufferArena.h"
+#include "../../OrthancFramework/Sources/MultiThreading/Semaphore.h"
 #include "../../OrthancFramework/Sources/MultiThreading/SharedMessageQueue.h"
+#include "../../OrthancFramework/Sources/MultiThreading/SingleFlight.h"
 #include "../../OrthancFramework/Sources/OrthancException.h"
 #include "../../OrthancFramework/Sources/SerializationToolbox.h"
+#include "../../OrthancFramework/Sources/SystemToolbox.h"
 
 
 using namespace Orthanc;
@@ -134,6 +138,24 @@ namespace
   };
 
 
+  class DummyTypedJob : public DummyJob
+  {
+  private:
+    std::string  type_;
+
+  public:
+    explicit DummyTypedJob(const std::string& type) :
+      type_(type)
+    {
+    }
+
+    virtual void GetJobType(std::string& type) ORTHANC_OVERRIDE
+    {
+      type = type_;
+    }
+  };
+
+
   class DummyInstancesJob : public SetOfInstancesJob
   {
   private:
@@ -281,6 +303,173 @@ TEST(MultiThreading, SharedMessageQueueClean)
 }
 
 
+TEST(MultiThreading, BufferArena)
+{
+  const size_t maxSize = BufferArena::GetMaxRetainedSizePerThread();
+  ASSERT_EQ(0u, maxSize);  // Disabled by default
+
+  // Start with an empty arena
+  BufferArena::SetMaxRetainedSizePerThread(0);
+  BufferArena::SetMaxRetainedSizePerThread(1024 * 1024);
+
+  uint64_t acquired1, reused1, retained1;
+  BufferArena::GetStatistics(acquired1, reused1, retained1);
+
+  const char* data = NULL;
+
+  {
+    BufferArena::Buffer buffer;
+    ASSERT_TRUE(buffer.GetContent().empty());
+    buffer.GetContent().resize(100000);
+    data = buffer.GetContent().c_str();
+  }
+
+  uint64_t acquired2, reused2, retained2;
+  BufferArena::GetStatistics(acquired2, reused2, retained2);
+  ASSERT_EQ(acquired1 + 1u, acquired2);
+  ASSERT_GE(retained2, 100000u);
+
+  {
+    // The memory is reused by the same thread
+    BufferArena::Buffer buffer;
+    ASSERT_TRUE(buffer.GetContent().empty());
+    ASSERT_GE(buffer.GetContent().capacity(), 100000u);
+    buffer.GetContent().resize(50000);
+    ASSERT_EQ(data, buffer.GetContent().c_str());
+
+    // Two buffers can be used simultaneously
+    BufferArena::Buffer buffer2;
+    ASSERT_TRUE(buffer2.GetContent().empty());
+    ASSERT_NE(&buffer.GetContent(), &buffer2.GetContent());
+  }
+
+  uint64_t acquired3, reused3, retained3;
+  BufferArena::GetStatistics(acquired3, reused3, retained3);
+  ASSERT_EQ(acquired2 + 2u, acquired3);
+  ASSERT_EQ(reused2 + 1u, reused3);
+
+  {
+    // Buffers that are too large are not retained
+    BufferArena::Buffer buffer;
+    buffer.GetContent().resize(2 * 1024 * 1024);
+  }
+
+  {
+    BufferArena::Buffer buffer;
+    ASSERT_LT(buffer.GetContent().capacity(), 2u * 1024u * 1024u);
+  }
+
+  // Reducing the limit frees the retained buffers
+  BufferArena::SetMaxRetainedSizePerThread(0);
+
+  {
+    BufferArena::Buffer buffer;
+    ASSERT_LT(buffer.GetContent().capacity(), 100000u);
+  }
+
+  // The limit on the total size applies to all the threads together
+  const size_t maxTotal = BufferArena::GetMaxRetainedSizeTotal();
+  BufferArena::SetMaxRetainedSizePerThread(1024 * 1024);
+  BufferArena::SetMaxRetainedSizeTotal(150000);
+
+  {
+    BufferArena::Buffer buffer1;
+    BufferArena::Buffer buffer2;
+    buffer1.GetContent().resize(100000);
+    buffer2.GetContent().resize(100000);
+  }
+
+  uint64_t acquired4, reused4, retained4;
+  BufferArena::GetStatistics(acquired4, reused4, retained4);
+  ASSERT_GE(retained4, 100000u);
+  ASSERT_LE(retained4, 150000u);
+
+  BufferArena::SetMaxRetainedSizePerThread(0);
+  BufferArena::SetMaxRetainedSizeTotal(maxTotal);
+  BufferArena::SetMaxRetainedSizePerThread(maxSize);
+}
+
+
+static void SingleFlightFollower(SingleFlight* flight,
+                                 int* value,
+                                 bool* success)
+{
+  SingleFlight::Accessor accessor(*flight, "key");
+  assert(!accessor.IsLeader());
+
+  boost::shared_ptr<IDynamicObject> result;
+  *success = accessor.WaitForLeader(result);
+
+  if (*success)
+  {
+    *value = dynamic_cast<const SingleValueObject<int>&>(*result).GetValue();
+  }
+}
+
+
+TEST(MultiThreading, SingleFlight)
+{
+  SingleFlight flight;
+  ASSERT_EQ(0u, flight.GetCollapsedCount());
+
+  {
+    SingleFlight::Accessor leader(flight, "key");
+    ASSERT_TRUE(leader.IsLeader());
+    ASSERT_EQ(0u, leader.GetFollowersCount());
+
+    // Other keys are independent
+    SingleFlight::Accessor other(flight, "other");
+    ASSERT_TRUE(other.IsLeader());
+
+    int value1 = 0, value2 = 0;
+    bool success1 = false, success2 = false;
+    boost::thread t1(SingleFlightFollower, &flight, &value1, &success1);
+    boost::thread t2(SingleFlightFollower, &flight, &value2, &success2);
+
+    while (leader.GetFollowersCount() < 2u)
+    {
+      SystemToolbox::USleep(1000);
+    }
+
+    leader.Publish(new SingleValueObject<int>(42));
+    ASSERT_THROW(leader.Publish(NULL), OrthancException);
+
+    t1.join();
+    t2.join();
+    ASSERT_TRUE(success1);
+    ASSERT_TRUE(success2);
+    ASSERT_EQ(42, value1);
+    ASSERT_EQ(42, value2);
+    ASSERT_EQ(2u, flight.GetCollapsedCount());
+
+    // Once published, a new load is started for the same key
+    SingleFlight::Accessor again(flight, "key");
+    ASSERT_TRUE(again.IsLeader());
+  }
+
+  {
+    // The followers are woken up if the leader fails
+    std::unique_ptr<SingleFlight::Accessor> leader(new SingleFlight::Accessor(flight, "key"));
+    ASSERT_TRUE(leader->IsLeader());
+
+    int value = 0;
+    bool success = true;
+    boost::thread t(SingleFlightFollower, &flight, &value, &success);
+
+    while (leader->GetFollowersCount() == 0u)
+    {
+      SystemToolbox::USleep(1000);
+    }
+
+    leader.reset(NULL);
+    t.join();
+    ASSERT_FALSE(success);
+    ASSERT_EQ(0, value);
+    ASSERT_EQ(2u, flight.GetCollapsedCount());
+  }
+}
+
+
 
 
 static bool CheckState(JobsRegistry& registry,
@@ -697,6 +886,85 @@ TEST(JobsRegistry, Cancel)
 
 
 
+TEST(JobsRegistry, FairScheduling)
+{
+  JobsRegistry registry(10);
+
+  std::string a1, a2, a3, m1;
+  registry.Submit(a1, new DummyTypedJob("Archive"), 30);
+  registry.Submit(a2, new DummyTypedJob("Archive"), 20);
+  registry.Submit(a3, new DummyTypedJob("Archive"), 10);
+  registry.Submit(m1, new DummyTypedJob("Modify"), 0);
+
+  std::set<std::string> types;
+  registry.ListJobTypes(types);
+  ASSERT_EQ(2u, types.size());
+  ASSERT_TRUE(types.find("Archive") != types.end());
+  ASSERT_TRUE(types.find("Modify") != types.end());
+
+  {
+    // Without fair scheduling, the priority is the only criterion
+    JobsRegistry::RunningJob job1(registry, 0);
+    ASSERT_TRUE(job1.IsValid());
+    ASSERT_EQ(a1, job1.GetId());
+
+    registry.SetFairScheduling(true);
+
+    // "Archive" already has one running job, "Modify" has none
+    JobsRegistry::RunningJob job2(registry, 0);
+    ASSERT_TRUE(job2.IsValid());
+    ASSERT_EQ(m1, job2.GetId());
+
+    registry.SetJobTypeMaxRunning("Archive", 1);
+
+    // Only "Archive" jobs are pending, but the limit is reached
+    JobsRegistry::RunningJob job3(registry, 1);
+    ASSERT_FALSE(job3.IsValid());
+  }
+
+  {
+    JobsRegistry::RunningJob job(registry, 0);
+    ASSERT_TRUE(job.IsValid());
+    ASSERT_EQ(a2, job.GetId());
+  }
+
+  uint64_t average, maximum;
+  ASSERT_TRUE(registry.GetJobTypeWaitTime(average, maximum, "Archive"));
+  ASSERT_LE(average, maximum);
+  ASSERT_TRUE(registry.GetJobTypeWaitTime(average, maximum, "Modify"));
+  ASSERT_FALSE(registry.GetJobTypeWaitTime(average, maximum, "Nope"));
+
+  ASSERT_THROW(registry.SetJobTypeWeight("Archive", 0), OrthancException);
+
+  ASSERT_TRUE(CheckState(registry, a3, JobState_Pending));
+}
+
+
+TEST(JobsRegistry, Aging)
+{
+  JobsRegistry registry(10);
+  registry.SetAgingDelay(1);
+
+  std::string i1, i2;
+  registry.Submit(i1, new DummyJob(), 0);
+  SystemToolbox::USleep(1500000);
+  registry.Submit(i2, new DummyJob(), 1);
+
+  {
+    // The first job has waited long enough to overtake the second one
+    JobsRegistry::RunningJob job(registry, 0);
+    ASSERT_TRUE(job.IsValid());
+    ASSERT_EQ(i1, job.GetId());
+  }
+
+  {
+    JobsRegistry::RunningJob job(registry, 0);
+    ASSERT_TRUE(job.IsValid());
+    ASSERT_EQ(i2, job.GetId());
+  }
+}
+
+
 TEST(JobsEngine, SubmitAndWait)
 {
   JobsEngine engine(10);
@@ -757,6 +1025,101 @@ TEST(JobsEngine, DISABLED_SequenceOfOperationsJob)
 }
 
 
+namespace
+{
+  class BlockingOperation : public IJobOperation
+  {
+  private:
+    Semaphore&  started_;
+    Semaphore&  resume_;
+
+  public:
+    BlockingOperation(Semaphore& started,
+                      Semaphore& resume) :
+      started_(started),
+      resume_(resume)
+    {
+    }
+
+    virtual void Apply(JobOperationValues& outputs,
+                       const IJobOperationValue& input) ORTHANC_OVERRIDE
+    {
+      started_.Release();
+      resume_.Acquire();
+      outputs.Append(input.Clone());
+    }
+
+    virtual void Serialize(Json::Value& result) const ORTHANC_OVERRIDE
+    {
+      result = Json::objectValue;
+    }
+  };
+}
+
+
+static void StepSequenceOfOperations(SequenceOfOperationsJob* job,
+                                     JobStepCode* code)
+{
+  *code = job->Step("dummy").GetCode();
+}
+
+
+TEST(JobsEngine, SequenceOfOperationsJobNonBlocking)
+{
+  Semaphore started(0), resume(0);
+
+  SequenceOfOperationsJob job;
+
+  {
+    SequenceOfOperationsJob::Lock lock(job);
+    lock.SetTrailingOperationTimeout(0);
+
+    size_t i = lock.AddOperation(new BlockingOperation(started, resume));
+    lock.AddInput(i, StringOperationValue("Hello"));
+  }
+
+  JobStepCode code = JobStepCode_Failure;
+  boost::thread thread(StepSequenceOfOperations, &job, &code);
+
+  started.Acquire();
+
+  {
+    // New operations can be added while the first one is running
+    SequenceOfOperationsJob::Lock lock(job);
+    ASSERT_EQ(1u, lock.GetOperationsCount());
+    ASSERT_EQ(0u, lock.GetProcessedOperationsCount());
+
+    size_t j = lock.AddOperation(new LogJobOperation);
+    lock.AddInput(j, StringOperationValue("World"));
+    ASSERT_EQ(2u, lock.GetOperationsCount());
+  }
+
+  resume.Release();
+  thread.join();
+  ASSERT_EQ(JobStepCode_Continue, code);
+
+  {
+    SequenceOfOperationsJob::Lock lock(job);
+    ASSERT_EQ(1u, lock.GetProcessedOperationsCount());
+  }
+
+  ASSERT_EQ(JobStepCode_Continue, job.Step("dummy").GetCode());  // Log operation
+
+  {
+    SequenceOfOperationsJob::Lock lock(job);
+    ASSERT_EQ(2u, lock.GetProcessedOperationsCount());
+  }
+
+  ASSERT_EQ(JobStepCode_Continue, job.Step("dummy").GetCode());  // End of the operations
+  ASSERT_EQ(JobStepCode_Success, job.Step("dummy").GetCode());   // Trailing timeout
+
+  {
+    SequenceOfOperationsJob::Lock lock(job);
+    ASSERT_TRUE(lock.IsDone());
+  }
+}
+
+
 static bool CheckSameJson(const Json::Value& a,
                           const Json::Value& b)
 {
@@ -346,6 +346,33 @@ TEST(MemoryStringCache, Basic)
 }
 
 
+TEST(MemoryStringCache, Shared)
+{
+  Orthanc::MemoryStringCache c;
+  c.SetMaximumSize(10);
+
+  boost::shared_ptr<const std::string> a(new std::string("hello"));
+  c.Add("a", a);
+
+  boost::shared_ptr<const std::string> b;
+  ASSERT_TRUE(c.Fetch(b, "a"));
+  ASSERT_EQ(a.get(), b.get());
+
+  std::string s;
+  ASSERT_TRUE(c.Fetch(s, "a"));
+  ASSERT_EQ("hello", s);
+
+  c.Add("b", "world!");  // Evicts "a"
+  ASSERT_FALSE(c.Fetch(s, "a"));
+  ASSERT_EQ("hello", *b);
+
+  ASSERT_TRUE(c.Fetch(b, "b"));
+  ASSERT_EQ("world!", *b);
+  ASSERT_FALSE(c.Fetch(b, "nope"));
+  ASSERT_EQ("world!", *b);
+}
+
+
 TEST(MemoryStringCache, Invalidate)
 {
   Orthanc::MemoryStringCache c;
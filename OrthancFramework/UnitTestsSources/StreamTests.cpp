@@ -30,6 +30,7 @@
 
 #include "../Sources/Toolbox.h"
 #include "../Sources/OrthancException.h"
+#include "../Sources/StringMemoryBuffer.h"
 #include "../Sources/HttpServer/BufferHttpSender.h"
 #include "../Sources/HttpServer/HttpStreamTranscoder.h"
 #include "../Sources/Compression/ZlibCompressor.h"
@@ -40,6 +41,12 @@
 #  include "../Sources/SystemToolbox.h"
 #endif
 
+#if ORTHANC_ENABLE_CIVETWEB == 1 || ORTHANC_ENABLE_MONGOOSE == 1
+#  include "../Sources/HttpServer/HttpOutput.h"
+#endif
+
+#include <boost/lexical_cast.hpp>
+
 
 using namespace Orthanc;
 
@@ -175,6 +182,37 @@ TEST(Zlib, Empty)
 }
 
 
+TEST(Zlib, CompressWithMD5)
+{
+  std::string s;
+  for (unsigned int i = 0; i < 200000; i++)
+  {
+    s.push_back(static_cast<char>('a' + (i * 7) % 13));
+  }
+
+  ZlibCompressor c;
+
+  for (unsigned int i = 0; i < 2; i++)
+  {
+    const std::string source = (i == 0 ? std::string() : s);
+
+    std::string compressed, md5, compressedMD5;
+    c.CompressWithMD5(compressed, md5, compressedMD5, source.empty() ? NULL : source.c_str(), source.size());
+
+    std::string expected;
+    Toolbox::ComputeMD5(expected, source);
+    ASSERT_EQ(expected, md5);
+
+    Toolbox::ComputeMD5(expected, compressed);
+    ASSERT_EQ(expected, compressedMD5);
+
+    std::string uncompressed;
+    IBufferCompressor::Uncompress(uncompressed, c, compressed);
+    ASSERT_EQ(source, uncompressed);
+  }
+}
+
+
 #if ORTHANC_SANDBOXED != 1
 static bool ReadAllStream(std::string& result,
                           IHttpStreamAnswer& stream,
@@ -224,6 +262,25 @@ TEST(BufferHttpSender, Basic)
     ASSERT_TRUE(ReadAllStream(t, sender));
     ASSERT_EQ(s, t);
   }
+
+  for (int cs = 0; cs < 5; cs++)
+  {
+    BufferHttpSender sender;
+    sender.SetChunkSize(cs);
+    sender.SetBuffer(StringMemoryBuffer::CreateFromCopy(s));
+    ASSERT_THROW(static_cast<const BufferHttpSender&>(sender).GetBuffer(), OrthancException);
+    ASSERT_TRUE(ReadAllStream(t, sender));
+    ASSERT_EQ(s, t);
+  }
+
+  {
+    BufferHttpSender sender;
+    sender.SetBuffer(StringMemoryBuffer::CreateFromCopy(s));
+    ASSERT_EQ(s, sender.GetBuffer());  // The memory buffer is moved into the string
+    ASSERT_EQ(s, static_cast<const BufferHttpSender&>(sender).GetBuffer());
+    ASSERT_TRUE(ReadAllStream(t, sender));
+    ASSERT_EQ(s, t);
+  }
 }
 #endif
 
@@ -334,3 +391,211 @@ TEST(HttpStreamTranscoder, Basic)
   }
 }
 #endif
+
+
+#if ORTHANC_ENABLE_CIVETWEB == 1 || ORTHANC_ENABLE_MONGOOSE == 1
+namespace
+{
+  class StringHttpOutputStream : public IHttpOutputStream
+  {
+  private:
+    std::string  header_;
+    std::string  body_;
+
+  public:
+    virtual void OnHttpStatusReceived(HttpStatus status) ORTHANC_OVERRIDE
+    {
+    }
+
+    virtual void Send(bool isHeader, const void* buffer, size_t length) ORTHANC_OVERRIDE
+    {
+      (isHeader ? header_ : body_).append(reinterpret_cast<const char*>(buffer), length);
+    }
+
+    virtual void DisableKeepAlive() ORTHANC_OVERRIDE
+    {
+    }
+
+    const std::string& GetHeader() const
+    {
+      return header_;
+    }
+
+    const std::string& GetBody() const
+    {
+      return body_;
+    }
+  };
+}
+
+
+static std::string CreateDicomMetaHeader(const std::string& transferSyntax)
+{
+  std::string s(128, '\0');
+  s += "DICM";
+
+  // (0002,0001) OB, followed by (0002,0010) UI
+  const char meta[] = { 0x02, 0x00, 0x01, 0x00, 'O', 'B', 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+  s.append(meta, sizeof(meta));
+
+  const char uid[] = { 0x02, 0x00, 0x10, 0x00, 'U', 'I', static_cast<char>(transferSyntax.size()), 0x00 };
+  s.append(uid, sizeof(uid));
+  s += transferSyntax;
+
+  return s;
+}
+
+
+TEST(HttpOutput, IsCompressibleContent)
+{
+  ASSERT_TRUE(HttpOutput::IsCompressibleContent("application/json; charset=utf-8", NULL, 0));
+  ASSERT_TRUE(HttpOutput::IsCompressibleContent("text/html", NULL, 0));
+  ASSERT_FALSE(HttpOutput::IsCompressibleContent("image/jpeg", NULL, 0));
+  ASSERT_FALSE(HttpOutput::IsCompressibleContent("Image/PNG", NULL, 0));
+  ASSERT_FALSE(HttpOutput::IsCompressibleContent("video/mp4", NULL, 0));
+  ASSERT_FALSE(HttpOutput::IsCompressibleContent("application/zip", NULL, 0));
+
+  std::string s = CreateDicomMetaHeader("1.2.840.10008.1.2.1");
+  ASSERT_TRUE(HttpOutput::IsCompressibleContent("application/dicom", s.c_str(), s.size()));
+
+  s = CreateDicomMetaHeader("1.2.840.10008.1.2.4.90");
+  ASSERT_FALSE(HttpOutput::IsCompressibleContent("application/dicom", s.c_str(), s.size()));
+
+  s = CreateDicomMetaHeader(std::string("1.2.840.10008.1.2.5") + '\0');  // Padding
+  ASSERT_FALSE(HttpOutput::IsCompressibleContent("application/dicom", s.c_str(), s.size()));
+
+  s = "Hello";
+  ASSERT_TRUE(HttpOutput::IsCompressibleContent("application/dicom", s.c_str(), s.size()));
+}
+
+
+TEST(HttpOutput, Compression)
+{
+  std::string large;
+  for (unsigned int i = 0; i < 100000; i++)
+  {
+    large += boost::lexical_cast<std::string>(i % 100);
+  }
+
+  GzipCompressor gzip;
+
+  {
+    // Small body => not compressed
+    StringHttpOutputStream stream;
+    HttpOutput output(stream, true);
+    output.SetGzipAllowed(true);
+    output.SetCompressionMinimumSize(1024);
+    output.SetContentType(MimeType_Json);
+    output.Answer("[]");
+    ASSERT_EQ(std::string::npos, stream.GetHeader().find("Content-Encoding"));
+    ASSERT_EQ("[]", stream.GetBody());
+  }
+
+  {
+    // Already compressed content => not compressed
+    StringHttpOutputStream stream;
+    HttpOutput output(stream, true);
+    output.SetGzipAllowed(true);
+    output.SetContentType(MimeType_Jpeg);
+    output.Answer(large);
+    ASSERT_EQ(std::string::npos, stream.GetHeader().find("Content-Encoding"));
+    ASSERT_EQ(large, stream.GetBody());
+  }
+
+  {
+    // Compressed in one single pass
+    StringHttpOutputStream stream;
+    HttpOutput output(stream, true);
+    output.SetGzipAllowed(true);
+    output.SetCompressionMinimumSize(1024);
+    output.SetContentType(MimeType_Json);
+    output.Answer(large);
+    ASSERT_NE(std::string::npos, stream.GetHeader().find("Content-Encoding: gzip\r\n"));
+    ASSERT_NE(std::string::npos, stream.GetHeader().find("Content-Length: "));
+
+    std::string uncompressed;
+    IBufferCompressor::Uncompress(uncompressed, gzip, stream.GetBody());
+    ASSERT_EQ(large, uncompressed);
+  }
+
+  {
+    // Compressed on-the-fly, using chunked transfer
+    StringHttpOutputStream stream;
+    HttpOutput output(stream, true);
+    output.SetGzipAllowed(true);
+    output.SetCompressionStreamingThreshold(1024);
+    output.SetContentType(MimeType_Json);
+    output.Answer(large);
+    ASSERT_NE(std::string::npos, stream.GetHeader().find("Content-Encoding: gzip\r\n"));
+    ASSERT_NE(std::string::npos, stream.GetHeader().find("Transfer-Encoding: chunked\r\n"));
+    ASSERT_EQ(std::string::npos, stream.GetHeader().find("Content-Length: "));
+
+    // Decode the chunks
+    const std::string& body = stream.GetBody();
+    std::string compressed;
+    size_t pos = 0;
+    for (;;)
+    {
+      size_t eol = body.find("\r\n", pos);
+      ASSERT_NE(std::string::npos, eol);
+      size_t size = strtoul(body.substr(pos, eol - pos).c_str(), NULL, 16);
+      if (size == 0)
+      {
+        ASSERT_EQ(body.size(), eol + 4);
+        break;
+      }
+
+      compressed += body.substr(eol + 2, size);
+      ASSERT_EQ("\r\n", body.substr(eol + 2 + size, 2));
+      pos = eol + 4 + size;
+    }
+
+    std::string uncompressed;
+    IBufferCompressor::Uncompress(uncompressed, gzip, compressed);
+    ASSERT_EQ(large, uncompressed);
+  }
+}
+
+
+TEST(HttpOutput, ETag)
+{
+  ASSERT_TRUE(HttpOutput::IsETagMatching("\"abc\"", "\"abc\""));
+  ASSERT_TRUE(HttpOutput::IsETagMatching(" \"xyz\" , \"abc\"", "\"abc\""));
+  ASSERT_TRUE(HttpOutput::IsETagMatching("W/\"abc\"", "\"abc\""));
+  ASSERT_TRUE(HttpOutput::IsETagMatching("*", "\"abc\""));
+  ASSERT_FALSE(HttpOutput::IsETagMatching("\"abcd\"", "\"abc\""));
+  ASSERT_FALSE(HttpOutput::IsETagMatching("", "\"abc\""));
+  ASSERT_FALSE(HttpOutput::IsETagMatching("\"abc\"", ""));
+
+  HttpToolbox::Arguments headers;
+
+  {
+    StringHttpOutputStream stream;
+    HttpOutput output(stream, false);
+    ASSERT_FALSE(output.AnswerNotModified(headers, "\"abc\"", "no-cache"));
+    output.Answer("hello");
+    ASSERT_EQ("hello", stream.GetBody());
+    ASSERT_NE(std::string::npos, stream.GetHeader().find("HTTP/1.1 200 OK"));
+    ASSERT_NE(std::string::npos, stream.GetHeader().find("ETag: \"abc\"\r\n"));
+    ASSERT_NE(std::string::npos, stream.GetHeader().find("Cache-Control: no-cache\r\n"));
+  }
+
+  headers["if-none-match"] = "\"abc\"";
+
+  {
+    StringHttpOutputStream stream;
+    HttpOutput output(stream, false);
+    ASSERT_TRUE(output.AnswerNotModified(headers, "\"abc\"", "no-cache"));
+    ASSERT_TRUE(stream.GetBody().empty());
+    ASSERT_NE(std::string::npos, stream.GetHeader().find("HTTP/1.1 304 Not Modified"));
+    ASSERT_NE(std::string::npos, stream.GetHeader().find("ETag: \"abc\"\r\n"));
+  }
+
+  {
+    StringHttpOutputStream stream;
+    HttpOutput output(stream, false);
+    ASSERT_FALSE(output.AnswerNotModified(headers, "\"def\"", ""));
+    ASSERT_TRUE(stream.GetHeader().empty());
+  }
+}
+#endif
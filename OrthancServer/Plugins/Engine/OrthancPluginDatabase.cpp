@@ -30,6 +30,8 @@
 
 #include "../../../OrthancFramework/Sources/Logging.h"
 #include "../../../OrthancFramework/Sources/OrthancException.h"
+#include "../../Sources/Database/Compatibility/GenericGetAllPublicIdsAfter.h"
+#include "../../Sources/Database/Compatibility/GenericLookupIdentifiers.h"
 #include "../../Sources/Database/Compatibility/ICreateInstance.h"
 #include "../../Sources/Database/Compatibility/IGetChildrenMetadata.h"
 #include "../../Sources/Database/Compatibility/ILookupResourceAndParent.h"
@@ -1274,6 +1276,26 @@ namespace Orthanc
     }
 
 
+    virtual void LookupIdentifiersExact(std::multimap<std::string, std::string>& target,
+                                        ResourceType level,
+                                        const DicomTag& tag,
+                                        const std::set<std::string>& values) ORTHANC_OVERRIDE
+    {
+      // No batched primitive in the database SDK for plugins
+      Compatibility::GenericLookupIdentifiers::Apply(target, *this, level, tag, values);
+    }
+
+
+    virtual void GetAllPublicIdsAfter(std::list<std::string>& target,
+                                      ResourceType resourceType,
+                                      const std::string& after,
+                                      size_t limit) ORTHANC_OVERRIDE
+    {
+      // No keyset pagination in the database SDK for plugins
+      Compatibility::GenericGetAllPublicIdsAfter::Apply(target, *this, resourceType, after, limit);
+    }
+
+
     virtual bool SelectPatientToRecycle(int64_t& internalId) ORTHANC_OVERRIDE
     {
       ResetAnswers();
@@ -1560,6 +1582,26 @@ namespace Orthanc
   }
 
 
+  void OrthancPluginDatabase::GetPagesCount(uint64_t& totalPages,
+                                            uint64_t& freePages)
+  {
+    throw OrthancException(ErrorCode_NotImplemented);
+  }
+
+
+  bool OrthancPluginDatabase::CompactIncrementally(unsigned int maxPages,
+                                                   unsigned int idleDelay)
+  {
+    throw OrthancException(ErrorCode_NotImplemented);
+  }
+
+
+  void OrthancPluginDatabase::Optimize()
+  {
+    throw OrthancException(ErrorCode_NotImplemented);
+  }
+
+
   IDatabaseWrapper::ITransaction* OrthancPluginDatabase::StartTransaction(TransactionType type,
                                                                           IDatabaseListener& listener)
   {
@@ -99,6 +99,19 @@ namespace Orthanc
       return false;
     }
 
+    virtual bool HasIncrementalCompaction() const ORTHANC_OVERRIDE
+    {
+      return false;
+    }
+
+    virtual void GetPagesCount(uint64_t& totalPages,
+                               uint64_t& freePages) ORTHANC_OVERRIDE;
+
+    virtual bool CompactIncrementally(unsigned int maxPages,
+                                      unsigned int idleDelay) ORTHANC_OVERRIDE;
+
+    virtual void Optimize() ORTHANC_OVERRIDE;
+
     virtual IDatabaseWrapper::ITransaction* StartTransaction(TransactionType type,
                                                              IDatabaseListener& listener)
       ORTHANC_OVERRIDE;
@@ -113,6 +126,11 @@ namespace Orthanc
       return false;  // No support for revisions in old API
     }
 
+    virtual bool HasKeysetPagination() const ORTHANC_OVERRIDE
+    {
+      return false;  // Emulated by "GenericGetAllPublicIdsAfter"
+    }
+
     void AnswerReceived(const _OrthancPluginDatabaseAnswer& answer);
   };
 }
@@ -29,6 +29,8 @@
 
 #include "../../../OrthancFramework/Sources/Logging.h"
 #include "../../../OrthancFramework/Sources/OrthancException.h"
+#include "../../Sources/Database/Compatibility/GenericGetAllPublicIdsAfter.h"
+#include "../../Sources/Database/Compatibility/GenericLookupIdentifiers.h"
 #include "../../Sources/Database/ResourcesContent.h"
 #include "../../Sources/Database/VoidDatabaseListener.h"
 #include "PluginsEnumerations.h"
@@ -1033,6 +1035,26 @@ namespace Orthanc
         return false;
       }
     }
+
+
+    virtual void LookupIdentifiersExact(std::multimap<std::string, std::string>& target,
+                                        ResourceType level,
+                                        const DicomTag& tag,
+                                        const std::set<std::string>& values) ORTHANC_OVERRIDE
+    {
+      // No batched primitive in the database SDK for plugins
+      Compatibility::GenericLookupIdentifiers::Apply(target, *this, level, tag, values);
+    }
+
+
+    virtual void GetAllPublicIdsAfter(std::list<std::string>& target,
+                                      ResourceType resourceType,
+                                      const std::string& after,
+                                      size_t limit) ORTHANC_OVERRIDE
+    {
+      // No keyset pagination in the database SDK for plugins
+      Compatibility::GenericGetAllPublicIdsAfter::Apply(target, *this, resourceType, after, limit);
+    }
   };
 
   
@@ -1169,6 +1191,26 @@ namespace Orthanc
   {
     CheckSuccess(backend_.close(database_));
   }
+
+
+  void OrthancPluginDatabaseV3::GetPagesCount(uint64_t& totalPages,
+                                              uint64_t& freePages)
+  {
+    throw OrthancException(ErrorCode_NotImplemented);
+  }
+
+
+  bool OrthancPluginDatabaseV3::CompactIncrementally(unsigned int maxPages,
+                                                     unsigned int idleDelay)
+  {
+    throw OrthancException(ErrorCode_NotImplemented);
+  }
+
+
+  void OrthancPluginDatabaseV3::Optimize()
+  {
+    throw OrthancException(ErrorCode_NotImplemented);
+  }
   
 
   IDatabaseWrapper::ITransaction* OrthancPluginDatabaseV3::StartTransaction(TransactionType type,
@@ -72,6 +72,19 @@ namespace Orthanc
       return false;
     }
 
+    virtual bool HasIncrementalCompaction() const ORTHANC_OVERRIDE
+    {
+      return false;
+    }
+
+    virtual void GetPagesCount(uint64_t& totalPages,
+                               uint64_t& freePages) ORTHANC_OVERRIDE;
+
+    virtual bool CompactIncrementally(unsigned int maxPages,
+                                      unsigned int idleDelay) ORTHANC_OVERRIDE;
+
+    virtual void Optimize() ORTHANC_OVERRIDE;
+
     virtual IDatabaseWrapper::ITransaction* StartTransaction(TransactionType type,
                                                              IDatabaseListener& listener)
       ORTHANC_OVERRIDE;
@@ -82,6 +95,11 @@ namespace Orthanc
                          IStorageArea& storageArea) ORTHANC_OVERRIDE;    
 
     virtual bool HasRevisionsSupport() const ORTHANC_OVERRIDE;
+
+    virtual bool HasKeysetPagination() const ORTHANC_OVERRIDE
+    {
+      return false;  // Emulated by "GenericGetAllPublicIdsAfter"
+    }
   };
 }
 
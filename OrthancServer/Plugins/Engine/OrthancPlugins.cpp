@@ -36,6 +36,7 @@
 #include "../../../OrthancFramework/Sources/Compression/ZlibCompressor.h"
 #include "../../../OrthancFramework/Sources/DicomFormat/DicomArray.h"
 #include "../../../OrthancFramework/Sources/DicomParsing/DicomWebJsonVisitor.h"
+#include "../../../OrthancFramework/Sources/DicomParsing/DicomWebJsonWriter.h"
 #include "../../../OrthancFramework/Sources/DicomParsing/FromDcmtkBridge.h"
 #include "../../../OrthancFramework/Sources/DicomParsing/Internals/DicomImageDecoder.h"
 #include "../../../OrthancFramework/Sources/DicomParsing/ToDcmtkBridge.h"
@@ -58,6 +59,7 @@
 #include "../../Sources/Database/VoidDatabaseListener.h"
 #include "../../Sources/OrthancConfiguration.h"
 #include "../../Sources/OrthancFindRequestHandler.h"
+#include "../../Sources/Search/DatabaseLookup.h"
 #include "../../Sources/Search/HierarchicalMatcher.h"
 #include "../../Sources/ServerContext.h"
 #include "../../Sources/ServerToolbox.h"
@@ -931,6 +933,172 @@ namespace Orthanc
     };
 
 
+    // New in Orthanc 1.11.0
+    class ResourcesLookup : public boost::noncopyable
+    {
+    private:
+      ResourceType        level_;
+      DatabaseLookup      lookup_;
+      std::set<DicomTag>  requestedTags_;
+
+    public:
+      explicit ResourcesLookup(ResourceType level) :
+        level_(level)
+      {
+      }
+
+      ResourceType GetLevel() const
+      {
+        return level_;
+      }
+
+      const DatabaseLookup& GetLookup() const
+      {
+        return lookup_;
+      }
+
+      const std::set<DicomTag>& GetRequestedTags() const
+      {
+        return requestedTags_;
+      }
+
+      void AddConstraint(const DicomTag& tag,
+                         const std::string& value,
+                         bool caseSensitive)
+      {
+        if (!value.empty())
+        {
+          // An empty string corresponds to an universal constraint,
+          // which mimics the behavior of "/tools/find"
+          lookup_.AddRestConstraint(tag, value, caseSensitive, true);
+        }
+      }
+
+      void AddRequestedTag(const DicomTag& tag)
+      {
+        requestedTags_.insert(tag);
+      }
+    };
+
+
+    /**
+     * New in Orthanc 1.11.0: The answers are stored as flat arrays
+     * of tag/value records, which avoids one allocation per answer,
+     * and which can be directly iterated by the plugins.
+     **/
+    class ResourcesLookupAnswers : public ServerContext::ILookupVisitor
+    {
+    private:
+      std::set<DicomTag>         requestedTags_;
+      std::vector<std::string>   ids_;
+      std::vector<size_t>        firstTag_;  // Index of the first tag of each answer in "tags_"
+      std::vector<DicomTag>      tags_;
+      std::vector<std::string>   values_;
+
+      void CheckAnswerIndex(size_t answer) const
+      {
+        if (answer >= ids_.size())
+        {
+          throw OrthancException(ErrorCode_ParameterOutOfRange);
+        }
+      }
+
+      void AddTag(const DicomMap& mainDicomTags,
+                  const DicomTag& tag)
+      {
+        std::string value;
+        if (mainDicomTags.LookupStringValue(value, tag, false /* no binary */))
+        {
+          tags_.push_back(tag);
+          values_.push_back(value);
+        }
+      }
+
+      size_t GetLastTag(size_t answer) const
+      {
+        return (answer + 1 < ids_.size() ? firstTag_[answer + 1] : tags_.size());
+      }
+
+    public:
+      explicit ResourcesLookupAnswers(const std::set<DicomTag>& requestedTags) :
+        requestedTags_(requestedTags)
+      {
+      }
+
+      virtual bool IsDicomAsJsonNeeded() const ORTHANC_OVERRIDE
+      {
+        return false;
+      }
+
+      virtual void MarkAsComplete() ORTHANC_OVERRIDE
+      {
+      }
+
+      virtual void Visit(const std::string& publicId,
+                         const std::string& instanceId,
+                         const DicomMap& mainDicomTags,
+                         const Json::Value* dicomAsJson) ORTHANC_OVERRIDE
+      {
+        ids_.push_back(publicId);
+        firstTag_.push_back(tags_.size());
+
+        if (requestedTags_.empty())
+        {
+          std::set<DicomTag> tags;
+          mainDicomTags.GetTags(tags);
+
+          for (std::set<DicomTag>::const_iterator it = tags.begin(); it != tags.end(); ++it)
+          {
+            AddTag(mainDicomTags, *it);
+          }
+        }
+        else
+        {
+          for (std::set<DicomTag>::const_iterator it = requestedTags_.begin(); it != requestedTags_.end(); ++it)
+          {
+            AddTag(mainDicomTags, *it);
+          }
+        }
+      }
+
+      size_t GetAnswersCount() const
+      {
+        return ids_.size();
+      }
+
+      const std::string& GetAnswerId(size_t answer) const
+      {
+        CheckAnswerIndex(answer);
+        return ids_[answer];
+      }
+
+      size_t GetTagsCount(size_t answer) const
+      {
+        CheckAnswerIndex(answer);
+        return GetLastTag(answer) - firstTag_[answer];
+      }
+
+      void GetTag(uint16_t& group,
+                  uint16_t& element,
+                  const char*& value,
+                  size_t answer,
+                  size_t tag) const
+      {
+        CheckAnswerIndex(answer);
+
+        size_t index = firstTag_[answer] + tag;
+        if (index >= GetLastTag(answer))
+        {
+          throw OrthancException(ErrorCode_ParameterOutOfRange);
+        }
+
+        group = tags_[index].GetGroup();
+        element = tags_[index].GetElement();
+        value = values_[index].c_str();
+      }
+    };
+
+
     class DicomWebBinaryFormatter : public DicomWebJsonVisitor::IBinaryFormatter
     {
     private:
@@ -1056,11 +1224,23 @@ namespace Orthanc
         DicomWebJsonVisitor visitor;
         visitor.SetFormatter(*this);
 
+        std::unique_ptr<DicomWebJsonWriter> writer;
+        if (isJson &&
+            DicomWebJsonWriter::IsSupported())
+        {
+          writer.reset(new DicomWebJsonWriter);
+          visitor.SetSink(*writer);
+        }
+
         dicom.Apply(visitor);
 
         std::string s;
 
-        if (isJson)
+        if (writer.get() != NULL)
+        {
+          writer->Flatten(s);
+        }
+        else if (isJson)
         {
           s = visitor.GetResult().toStyledString();
         }
@@ -2522,6 +2702,38 @@ namespace Orthanc
   };
 
 
+  // New in Orthanc 1.11.0: The bytes are shared with the storage cache
+  class OrthancPlugins::DicomInstanceFromStorage : public IDicomInstance
+  {
+  private:
+    std::unique_ptr<IMemoryBuffer>         buffer_;
+    std::unique_ptr<DicomInstanceToStore>  instance_;
+
+  public:
+    explicit DicomInstanceFromStorage(IMemoryBuffer* buffer) :
+      buffer_(buffer)
+    {
+      if (buffer_.get() == NULL)
+      {
+        throw OrthancException(ErrorCode_NullPointer);
+      }
+
+      instance_.reset(DicomInstanceToStore::CreateFromBuffer(buffer_->GetData(), buffer_->GetSize()));
+      instance_->SetOrigin(DicomInstanceOrigin::FromPlugins());
+    }
+
+    virtual bool CanBeFreed() const ORTHANC_OVERRIDE
+    {
+      return true;
+    }
+
+    virtual const DicomInstanceToStore& GetInstance() const ORTHANC_OVERRIDE
+    {
+      return *instance_;
+    };
+  };
+
+
   class OrthancPlugins::DicomInstanceFromTranscoded : public IDicomInstance
   {
   private:
@@ -3308,6 +3520,29 @@ namespace Orthanc
   }
 
 
+  void OrthancPlugins::ExecuteResourcesLookup(const void* parameters)
+  {
+    const _OrthancPluginExecuteResourcesLookup& p = 
+      *reinterpret_cast<const _OrthancPluginExecuteResourcesLookup*>(parameters);
+
+    if (p.lookup == NULL)
+    {
+      throw OrthancException(ErrorCode_NullPointer);
+    }
+
+    const ResourcesLookup& lookup = *reinterpret_cast<const ResourcesLookup*>(p.lookup);
+
+    std::unique_ptr<ResourcesLookupAnswers> answers(new ResourcesLookupAnswers(lookup.GetRequestedTags()));
+
+    {
+      PImpl::ServerContextLock lock(*pimpl_);
+      lock.GetContext().Apply(*answers, lookup.GetLookup(), lookup.GetLevel(), p.since, p.limit);
+    }
+
+    *(p.target) = reinterpret_cast<OrthancPluginResourcesLookupAnswers*>(answers.release());
+  }
+
+
   static void AccessInstanceMetadataInternal(bool checkExistence,
                                              const _OrthancPluginAccessDicomInstance& params,
                                              const DicomInstanceToStore& instance)
@@ -4995,6 +5230,134 @@ namespace Orthanc
         }
       }
 
+      case _OrthancPluginService_CreateResourcesLookup:
+      {
+        const _OrthancPluginCreateResourcesLookup& p =
+          *reinterpret_cast<const _OrthancPluginCreateResourcesLookup*>(parameters);
+        *(p.target) = reinterpret_cast<OrthancPluginResourcesLookup*>(new ResourcesLookup(Plugins::Convert(p.level)));
+        return true;
+      }
+
+      case _OrthancPluginService_FreeResourcesLookup:
+      {
+        const _OrthancPluginFreeResourcesLookup& p =
+          *reinterpret_cast<const _OrthancPluginFreeResourcesLookup*>(parameters);
+
+        if (p.lookup != NULL)
+        {
+          delete reinterpret_cast<ResourcesLookup*>(p.lookup);
+        }
+
+        return true;
+      }
+
+      case _OrthancPluginService_AddResourcesLookupConstraint:
+      {
+        const _OrthancPluginAddResourcesLookupConstraint& p =
+          *reinterpret_cast<const _OrthancPluginAddResourcesLookupConstraint*>(parameters);
+
+        if (p.lookup == NULL ||
+            p.value == NULL)
+        {
+          throw OrthancException(ErrorCode_NullPointer);
+        }
+        else
+        {
+          reinterpret_cast<ResourcesLookup*>(p.lookup)->AddConstraint(
+            DicomTag(p.group, p.element), p.value, p.caseSensitive != 0);
+          return true;
+        }
+      }
+
+      case _OrthancPluginService_AddResourcesLookupRequestedTag:
+      {
+        const _OrthancPluginAddResourcesLookupRequestedTag& p =
+          *reinterpret_cast<const _OrthancPluginAddResourcesLookupRequestedTag*>(parameters);
+
+        if (p.lookup == NULL)
+        {
+          throw OrthancException(ErrorCode_NullPointer);
+        }
+        else
+        {
+          reinterpret_cast<ResourcesLookup*>(p.lookup)->AddRequestedTag(DicomTag(p.group, p.element));
+          return true;
+        }
+      }
+
+      case _OrthancPluginService_ExecuteResourcesLookup:
+        ExecuteResourcesLookup(parameters);
+        return true;
+
+      case _OrthancPluginService_FreeResourcesLookupAnswers:
+      {
+        const _OrthancPluginFreeResourcesLookupAnswers& p =
+          *reinterpret_cast<const _OrthancPluginFreeResourcesLookupAnswers*>(parameters);
+
+        if (p.answers != NULL)
+        {
+          delete reinterpret_cast<ResourcesLookupAnswers*>(p.answers);
+        }
+
+        return true;
+      }
+
+      case _OrthancPluginService_GetResourcesLookupAnswersCount:
+      case _OrthancPluginService_GetResourcesLookupAnswerTagsCount:
+      {
+        const _OrthancPluginGetResourcesLookupAnswerCount& p =
+          *reinterpret_cast<const _OrthancPluginGetResourcesLookupAnswerCount*>(parameters);
+
+        if (p.answers == NULL)
+        {
+          throw OrthancException(ErrorCode_NullPointer);
+        }
+        else
+        {
+          const ResourcesLookupAnswers& answers = *reinterpret_cast<const ResourcesLookupAnswers*>(p.answers);
+          *(p.target) = static_cast<uint32_t>(
+            service == _OrthancPluginService_GetResourcesLookupAnswersCount ?
+            answers.GetAnswersCount() : answers.GetTagsCount(p.answerIndex));
+          return true;
+        }
+      }
+
+      case _OrthancPluginService_GetResourcesLookupAnswerId:
+      {
+        const _OrthancPluginGetResourcesLookupAnswerId& p =
+          *reinterpret_cast<const _OrthancPluginGetResourcesLookupAnswerId*>(parameters);
+
+        if (p.answers == NULL)
+        {
+          throw OrthancException(ErrorCode_NullPointer);
+        }
+        else
+        {
+          *(p.target) = reinterpret_cast<const ResourcesLookupAnswers*>(p.answers)->GetAnswerId(p.answerIndex).c_str();
+          return true;
+        }
+      }
+
+      case _OrthancPluginService_GetResourcesLookupAnswerTag:
+      {
+        const _OrthancPluginGetResourcesLookupAnswerTag& p =
+          *reinterpret_cast<const _OrthancPluginGetResourcesLookupAnswerTag*>(parameters);
+
+        if (p.answers == NULL ||
+            p.group == NULL ||
+            p.element == NULL ||
+            p.value == NULL)
+        {
+          throw OrthancException(ErrorCode_NullPointer);
+        }
+        else
+        {
+          reinterpret_cast<const ResourcesLookupAnswers*>(p.answers)->GetTag(
+            *p.group, *p.element, *p.value, p.answerIndex, p.tagIndex);
+          return true;
+        }
+      }
+
       case _OrthancPluginService_GetPeers:
       {
         const _OrthancPluginGetPeers& p =
@@ -5211,6 +5574,28 @@ namespace Orthanc
         return true;
       }
         
+      case _OrthancPluginService_LoadDicomInstance:
+      {
+        const _OrthancPluginLoadDicomInstance& p =
+          *reinterpret_cast<const _OrthancPluginLoadDicomInstance*>(parameters);
+
+        if (p.instanceId == NULL)
+        {
+          throw OrthancException(ErrorCode_NullPointer);
+        }
+
+        std::unique_ptr<IMemoryBuffer> buffer;
+
+        {
+          PImpl::ServerContextLock lock(*pimpl_);
+          buffer.reset(lock.GetContext().ReadSharedDicom(p.instanceId));
+        }
+
+        *(p.target) = reinterpret_cast<OrthancPluginDicomInstance*>(
+          new DicomInstanceFromStorage(buffer.release()));
+        return true;
+      }
+
       case _OrthancPluginService_FreeDicomInstance:
       {
         const _OrthancPluginFreeDicomInstance& p =
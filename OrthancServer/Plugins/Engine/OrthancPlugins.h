@@ -89,6 +89,7 @@ namespace Orthanc
     class IDicomInstance;
     class DicomInstanceFromCallback;
     class DicomInstanceFromBuffer;
+    class DicomInstanceFromStorage;
     class DicomInstanceFromTranscoded;
     class WebDavCollection;
     
@@ -211,6 +212,8 @@ namespace Orthanc
     void ApplyCreateImage(_OrthancPluginService service,
                           const void* parameters);
 
+    void ExecuteResourcesLookup(const void* parameters);
+
     void ApplyLookupDictionary(const void* parameters);
 
     void ApplySendMultipartItem(const void* parameters);
@@ -503,6 +503,16 @@ extern "C"
     _OrthancPluginService_ReconstructMainDicomTags = 3014,
     _OrthancPluginService_RestApiGet2 = 3015,
     _OrthancPluginService_CallRestApi = 3016,              /* New in Orthanc 1.9.2 */
+    _OrthancPluginService_CreateResourcesLookup = 3017,    /* New in Orthanc 1.11.0 */
+    _OrthancPluginService_FreeResourcesLookup = 3018,      /* New in Orthanc 1.11.0 */
+    _OrthancPluginService_AddResourcesLookupConstraint = 3019,    /* New in Orthanc 1.11.0 */
+    _OrthancPluginService_AddResourcesLookupRequestedTag = 3020,  /* New in Orthanc 1.11.0 */
+    _OrthancPluginService_ExecuteResourcesLookup = 3021,   /* New in Orthanc 1.11.0 */
+    _OrthancPluginService_FreeResourcesLookupAnswers = 3022,      /* New in Orthanc 1.11.0 */
+    _OrthancPluginService_GetResourcesLookupAnswersCount = 3023,  /* New in Orthanc 1.11.0 */
+    _OrthancPluginService_GetResourcesLookupAnswerId = 3024,      /* New in Orthanc 1.11.0 */
+    _OrthancPluginService_GetResourcesLookupAnswerTagsCount = 3025,  /* New in Orthanc 1.11.0 */
+    _OrthancPluginService_GetResourcesLookupAnswerTag = 3026,     /* New in Orthanc 1.11.0 */
 
     /* Access to DICOM instances */
     _OrthancPluginService_GetInstanceRemoteAet = 4000,
@@ -525,6 +535,7 @@ extern "C"
     _OrthancPluginService_GetInstanceAdvancedJson = 4017,  /* New in Orthanc 1.7.0 */
     _OrthancPluginService_GetInstanceDicomWebJson = 4018,  /* New in Orthanc 1.7.0 */
     _OrthancPluginService_GetInstanceDicomWebXml = 4019,   /* New in Orthanc 1.7.0 */
+    _OrthancPluginService_LoadDicomInstance = 4020,        /* New in Orthanc 1.11.0 */
     
     /* Services for plugins implementing a database back-end */
     _OrthancPluginService_RegisterDatabaseBackend = 5000,    /* New in Orthanc 0.8.6 */
@@ -1160,6 +1171,22 @@ extern "C"
    **/
   typedef struct _OrthancPluginDicomWebNode_t OrthancPluginDicomWebNode;
 
+
+
+  /**
+   * @brief Opaque structure to a lookup for resources in the Orthanc database.
+   * @ingroup Orthanc
+   **/
+  typedef struct _OrthancPluginResourcesLookup_t OrthancPluginResourcesLookup;
+
+
+
+  /**
+   * @brief Opaque structure to the answers of a lookup for resources in the Orthanc database.
+   * @ingroup Orthanc
+   **/
+  typedef struct _OrthancPluginResourcesLookupAnswers_t OrthancPluginResourcesLookupAnswers;
+
   
 
   /**
@@ -9004,6 +9031,481 @@ extern "C"
   }
   
 
+
+
+  typedef struct
+  {
+    OrthancPluginResourcesLookup**  target;
+    OrthancPluginResourceType       level;
+  } _OrthancPluginCreateResourcesLookup;
+
+  /**
+   * @brief Create a lookup for resources in the Orthanc database.
+   *
+   * This function creates a lookup for resources stored in the
+   * Orthanc database, which is the native counterpart of the
+   * "/tools/find" route of the REST API. Contrarily to calling
+   * "/tools/find" through OrthancPluginRestApiPost(), neither the
+   * HTTP layer nor JSON serialization are involved. The constraints
+   * are added with OrthancPluginAddResourcesLookupConstraint(), and
+   * the lookup is run with OrthancPluginExecuteResourcesLookup().
+   *
+   * @param context The Orthanc plugin context, as received by OrthancPluginInitialize().
+   * @param level The level of the resources of interest.
+   * @return The newly allocated lookup. It must be freed with OrthancPluginFreeResourcesLookup().
+   * @ingroup Orthanc
+   **/
+  ORTHANC_PLUGIN_INLINE OrthancPluginResourcesLookup* OrthancPluginCreateResourcesLookup(
+    OrthancPluginContext*      context,
+    OrthancPluginResourceType  level)
+  {
+    OrthancPluginResourcesLookup* target = NULL;
+
+    _OrthancPluginCreateResourcesLookup params;
+    memset(&params, 0, sizeof(params));
+    params.target = &target;
+    params.level = level;
+
+    if (context->InvokeService(context, _OrthancPluginService_CreateResourcesLookup, &params) != OrthancPluginErrorCode_Success)
+    {
+      return NULL;
+    }
+    else
+    {
+      return target;
+    }
+  }
+
+
+  typedef struct
+  {
+    OrthancPluginResourcesLookup*  lookup;
+  } _OrthancPluginFreeResourcesLookup;
+
+  /**
+   * @brief Free a lookup for resources.
+   *
+   * This function frees a lookup that was created using OrthancPluginCreateResourcesLookup().
+   *
+   * @param context The Orthanc plugin context, as received by OrthancPluginInitialize().
+   * @param lookup The lookup of interest.
+   * @ingroup Orthanc
+   **/
+  ORTHANC_PLUGIN_INLINE void OrthancPluginFreeResourcesLookup(
+    OrthancPluginContext*          context, 
+    OrthancPluginResourcesLookup*  lookup)
+  {
+    _OrthancPluginFreeResourcesLookup params;
+    params.lookup = lookup;
+
+    context->InvokeService(context, _OrthancPluginService_FreeResourcesLookup, &params);
+  }
+
+
+  typedef struct
+  {
+    OrthancPluginResourcesLookup*  lookup;
+    uint16_t                       group;
+    uint16_t                       element;
+    const char*                    value;
+    uint8_t                        caseSensitive;
+  } _OrthancPluginAddResourcesLookupConstraint;
+
+  /**
+   * @brief Add a constraint to a lookup for resources.
+   *
+   * This function adds a constraint on one DICOM tag to a lookup
+   * that was created using OrthancPluginCreateResourcesLookup(). The
+   * value follows the same syntax as the "Query" field of
+   * "/tools/find" (i.e. the syntax of C-FIND): It can contain
+   * wildcards ("*" and "?"), ranges ("-") or lists ("\"). An empty
+   * value corresponds to an universal constraint, and is ignored.
+   *
+   * The constraints on the main DICOM tags are evaluated by the
+   * database. As in "/tools/find", the constraints on other tags are
+   * supported, but they are evaluated by reading the DICOM file of
+   * each candidate resource from the storage area, which is much
+   * slower.
+   *
+   * @param context The Orthanc plugin context, as received by OrthancPluginInitialize().
+   * @param lookup The lookup of interest.
+   * @param group The group of the DICOM tag.
+   * @param element The element of the DICOM tag.
+   * @param value The value of the constraint.
+   * @param caseSensitive Whether the matching of PN value representations is case-sensitive.
+   * @return 0 if success, other value if error.
+   * @ingroup Orthanc
+   **/
+  ORTHANC_PLUGIN_INLINE OrthancPluginErrorCode OrthancPluginAddResourcesLookupConstraint(
+    OrthancPluginContext*          context,
+    OrthancPluginResourcesLookup*  lookup,
+    uint16_t                       group,
+    uint16_t                       element,
+    const char*                    value,
+    uint8_t                        caseSensitive)
+  {
+    _OrthancPluginAddResourcesLookupConstraint params;
+    memset(&params, 0, sizeof(params));
+    params.lookup = lookup;
+    params.group = group;
+    params.element = element;
+    params.value = value;
+    params.caseSensitive = caseSensitive;
+
+    return context->InvokeService(context, _OrthancPluginService_AddResourcesLookupConstraint, &params);
+  }
+
+
+  typedef struct
+  {
+    OrthancPluginResourcesLookup*  lookup;
+    uint16_t                       group;
+    uint16_t                       element;
+  } _OrthancPluginAddResourcesLookupRequestedTag;
+
+  /**
+   * @brief Request one DICOM tag in the answers of a lookup for resources.
+   *
+   * This function restricts the DICOM tags that are reported in the
+   * answers of a lookup to the given tag (this function can be called
+   * several times). If no tag is requested, all the main DICOM tags
+   * that are stored in the Orthanc database for the matching
+   * resources (and for their parents) are reported. The tags that are
+   * not main DICOM tags are never reported, as the storage area is
+   * not read to build the answers (it is only read to evaluate the
+   * constraints on such tags, if any).
+   *
+   * @param context The Orthanc plugin context, as received by OrthancPluginInitialize().
+   * @param lookup The lookup of interest.
+   * @param group The group of the DICOM tag.
+   * @param element The element of the DICOM tag.
+   * @return 0 if success, other value if error.
+   * @ingroup Orthanc
+   **/
+  ORTHANC_PLUGIN_INLINE OrthancPluginErrorCode OrthancPluginAddResourcesLookupRequestedTag(
+    OrthancPluginContext*          context,
+    OrthancPluginResourcesLookup*  lookup,
+    uint16_t                       group,
+    uint16_t                       element)
+  {
+    _OrthancPluginAddResourcesLookupRequestedTag params;
+    memset(&params, 0, sizeof(params));
+    params.lookup = lookup;
+    params.group = group;
+    params.element = element;
+
+    return context->InvokeService(context, _OrthancPluginService_AddResourcesLookupRequestedTag, &params);
+  }
+
+
+  typedef struct
+  {
+    OrthancPluginResourcesLookupAnswers**  target;
+    const OrthancPluginResourcesLookup*    lookup;
+    uint32_t                               since;
+    uint32_t                               limit;
+  } _OrthancPluginExecuteResourcesLookup;
+
+  /**
+   * @brief Execute a lookup for resources.
+   *
+   * This function runs a lookup that was created using
+   * OrthancPluginCreateResourcesLookup() against the Orthanc
+   * database. The answers are accessed through
+   * OrthancPluginGetResourcesLookupAnswersCount(),
+   * OrthancPluginGetResourcesLookupAnswerId(),
+   * OrthancPluginGetResourcesLookupAnswerTagsCount() and
+   * OrthancPluginGetResourcesLookupAnswerTag().
+   *
+   * @param context The Orthanc plugin context, as received by OrthancPluginInitialize().
+   * @param lookup The lookup of interest.
+   * @param since The number of matching resources to skip (for paging).
+   * @param limit The maximum number of answers (0 means no limit).
+   * @return The newly allocated answers, or NULL in the case of an error. They
+   * must be freed with OrthancPluginFreeResourcesLookupAnswers().
+   * @ingroup Orthanc
+   **/
+  ORTHANC_PLUGIN_INLINE OrthancPluginResourcesLookupAnswers* OrthancPluginExecuteResourcesLookup(
+    OrthancPluginContext*                context,
+    const OrthancPluginResourcesLookup*  lookup,
+    uint32_t                             since,
+    uint32_t                             limit)
+  {
+    OrthancPluginResourcesLookupAnswers* target = NULL;
+
+    _OrthancPluginExecuteResourcesLookup params;
+    memset(&params, 0, sizeof(params));
+    params.target = &target;
+    params.lookup = lookup;
+    params.since = since;
+    params.limit = limit;
+
+    if (context->InvokeService(context, _OrthancPluginService_ExecuteResourcesLookup, &params) != OrthancPluginErrorCode_Success)
+    {
+      return NULL;
+    }
+    else
+    {
+      return target;
+    }
+  }
+
+
+  typedef struct
+  {
+    OrthancPluginResourcesLookupAnswers*  answers;
+  } _OrthancPluginFreeResourcesLookupAnswers;
+
+  /**
+   * @brief Free the answers of a lookup for resources.
+   *
+   * This function frees the answers that were created using OrthancPluginExecuteResourcesLookup().
+   *
+   * @param context The Orthanc plugin context, as received by OrthancPluginInitialize().
+   * @param answers The answers of interest.
+   * @ingroup Orthanc
+   **/
+  ORTHANC_PLUGIN_INLINE void OrthancPluginFreeResourcesLookupAnswers(
+    OrthancPluginContext*                 context, 
+    OrthancPluginResourcesLookupAnswers*  answers)
+  {
+    _OrthancPluginFreeResourcesLookupAnswers params;
+    params.answers = answers;
+
+    context->InvokeService(context, _OrthancPluginService_FreeResourcesLookupAnswers, &params);
+  }
+
+
+  typedef struct
+  {
+    uint32_t*                                   target;
+    const OrthancPluginResourcesLookupAnswers*  answers;
+    uint32_t                                    answerIndex;
+  } _OrthancPluginGetResourcesLookupAnswerCount;
+
+  /**
+   * @brief Get the number of answers of a lookup for resources.
+   *
+   * This function returns the number of resources that matched a
+   * lookup. This function is thread-safe.
+   *
+   * @param context The Orthanc plugin context, as received by OrthancPluginInitialize().
+   * @param answers The answers of interest.
+   * @result The number of answers.
+   * @ingroup Orthanc
+   **/
+  ORTHANC_PLUGIN_INLINE uint32_t OrthancPluginGetResourcesLookupAnswersCount(
+    OrthancPluginContext*                       context,
+    const OrthancPluginResourcesLookupAnswers*  answers)
+  {
+    uint32_t target = 0;
+
+    _OrthancPluginGetResourcesLookupAnswerCount params;
+    memset(&params, 0, sizeof(params));
+    params.target = &target;
+    params.answers = answers;
+
+    if (context->InvokeService(context, _OrthancPluginService_GetResourcesLookupAnswersCount, &params) != OrthancPluginErrorCode_Success)
+    {
+      /* Error */
+      return 0;
+    }
+    else
+    {
+      return target;
+    }
+  }
+
+
+  typedef struct
+  {
+    const char**                                target;
+    const OrthancPluginResourcesLookupAnswers*  answers;
+    uint32_t                                    answerIndex;
+  } _OrthancPluginGetResourcesLookupAnswerId;
+
+  /**
+   * @brief Get the Orthanc identifier of one answer of a lookup for resources.
+   *
+   * This function returns the Orthanc identifier of one resource
+   * that matched a lookup. This function is thread-safe.
+   *
+   * @param context The Orthanc plugin context, as received by OrthancPluginInitialize().
+   * @param answers The answers of interest.
+   * @param answerIndex The index of the answer of interest.
+   * This value must be lower than OrthancPluginGetResourcesLookupAnswersCount().
+   * @result The Orthanc identifier, or NULL in the case of an error.
+   * It must not be freed, as it is owned by "answers".
+   * @ingroup Orthanc
+   **/
+  ORTHANC_PLUGIN_INLINE const char* OrthancPluginGetResourcesLookupAnswerId(
+    OrthancPluginContext*                       context,
+    const OrthancPluginResourcesLookupAnswers*  answers,
+    uint32_t                                    answerIndex)
+  {
+    const char* target = NULL;
+
+    _OrthancPluginGetResourcesLookupAnswerId params;
+    memset(&params, 0, sizeof(params));
+    params.target = &target;
+    params.answers = answers;
+    params.answerIndex = answerIndex;
+
+    if (context->InvokeService(context, _OrthancPluginService_GetResourcesLookupAnswerId, &params) != OrthancPluginErrorCode_Success)
+    {
+      /* Error */
+      return NULL;
+    }
+    else
+    {
+      return target;
+    }
+  }
+
+
+  /**
+   * @brief Get the number of DICOM tags in one answer of a lookup for resources.
+   *
+   * This function returns the number of DICOM tags that are reported
+   * for one resource that matched a lookup. This function is
+   * thread-safe.
+   *
+   * @param context The Orthanc plugin context, as received by OrthancPluginInitialize().
+   * @param answers The answers of interest.
+   * @param answerIndex The index of the answer of interest.
+   * This value must be lower than OrthancPluginGetResourcesLookupAnswersCount().
+   * @result The number of DICOM tags.
+   * @ingroup Orthanc
+   **/
+  ORTHANC_PLUGIN_INLINE uint32_t OrthancPluginGetResourcesLookupAnswerTagsCount(
+    OrthancPluginContext*                       context,
+    const OrthancPluginResourcesLookupAnswers*  answers,
+    uint32_t                                    answerIndex)
+  {
+    uint32_t target = 0;
+
+    _OrthancPluginGetResourcesLookupAnswerCount params;
+    memset(&params, 0, sizeof(params));
+    params.target = &target;
+    params.answers = answers;
+    params.answerIndex = answerIndex;
+
+    if (context->InvokeService(context, _OrthancPluginService_GetResourcesLookupAnswerTagsCount, &params) != OrthancPluginErrorCode_Success)
+    {
+      /* Error */
+      return 0;
+    }
+    else
+    {
+      return target;
+    }
+  }
+
+
+  typedef struct
+  {
+    uint16_t*                                   group;
+    uint16_t*                                   element;
+    const char**                                value;
+    const OrthancPluginResourcesLookupAnswers*  answers;
+    uint32_t                                    answerIndex;
+    uint32_t                                    tagIndex;
+  } _OrthancPluginGetResourcesLookupAnswerTag;
+
+  /**
+   * @brief Get one DICOM tag of one answer of a lookup for resources.
+   *
+   * This function returns one DICOM tag, together with its value,
+   * that is reported for one resource that matched a lookup. This
+   * function is thread-safe.
+   *
+   * @param context The Orthanc plugin context, as received by OrthancPluginInitialize().
+   * @param group The group of the DICOM tag (out).
+   * @param element The element of the DICOM tag (out).
+   * @param value The value of the DICOM tag, encoded in UTF-8 (out). It must not be
+   * freed, as it is owned by "answers".
+   * @param answers The answers of interest.
+   * @param answerIndex The index of the answer of interest.
+   * This value must be lower than OrthancPluginGetResourcesLookupAnswersCount().
+   * @param tagIndex The index of the DICOM tag of interest.
+   * This value must be lower than OrthancPluginGetResourcesLookupAnswerTagsCount().
+   * @return 0 if success, other value if error.
+   * @ingroup Orthanc
+   **/
+  ORTHANC_PLUGIN_INLINE OrthancPluginErrorCode OrthancPluginGetResourcesLookupAnswerTag(
+    OrthancPluginContext*                       context,
+    uint16_t*                                   group,
+    uint16_t*                                   element,
+    const char**                                value,
+    const OrthancPluginResourcesLookupAnswers*  answers,
+    uint32_t                                    answerIndex,
+    uint32_t                                    tagIndex)
+  {
+    _OrthancPluginGetResourcesLookupAnswerTag params;
+    memset(&params, 0, sizeof(params));
+    params.group = group;
+    params.element = element;
+    params.value = value;
+    params.answers = answers;
+    params.answerIndex = answerIndex;
+    params.tagIndex = tagIndex;
+
+    return context->InvokeService(context, _OrthancPluginService_GetResourcesLookupAnswerTag, &params);
+  }
+
+
+  typedef struct
+  {
+    OrthancPluginDicomInstance**  target;
+    const char*                   instanceId;
+  } _OrthancPluginLoadDicomInstance;
+
+  /**
+   * @brief Load a DICOM instance from the storage area of Orthanc.
+   *
+   * This function gives read-only access to the DICOM file of an
+   * instance that is stored by Orthanc. If the file is not
+   * compressed, its bytes are shared with the storage cache of
+   * Orthanc, which avoids the copy that is done by
+   * OrthancPluginGetDicomForInstance(). The bytes remain available
+   * until the instance is freed, even if the instance is removed
+   * from the cache in the meantime. The resulting instance can be
+   * used with the other functions of the "DicomInstance" group
+   * (e.g. OrthancPluginGetInstanceData() or
+   * OrthancPluginGetInstanceJson()), in which case the DICOM file is
+   * parsed at most once.
+   *
+   * @param context The Orthanc plugin context, as received by OrthancPluginInitialize().
+   * @param instanceId The Orthanc identifier of the DICOM instance of interest.
+   * @return The DICOM instance, or NULL in the case of an error
+   * (the error is OrthancPluginErrorCode_UnknownResource if the
+   * instance does not exist). It must be freed with
+   * OrthancPluginFreeDicomInstance().
+   * @ingroup DicomInstance
+   **/
+  ORTHANC_PLUGIN_INLINE OrthancPluginDicomInstance* OrthancPluginLoadDicomInstance(
+    OrthancPluginContext*  context,
+    const char*            instanceId)
+  {
+    OrthancPluginDicomInstance* target = NULL;
+
+    _OrthancPluginLoadDicomInstance params;
+    memset(&params, 0, sizeof(params));
+    params.target = &target;
+    params.instanceId = instanceId;
+
+    if (context->InvokeService(context, _OrthancPluginService_LoadDicomInstance, &params) != OrthancPluginErrorCode_Success)
+    {
+      /* Error */
+      return NULL;
+    }
+    else
+    {
+      return target;
+    }
+  }
+  
+
 #ifdef  __cplusplus
 }
 #endif
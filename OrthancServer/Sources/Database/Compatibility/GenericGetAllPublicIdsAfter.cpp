@@ -0,0 +1,74 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+#include "../../PrecompiledHeadersServer.h"
+#include "GenericGetAllPublicIdsAfter.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace Orthanc
+{
+  namespace Compatibility
+  {
+    void GenericGetAllPublicIdsAfter::Apply(std::list<std::string>& target,
+                                            IDatabaseWrapper::ITransaction& transaction,
+                                            ResourceType resourceType,
+                                            const std::string& after,
+                                            size_t limit)
+    {
+      target.clear();
+
+      if (limit == 0)
+      {
+        return;
+      }
+
+      std::list<std::string> all;
+      transaction.GetAllPublicIds(all, resourceType);
+
+      std::vector<std::string> candidates;
+      candidates.reserve(all.size());
+
+      for (std::list<std::string>::const_iterator it = all.begin(); it != all.end(); ++it)
+      {
+        if (*it > after)
+        {
+          candidates.push_back(*it);
+        }
+      }
+
+      if (candidates.size() > limit)
+      {
+        std::partial_sort(candidates.begin(), candidates.begin() + limit, candidates.end());
+        candidates.resize(limit);
+      }
+      else
+      {
+        std::sort(candidates.begin(), candidates.end());
+      }
+
+      target.assign(candidates.begin(), candidates.end());
+    }
+  }
+}
@@ -0,0 +1,50 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+#pragma once
+
+#include "../IDatabaseWrapper.h"
+
+namespace Orthanc
+{
+  namespace Compatibility
+  {
+    /**
+     * Fallback for the database engines that cannot list the
+     * resources by increasing public ID: All the public IDs of the
+     * level are retrieved, then filtered and sorted in memory. This
+     * is linear in the number of resources for each page: Walking
+     * through a whole level must use "StatelessDatabaseOperations::
+     * UuidsPager", that only calls "GetAllPublicIds()" once per pass.
+     **/
+    class GenericGetAllPublicIdsAfter : public boost::noncopyable
+    {
+    public:
+      static void Apply(std::list<std::string>& target,
+                        IDatabaseWrapper::ITransaction& transaction,
+                        ResourceType resourceType,
+                        const std::string& after,
+                        size_t limit);
+    };
+  }
+}
@@ -0,0 +1,61 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+#include "../../PrecompiledHeadersServer.h"
+#include "GenericLookupIdentifiers.h"
+
+#include "../../Search/DatabaseConstraint.h"
+
+namespace Orthanc
+{
+  namespace Compatibility
+  {
+    void GenericLookupIdentifiers::Apply(std::multimap<std::string, std::string>& target,
+                                         IDatabaseWrapper::ITransaction& transaction,
+                                         ResourceType level,
+                                         const DicomTag& tag,
+                                         const std::set<std::string>& values)
+    {
+      target.clear();
+
+      for (std::set<std::string>::const_iterator it = values.begin(); it != values.end(); ++it)
+      {
+        std::vector<std::string> value;
+        value.push_back(*it);
+
+        std::vector<DatabaseConstraint> lookup;
+        lookup.push_back(DatabaseConstraint(level, tag, true /* identifier */, ConstraintType_Equal,
+                                            value, true /* case sensitive */, true /* mandatory */));
+
+        std::list<std::string> resources;
+        transaction.ApplyLookupResources(resources, NULL, lookup, level, 0);
+
+        for (std::list<std::string>::const_iterator resource = resources.begin();
+             resource != resources.end(); ++resource)
+        {
+          target.insert(std::make_pair(*it, *resource));
+        }
+      }
+    }
+  }
+}
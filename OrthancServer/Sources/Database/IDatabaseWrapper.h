@@ -31,6 +31,7 @@
 
 #include <list>
 #include <boost/noncopyable.hpp>
+#include <map>
 #include <set>
 
 namespace Orthanc
@@ -235,6 +236,30 @@ namespace Orthanc
                                            ResourceType& type,
                                            std::string& parentPublicId,
                                            const std::string& publicId) = 0;
+
+
+      /**
+       * Primitives introduced in Orthanc 1.11.0
+       **/
+
+      // Looks up all the resources of the given level whose DICOM
+      // identifier "tag" exactly matches one of the (already
+      // normalized) "values". The "target" associates each matching
+      // value with the public ID of the resource.
+      virtual void LookupIdentifiersExact(std::multimap<std::string, std::string>& target,
+                                          ResourceType level,
+                                          const DicomTag& tag,
+                                          const std::set<std::string>& values) = 0;
+
+      // Lists at most "limit" resources of the given level whose
+      // public ID is strictly greater than "after", by increasing
+      // public ID. Contrarily to "GetAllPublicIds()" with an offset,
+      // this pagination is not affected by the resources that are
+      // added or removed between two pages.
+      virtual void GetAllPublicIdsAfter(std::list<std::string>& target,
+                                        ResourceType resourceType,
+                                        const std::string& after,
+                                        size_t limit) = 0;
     };
 
 
@@ -250,6 +275,25 @@ namespace Orthanc
 
     virtual bool HasFlushToDisk() const = 0;
 
+    /**
+     * New in Orthanc 1.11.0: Online compaction of the database, in
+     * small slices that don't block the other transactions for a
+     * long time. "CompactIncrementally()" reclaims at most "maxPages"
+     * free pages, but only if no transaction was started during the
+     * last "idleDelay" milliseconds: It returns "false" if the
+     * database is not idle. "Optimize()" refreshes the statistics
+     * that are used by the query planner.
+     **/
+    virtual bool HasIncrementalCompaction() const = 0;
+
+    virtual void GetPagesCount(uint64_t& totalPages,
+                               uint64_t& freePages) = 0;
+
+    virtual bool CompactIncrementally(unsigned int maxPages,
+                                      unsigned int idleDelay) = 0;
+
+    virtual void Optimize() = 0;
+
     virtual ITransaction* StartTransaction(TransactionType type,
                                            IDatabaseListener& listener) = 0;
 
@@ -259,5 +303,10 @@ namespace Orthanc
                          IStorageArea& storageArea) = 0;
 
     virtual bool HasRevisionsSupport() const = 0;
+
+    // New in Orthanc 1.11.0: Whether "GetAllPublicIdsAfter()" is
+    // natively implemented by the database engine, i.e. without
+    // retrieving all the public IDs of the level at each call
+    virtual bool HasKeysetPagination() const = 0;
   };
 }
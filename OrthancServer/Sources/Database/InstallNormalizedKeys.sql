@@ -0,0 +1,60 @@
+-- Orthanc - A Lightweight, RESTful DICOM Store
+-- Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+-- Department, University Hospital of Liege, Belgium
+-- Copyright (C) 2017-2022 Osimis S.A., Belgium
+-- Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+--
+-- This program is free software: you can redistribute it and/or
+-- modify it under the terms of the GNU General Public License as
+-- published by the Free Software Foundation, either version 3 of the
+-- License, or (at your option) any later version.
+-- 
+-- This program is distributed in the hope that it will be useful, but
+-- WITHOUT ANY WARRANTY; without even the implied warranty of
+-- MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+-- General Public License for more details.
+--
+-- You should have received a copy of the GNU General Public License
+-- along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+
+-- New in Orthanc 1.11.0: Normalized keys of the main DICOM tags
+-- (upper case, as computed by the built-in "upper()" function of
+-- SQLite), so that the prefix wildcards can be turned into range
+-- scans. The keys are stored in a separate table that is kept
+-- up-to-date by triggers, so that the "MainDicomTags" table is
+-- unchanged and older versions of Orthanc can still write to the
+-- database. The keys of the main DICOM tags that were stored before
+-- the installation of this table are computed in the background, by
+-- batches (cf. "SQLiteDatabaseWrapper::FillNormalizedKeys()").
+
+CREATE TABLE MainDicomTagsNormalized(
+       id INTEGER REFERENCES Resources(internalId) ON DELETE CASCADE,
+       tagGroup INTEGER,
+       tagElement INTEGER,
+       normalizedValue TEXT,
+       PRIMARY KEY(id, tagGroup, tagElement)
+       );
+
+CREATE INDEX MainDicomTagsNormalizedIndex ON MainDicomTagsNormalized(tagGroup, tagElement, normalizedValue COLLATE BINARY);
+
+CREATE TRIGGER MainDicomTagsNormalizedInserted
+AFTER INSERT ON MainDicomTags
+BEGIN
+  INSERT OR REPLACE INTO MainDicomTagsNormalized (id, tagGroup, tagElement, normalizedValue)
+    VALUES (new.id, new.tagGroup, new.tagElement, upper(new.value));
+END;
+
+CREATE TRIGGER MainDicomTagsNormalizedUpdated
+AFTER UPDATE ON MainDicomTags
+BEGIN
+  DELETE FROM MainDicomTagsNormalized WHERE id = old.id AND tagGroup = old.tagGroup AND tagElement = old.tagElement;
+  INSERT OR REPLACE INTO MainDicomTagsNormalized (id, tagGroup, tagElement, normalizedValue)
+    VALUES (new.id, new.tagGroup, new.tagElement, upper(new.value));
+END;
+
+CREATE TRIGGER MainDicomTagsNormalizedDeleted
+AFTER DELETE ON MainDicomTags
+BEGIN
+  DELETE FROM MainDicomTagsNormalized WHERE id = old.id AND tagGroup = old.tagGroup AND tagElement = old.tagElement;
+END;
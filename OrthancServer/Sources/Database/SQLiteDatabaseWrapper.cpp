@@ -45,8 +45,14 @@ namespace Orthanc
   {
   private:
     std::list<std::string>  values_;
+    bool                    hasNormalizedKeys_;
 
   public:
+    explicit LookupFormatter(bool hasNormalizedKeys) :
+      hasNormalizedKeys_(hasNormalizedKeys)
+    {
+    }
+
     virtual std::string GenerateParameter(const std::string& value) ORTHANC_OVERRIDE
     {
       values_.push_back(value);
@@ -68,6 +74,11 @@ namespace Orthanc
       return false;
     }
 
+    virtual bool HasNormalizedKeys() const ORTHANC_OVERRIDE
+    {
+      return hasNormalizedKeys_;  // New in Orthanc 1.11.0
+    }
+
     void Bind(SQLite::Statement& statement) const
     {
       size_t pos = 0;
@@ -300,16 +311,19 @@ namespace Orthanc
     boost::mutex::scoped_lock  lock_;
     IDatabaseListener&         listener_;
     SignalRemainingAncestor&   signalRemainingAncestor_;
+    const bool&                hasNormalizedKeys_;  // Protected by the mutex
 
   public:
     TransactionBase(boost::mutex& mutex,
                     SQLite::Connection& db,
                     IDatabaseListener& listener,
-                    SignalRemainingAncestor& signalRemainingAncestor) :
+                    SignalRemainingAncestor& signalRemainingAncestor,
+                    const bool& hasNormalizedKeys) :
       UnitTestsTransaction(db),
       lock_(mutex),
       listener_(listener),
-      signalRemainingAncestor_(signalRemainingAncestor)
+      signalRemainingAncestor_(signalRemainingAncestor),
+      hasNormalizedKeys_(hasNormalizedKeys)
     {
     }
 
@@ -343,7 +357,7 @@ namespace Orthanc
                                       ResourceType queryLevel,
                                       size_t limit) ORTHANC_OVERRIDE
     {
-      LookupFormatter formatter;
+      LookupFormatter formatter(hasNormalizedKeys_);
 
       std::string sql;
       LookupFormatter::Apply(sql, formatter, lookup, queryLevel, limit);
@@ -379,6 +393,89 @@ namespace Orthanc
     }
 
 
+    virtual void LookupIdentifiersExact(std::multimap<std::string, std::string>& target,
+                                        ResourceType level,
+                                        const DicomTag& tag,
+                                        const std::set<std::string>& values) ORTHANC_OVERRIDE
+    {
+      // Stay far below "SQLITE_MAX_VARIABLE_NUMBER" (999 in older SQLite)
+      static const size_t BATCH_SIZE = 500;
+
+      target.clear();
+
+      std::set<std::string>::const_iterator it = values.begin();
+      while (it != values.end())
+      {
+        std::vector<std::string> batch;
+        batch.reserve(BATCH_SIZE);
+
+        while (it != values.end() &&
+               batch.size() < BATCH_SIZE)
+        {
+          batch.push_back(*it);
+          ++it;
+        }
+
+        // Without "INDEXED BY", SQLite favors the index on the tag,
+        // which would scan all the identifiers of the level
+        std::string sql = ("SELECT d.value, r.publicId FROM DicomIdentifiers AS d "
+                           "INDEXED BY DicomIdentifiersIndexValues "
+                           "INNER JOIN Resources AS r ON r.internalId = d.id "
+                           "WHERE r.resourceType=? AND d.tagGroup=? AND d.tagElement=? AND d.value IN (");
+
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+          sql += (i == 0 ? "?" : ",?");
+        }
+
+        sql += ")";
+
+        // Not cached, as the number of parameters depends on the batch
+        SQLite::Statement s(db_, sql);
+        s.BindInt(0, level);
+        s.BindInt(1, tag.GetGroup());
+        s.BindInt(2, tag.GetElement());
+
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+          s.BindString(3 + static_cast<int>(i), batch[i]);
+        }
+
+        while (s.Step())
+        {
+          target.insert(std::make_pair(s.ColumnString(0), s.ColumnString(1)));
+        }
+      }
+    }
+
+
+    virtual void GetAllPublicIdsAfter(std::list<std::string>& target,
+                                      ResourceType resourceType,
+                                      const std::string& after,
+                                      size_t limit) ORTHANC_OVERRIDE
+    {
+      target.clear();
+
+      if (limit == 0)
+      {
+        return;
+      }
+
+      // Walks the "PublicIndex" index
+      SQLite::Statement s(db_, SQLITE_FROM_HERE,
+                          "SELECT publicId FROM Resources WHERE "
+                          "resourceType=? AND publicId>? ORDER BY publicId LIMIT ?");
+      s.BindInt(0, resourceType);
+      s.BindString(1, after);
+      s.BindInt64(2, static_cast<int64_t>(limit));
+
+      while (s.Step())
+      {
+        target.push_back(s.ColumnString(0));
+      }
+    }
+
+
     // From the "ICreateInstance" interface
     virtual void AttachChild(int64_t parent,
                              int64_t child) ORTHANC_OVERRIDE
@@ -1022,7 +1119,7 @@ namespace Orthanc
                                  const DicomTag& tag,
                                  const std::string& value) ORTHANC_OVERRIDE
     {
-      SQLite::Statement s(db_, SQLITE_FROM_HERE, "INSERT INTO MainDicomTags VALUES(?, ?, ?, ?)");
+      SQLite::Statement s(db_, SQLITE_FROM_HERE, "INSERT INTO MainDicomTags (id, tagGroup, tagElement, value) VALUES(?, ?, ?, ?)");
       s.BindInt64(0, id);
       s.BindInt(1, tag.GetGroup());
       s.BindInt(2, tag.GetElement());
@@ -1174,7 +1271,7 @@ namespace Orthanc
   public:
     ReadWriteTransaction(SQLiteDatabaseWrapper& that,
                          IDatabaseListener& listener) :
-      TransactionBase(that.mutex_, that.db_, listener, *that.signalRemainingAncestor_),
+      TransactionBase(that.mutex_, that.db_, listener, *that.signalRemainingAncestor_, that.hasNormalizedKeys_),
       that_(that),
       transaction_(new SQLite::Transaction(that_.db_))
     {
@@ -1228,7 +1325,7 @@ namespace Orthanc
   public:
     ReadOnlyTransaction(SQLiteDatabaseWrapper& that,
                         IDatabaseListener& listener) :
-      TransactionBase(that.mutex_, that.db_, listener, *that.signalRemainingAncestor_),
+      TransactionBase(that.mutex_, that.db_, listener, *that.signalRemainingAncestor_, that.hasNormalizedKeys_),
       that_(that)
     {
       if (that_.activeTransaction_ != NULL)
@@ -1262,7 +1359,12 @@ namespace Orthanc
   SQLiteDatabaseWrapper::SQLiteDatabaseWrapper(const std::string& path) : 
     activeTransaction_(NULL), 
     signalRemainingAncestor_(NULL),
-    version_(0)
+    version_(0),
+    incrementalVacuum_(false),
+    hasIncrementalVacuum_(false),
+    lastTransaction_(boost::posix_time::microsec_clock::universal_time()),
+    hasNormalizedKeys_(false),
+    normalizedKeysProgress_(0)
   {
     db_.Open(path);
   }
@@ -1271,7 +1373,12 @@ namespace Orthanc
   SQLiteDatabaseWrapper::SQLiteDatabaseWrapper() : 
     activeTransaction_(NULL), 
     signalRemainingAncestor_(NULL),
-    version_(0)
+    version_(0),
+    incrementalVacuum_(false),
+    hasIncrementalVacuum_(false),
+    lastTransaction_(boost::posix_time::microsec_clock::universal_time()),
+    hasNormalizedKeys_(false),
+    normalizedKeysProgress_(0)
   {
     db_.OpenInMemory();
   }
@@ -1285,6 +1392,27 @@ namespace Orthanc
   }
 
 
+  static void InstallNormalizedKeys(SQLite::Connection& db)
+  {
+    if (!db.DoesTableExist("MainDicomTagsNormalized"))
+    {
+      LOG(INFO) << "Installing the SQLite table of the normalized keys of the main DICOM tags";
+      std::string query;
+      ServerResources::GetFileResource(query, ServerResources::INSTALL_NORMALIZED_KEYS);
+      db.Execute(query);
+    }
+  }
+
+
+  static void SetNormalizedKeysComplete(SQLite::Connection& db)
+  {
+    SQLite::Statement s(db, SQLITE_FROM_HERE, "INSERT OR REPLACE INTO GlobalProperties (property, value) VALUES(?, ?)");
+    s.BindInt(0, GlobalProperty_HasNormalizedKeys);
+    s.BindString(1, "1");
+    s.Run();
+  }
+
+
   void SQLiteDatabaseWrapper::Open()
   {
     {
@@ -1301,6 +1429,13 @@ namespace Orthanc
     
       db_.Execute("PRAGMA ENCODING=\"UTF-8\";");
 
+      if (incrementalVacuum_)
+      {
+        // New in Orthanc 1.11.0. This is only taken into account if
+        // the database is empty, i.e. before the tables are created.
+        db_.Execute("PRAGMA AUTO_VACUUM=INCREMENTAL;");
+      }
+
       // Performance tuning of SQLite with PRAGMAs
       // http://www.sqlite.org/pragma.html
       db_.Execute("PRAGMA SYNCHRONOUS=NORMAL;");
@@ -1361,10 +1496,51 @@ namespace Orthanc
           ServerResources::GetFileResource(query, ServerResources::INSTALL_TRACK_ATTACHMENTS_SIZE);
           db_.Execute(query);
         }
+
+        // New in Orthanc 1.11.0. The triggers keep the normalized keys
+        // up-to-date, but the keys of the main DICOM tags that already
+        // exist are computed in the background by "FlushToDisk()", so
+        // as not to scan the whole table at startup.
+        InstallNormalizedKeys(db_);
+
+        if (transaction->LookupGlobalProperty(tmp, GlobalProperty_HasNormalizedKeys, true /* unused in SQLite */) &&
+            tmp == "1")
+        {
+          hasNormalizedKeys_ = true;
+        }
+        else
+        {
+          SQLite::Statement s(db_, SQLITE_FROM_HERE, "SELECT 1 FROM MainDicomTags LIMIT 1");
+          if (s.Step())
+          {
+            LOG(WARNING) << "The normalized keys of the main DICOM tags will be computed in the background, "
+                         << "the prefix wildcards will use them once this is complete";
+          }
+          else
+          {
+            SetNormalizedKeysComplete(db_);  // Empty database
+            hasNormalizedKeys_ = true;
+          }
+        }
       }
 
       transaction->Commit(0);
     }
+
+    if (incrementalVacuum_)
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      // 2 corresponds to "INCREMENTAL" (0 is "NONE", 1 is "FULL")
+      hasIncrementalVacuum_ = (ReadPragma("auto_vacuum") == 2);
+
+      if (!hasIncrementalVacuum_)
+      {
+        LOG(WARNING) << "The SQLite index was created without incremental vacuum, it will "
+                     << "not shrink until Orthanc is stopped and the following commands are "
+                     << "executed once: PRAGMA auto_vacuum=INCREMENTAL; VACUUM;";
+      }
+    }
   }
 
 
@@ -1431,6 +1607,13 @@ namespace Orthanc
       
       {
         std::unique_ptr<ITransaction> transaction(StartTransaction(TransactionType_ReadWrite, listener));
+
+        // The triggers must exist before the main DICOM tags are
+        // reconstructed, and the background computation of the
+        // normalized keys will start once the schema is upgraded
+        InstallNormalizedKeys(db_);
+
+
         ServerToolbox::ReconstructMainDicomTags(*transaction, storageArea, ResourceType_Patient);
         ServerToolbox::ReconstructMainDicomTags(*transaction, storageArea, ResourceType_Study);
         ServerToolbox::ReconstructMainDicomTags(*transaction, storageArea, ResourceType_Series);
@@ -1451,13 +1634,19 @@ namespace Orthanc
     switch (type)
     {
       case TransactionType_ReadOnly:
-        return new ReadOnlyTransaction(*this, listener);  // This is a no-op transaction in SQLite (thanks to mutex)
+      {
+        // This is a no-op transaction in SQLite (thanks to mutex)
+        std::unique_ptr<ReadOnlyTransaction> transaction(new ReadOnlyTransaction(*this, listener));
+        lastTransaction_ = boost::posix_time::microsec_clock::universal_time();  // Protected by the mutex
+        return transaction.release();
+      }
 
       case TransactionType_ReadWrite:
       {
         std::unique_ptr<ReadWriteTransaction> transaction;
         transaction.reset(new ReadWriteTransaction(*this, listener));
         transaction->Begin();
+        lastTransaction_ = boost::posix_time::microsec_clock::universal_time();  // Protected by the mutex
         return transaction.release();
       }
 
@@ -1471,6 +1660,134 @@ namespace Orthanc
   {
     boost::mutex::scoped_lock lock(mutex_);
     db_.FlushToDisk();
+
+    if (version_ == 6 &&
+        !hasNormalizedKeys_)
+    {
+      FillNormalizedKeys();
+    }
+  }
+
+
+  void SQLiteDatabaseWrapper::FillNormalizedKeys()
+  {
+    // The mutex must be locked by the caller, which implies that no
+    // transaction is active. The batches are bounded so that the
+    // other transactions are not blocked for a long time.
+    static const unsigned int BATCH_SIZE = 1000;  // Number of resources
+
+    int64_t last;
+
+    {
+      SQLite::Statement s(db_, SQLITE_FROM_HERE,
+                          "SELECT MAX(internalId) FROM (SELECT internalId FROM Resources "
+                          "WHERE internalId > ? ORDER BY internalId LIMIT ?)");
+      s.BindInt64(0, normalizedKeysProgress_);
+      s.BindInt(1, BATCH_SIZE);
+
+      if (!s.Step() ||
+          s.ColumnIsNull(0))
+      {
+        SetNormalizedKeysComplete(db_);
+        hasNormalizedKeys_ = true;
+        LOG(WARNING) << "The normalized keys of the main DICOM tags are now available";
+        return;
+      }
+
+      last = s.ColumnInt64(0);
+    }
+
+    SQLite::Transaction transaction(db_);
+    transaction.Begin();
+
+    {
+      // The keys that were already stored by the triggers are kept
+      SQLite::Statement s(db_, SQLITE_FROM_HERE,
+                          "INSERT OR IGNORE INTO MainDicomTagsNormalized (id, tagGroup, tagElement, normalizedValue) "
+                          "SELECT id, tagGroup, tagElement, upper(value) FROM MainDicomTags WHERE id > ? AND id <= ?");
+      s.BindInt64(0, normalizedKeysProgress_);
+      s.BindInt64(1, last);
+      s.Run();
+    }
+
+    transaction.Commit();
+    normalizedKeysProgress_ = last;
+  }
+
+
+  int64_t SQLiteDatabaseWrapper::ReadPragma(const char* pragma)
+  {
+    // The mutex must be locked by the caller
+    SQLite::Statement s(db_, std::string("PRAGMA ") + pragma);
+    if (s.Step())
+    {
+      return s.ColumnInt64(0);
+    }
+    else
+    {
+      throw OrthancException(ErrorCode_Database);
+    }
+  }
+
+
+  void SQLiteDatabaseWrapper::SetIncrementalVacuum(bool enabled)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    if (signalRemainingAncestor_ != NULL)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);  // Already open
+    }
+    else
+    {
+      incrementalVacuum_ = enabled;
+    }
+  }
+
+
+  void SQLiteDatabaseWrapper::GetPagesCount(uint64_t& totalPages,
+                                            uint64_t& freePages)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    totalPages = static_cast<uint64_t>(ReadPragma("page_count"));
+    freePages = static_cast<uint64_t>(ReadPragma("freelist_count"));
+  }
+
+
+  bool SQLiteDatabaseWrapper::CompactIncrementally(unsigned int maxPages,
+                                                   unsigned int idleDelay)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    if (boost::posix_time::microsec_clock::universal_time() <
+        lastTransaction_ + boost::posix_time::milliseconds(idleDelay))
+    {
+      return false;  // Not idle
+    }
+    else
+    {
+      // This is a no-op if "auto_vacuum" is not set to "INCREMENTAL"
+      db_.Execute("PRAGMA incremental_vacuum(" + boost::lexical_cast<std::string>(maxPages) + ");");
+      return true;
+    }
+  }
+
+
+  void SQLiteDatabaseWrapper::Optimize()
+  {
+#if ORTHANC_SQLITE_VERSION >= 3032000
+    boost::mutex::scoped_lock lock(mutex_);
+
+    // Bound the number of rows that are scanned by "ANALYZE" for
+    // each index, which makes "optimize" fast even on large databases
+    db_.Execute("PRAGMA analysis_limit=1000;");
+    db_.Execute("PRAGMA optimize;");
+#else
+    // "analysis_limit" is only available since SQLite 3.32.0: Without
+    // it, "optimize" could scan whole tables and block the index
+    // for a long time, so it is skipped
+    LOG(INFO) << "Optimizing the SQLite index requires SQLite >= 3.32.0";
+#endif
   }
 
 
@@ -1512,7 +1829,7 @@ namespace Orthanc
                                                                     const DicomTag& tag,
                                                                     const std::string& value)
   {
-    SQLite::Statement s(db_, SQLITE_FROM_HERE, "INSERT INTO MainDicomTags VALUES(?, ?, ?, ?)");
+    SQLite::Statement s(db_, SQLITE_FROM_HERE, "INSERT INTO MainDicomTags (id, tagGroup, tagElement, value) VALUES(?, ?, ?, ?)");
     s.BindInt64(0, id);
     s.BindInt(1, tag.GetGroup());
     s.BindInt(2, tag.GetElement());
@@ -26,6 +26,7 @@
 
 #include "../../../OrthancFramework/Sources/SQLite/Connection.h"
 
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/thread/mutex.hpp>
 
 namespace Orthanc
@@ -51,6 +52,15 @@ namespace Orthanc
     TransactionBase*          activeTransaction_;
     SignalRemainingAncestor*  signalRemainingAncestor_;
     unsigned int              version_;
+    bool                      incrementalVacuum_;
+    bool                      hasIncrementalVacuum_;
+    boost::posix_time::ptime  lastTransaction_;
+    bool                      hasNormalizedKeys_;
+    int64_t                   normalizedKeysProgress_;
+
+    int64_t ReadPragma(const char* pragma);
+
+    void FillNormalizedKeys();
 
     void GetChangesInternal(std::list<ServerIndexChange>& target,
                             bool& done,
@@ -84,6 +94,25 @@ namespace Orthanc
       return true;
     }
 
+    // New in Orthanc 1.11.0: Must be called before "Open()". This
+    // sets "auto_vacuum" to "INCREMENTAL" for new databases.
+    void SetIncrementalVacuum(bool enabled);
+
+    // Only true if incremental vacuum was requested, and if the
+    // database file was actually created with "auto_vacuum=INCREMENTAL"
+    virtual bool HasIncrementalCompaction() const ORTHANC_OVERRIDE
+    {
+      return hasIncrementalVacuum_;
+    }
+
+    virtual void GetPagesCount(uint64_t& totalPages,
+                               uint64_t& freePages) ORTHANC_OVERRIDE;
+
+    virtual bool CompactIncrementally(unsigned int maxPages,
+                                      unsigned int idleDelay) ORTHANC_OVERRIDE;
+
+    virtual void Optimize() ORTHANC_OVERRIDE;
+
     virtual unsigned int GetDatabaseVersion() ORTHANC_OVERRIDE
     {
       return version_;
@@ -97,6 +126,11 @@ namespace Orthanc
       return false;  // TODO - REVISIONS
     }
 
+    virtual bool HasKeysetPagination() const ORTHANC_OVERRIDE
+    {
+      return true;
+    }
+
 
     /**
      * The "StartTransaction()" method is guaranteed to return a class
@@ -37,6 +37,7 @@
 #include "../ServerToolbox.h"
 #include "ResourcesContent.h"
 
+#include <algorithm>
 #include <boost/lexical_cast.hpp>
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
@@ -710,17 +711,12 @@ namespace Orthanc
   }
   
 
-  bool StatelessDatabaseOperations::ExpandResource(ExpandedResource& target,
-                                                   const std::string& publicId,
-                                                   ResourceType level,
-                                                   const std::set<DicomTag>& requestedTags,
-                                                   ExpandResourceDbFlags expandFlags)
-  {    
-    class Operations : public ReadOnlyOperationsT6<
-      bool&, ExpandedResource&, const std::string&, ResourceType, const std::set<DicomTag>&, ExpandResourceDbFlags>
+  namespace
+  {
+    // New in Orthanc 1.11.0: Shared by "ExpandResource()" and "ExpandResources()"
+    class ResourceExpander : public boost::noncopyable
     {
     private:
-  
       static bool LookupStringMetadata(std::string& result,
                                        const std::map<MetadataType, std::string>& metadata,
                                        MetadataType type)
@@ -762,208 +758,356 @@ namespace Orthanc
 
 
     public:
-      virtual void ApplyTuple(ReadOnlyTransaction& transaction,
-                              const Tuple& tuple) ORTHANC_OVERRIDE
-      {
-        // Lookup for the requested resource
-        int64_t internalId;
-        ResourceType type;
-        std::string parent;
-        if (!transaction.LookupResourceAndParent(internalId, type, parent, tuple.get<2>()) ||
-            type != tuple.get<3>())
-        {
-          tuple.get<0>() = false;
+      static void Expand(ExpandedResource& target,
+                         StatelessDatabaseOperations::ReadOnlyTransaction& transaction,
+                         int64_t internalId,
+                         ResourceType type,
+                         const std::string& parent,
+                         const std::string& publicId,
+                         const std::set<DicomTag>& requestedTags,
+                         ExpandResourceDbFlags expandFlags)
+      {
+        // Set information about the parent resource (if it exists)
+        if (type == ResourceType_Patient)
+        {
+          if (!parent.empty())
+          {
+            throw OrthancException(ErrorCode_DatabasePlugin);
+          }
         }
         else
         {
-          ExpandedResource& target = tuple.get<1>();
-          ExpandResourceDbFlags expandFlags = tuple.get<5>();
-
-          // Set information about the parent resource (if it exists)
-          if (type == ResourceType_Patient)
+          if (parent.empty())
           {
-            if (!parent.empty())
-            {
-              throw OrthancException(ErrorCode_DatabasePlugin);
-            }
+            throw OrthancException(ErrorCode_DatabasePlugin);
           }
-          else
-          {
-            if (parent.empty())
-            {
-              throw OrthancException(ErrorCode_DatabasePlugin);
-            }
 
-            target.parentId_ = parent;
-          }
+          target.parentId_ = parent;
+        }
 
-          target.type_ = type;
-          target.id_ = tuple.get<2>();
+        target.type_ = type;
+        target.id_ = publicId;
 
-          if (expandFlags & ExpandResourceDbFlags_IncludeChildren)
-          {
-            // List the children resources
-            transaction.GetChildrenPublicId(target.childrenIds_, internalId);
-          }
+        if (expandFlags & ExpandResourceDbFlags_IncludeChildren)
+        {
+          // List the children resources
+          transaction.GetChildrenPublicId(target.childrenIds_, internalId);
+        }
 
-          if (expandFlags & ExpandResourceDbFlags_IncludeMetadata)
+        if (expandFlags & ExpandResourceDbFlags_IncludeMetadata)
+        {
+          // Extract the metadata
+          transaction.GetAllMetadata(target.metadata_, internalId);
+
+          switch (type)
           {
-            // Extract the metadata
-            transaction.GetAllMetadata(target.metadata_, internalId);
+            case ResourceType_Patient:
+            case ResourceType_Study:
+              break;
 
-            switch (type)
+            case ResourceType_Series:
             {
-              case ResourceType_Patient:
-              case ResourceType_Study:
-                break;
-
-              case ResourceType_Series:
+              int64_t i;
+              if (LookupIntegerMetadata(i, target.metadata_, MetadataType_Series_ExpectedNumberOfInstances))
               {
-                int64_t i;
-                if (LookupIntegerMetadata(i, target.metadata_, MetadataType_Series_ExpectedNumberOfInstances))
-                {
-                  target.expectedNumberOfInstances_ = static_cast<int>(i);
-                  target.status_ = EnumerationToString(transaction.GetSeriesStatus(internalId, i));
-                }
-                else
-                {
-                  target.expectedNumberOfInstances_ = -1;
-                  target.status_ = EnumerationToString(SeriesStatus_Unknown);
-                }
-
-                break;
+                target.expectedNumberOfInstances_ = static_cast<int>(i);
+                target.status_ = EnumerationToString(transaction.GetSeriesStatus(internalId, i));
               }
-
-              case ResourceType_Instance:
+              else
               {
-                FileInfo attachment;
-                int64_t revision;  // ignored
-                if (!transaction.LookupAttachment(attachment, revision, internalId, FileContentType_Dicom))
-                {
-                  throw OrthancException(ErrorCode_InternalError);
-                }
+                target.expectedNumberOfInstances_ = -1;
+                target.status_ = EnumerationToString(SeriesStatus_Unknown);
+              }
 
-                target.fileSize_ = static_cast<unsigned int>(attachment.GetUncompressedSize());
-                target.fileUuid_ = attachment.GetUuid();
+              break;
+            }
 
-                int64_t i;
-                if (LookupIntegerMetadata(i, target.metadata_, MetadataType_Instance_IndexInSeries))
-                {
-                  target.indexInSeries_ = static_cast<int>(i);
-                }
-                else
-                {
-                  target.indexInSeries_ = -1;
-                }
+            case ResourceType_Instance:
+            {
+              FileInfo attachment;
+              int64_t revision;  // ignored
+              if (!transaction.LookupAttachment(attachment, revision, internalId, FileContentType_Dicom))
+              {
+                throw OrthancException(ErrorCode_InternalError);
+              }
 
-                break;
+              target.fileSize_ = static_cast<unsigned int>(attachment.GetUncompressedSize());
+              target.fileUuid_ = attachment.GetUuid();
+
+              int64_t i;
+              if (LookupIntegerMetadata(i, target.metadata_, MetadataType_Instance_IndexInSeries))
+              {
+                target.indexInSeries_ = static_cast<int>(i);
+              }
+              else
+              {
+                target.indexInSeries_ = -1;
               }
 
-              default:
-                throw OrthancException(ErrorCode_InternalError);
+              break;
             }
 
-            // check the main dicom tags list has not changed since the resource was stored
-            target.mainDicomTagsSignature_ = DicomMap::GetDefaultMainDicomTagsSignature(type);
-            LookupStringMetadata(target.mainDicomTagsSignature_, target.metadata_, MetadataType_MainDicomTagsSignature);
+            default:
+              throw OrthancException(ErrorCode_InternalError);
           }
 
-          if (expandFlags & ExpandResourceDbFlags_IncludeMainDicomTags)
+          // check the main dicom tags list has not changed since the resource was stored
+          target.mainDicomTagsSignature_ = DicomMap::GetDefaultMainDicomTagsSignature(type);
+          LookupStringMetadata(target.mainDicomTagsSignature_, target.metadata_, MetadataType_MainDicomTagsSignature);
+        }
+
+        if (expandFlags & ExpandResourceDbFlags_IncludeMainDicomTags)
+        {
+          // read all tags from DB
+          transaction.GetMainDicomTags(target.tags_, internalId);
+
+          // check if we have access to all requestedTags or if we must get tags from parents
+          if (requestedTags.size() > 0)
           {
-            // read all tags from DB
-            transaction.GetMainDicomTags(target.tags_, internalId);
+            std::set<DicomTag> savedMainDicomTags;
+            
+            FromDcmtkBridge::ParseListOfTags(savedMainDicomTags, target.mainDicomTagsSignature_);
 
-            // check if we have access to all requestedTags or if we must get tags from parents
-            const std::set<DicomTag>& requestedTags = tuple.get<4>();
+            // read parent main dicom tags as long as we don't have gathered all requested tags
+            ResourceType currentLevel = target.type_;
+            int64_t currentInternalId = internalId;
+            Toolbox::GetMissingsFromSet(target.missingRequestedTags_, requestedTags, savedMainDicomTags);
 
-            if (requestedTags.size() > 0)
+            while ((target.missingRequestedTags_.size() > 0)
+                  && currentLevel != ResourceType_Patient)
             {
-              std::set<DicomTag> savedMainDicomTags;
-              
-              FromDcmtkBridge::ParseListOfTags(savedMainDicomTags, target.mainDicomTagsSignature_);
-
-              // read parent main dicom tags as long as we don't have gathered all requested tags
-              ResourceType currentLevel = target.type_;
-              int64_t currentInternalId = internalId;
-              Toolbox::GetMissingsFromSet(target.missingRequestedTags_, requestedTags, savedMainDicomTags);
+              currentLevel = GetParentResourceType(currentLevel);
 
-              while ((target.missingRequestedTags_.size() > 0)
-                    && currentLevel != ResourceType_Patient)
+              int64_t currentParentId;
+              if (!transaction.LookupParent(currentParentId, currentInternalId))
               {
-                currentLevel = GetParentResourceType(currentLevel);
+                break;
+              }
 
-                int64_t currentParentId;
-                if (!transaction.LookupParent(currentParentId, currentInternalId))
-                {
-                  break;
-                }
+              std::map<MetadataType, std::string> parentMetadata;
+              transaction.GetAllMetadata(parentMetadata, currentParentId);
 
-                std::map<MetadataType, std::string> parentMetadata;
-                transaction.GetAllMetadata(parentMetadata, currentParentId);
+              std::string parentMainDicomTagsSignature = DicomMap::GetDefaultMainDicomTagsSignature(currentLevel);
+              LookupStringMetadata(parentMainDicomTagsSignature, parentMetadata, MetadataType_MainDicomTagsSignature);
 
-                std::string parentMainDicomTagsSignature = DicomMap::GetDefaultMainDicomTagsSignature(currentLevel);
-                LookupStringMetadata(parentMainDicomTagsSignature, parentMetadata, MetadataType_MainDicomTagsSignature);
+              std::set<DicomTag> parentSavedMainDicomTags;
+              FromDcmtkBridge::ParseListOfTags(parentSavedMainDicomTags, parentMainDicomTagsSignature);
+              
+              size_t previousMissingCount = target.missingRequestedTags_.size();
+              Toolbox::AppendSets(savedMainDicomTags, parentSavedMainDicomTags);
+              Toolbox::GetMissingsFromSet(target.missingRequestedTags_, requestedTags, savedMainDicomTags);
 
-                std::set<DicomTag> parentSavedMainDicomTags;
-                FromDcmtkBridge::ParseListOfTags(parentSavedMainDicomTags, parentMainDicomTagsSignature);
-                
-                size_t previousMissingCount = target.missingRequestedTags_.size();
+              // read the parent tags from DB only if it reduces the number of missing tags
+              if (target.missingRequestedTags_.size() < previousMissingCount)
+              { 
                 Toolbox::AppendSets(savedMainDicomTags, parentSavedMainDicomTags);
-                Toolbox::GetMissingsFromSet(target.missingRequestedTags_, requestedTags, savedMainDicomTags);
 
-                // read the parent tags from DB only if it reduces the number of missing tags
-                if (target.missingRequestedTags_.size() < previousMissingCount)
-                { 
-                  Toolbox::AppendSets(savedMainDicomTags, parentSavedMainDicomTags);
+                DicomMap parentTags;
+                transaction.GetMainDicomTags(parentTags, currentParentId);
 
-                  DicomMap parentTags;
-                  transaction.GetMainDicomTags(parentTags, currentParentId);
-
-                  target.tags_.Merge(parentTags);
-                }
-
-                currentInternalId = currentParentId;
+                target.tags_.Merge(parentTags);
               }
+
+              currentInternalId = currentParentId;
             }
           }
+        }
 
-          std::string tmp;
+        std::string tmp;
 
-          if (LookupStringMetadata(tmp, target.metadata_, MetadataType_AnonymizedFrom))
+        if (LookupStringMetadata(tmp, target.metadata_, MetadataType_AnonymizedFrom))
+        {
+          target.anonymizedFrom_ = tmp;
+        }
+
+        if (LookupStringMetadata(tmp, target.metadata_, MetadataType_ModifiedFrom))
+        {
+          target.modifiedFrom_ = tmp;
+        }
+
+        if (type == ResourceType_Patient ||
+            type == ResourceType_Study ||
+            type == ResourceType_Series)
+        {
+          target.isStable_ = !transaction.GetTransactionContext().IsUnstableResource(internalId);
+
+          if (LookupStringMetadata(tmp, target.metadata_, MetadataType_LastUpdate))
           {
-            target.anonymizedFrom_ = tmp;
+            target.lastUpdate_ = tmp;
           }
+        }
+        else
+        {
+          target.isStable_ = false;
+        }
+      }
+    };
+  }
+
+
+  bool StatelessDatabaseOperations::ExpandResource(ExpandedResource& target,
+                                                   const std::string& publicId,
+                                                   ResourceType level,
+                                                   const std::set<DicomTag>& requestedTags,
+                                                   ExpandResourceDbFlags expandFlags)
+  {    
+    class Operations : public ReadOnlyOperationsT6<
+      bool&, ExpandedResource&, const std::string&, ResourceType, const std::set<DicomTag>&, ExpandResourceDbFlags>
+    {
+    public:
+      virtual void ApplyTuple(ReadOnlyTransaction& transaction,
+                              const Tuple& tuple) ORTHANC_OVERRIDE
+      {
+        // Lookup for the requested resource
+        int64_t internalId;
+        ResourceType type;
+        std::string parent;
+        if (!transaction.LookupResourceAndParent(internalId, type, parent, tuple.get<2>()) ||
+            type != tuple.get<3>())
+        {
+          tuple.get<0>() = false;
+        }
+        else
+        {
+          ResourceExpander::Expand(tuple.get<1>(), transaction, internalId, type, parent,
+                                   tuple.get<2>(), tuple.get<4>(), tuple.get<5>());
+          tuple.get<0>() = true;
+        }
+      }
+    };
 
-          if (LookupStringMetadata(tmp, target.metadata_, MetadataType_ModifiedFrom))
+    bool found;
+    Operations operations;
+    operations.Apply(*this, found, target, publicId, level, requestedTags, expandFlags);
+    return found;
+  }
+
+
+  void StatelessDatabaseOperations::ExpandResources(IExpandedResourceVisitor& visitor,
+                                                    const std::list<std::string>& publicIds,
+                                                    const std::set<DicomTag>& requestedTags,
+                                                    ExpandResourceDbFlags expandFlags)
+  {
+    class Operations : public ReadOnlyOperationsT4<
+      IExpandedResourceVisitor&, const std::list<std::string>&, const std::set<DicomTag>&, ExpandResourceDbFlags>
+    {
+    public:
+      virtual void ApplyTuple(ReadOnlyTransaction& transaction,
+                              const Tuple& tuple) ORTHANC_OVERRIDE
+      {
+        const std::list<std::string>& publicIds = tuple.get<1>();
+
+        for (std::list<std::string>::const_iterator it = publicIds.begin(); it != publicIds.end(); ++it)
+        {
+          int64_t internalId;
+          ResourceType type;
+          std::string parent;
+          if (transaction.LookupResourceAndParent(internalId, type, parent, *it))
           {
-            target.modifiedFrom_ = tmp;
+            ExpandedResource resource;
+            ResourceExpander::Expand(resource, transaction, internalId, type, parent,
+                                     *it, tuple.get<2>(), tuple.get<3>());
+            tuple.get<0>().Visit(resource);
           }
+        }
+      }
+    };
+
+    Operations operations;
+    operations.Apply(*this, visitor, publicIds, requestedTags, expandFlags);
+  }
 
-          if (type == ResourceType_Patient ||
-              type == ResourceType_Study ||
-              type == ResourceType_Series)
+
+  void StatelessDatabaseOperations::LookupResourcesAtLevel(std::set<std::string>& target,
+                                                           const std::set<std::string>& resources,
+                                                           ResourceType level)
+  {
+    class Operations : public ReadOnlyOperationsT3<std::set<std::string>&, const std::set<std::string>&, ResourceType>
+    {
+    public:
+      virtual void ApplyTuple(ReadOnlyTransaction& transaction,
+                              const Tuple& tuple) ORTHANC_OVERRIDE
+      {
+        std::set<std::string>& target = tuple.get<0>();
+        const ResourceType level = tuple.get<2>();
+
+        assert(ResourceType_Patient < ResourceType_Study &&
+               ResourceType_Study < ResourceType_Series &&
+               ResourceType_Series < ResourceType_Instance);
+
+        target.clear();
+
+        for (std::set<std::string>::const_iterator it = tuple.get<1>().begin(); it != tuple.get<1>().end(); ++it)
+        {
+          int64_t internalId;
+          ResourceType type;
+          if (!transaction.LookupResource(internalId, type, *it))
           {
-            target.isStable_ = !transaction.GetTransactionContext().IsUnstableResource(internalId);
+            continue;  // Unknown resource
+          }
+          else if (type == level)
+          {
+            // This resource is already from the level of interest
+            target.insert(*it);
+          }
+          else if (type < level)
+          {
+            // Need to explore children
+            std::list<int64_t> current;
+            current.push_back(internalId);
 
-            if (LookupStringMetadata(tmp, target.metadata_, MetadataType_LastUpdate))
+            for (;;)
             {
-              target.lastUpdate_ = tmp;
+              type = GetChildResourceType(type);
+
+              if (type == level)
+              {
+                for (std::list<int64_t>::const_iterator parent = current.begin(); parent != current.end(); ++parent)
+                {
+                  std::list<std::string> children;
+                  transaction.GetChildrenPublicId(children, *parent);
+                  target.insert(children.begin(), children.end());
+                }
+
+                break;  // done
+              }
+              else
+              {
+                std::list<int64_t> next;
+
+                for (std::list<int64_t>::const_iterator parent = current.begin(); parent != current.end(); ++parent)
+                {
+                  std::list<int64_t> children;
+                  transaction.GetChildrenInternalId(children, *parent);
+                  next.splice(next.end(), children);
+                }
+
+                current.swap(next);
+              }
             }
           }
           else
           {
-            target.isStable_ = false;
-          }
+            // Need to explore parents
+            int64_t parentId;
+            while (type != level &&
+                   transaction.LookupParent(parentId, internalId))
+            {
+              internalId = parentId;
+              type = GetParentResourceType(type);
+            }
 
-          tuple.get<0>() = true;
+            if (type == level)
+            {
+              target.insert(transaction.GetPublicId(internalId));
+            }
+          }
         }
       }
     };
 
-    bool found;
     Operations operations;
-    operations.Apply(*this, found, target, publicId, level, requestedTags, expandFlags);
-    return found;
+    operations.Apply(*this, target, resources, level);
   }
 
 
@@ -1079,6 +1223,94 @@ namespace Orthanc
   }
 
 
+  void StatelessDatabaseOperations::GetUuidsAfter(std::list<std::string>& target,
+                                                  ResourceType resourceType,
+                                                  const std::string& after,
+                                                  size_t limit)
+  {
+    if (limit == 0)
+    {
+      target.clear();
+    }
+    else
+    {
+      class Operations : public ReadOnlyOperationsT4<std::list<std::string>&, ResourceType, const std::string&, size_t>
+      {
+      public:
+        virtual void ApplyTuple(ReadOnlyTransaction& transaction,
+                                const Tuple& tuple) ORTHANC_OVERRIDE
+        {
+          transaction.GetAllPublicIdsAfter(tuple.get<0>(), tuple.get<1>(), tuple.get<2>(), tuple.get<3>());
+        }
+      };
+
+      Operations operations;
+      operations.Apply(*this, target, resourceType, after, limit);
+    }
+  }
+
+
+  StatelessDatabaseOperations::UuidsPager::UuidsPager(StatelessDatabaseOperations& index,
+                                                      ResourceType level,
+                                                      size_t pageSize) :
+    index_(index),
+    level_(level),
+    pageSize_(pageSize),
+    hasSnapshot_(false),
+    position_(0)
+  {
+    if (pageSize == 0)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+  }
+
+
+  bool StatelessDatabaseOperations::UuidsPager::GetNextPage(std::list<std::string>& page)
+  {
+    page.clear();
+
+    if (index_.HasKeysetPagination())
+    {
+      index_.GetUuidsAfter(page, level_, last_, pageSize_);
+    }
+    else
+    {
+      if (!hasSnapshot_)
+      {
+        std::list<std::string> all;
+        index_.GetAllUuids(all, level_);
+
+        snapshot_.assign(all.begin(), all.end());
+        std::sort(snapshot_.begin(), snapshot_.end());
+        hasSnapshot_ = true;
+        position_ = 0;
+      }
+
+      while (position_ < snapshot_.size() &&
+             page.size() < pageSize_)
+      {
+        page.push_back(snapshot_[position_]);
+        position_++;
+      }
+    }
+
+    if (page.empty())
+    {
+      // End of the pass: Start again from the beginning at the next call
+      last_.clear();
+      hasSnapshot_ = false;
+      snapshot_.clear();
+      return false;
+    }
+    else
+    {
+      last_ = page.back();
+      return true;
+    }
+  }
+
+
   void StatelessDatabaseOperations::GetGlobalStatistics(/* out */ uint64_t& diskSize,
                                                         /* out */ uint64_t& uncompressedSize,
                                                         /* out */ uint64_t& countPatients, 
@@ -1644,6 +1876,82 @@ namespace Orthanc
   }
 
 
+  void StatelessDatabaseOperations::LookupIdentifiersExact(std::multimap<std::string, std::string>& result,
+                                                           ResourceType level,
+                                                           const DicomTag& tag,
+                                                           const std::set<std::string>& values)
+  {
+    assert((level == ResourceType_Patient && tag == DICOM_TAG_PATIENT_ID) ||
+           (level == ResourceType_Study && tag == DICOM_TAG_STUDY_INSTANCE_UID) ||
+           (level == ResourceType_Study && tag == DICOM_TAG_ACCESSION_NUMBER) ||
+           (level == ResourceType_Series && tag == DICOM_TAG_SERIES_INSTANCE_UID) ||
+           (level == ResourceType_Instance && tag == DICOM_TAG_SOP_INSTANCE_UID));
+    
+    result.clear();
+
+    // Several values might share the same normalized form
+    typedef std::multimap<std::string, std::string>  Normalization;
+    
+    Normalization normalized;
+    std::set<std::string> query;
+
+    for (std::set<std::string>::const_iterator it = values.begin(); it != values.end(); ++it)
+    {
+      const std::string s = ServerToolbox::NormalizeIdentifier(*it);
+      normalized.insert(std::make_pair(s, *it));
+      query.insert(s);
+    }
+
+    if (query.empty())
+    {
+      return;
+    }
+
+
+    class Operations : public IReadOnlyOperations
+    {
+    private:
+      std::multimap<std::string, std::string>&  target_;
+      const std::set<std::string>&              query_;
+      ResourceType                              level_;
+      const DicomTag&                           tag_;
+      
+    public:
+      Operations(std::multimap<std::string, std::string>& target,
+                 const std::set<std::string>& query,
+                 ResourceType level,
+                 const DicomTag& tag) :
+        target_(target),
+        query_(query),
+        level_(level),
+        tag_(tag)
+      {
+      }
+
+      virtual void Apply(ReadOnlyTransaction& transaction) ORTHANC_OVERRIDE
+      {
+        transaction.LookupIdentifiersExact(target_, level_, tag_, query_);
+      }
+    };
+
+    std::multimap<std::string, std::string> found;
+    
+    Operations operations(found, query, level, tag);
+    Apply(operations);
+
+    for (std::multimap<std::string, std::string>::const_iterator it = found.begin(); it != found.end(); ++it)
+    {
+      std::pair<Normalization::const_iterator, Normalization::const_iterator>
+        range = normalized.equal_range(it->first);
+      
+      for (Normalization::const_iterator value = range.first; value != range.second; ++value)
+      {
+        result.insert(std::make_pair(value->second, it->second));
+      }
+    }
+  }
+
+
   bool StatelessDatabaseOperations::LookupGlobalProperty(std::string& value,
                                                          GlobalProperty property,
                                                          bool shared)
@@ -2563,58 +2871,65 @@ namespace Orthanc
                                               ChangeType changeType,
                                               const std::string& publicId,
                                               ResourceType level)
+  {
+    std::vector<ChangeToLog> changes;
+    changes.push_back(ChangeToLog(internalId, changeType, publicId, level));
+    LogChanges(changes);
+  }
+
+
+  void StatelessDatabaseOperations::LogChanges(const std::vector<ChangeToLog>& changes)
   {
     class Operations : public IReadWriteOperations
     {
     private:
-      int64_t             internalId_;
-      ChangeType          changeType_;
-      const std::string&  publicId_;
-      ResourceType        level_;
+      const std::vector<ChangeToLog>&  changes_;
       
     public:
-      Operations(int64_t internalId,
-                 ChangeType changeType,
-                 const std::string& publicId,
-                 ResourceType level) :
-        internalId_(internalId),
-        changeType_(changeType),
-        publicId_(publicId),
-        level_(level)
+      explicit Operations(const std::vector<ChangeToLog>& changes) :
+        changes_(changes)
       {
       }
         
       virtual void Apply(ReadWriteTransaction& transaction) ORTHANC_OVERRIDE
       {
-        int64_t id;
-        ResourceType type;
-        if (transaction.LookupResource(id, type, publicId_) &&
-            id == internalId_)
+        for (size_t i = 0; i < changes_.size(); i++)
         {
-          /**
-           * Make sure that the resource is still existing, with the
-           * same internal ID, which indicates the absence of bouncing
-           * (if deleting then recreating the same resource). Don't
-           * throw an exception if the resource has been deleted,
-           * because this function might e.g. be called from
-           * "StatelessDatabaseOperations::UnstableResourcesMonitorThread()"
-           * (for which a deleted resource is *not* an error case).
-           **/
-          if (type == level_)
-          {
-            transaction.LogChange(id, changeType_, type, publicId_);
-          }
-          else
+          const ChangeToLog& change = changes_[i];
+
+          int64_t id;
+          ResourceType type;
+          if (transaction.LookupResource(id, type, change.GetPublicId()) &&
+              id == change.GetInternalId())
           {
-            // Consistency check
-            throw OrthancException(ErrorCode_UnknownResource);
+            /**
+             * Make sure that the resource is still existing, with the
+             * same internal ID, which indicates the absence of bouncing
+             * (if deleting then recreating the same resource). Don't
+             * throw an exception if the resource has been deleted,
+             * because this function might e.g. be called from
+             * "ServerIndex::UnstableResourcesMonitorThread()" (for
+             * which a deleted resource is *not* an error case).
+             **/
+            if (type == change.GetLevel())
+            {
+              transaction.LogChange(id, change.GetChangeType(), type, change.GetPublicId());
+            }
+            else
+            {
+              // Consistency check
+              throw OrthancException(ErrorCode_UnknownResource);
+            }
           }
         }
       }
     };
 
-    Operations operations(internalId, changeType, publicId, level);
-    Apply(operations);
+    if (!changes.empty())
+    {
+      Operations operations(changes);
+      Apply(operations);
+    }
   }
 
 
@@ -2851,7 +3166,8 @@ namespace Orthanc
                                                  uint64_t pixelDataOffset,
                                                  uint64_t maximumStorageSize,
                                                  unsigned int maximumPatients,
-                                                 bool isReconstruct)
+                                                 bool isReconstruct,
+                                                 const std::string& expectedDicomUuid)
   {
     class Operations : public IReadWriteOperations
     {
@@ -2870,6 +3186,7 @@ namespace Orthanc
       uint64_t                             maximumStorageSize_;
       unsigned int                         maximumPatientCount_;
       bool                                 isReconstruct_;
+      const std::string&                   expectedDicomUuid_;
 
       // Auto-computed fields
       bool          hasExpectedInstances_;
@@ -2958,7 +3275,8 @@ namespace Orthanc
                  uint64_t pixelDataOffset,
                  uint64_t maximumStorageSize,
                  unsigned int maximumPatientCount,
-                 bool isReconstruct) :
+                 bool isReconstruct,
+                 const std::string& expectedDicomUuid) :
         storeStatus_(StoreStatus_Failure),
         instanceMetadata_(instanceMetadata),
         dicomSummary_(dicomSummary),
@@ -2972,7 +3290,8 @@ namespace Orthanc
         pixelDataOffset_(pixelDataOffset),
         maximumStorageSize_(maximumStorageSize),
         maximumPatientCount_(maximumPatientCount),
-        isReconstruct_(isReconstruct)
+        isReconstruct_(isReconstruct),
+        expectedDicomUuid_(expectedDicomUuid)
       {
         hasExpectedInstances_ = ComputeExpectedNumberOfInstances(expectedInstances_, dicomSummary);
     
@@ -2997,6 +3316,23 @@ namespace Orthanc
           IDatabaseWrapper::CreateInstanceResult status;
           int64_t instanceId;
 
+          if (!expectedDicomUuid_.empty())
+          {
+            // Compare-and-swap: Only replace the instance if its DICOM
+            // file has not been changed or removed in the meantime
+            ResourceType type;
+            FileInfo current;
+            int64_t revision;
+            if (!transaction.LookupResource(instanceId, type, hashInstance_) ||
+                type != ResourceType_Instance ||
+                !transaction.LookupAttachment(current, revision, instanceId, FileContentType_Dicom) ||
+                current.GetUuid() != expectedDicomUuid_)
+            {
+              storeStatus_ = StoreStatus_AlreadyStored;
+              return;
+            }
+          }
+
           // Check whether this instance is already stored
           if (!transaction.CreateInstance(status, instanceId, hashPatient_,
                                           hashStudy_, hashSeries_, hashInstance_))
@@ -3275,7 +3611,8 @@ namespace Orthanc
 
     Operations operations(instanceMetadata, dicomSummary, attachments, metadata, origin,
                           overwrite, hasTransferSyntax, transferSyntax, hasPixelDataOffset,
-                          pixelDataOffset, maximumStorageSize, maximumPatients, isReconstruct);
+                          pixelDataOffset, maximumStorageSize, maximumPatients, isReconstruct,
+                          expectedDicomUuid);
     Apply(operations);
     return operations.GetStoreStatus();
   }
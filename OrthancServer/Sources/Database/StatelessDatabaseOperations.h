@@ -29,6 +29,7 @@
 
 #include <boost/shared_ptr.hpp>
 #include <boost/thread/shared_mutex.hpp>
+#include <vector>
 
 
 namespace Orthanc
@@ -82,6 +83,48 @@ namespace Orthanc
     typedef std::list<FileInfo> Attachments;
     typedef std::map<std::pair<ResourceType, MetadataType>, std::string>  MetadataMap;
 
+    // New in Orthanc 1.11.0
+    class ChangeToLog
+    {
+    private:
+      int64_t       internalId_;
+      ChangeType    changeType_;
+      std::string   publicId_;
+      ResourceType  level_;
+
+    public:
+      ChangeToLog(int64_t internalId,
+                  ChangeType changeType,
+                  const std::string& publicId,
+                  ResourceType level) :
+        internalId_(internalId),
+        changeType_(changeType),
+        publicId_(publicId),
+        level_(level)
+      {
+      }
+
+      int64_t GetInternalId() const
+      {
+        return internalId_;
+      }
+
+      ChangeType GetChangeType() const
+      {
+        return changeType_;
+      }
+
+      const std::string& GetPublicId() const
+      {
+        return publicId_;
+      }
+
+      ResourceType GetLevel() const
+      {
+        return level_;
+      }
+    };
+
     class ITransactionContext : public IDatabaseListener
     {
     public:
@@ -182,6 +225,14 @@ namespace Orthanc
         return transaction_.GetAllPublicIds(target, resourceType, since, limit);
       }  
 
+      void GetAllPublicIdsAfter(std::list<std::string>& target,
+                                ResourceType resourceType,
+                                const std::string& after,
+                                size_t limit)
+      {
+        return transaction_.GetAllPublicIdsAfter(target, resourceType, after, limit);
+      }
+
       void GetChanges(std::list<ServerIndexChange>& target /*out*/,
                       bool& done /*out*/,
                       int64_t since,
@@ -310,6 +361,14 @@ namespace Orthanc
       {
         return transaction_.LookupResourceAndParent(id, type, parentPublicId, publicId);
       }
+
+      void LookupIdentifiersExact(std::multimap<std::string, std::string>& target,
+                                  ResourceType level,
+                                  const DicomTag& tag,
+                                  const std::set<std::string>& values)
+      {
+        transaction_.LookupIdentifiersExact(target, level, tag, values);
+      }
     };
 
 
@@ -434,6 +493,20 @@ namespace Orthanc
 
       virtual void Apply(ReadWriteTransaction& transaction) = 0;
     };
+
+
+    // New in Orthanc 1.11.0
+    class IExpandedResourceVisitor : public boost::noncopyable
+    {
+    public:
+      virtual ~IExpandedResourceVisitor()
+      {
+      }
+
+      // This method is invoked while the read-only transaction is
+      // running: It must be fast, and it must not access the index
+      virtual void Visit(ExpandedResource& resource) = 0;
+    };
     
 
   private:
@@ -483,6 +556,35 @@ namespace Orthanc
       return hasFlushToDisk_;
     }
 
+    // New in Orthanc 1.11.0: Online compaction of the database
+    bool HasIncrementalCompaction() const
+    {
+      return db_.HasIncrementalCompaction();
+    }
+
+    // New in Orthanc 1.11.0
+    bool HasKeysetPagination() const
+    {
+      return db_.HasKeysetPagination();
+    }
+
+    void GetDatabasePagesCount(uint64_t& totalPages,
+                               uint64_t& freePages)
+    {
+      db_.GetPagesCount(totalPages, freePages);
+    }
+
+    bool CompactDatabaseIncrementally(unsigned int maxPages,
+                                      unsigned int idleDelay)
+    {
+      return db_.CompactIncrementally(maxPages, idleDelay);
+    }
+
+    void OptimizeDatabase()
+    {
+      db_.Optimize();
+    }
+
     void Apply(IReadOnlyOperations& operations);
   
     void Apply(IReadWriteOperations& operations);
@@ -493,6 +595,21 @@ namespace Orthanc
                         const std::set<DicomTag>& requestedTags,
                         ExpandResourceDbFlags expandFlags);
 
+    // New in Orthanc 1.11.0: Expand a batch of resources using one
+    // single read-only transaction. The resources that do not exist
+    // anymore are skipped.
+    void ExpandResources(IExpandedResourceVisitor& visitor,
+                         const std::list<std::string>& publicIds,
+                         const std::set<DicomTag>& requestedTags,
+                         ExpandResourceDbFlags expandFlags);
+
+    // New in Orthanc 1.11.0: Explore the DICOM hierarchy upward or
+    // downward from each of the "resources", in order to find the
+    // resources at the given level, in one single transaction
+    void LookupResourcesAtLevel(std::set<std::string>& target,
+                                const std::set<std::string>& resources,
+                                ResourceType level);
+
     void GetAllMetadata(std::map<MetadataType, std::string>& target,
                         const std::string& publicId,
                         ResourceType level);
@@ -505,6 +622,46 @@ namespace Orthanc
                      size_t since,
                      size_t limit);
 
+    // New in Orthanc 1.11.0. Keyset pagination: Lists at most "limit"
+    // resources whose public ID is strictly greater than "after" (use
+    // an empty string for the first page). The next page starts
+    // after the last item of "target".
+    void GetUuidsAfter(std::list<std::string>& target,
+                       ResourceType resourceType,
+                       const std::string& after,
+                       size_t limit);
+
+    /**
+     * New in Orthanc 1.11.0: Walks through all the resources of one
+     * level by increasing public ID, one page at a time. If the
+     * database engine has no native keyset pagination (which is the
+     * case of the database plugins), the sorted list of the public
+     * IDs is retrieved once at the beginning of each pass, and the
+     * pages are read from this snapshot, so that a pass is not
+     * quadratic in the number of resources. The resources that are
+     * created during such a pass are only seen by the next pass.
+     **/
+    class UuidsPager : public boost::noncopyable
+    {
+    private:
+      StatelessDatabaseOperations&  index_;
+      ResourceType                  level_;
+      size_t                        pageSize_;
+      std::string                   last_;
+      bool                          hasSnapshot_;
+      std::vector<std::string>      snapshot_;
+      size_t                        position_;
+
+    public:
+      UuidsPager(StatelessDatabaseOperations& index,
+                 ResourceType level,
+                 size_t pageSize);
+
+      // Returns "false" once the pass is complete, in which case the
+      // next call starts a new pass from the beginning of the index
+      bool GetNextPage(std::list<std::string>& page);
+    };
+
     void GetGlobalStatistics(/* out */ uint64_t& diskSize,
                              /* out */ uint64_t& uncompressedSize,
                              /* out */ uint64_t& countPatients, 
@@ -565,6 +722,15 @@ namespace Orthanc
                                const DicomTag& tag,
                                const std::string& value);
 
+    // New in Orthanc 1.11.0. Looks up a whole set of identifiers in
+    // one single transaction. The "result" maps each value of
+    // "values" to the public IDs of the matching resources (values
+    // that do not match any resource are absent from "result").
+    void LookupIdentifiersExact(std::multimap<std::string, std::string>& result,
+                                ResourceType level,
+                                const DicomTag& tag,
+                                const std::set<std::string>& values);
+
     bool LookupGlobalProperty(std::string& value,
                               GlobalProperty property,
                               bool shared);
@@ -646,8 +812,18 @@ namespace Orthanc
                    const std::string& publicId,
                    ResourceType level);
 
+    // Log a batch of changes in one single transaction (new in
+    // Orthanc 1.11.0). The changes about resources that have been
+    // deleted in the meantime are ignored.
+    void LogChanges(const std::vector<ChangeToLog>& changes);
+
     void ReconstructInstance(const ParsedDicomFile& dicom);
 
+    // If "expectedDicomUuid" is not empty (new in Orthanc 1.11.0),
+    // the instance is only overwritten if its current DICOM
+    // attachment has this UUID. Otherwise, the index is left
+    // unchanged and "StoreStatus_AlreadyStored" is returned. This
+    // compare-and-swap is done in the same transaction as the store.
     StoreStatus Store(std::map<MetadataType, std::string>& instanceMetadata,
                       const DicomMap& dicomSummary,
                       const Attachments& attachments,
@@ -660,7 +836,8 @@ namespace Orthanc
                       uint64_t pixelDataOffset,
                       uint64_t maximumStorageSize,
                       unsigned int maximumPatients,
-                      bool isReconstruct);
+                      bool isReconstruct,
+                      const std::string& expectedDicomUuid);
 
     StoreStatus AddAttachment(int64_t& newRevision /*out*/,
                               const FileInfo& attachment,
@@ -24,6 +24,9 @@
 #include "DicomInstanceToStore.h"
 
 #include "OrthancConfiguration.h"
+#include "ServerToolbox.h"
+
+#include "../../OrthancFramework/Sources/DicomFormat/DicomStreamReader.h"
 
 #include "../../OrthancFramework/Sources/DicomParsing/FromDcmtkBridge.h"
 #include "../../OrthancFramework/Sources/DicomParsing/Internals/DicomFrameIndex.h"
@@ -44,12 +47,47 @@ namespace Orthanc
     const void*                       buffer_;
     size_t                            size_;
     std::unique_ptr<ParsedDicomFile>  parsed_;
+    bool                              isPixelDataOffsetComputed_;
+    bool                              hasPixelDataOffset_;
+    uint64_t                          pixelDataOffset_;
+    std::unique_ptr<ParsedDicomFile>  header_;
+
+    /**
+     * New in Orthanc 1.11.0: Parse the DICOM file only until the
+     * pixel data, which is sufficient to compute the summary and the
+     * DICOM-as-JSON of the instance. The full dataset is only parsed
+     * if "GetParsedDicomFile()" is explicitly invoked (e.g. for
+     * transcoding or by Lua/plugins). Returns NULL if the truncated
+     * dataset cannot be used.
+     **/
+    const ParsedDicomFile* GetHeader() const
+    {
+      if (parsed_.get() != NULL)
+      {
+        return NULL;  // The full dataset is already available
+      }
+
+      if (header_.get() == NULL)
+      {
+        uint64_t offset;
+        if (LookupPixelDataOffset(offset) &&
+            offset < static_cast<uint64_t>(size_))
+        {
+          const_cast<FromBuffer&>(*this).header_.reset(new ParsedDicomFile(buffer_, static_cast<size_t>(offset)));
+        }
+      }
+
+      return header_.get();
+    }
 
   public:
     FromBuffer(const void* buffer,
                size_t size) :
       buffer_(buffer),
-      size_(size)
+      size_(size),
+      isPixelDataOffsetComputed_(false),
+      hasPixelDataOffset_(false),
+      pixelDataOffset_(0)
     {
     }
 
@@ -72,6 +110,59 @@ namespace Orthanc
     {
       return size_;
     }
+
+    virtual bool LookupPixelDataOffset(uint64_t& offset) const ORTHANC_OVERRIDE
+    {
+      if (!isPixelDataOffsetComputed_)
+      {
+        FromBuffer& that = const_cast<FromBuffer&>(*this);
+        that.hasPixelDataOffset_ = DicomStreamReader::LookupPixelDataOffset(that.pixelDataOffset_, buffer_, size_);
+        that.isPixelDataOffsetComputed_ = true;
+      }
+
+      offset = pixelDataOffset_;
+      return hasPixelDataOffset_;
+    }
+
+    virtual bool HasPixelData() const ORTHANC_OVERRIDE
+    {
+      uint64_t offset;
+      if (LookupPixelDataOffset(offset))
+      {
+        return true;
+      }
+      else
+      {
+        return DicomInstanceToStore::HasPixelData();
+      }
+    }
+
+    virtual void GetSummary(DicomMap& summary) const ORTHANC_OVERRIDE
+    {
+      const ParsedDicomFile* header = GetHeader();
+      if (header == NULL)
+      {
+        DicomInstanceToStore::GetSummary(summary);
+      }
+      else
+      {
+        OrthancConfiguration::DefaultExtractDicomSummary(summary, *header);
+      }
+    }
+
+    virtual void GetDicomAsJson(Json::Value& dicomAsJson) const ORTHANC_OVERRIDE
+    {
+      const ParsedDicomFile* header = GetHeader();
+      if (header == NULL)
+      {
+        DicomInstanceToStore::GetDicomAsJson(dicomAsJson);
+      }
+      else
+      {
+        OrthancConfiguration::DefaultDicomDatasetToJson(dicomAsJson, *header);
+        ServerToolbox::InjectEmptyPixelData(dicomAsJson);
+      }
+    }
   };
 
     
@@ -263,6 +354,12 @@ namespace Orthanc
   }
 
 
+  bool DicomInstanceToStore::LookupPixelDataOffset(uint64_t& offset) const
+  {
+    return DicomStreamReader::LookupPixelDataOffset(offset, GetBufferData(), GetBufferSize());
+  }
+
+
   bool DicomInstanceToStore::HasPixelData() const
   {
     return GetParsedDicomFile().HasTag(DICOM_TAG_PIXEL_DATA);
@@ -94,6 +94,12 @@ namespace Orthanc
       metadata_[std::make_pair(level, metadata)] = value;
     }
 
+    void RemoveMetadata(ResourceType level,
+                        MetadataType metadata)
+    {
+      metadata_.erase(std::make_pair(level, metadata));
+    }
+
     void CopyMetadata(const MetadataMap& metadata);
 
     bool LookupTransferSyntax(DicomTransferSyntax& result) const;
@@ -104,6 +110,9 @@ namespace Orthanc
 
     virtual size_t GetBufferSize() const = 0;
 
+    // New in Orthanc 1.11.0
+    virtual bool LookupPixelDataOffset(uint64_t& offset) const;
+
     virtual bool HasPixelData() const;
 
     virtual void GetSummary(DicomMap& summary) const;
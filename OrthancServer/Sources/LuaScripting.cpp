@@ -719,40 +719,103 @@ namespace Orthanc
       throw OrthancException(ErrorCode_InternalError);
     }
 
-    LuaJobManager::Lock lock(jobManager_, context_.GetJobsEngine());
-
-    bool isFirst = true;
-    size_t previous = 0;  // Dummy initialization to avoid warning
+    /**
+     * Split the operations into chains: A chain starts with an
+     * operation on a resource, and continues with the operations
+     * that are applied to the output of their predecessor (as in
+     * "SendToModality(ModifyInstance(...), ...)").
+     **/
+    std::vector<Json::Value::ArrayIndex> chainStarts;
+    bool isRouting = true;
 
     for (Json::Value::ArrayIndex i = 0; i < operations.size(); ++i)
     {
       if (operations[i].type() != Json::objectValue ||
-          !operations[i].isMember("Operation"))
+          !operations[i].isMember("Operation") ||
+          !operations[i].isMember("Resource"))
       {
         throw OrthancException(ErrorCode_InternalError);
       }
 
-      const Json::Value& parameters = operations[i];
-      if (!parameters.isMember("Resource"))
+      if (i == 0 ||
+          !operations[i]["Resource"].asString().empty())
       {
-        throw OrthancException(ErrorCode_InternalError);
+        chainStarts.push_back(i);
       }
 
-      std::string operation = parameters["Operation"].asString();
-      size_t index = ParseOperation(lock, operation, operations[i]);
-        
-      std::string resource = parameters["Resource"].asString();
-      if (!resource.empty())
+      const std::string operation = operations[i]["Operation"].asString();
+      if (operation != "store-scu" &&
+          operation != "store-peer" &&
+          operation != "modify")
       {
-        lock.AddDicomInstanceInput(index, context_, resource);
+        isRouting = false;
       }
-      else if (!isFirst)
+    }
+
+    chainStarts.push_back(operations.size());
+
+    LuaJobManager::Lock lock(jobManager_, context_.GetJobsEngine());
+
+    if (!isRouting)
+    {
+      // The operations of this script might depend on the routing
+      // operations that were queued by the previous scripts (e.g.
+      // "Delete()" in "OnStableStudy()" after "SendToModality()" in
+      // "OnStoredInstance()"): Wait for the other lanes to be drained
+      lock.SelectDefaultLaneAfterOtherLanes();
+    }
+
+    for (size_t chain = 0; chain + 1 < chainStarts.size(); chain++)
+    {
+      /**
+       * New in Orthanc 1.11.0: If the script only routes instances,
+       * each chain is sent to the lane of its destination, which
+       * allows to send to different destinations in parallel. Other
+       * operations (such as "Delete()" after "SendToModality()") must
+       * be applied in order, so they are kept in the default lane,
+       * after the operations that are queued in the other lanes.
+       **/
+      std::string destination;
+
+      if (isRouting)
       {
-        lock.Connect(previous, index);
+        for (Json::Value::ArrayIndex i = chainStarts[chain]; i < chainStarts[chain + 1]; ++i)
+        {
+          const std::string operation = operations[i]["Operation"].asString();
+          if (operation == "store-scu")
+          {
+            destination += "modality:" + operations[i]["Modality"].asString() + "\n";
+          }
+          else if (operation == "store-peer")
+          {
+            destination += "peer:" + operations[i]["Peer"].asString() + "\n";
+          }
+        }
       }
 
-      isFirst = false;
-      previous = index;
+      lock.SelectLane(destination);
+
+      size_t previous = 0;  // Dummy initialization to avoid warning
+
+      for (Json::Value::ArrayIndex i = chainStarts[chain]; i < chainStarts[chain + 1]; ++i)
+      {
+        const Json::Value& parameters = operations[i];
+
+        std::string operation = parameters["Operation"].asString();
+        size_t index = ParseOperation(lock, operation, parameters);
+        
+        std::string resource = parameters["Resource"].asString();
+        if (!resource.empty())
+        {
+          lock.AddDicomInstanceInput(index, context_, resource);
+        }
+        else if (i != chainStarts[chain])
+        {
+          lock.Connect(previous, index);
+        }
+
+        previous = index;
+      }
     }
   }
 
@@ -810,8 +873,6 @@ namespace Orthanc
           LOG(ERROR) << "Error while processing Lua events: " << e.What();
         }
       }
-
-      that->jobManager_.GetDicomConnectionManager().CloseIfInactive();
     }
   }
 
@@ -990,6 +1051,9 @@ namespace Orthanc
     std::list<std::string> luaScripts;
     configLock.GetConfiguration().GetListOfStringsParameter(luaScripts, "LuaScripts");
 
+    // New configuration option in Orthanc 1.11.0
+    jobManager_.SetMaxLanes(configLock.GetConfiguration().GetUnsignedIntegerParameter("LuaRoutingLanes", 0));
+
     LuaScripting::Lock lock(*this);
 
     for (std::list<std::string>::const_iterator
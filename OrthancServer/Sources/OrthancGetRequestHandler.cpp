@@ -441,12 +441,18 @@ namespace Orthanc
       std::vector<std::string> tokens;
       Toolbox::TokenizeString(tokens, value.GetContent(), '\\');
 
+      // Look up all the UIDs at once, in one single transaction
+      std::multimap<std::string, std::string> matches;
+      context_.GetIndex().LookupIdentifiersExact(
+        matches, level, tag, std::set<std::string>(tokens.begin(), tokens.end()));
+
       for (size_t i = 0; i < tokens.size(); i++)
       {
-        std::vector<std::string> tmp;
-        context_.GetIndex().LookupIdentifierExact(tmp, level, tag, tokens[i]);
+        std::pair<std::multimap<std::string, std::string>::const_iterator,
+                  std::multimap<std::string, std::string>::const_iterator>
+          range = matches.equal_range(tokens[i]);
 
-        if (tmp.empty())
+        if (range.first == range.second)
         {
           CLOG(ERROR, DICOM) << "C-GET: Cannot locate resource \"" << tokens[i]
                              << "\" at the " << EnumerationToString(level) << " level";
@@ -454,9 +460,10 @@ namespace Orthanc
         }
         else
         {
-          for (size_t j = 0; j < tmp.size(); j++)
+          for (std::multimap<std::string, std::string>::const_iterator
+                 it = range.first; it != range.second; ++it)
           {
-            publicIds.push_back(tmp[j]);
+            publicIds.push_back(it->second);
           }
         }
       }
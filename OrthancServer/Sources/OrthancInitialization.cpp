@@ -39,6 +39,7 @@
 
 #include "../../OrthancFramework/Sources/DicomParsing/FromDcmtkBridge.h"
 #include "../../OrthancFramework/Sources/FileStorage/FilesystemStorage.h"
+#include "../../OrthancFramework/Sources/FileStorage/TieredFilesystemStorage.h"
 #include "../../OrthancFramework/Sources/HttpClient.h"
 #include "../../OrthancFramework/Sources/Logging.h"
 #include "../../OrthancFramework/Sources/OrthancException.h"
@@ -432,7 +433,12 @@ namespace Orthanc
     {
     }
 
-    return new SQLiteDatabaseWrapper(indexDirectory.string() + "/index");
+    std::unique_ptr<SQLiteDatabaseWrapper> database(new SQLiteDatabaseWrapper(indexDirectory.string() + "/index"));
+
+    // New in Orthanc 1.11.0
+    database->SetIncrementalVacuum(lock.GetConfiguration().GetBooleanParameter("IndexIncrementalVacuum", false));
+
+    return database.release();
   }
 
 
@@ -443,13 +449,16 @@ namespace Orthanc
     class FilesystemStorageWithoutDicom : public IStorageArea
     {
     private:
-      FilesystemStorage storage_;
+      std::unique_ptr<IStorageArea> storage_;
 
     public:
-      FilesystemStorageWithoutDicom(const std::string& path,
-                                    bool fsyncOnWrite) :
-        storage_(path, fsyncOnWrite)
+      explicit FilesystemStorageWithoutDicom(IStorageArea* storage /* takes ownership */) :
+        storage_(storage)
       {
+        if (storage == NULL)
+        {
+          throw OrthancException(ErrorCode_NullPointer);
+        }
       }
 
       virtual void Create(const std::string& uuid,
@@ -459,7 +468,7 @@ namespace Orthanc
       {
         if (type != FileContentType_Dicom)
         {
-          storage_.Create(uuid, content, size, type);
+          storage_->Create(uuid, content, size, type);
         }
       }
 
@@ -468,7 +477,7 @@ namespace Orthanc
       {
         if (type != FileContentType_Dicom)
         {
-          return storage_.Read(uuid, type);
+          return storage_->Read(uuid, type);
         }
         else
         {
@@ -483,7 +492,7 @@ namespace Orthanc
       {
         if (type != FileContentType_Dicom)
         {
-          return storage_.ReadRange(uuid, type, start, end);
+          return storage_->ReadRange(uuid, type, start, end);
         }
         else
         {
@@ -493,7 +502,7 @@ namespace Orthanc
 
       virtual bool HasReadRange() const ORTHANC_OVERRIDE
       {
-        return storage_.HasReadRange();
+        return storage_->HasReadRange();
       }
 
       virtual void Remove(const std::string& uuid,
@@ -501,7 +510,7 @@ namespace Orthanc
       {
         if (type != FileContentType_Dicom)
         {
-          storage_.Remove(uuid, type);
+          storage_->Remove(uuid, type);
         }
       }
     };
@@ -512,6 +521,10 @@ namespace Orthanc
   {
     static const char* const SYNC_STORAGE_AREA = "SyncStorageArea";
     static const char* const STORE_DICOM = "StoreDicom";
+    static const char* const STORAGE_MEMORY_MAPPING = "StorageMemoryMapping";
+    static const char* const COLD_STORAGE_DIRECTORY = "ColdStorageDirectory";
+    static const char* const COLD_STORAGE_DELAY = "ColdStorageDelay";
+    static const char* const COLD_STORAGE_MIGRATION_INTERVAL = "ColdStorageMigrationInterval";
     
     OrthancConfiguration::ReaderLock lock;
 
@@ -526,14 +539,50 @@ namespace Orthanc
     // New in Orthanc 1.7.4
     bool fsyncOnWrite = lock.GetConfiguration().GetBooleanParameter(SYNC_STORAGE_AREA, true);
 
+    // New in Orthanc 1.11.0
+    bool memoryMapping = lock.GetConfiguration().GetBooleanParameter(STORAGE_MEMORY_MAPPING, false);
+    if (memoryMapping)
+    {
+      LOG(WARNING) << "Large files of the storage area are read using memory mapping";
+    }
+
+    std::unique_ptr<IStorageArea> storage;
+
+    std::string coldStorageDirectoryStr;
+    if (lock.GetConfiguration().LookupStringParameter(coldStorageDirectoryStr, COLD_STORAGE_DIRECTORY))
+    {
+      // New in Orthanc 1.11.0
+      boost::filesystem::path coldStorageDirectory =
+        lock.GetConfiguration().InterpretStringParameterAsPath(coldStorageDirectoryStr);
+
+      unsigned int delay = lock.GetConfiguration().GetUnsignedIntegerParameter(COLD_STORAGE_DELAY, 168);
+      unsigned int interval = lock.GetConfiguration().GetUnsignedIntegerParameter(COLD_STORAGE_MIGRATION_INTERVAL, 3600);
+
+      LOG(WARNING) << "Cold storage directory: " << coldStorageDirectory
+                   << " (files not accessed for " << delay << " hours are migrated to this directory)";
+
+      std::unique_ptr<TieredFilesystemStorage> tiered(
+        new TieredFilesystemStorage(storageDirectory.string(), coldStorageDirectory.string(), fsyncOnWrite));
+      tiered->SetMemoryMapping(memoryMapping);
+      tiered->SetColdDelay(delay * 3600);
+      tiered->StartMigration(interval);
+      storage.reset(tiered.release());
+    }
+    else
+    {
+      std::unique_ptr<FilesystemStorage> filesystem(new FilesystemStorage(storageDirectory.string(), fsyncOnWrite));
+      filesystem->SetMemoryMapping(memoryMapping);
+      storage.reset(filesystem.release());
+    }
+
     if (lock.GetConfiguration().GetBooleanParameter(STORE_DICOM, true))
     {
-      return new FilesystemStorage(storageDirectory.string(), fsyncOnWrite);
+      return storage.release();
     }
     else
     {
       LOG(WARNING) << "The DICOM files will not be stored, Orthanc running in index-only mode";
-      return new FilesystemStorageWithoutDicom(storageDirectory.string(), fsyncOnWrite);
+      return new FilesystemStorageWithoutDicom(storage.release());
     }
   }
 
@@ -49,7 +49,7 @@ namespace Orthanc
       RemoteModalityParameters remote_;
       std::string originatorAet_;
       uint16_t originatorId_;
-      std::unique_ptr<DicomStoreUserConnection> connection_;
+      std::unique_ptr<DicomConnectionPool::Accessor> connection_;
 
     public:
       SynchronousMove(ServerContext& context,
@@ -104,12 +104,21 @@ namespace Orthanc
         if (connection_.get() == NULL)
         {
           DicomAssociationParameters params(localAet_, remote_);
-          connection_.reset(new DicomStoreUserConnection(params));
+          connection_.reset(new DicomConnectionPool::Accessor(context_.GetDicomConnectionPool(), params));
         }
 
-        std::string sopClassUid, sopInstanceUid;  // Unused
-        context_.StoreWithTranscoding(sopClassUid, sopInstanceUid, *connection_, dicom,
-                                      true, originatorAet_, originatorId_);
+        try
+        {
+          std::string sopClassUid, sopInstanceUid;  // Unused
+          context_.StoreWithTranscoding(sopClassUid, sopInstanceUid, connection_->GetConnection(), dicom,
+                                        true, originatorAet_, originatorId_);
+        }
+        catch (OrthancException&)
+        {
+          connection_->Discard();
+          connection_.reset(NULL);
+          throw;
+        }
 
         return Status_Success;
       }
@@ -270,13 +279,24 @@ namespace Orthanc
 
       std::vector<std::string> tokens;
       Toolbox::TokenizeString(tokens, content, '\\');
+
+      // Look up all the UIDs at once, in one single transaction
+      std::multimap<std::string, std::string> matches;
+      context_.GetIndex().LookupIdentifiersExact(
+        matches, level, tag, std::set<std::string>(tokens.begin(), tokens.end()));
+
+      // Concatenate "publicIds" with "matches", in the order of the tokens
       for (size_t i = 0; i < tokens.size(); i++)
       {
-        std::vector<std::string> matches;
-        context_.GetIndex().LookupIdentifierExact(matches, level, tag, tokens[i]);
+        std::pair<std::multimap<std::string, std::string>::const_iterator,
+                  std::multimap<std::string, std::string>::const_iterator>
+          range = matches.equal_range(tokens[i]);
 
-        // Concatenate "publicIds" with "matches"
-        publicIds.insert(publicIds.end(), matches.begin(), matches.end());
+        for (std::multimap<std::string, std::string>::const_iterator
+               it = range.first; it != range.second; ++it)
+        {
+          publicIds.push_back(it->second);
+        }
       }
 
       return true;
@@ -1495,11 +1495,21 @@ namespace Orthanc
     }
 
     Json::Value body = Json::objectValue;  // No body
-    DicomStoreUserConnection connection(GetAssociationParameters(call, body));
+    DicomConnectionPool::Accessor connection(OrthancRestApi::GetContext(call).GetDicomConnectionPool(),
+                                             GetAssociationParameters(call, body));
 
     std::string sopClassUid, sopInstanceUid;
-    connection.Store(sopClassUid, sopInstanceUid, call.GetBodyData(),
-                     call.GetBodySize(), false /* Not a C-MOVE */, "", 0);
+
+    try
+    {
+      connection.GetConnection().Store(sopClassUid, sopInstanceUid, call.GetBodyData(),
+                                       call.GetBodySize(), false /* Not a C-MOVE */, "", 0);
+    }
+    catch (OrthancException&)
+    {
+      connection.Discard();
+      throw;
+    }
 
     Json::Value answer = Json::objectValue;
     answer[SOP_CLASS_UID] = sopClassUid;
@@ -2466,20 +2476,26 @@ namespace Orthanc
         std::vector<std::string> sopInstanceUids;
         accessor.GetReport().GetSuccessSopInstanceUids(sopInstanceUids);
 
-        for (size_t i = 0; i < sopInstanceUids.size(); i++)
-        {
-          std::vector<std::string> orthancId;
-          context.GetIndex().LookupIdentifierExact(
-            orthancId, ResourceType_Instance, DICOM_TAG_SOP_INSTANCE_UID, sopInstanceUids[i]);
+        std::multimap<std::string, std::string> orthancIds;
+        context.GetIndex().LookupIdentifiersExact(
+          orthancIds, ResourceType_Instance, DICOM_TAG_SOP_INSTANCE_UID,
+          std::set<std::string>(sopInstanceUids.begin(), sopInstanceUids.end()));
 
-          for (size_t j = 0; j < orthancId.size(); j++)
-          {
-            CLOG(INFO, HTTP) << "Storage commitment - Removing SOP instance UID / Orthanc ID: "
-                             << sopInstanceUids[i] << " / " << orthancId[j];
+        std::set<std::string> removed;
 
-            Json::Value tmp;
-            context.GetIndex().DeleteResource(tmp, orthancId[j], ResourceType_Instance);
+        for (std::multimap<std::string, std::string>::const_iterator
+               it = orthancIds.begin(); it != orthancIds.end(); ++it)
+        {
+          if (!removed.insert(it->second).second)
+          {
+            continue;  // Several UIDs sharing the same normalized form
           }
+
+          CLOG(INFO, HTTP) << "Storage commitment - Removing SOP instance UID / Orthanc ID: "
+                           << it->first << " / " << it->second;
+
+          Json::Value tmp;
+          context.GetIndex().DeleteResource(tmp, it->second, ResourceType_Instance);
         }
           
         call.GetOutput().AnswerBuffer("{}", MimeType_Json);
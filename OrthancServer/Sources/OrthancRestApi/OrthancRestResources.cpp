@@ -25,7 +25,7 @@
 
 #include "../../../OrthancFramework/Sources/Compression/GzipCompressor.h"
 #include "../../../OrthancFramework/Sources/DicomFormat/DicomImageInformation.h"
-#include "../../../OrthancFramework/Sources/DicomParsing/DicomWebJsonVisitor.h"
+#include "../../../OrthancFramework/Sources/DicomParsing/DicomWebJsonWriter.h"
 #include "../../../OrthancFramework/Sources/DicomParsing/FromDcmtkBridge.h"
 #include "../../../OrthancFramework/Sources/DicomParsing/Internals/DicomImageDecoder.h"
 #include "../../../OrthancFramework/Sources/HttpServer/HttpContentNegociation.h"
@@ -33,10 +33,12 @@
 #include "../../../OrthancFramework/Sources/Images/ImageProcessing.h"
 #include "../../../OrthancFramework/Sources/Images/NumpyWriter.h"
 #include "../../../OrthancFramework/Sources/Logging.h"
+#include "../../../OrthancFramework/Sources/MultiThreading/BufferArena.h"
 #include "../../../OrthancFramework/Sources/MultiThreading/Semaphore.h"
 #include "../../../OrthancFramework/Sources/SerializationToolbox.h"
 
 #include "../OrthancConfiguration.h"
+#include "../Search/ColumnarIndex.h"
 #include "../Search/DatabaseLookup.h"
 #include "../ServerContext.h"
 #include "../ServerToolbox.h"
@@ -105,6 +107,66 @@ namespace Orthanc
   }
 
 
+  /**
+   * New in Orthanc 1.11.0: DICOM instances are immutable, so the
+   * content that is derived from an instance is identified by the
+   * UUID of its DICOM attachment (which changes if the instance is
+   * overwritten), by the URI, by the GET arguments (rendering
+   * parameters, format of the tags...), and by the "Accept" header.
+   * Returns "true" iff "304 Not Modified" was sent, in which case the
+   * storage area must not be accessed.
+   *
+   * The "attachment" is looked up by the caller, which gives it to
+   * the functions that read the storage area. The ETag is strong if
+   * the answer is sent as is. If the client accepts compression, the
+   * same entity may be sent with a gzip "Content-Encoding" by
+   * HttpOutput, so the ETag is weak (RFC 7232, Section 2.1).
+   **/
+  static bool AnswerIfInstanceNotModified(RestApiGetCall& call,
+                                          const FileInfo& attachment)
+  {
+    std::string variant = Toolbox::FlattenUri(call.GetFullUri());
+
+    for (HttpToolbox::Arguments::const_iterator it = call.GetArguments().begin();
+         it != call.GetArguments().end(); ++it)
+    {
+      variant += "&" + it->first + "=" + it->second;
+    }
+
+    variant += "&accept=" + call.GetHttpHeader("accept", "");
+
+    std::string md5;
+    Toolbox::ComputeMD5(md5, variant);
+
+    HttpOutput& output = call.GetOutput().GetLowLevelOutput();
+
+    std::string etag = "\"" + attachment.GetUuid() + "-" + md5 + "\"";
+    if (output.IsGzipAllowed() ||
+        output.IsDeflateAllowed())
+    {
+      etag = "W/" + etag;
+    }
+
+    output.AddHeader("Vary", "Accept-Encoding");
+
+    // "no-cache" allows the clients to store the answer, but forces
+    // them to revalidate, as the instance might have been deleted
+    return call.GetOutput().AnswerNotModified(call.GetHttpHeaders(), etag, "no-cache");
+  }
+
+
+  static void LookupInstanceDicom(FileInfo& attachment,
+                                  RestApiGetCall& call,
+                                  const std::string& publicId)
+  {
+    int64_t revision;  // Ignored
+    if (!OrthancRestApi::GetIndex(call).LookupAttachment(attachment, revision, publicId, FileContentType_Dicom))
+    {
+      throw OrthancException(ErrorCode_UnknownResource);
+    }
+  }
+
+
   static void ParseSetOfTags(std::set<DicomTag>& target,
                              const RestApiGetCall& call,
                              const std::string& argument)
@@ -347,6 +409,8 @@ namespace Orthanc
         .SetDescription("Download one DICOM instance")
         .SetUriArgument("id", "Orthanc identifier of the DICOM instance of interest")
         .SetHttpHeader("Accept", "This HTTP header can be set to retrieve the DICOM instance in DICOMweb format")
+        .SetHttpHeader("If-None-Match", "Optional ETag of a previous answer, to check if the content has changed")
+        .SetAnswerHeader("ETag", "Identifier of the content, to be used in further conditional requests")
         .AddAnswerType(MimeType_Dicom, "The DICOM instance")
         .AddAnswerType(MimeType_DicomWebJson, "The DICOM instance, in DICOMweb JSON format")
         .AddAnswerType(MimeType_DicomWebXml, "The DICOM instance, in DICOMweb XML format");
@@ -357,6 +421,14 @@ namespace Orthanc
 
     std::string publicId = call.GetUriComponent("id", "");
 
+    FileInfo attachment;
+    LookupInstanceDicom(attachment, call, publicId);
+
+    if (AnswerIfInstanceNotModified(call, attachment))
+    {
+      return;
+    }
+
     HttpToolbox::Arguments::const_iterator accept = call.GetHttpHeaders().find("accept");
     if (accept != call.GetHttpHeaders().end())
     {
@@ -369,23 +441,39 @@ namespace Orthanc
             mime == MimeType_DicomWebXml)
         {
           DicomWebJsonVisitor visitor;
+
+          // New in Orthanc 1.11.0: The DICOMweb JSON document is
+          // directly written while visiting the tags, without an
+          // intermediate "Json::Value" tree
+          std::unique_ptr<DicomWebJsonWriter> writer;
+          if (mime == MimeType_DicomWebJson &&
+              DicomWebJsonWriter::IsSupported())
+          {
+            writer.reset(new DicomWebJsonWriter);
+            visitor.SetSink(*writer);
+          }
           
           {
-            ServerContext::DicomCacheLocker locker(OrthancRestApi::GetContext(call), publicId);
+            ServerContext::DicomCacheLocker locker(OrthancRestApi::GetContext(call), publicId, attachment);
             locker.GetDicom().Apply(visitor);
           }
 
-          if (mime == MimeType_DicomWebJson)
+          std::string s;
+
+          if (writer.get() != NULL)
           {
-            std::string s = visitor.GetResult().toStyledString();
-            call.GetOutput().AnswerBuffer(s, MimeType_DicomWebJson);
+            writer->Flatten(s);
+          }
+          else if (mime == MimeType_DicomWebJson)
+          {
+            s = visitor.GetResult().toStyledString();
           }
           else
           {
-            std::string xml;
-            visitor.FormatXml(xml);
-            call.GetOutput().AnswerBuffer(xml, MimeType_DicomWebXml);
+            visitor.FormatXml(s);
           }
+
+          call.GetOutput().AnswerBuffer(s, mime);
           
           return;
         }
@@ -395,7 +483,7 @@ namespace Orthanc
       }
     }
 
-    context.AnswerAttachment(call.GetOutput(), publicId, FileContentType_Dicom);
+    context.AnswerAttachment(call.GetOutput(), attachment);
   }
 
 
@@ -434,6 +522,14 @@ namespace Orthanc
 
     std::string publicId = call.GetUriComponent("id", "");
 
+    FileInfo attachment;
+    LookupInstanceDicom(attachment, call, publicId);
+
+    if (AnswerIfInstanceNotModified(call, attachment))
+    {
+      return;
+    }
+
     std::set<DicomTag> ignoreTagLength;
     ParseSetOfTags(ignoreTagLength, call, IGNORE_LENGTH);
     
@@ -441,7 +537,7 @@ namespace Orthanc
         !ignoreTagLength.empty())
     {
       Json::Value full;
-      context.ReadDicomAsJson(full, publicId, ignoreTagLength);
+      context.ReadDicomAsJson(full, publicId, attachment, ignoreTagLength);
       AnswerDicomAsJson(call, full, format);
     }
     else
@@ -450,7 +546,7 @@ namespace Orthanc
       // simplification is asked, and if no "ignore-length" argument
       // is present
       Json::Value full;
-      context.ReadDicomAsJson(full, publicId);
+      context.ReadDicomAsJson(full, publicId, attachment, ignoreTagLength);
       call.GetOutput().AnswerJson(full);
     }
   }
@@ -466,6 +562,8 @@ namespace Orthanc
         .SetSummary("Get DICOM tags")
         .SetDescription("Get the DICOM tags in the specified format. By default, the `full` format is used, which "
                         "combines hexadecimal tags with human-readable description.")
+        .SetHttpHeader("If-None-Match", "Optional ETag of a previous answer, to check if the content has changed")
+        .SetAnswerHeader("ETag", "Identifier of the content, to be used in further conditional requests")
         .SetUriArgument("id", "Orthanc identifier of the DICOM instance of interest")
         .SetHttpGetArgument(IGNORE_LENGTH, RestApiCallDocumentation::Type_JsonListOfStrings,
                             "Also include the DICOM tags that are provided in this list, even if their associated value is long", false)
@@ -677,6 +775,30 @@ namespace Orthanc
 
   namespace
   {
+    /**
+     * Intermediate image whose pixels are stored in a buffer that is
+     * recycled across the requests handled by the same HTTP thread
+     * (new in Orthanc 1.11.0)
+     **/
+    class ArenaImage : public ImageAccessor
+    {
+    private:
+      BufferArena::Buffer  buffer_;
+
+    public:
+      ArenaImage(PixelFormat format,
+                 unsigned int width,
+                 unsigned int height)
+      {
+        const unsigned int pitch = ::Orthanc::GetBytesPerPixel(format) * width;
+        buffer_.GetContent().resize(static_cast<size_t>(pitch) * static_cast<size_t>(height));
+
+        AssignWritable(format, width, height, pitch,
+                       buffer_.GetContent().empty() ? NULL : &buffer_.GetContent() [0]);
+      }
+    };
+
+
     class IDecodedFrameHandler : public boost::noncopyable
     {
     public:
@@ -805,8 +927,17 @@ namespace Orthanc
         try
         {
           std::string publicId = call.GetUriComponent("id", "");
+          context.SignalInstanceAccessed(publicId);
+
+          FileInfo attachment;
+          LookupInstanceDicom(attachment, call, publicId);
+
+          if (AnswerIfInstanceNotModified(call, attachment))
+          {
+            return;
+          }
 
-          decoded.reset(context.DecodeDicomFrame(publicId, frame));
+          decoded.reset(context.DecodeDicomFrame(publicId, attachment, frame));
 
           if (decoded.get() == NULL)
           {
@@ -821,7 +952,7 @@ namespace Orthanc
              * necessary to deal with MONOCHROME1 photometric
              * interpretation, and with windowing parameters.
              **/ 
-            ServerContext::DicomCacheLocker locker(context, publicId);
+            ServerContext::DicomCacheLocker locker(context, publicId, attachment);
             handler.Handle(call, decoded, &locker.GetDicom(), frame);
           }
           else
@@ -1092,7 +1223,7 @@ namespace Orthanc
           // Grayscale image: (1) convert to Float32, (2) apply
           // windowing to get a Grayscale8, (3) possibly resize
 
-          Image converted(PixelFormat_Float32, decoded->GetWidth(), decoded->GetHeight(), false);
+          ArenaImage converted(PixelFormat_Float32, decoded->GetWidth(), decoded->GetHeight());
           ImageProcessing::Convert(converted, *decoded);
 
           // Avoid divisions by zero
@@ -1235,7 +1366,7 @@ namespace Orthanc
           double rescaleIntercept, rescaleSlope;
           dicom.GetRescale(rescaleIntercept, rescaleSlope, frame);
 
-          Image converted(PixelFormat_Float32, decoded->GetWidth(), decoded->GetHeight(), false);
+          ArenaImage converted(PixelFormat_Float32, decoded->GetWidth(), decoded->GetHeight());
           ImageProcessing::Convert(converted, *decoded);
           ImageProcessing::ShiftScale2(converted, static_cast<float>(rescaleIntercept), static_cast<float>(rescaleSlope), false);
 
@@ -1299,6 +1430,8 @@ namespace Orthanc
 
       NumpyVisitor visitor(0 /* no depth, 2D frame */, rescale);
 
+      OrthancRestApi::GetContext(call).SignalInstanceAccessed(instanceId);
+
       {
         Semaphore::Locker throttling(throttlingSemaphore_);
         ServerContext::DicomCacheLocker locker(OrthancRestApi::GetContext(call), instanceId);
@@ -1502,11 +1635,31 @@ namespace Orthanc
     }
 
     std::string publicId = call.GetUriComponent("id", "");
+
+    ServerContext& context = OrthancRestApi::GetContext(call);
+    context.SignalInstanceAccessed(publicId);
+
+    // The attachment and the frame offsets are read in one single
+    // transaction (new in Orthanc 1.11.0)
+    ServerContext::RawFrameSource source;
+    if (!context.LookupRawFrameSource(source, publicId))
+    {
+      throw OrthancException(ErrorCode_UnknownResource);
+    }
+
+    if (AnswerIfInstanceNotModified(call, source.GetAttachment()))
+    {
+      return;
+    }
+
     std::string raw;
     MimeType mime;
 
+
+    // Avoid reading the full DICOM file if possible (new in Orthanc 1.11.0)
+    if (!context.ReadRawFrame(raw, mime, publicId, source, frame))
     {
-      ServerContext::DicomCacheLocker locker(OrthancRestApi::GetContext(call), publicId);
+      ServerContext::DicomCacheLocker locker(context, publicId, source.GetAttachment());
       locker.GetDicom().GetRawFrame(raw, mime, frame);
     }
 
@@ -3063,6 +3216,201 @@ namespace Orthanc
   }
 
 
+  // New in Orthanc 1.11.0
+  static void GroupBy(RestApiPostCall& call)
+  {
+    static const char* const KEY_CASE_SENSITIVE = "CaseSensitive";
+    static const char* const KEY_COUNT = "Count";
+    static const char* const KEY_COUNT_LEVEL = "CountLevel";
+    static const char* const KEY_GROUP_BY = "GroupBy";
+    static const char* const KEY_LEVEL = "Level";
+    static const char* const KEY_MINIMUM_COUNT = "MinimumCount";
+    static const char* const KEY_QUERY = "Query";
+    static const char* const KEY_TOTAL_SIZE = "TotalSize";
+    static const char* const KEY_VALUES = "Values";
+
+    if (call.IsDocumentation())
+    {
+      call.GetDocumentation()
+        .SetTag("System")
+        .SetSummary("Aggregate local resources")
+        .SetDescription("Count the local resources that match a query, grouped by the values of some main DICOM tags. "
+                        "The aggregates are computed from the in-memory columnar index, without accessing the database: "
+                        "This requires the configuration option `ColumnarIndex` to be `true`.")
+        .SetRequestField(KEY_LEVEL, RestApiCallDocumentation::Type_String,
+                         "Level of the resources to be counted (`Patient`, `Study`, `Series` or `Instance`)", true)
+        .SetRequestField(KEY_GROUP_BY, RestApiCallDocumentation::Type_JsonListOfStrings,
+                         "List of the main DICOM tags whose values define the groups. These tags can be stored at "
+                         "the level of the query, or at one of its ancestors.", true)
+        .SetRequestField(KEY_QUERY, RestApiCallDocumentation::Type_JsonObject,
+                         "Associative array containing the filter on the values of the main DICOM tags, with the same "
+                         "syntax as in `/tools/find`", false)
+        .SetRequestField(KEY_CASE_SENSITIVE, RestApiCallDocumentation::Type_Boolean,
+                         "Enable case-sensitive search for PN value representations (defaults to configuration option `CaseSensitivePN`)", false)
+        .SetRequestField(KEY_COUNT_LEVEL, RestApiCallDocumentation::Type_String,
+                         "Count the distinct parent resources at this level, instead of the resources at the level "
+                         "of the query (e.g. count the studies when grouping the series by modality)", false)
+        .SetRequestField(KEY_MINIMUM_COUNT, RestApiCallDocumentation::Type_Number,
+                         "Only report the groups whose count is at least this value", false)
+        .AddAnswerType(MimeType_Json, "JSON array containing the groups, sorted by their values. Each group "
+                       "contains the `Values` of the tags, the `Count`, and the `TotalSize` of the DICOM files "
+                       "if the query is at the instance level.");
+      return;
+    }
+
+    ServerContext& context = OrthancRestApi::GetContext(call);
+
+    Json::Value request;
+    if (!call.ParseJsonRequest(request) ||
+        request.type() != Json::objectValue)
+    {
+      throw OrthancException(ErrorCode_BadRequest, 
+                             "The body must contain a JSON object");
+    }
+    else if (!request.isMember(KEY_LEVEL) ||
+             request[KEY_LEVEL].type() != Json::stringValue)
+    {
+      throw OrthancException(ErrorCode_BadRequest, 
+                             "Field \"" + std::string(KEY_LEVEL) + "\" is missing, or should be a string");
+    }
+    else if (!request.isMember(KEY_GROUP_BY) ||
+             request[KEY_GROUP_BY].type() != Json::arrayValue)
+    {
+      throw OrthancException(ErrorCode_BadRequest, 
+                             "Field \"" + std::string(KEY_GROUP_BY) + "\" is missing, or should be an array");
+    }
+    else if (request.isMember(KEY_QUERY) &&
+             request[KEY_QUERY].type() != Json::objectValue)
+    {
+      throw OrthancException(ErrorCode_BadRequest, 
+                             "Field \"" + std::string(KEY_QUERY) + "\" should be a JSON object");
+    }
+    else if (request.isMember(KEY_CASE_SENSITIVE) && 
+             request[KEY_CASE_SENSITIVE].type() != Json::booleanValue)
+    {
+      throw OrthancException(ErrorCode_BadRequest, 
+                             "Field \"" + std::string(KEY_CASE_SENSITIVE) + "\" should be a Boolean");
+    }
+    else if (request.isMember(KEY_COUNT_LEVEL) &&
+             request[KEY_COUNT_LEVEL].type() != Json::stringValue)
+    {
+      throw OrthancException(ErrorCode_BadRequest, 
+                             "Field \"" + std::string(KEY_COUNT_LEVEL) + "\" should be a string");
+    }
+    else if (request.isMember(KEY_MINIMUM_COUNT) &&
+             request[KEY_MINIMUM_COUNT].type() != Json::intValue)
+    {
+      throw OrthancException(ErrorCode_BadRequest, 
+                             "Field \"" + std::string(KEY_MINIMUM_COUNT) + "\" should be an integer");
+    }
+    else
+    {
+      const ResourceType level = StringToResourceType(request[KEY_LEVEL].asCString());
+
+      ResourceType countLevel = level;
+      if (request.isMember(KEY_COUNT_LEVEL))
+      {
+        countLevel = StringToResourceType(request[KEY_COUNT_LEVEL].asCString());
+      }
+
+      uint64_t minimumCount = 0;
+      if (request.isMember(KEY_MINIMUM_COUNT))
+      {
+        int tmp = request[KEY_MINIMUM_COUNT].asInt();
+        if (tmp < 0)
+        {
+          throw OrthancException(ErrorCode_ParameterOutOfRange,
+                                 "Field \"" + std::string(KEY_MINIMUM_COUNT) + "\" should be a positive integer");
+        }
+
+        minimumCount = static_cast<uint64_t>(tmp);
+      }
+
+      bool caseSensitive = false;
+      if (request.isMember(KEY_CASE_SENSITIVE))
+      {
+        caseSensitive = request[KEY_CASE_SENSITIVE].asBool();
+      }
+
+      const Json::Value& groupByNames = request[KEY_GROUP_BY];
+
+      std::vector<DicomTag> groupBy;
+      groupBy.reserve(groupByNames.size());
+
+      for (Json::Value::ArrayIndex i = 0; i < groupByNames.size(); i++)
+      {
+        if (groupByNames[i].type() != Json::stringValue)
+        {
+          throw OrthancException(ErrorCode_BadRequest,
+                                 "Field \"" + std::string(KEY_GROUP_BY) + "\" should only contain strings");
+        }
+
+        groupBy.push_back(FromDcmtkBridge::ParseTag(groupByNames[i].asString()));
+      }
+
+      DatabaseLookup query;
+
+      if (request.isMember(KEY_QUERY))
+      {
+        Json::Value::Members members = request[KEY_QUERY].getMemberNames();
+        for (size_t i = 0; i < members.size(); i++)
+        {
+          if (request[KEY_QUERY][members[i]].type() != Json::stringValue)
+          {
+            throw OrthancException(ErrorCode_BadRequest,
+                                   "Tag \"" + members[i] + "\" should be associated with a string");
+          }
+
+          const std::string value = request[KEY_QUERY][members[i]].asString();
+
+          if (!value.empty())
+          {
+            // An empty string corresponds to an universal constraint, as in "/tools/find"
+            query.AddRestConstraint(FromDcmtkBridge::ParseTag(members[i]), 
+                                    value, caseSensitive, true);
+          }
+        }
+      }
+
+      ColumnarIndex& index = context.GetColumnarIndex();
+      if (!index.IsLoaded())
+      {
+        throw OrthancException(ErrorCode_DatabaseUnavailable,
+                               "The columnar index is still being loaded from the database");
+      }
+
+      std::list<ColumnarIndex::Group> groups;
+      index.GroupBy(groups, level, groupBy, query, countLevel, minimumCount);
+
+      Json::Value answer = Json::arrayValue;
+
+      for (std::list<ColumnarIndex::Group>::const_iterator it = groups.begin(); it != groups.end(); ++it)
+      {
+        assert(it->GetValues().size() == groupBy.size());
+
+        Json::Value values = Json::objectValue;
+        for (size_t i = 0; i < groupBy.size(); i++)
+        {
+          values[groupByNames[static_cast<Json::Value::ArrayIndex>(i)].asString()] = it->GetValues()[i];
+        }
+
+        Json::Value group = Json::objectValue;
+        group[KEY_VALUES] = values;
+        group[KEY_COUNT] = static_cast<Json::UInt64>(it->GetCount());
+
+        if (level == ResourceType_Instance)
+        {
+          group[KEY_TOTAL_SIZE] = static_cast<Json::UInt64>(it->GetTotalSize());
+        }
+
+        answer.append(group);
+      }
+
+      call.GetOutput().AnswerJson(answer);
+    }
+  }
+
+
   template <enum ResourceType start, 
             enum ResourceType end>
   static void GetChildResources(RestApiGetCall& call)
@@ -3467,42 +3815,271 @@ namespace Orthanc
   }
 
 
-  static void GetBulkChildren(std::set<std::string>& target,
-                              ServerIndex& index,
-                              const std::set<std::string>& source)
+  namespace
   {
-    target.clear();
+    // New in Orthanc 1.11.0: Description of the fields that are
+    // returned by "/tools/bulk-content"
+    class BulkContentProjection : public boost::noncopyable
+    {
+    private:
+      DicomToJsonFormat       format_;
+      bool                    metadata_;
+      std::set<MetadataType>  metadataFilter_;       // Empty means "all"
+      bool                    mainDicomTags_;
+      std::set<DicomTag>      mainDicomTagsFilter_;  // Empty means "all"
+      bool                    children_;
+
+      static bool ReadField(const Json::Value& request,
+                            const char* field,
+                            std::set<std::string>& filter)
+      {
+        filter.clear();
+
+        if (!request.isMember(field))
+        {
+          return true;
+        }
+        else if (request[field].type() == Json::booleanValue)
+        {
+          return request[field].asBool();
+        }
+        else
+        {
+          SerializationToolbox::ReadSetOfStrings(filter, request, field);
+          return true;
+        }
+      }
+
+    public:
+      BulkContentProjection(const Json::Value& request,
+                            DicomToJsonFormat format) :
+        format_(format)
+      {
+        std::set<std::string> filter;
+
+        metadata_ = ReadField(request, "Metadata", filter);
+        for (std::set<std::string>::const_iterator it = filter.begin(); it != filter.end(); ++it)
+        {
+          metadataFilter_.insert(StringToMetadata(*it));
+        }
+
+        mainDicomTags_ = ReadField(request, "MainDicomTags", filter);
+        for (std::set<std::string>::const_iterator it = filter.begin(); it != filter.end(); ++it)
+        {
+          mainDicomTagsFilter_.insert(FromDcmtkBridge::ParseTag(*it));
+        }
+
+        children_ = true;
+        if (request.isMember("Children"))
+        {
+          children_ = SerializationToolbox::ReadBoolean(request, "Children");
+        }
+      }
+
+      ExpandResourceDbFlags GetExpandFlags() const
+      {
+        // The metadata are always needed, as they contain the
+        // signature of the main DICOM tags and the information about
+        // the series and the instances
+        int flags = ExpandResourceDbFlags_IncludeMetadata;
+
+        if (mainDicomTags_)
+        {
+          flags |= ExpandResourceDbFlags_IncludeMainDicomTags;
+        }
+
+        if (children_)
+        {
+          flags |= ExpandResourceDbFlags_IncludeChildren;
+        }
+
+        return static_cast<ExpandResourceDbFlags>(flags);
+      }
+
+      void Format(Json::Value& target,
+                  ExpandedResource& resource) const
+      {
+        if (!mainDicomTagsFilter_.empty())
+        {
+          DicomMap filtered;
+          resource.tags_.ExtractTags(filtered, mainDicomTagsFilter_);
+          resource.tags_.Clear();
+          resource.tags_.Merge(filtered);
+        }
+
+        std::set<DicomTag> emptyRequestedTags;  // not supported for bulk content
+        ServerContext::SerializeExpandedResource(target, resource, format_, emptyRequestedTags);
+
+        if (!mainDicomTags_)
+        {
+          target.removeMember("MainDicomTags");
+          target.removeMember("PatientMainDicomTags");
+        }
+
+        if (!children_)
+        {
+          target.removeMember("Studies");
+          target.removeMember("Series");
+          target.removeMember("Instances");
+        }
+
+        if (metadata_)
+        {
+          Json::Value& metadata = target["Metadata"];
+          metadata = Json::objectValue;
 
-    for (std::set<std::string>::const_iterator
-           it = source.begin(); it != source.end(); ++it)
+          for (std::map<MetadataType, std::string>::const_iterator
+                 it = resource.metadata_.begin(); it != resource.metadata_.end(); ++it)
+          {
+            if (metadataFilter_.empty() ||
+                metadataFilter_.find(it->first) != metadataFilter_.end())
+            {
+              metadata[EnumerationToString(it->first)] = it->second;
+            }
+          }
+        }
+      }
+    };
+
+
+    class BulkContentVisitor : public StatelessDatabaseOperations::IExpandedResourceVisitor
     {
-      std::list<std::string> children;
-      index.GetChildren(children, *it);
+    private:
+      const BulkContentProjection&  projection_;
+      Json::Value&                  target_;
 
-      for (std::list<std::string>::const_iterator
-             child = children.begin(); child != children.end(); ++child)
+    public:
+      BulkContentVisitor(const BulkContentProjection& projection,
+                         Json::Value& target) :
+        projection_(projection),
+        target_(target)
       {
-        target.insert(*child);
+        target_ = Json::arrayValue;
       }
-    }
-  }
+
+      virtual void Visit(ExpandedResource& resource) ORTHANC_OVERRIDE
+      {
+        Json::Value item;
+        projection_.Format(item, resource);
+        target_.append(item);
+      }
+    };
 
 
-  static void AddMetadata(Json::Value& target,
-                          ServerIndex& index,
-                          const std::string& resource,
-                          ResourceType level)
-  {
-    target = Json::objectValue;
-    
-    std::map<MetadataType, std::string> content;
-    index.GetAllMetadata(content, resource, level);
-    
-    for (std::map<MetadataType, std::string>::const_iterator
-           it = content.begin(); it != content.end(); ++it)
+    // Expand the resources by pages, each page being read in one
+    // single transaction, and stream the resulting JSON array
+    class BulkContentStream : public IHttpStreamAnswer
     {
-      target[EnumerationToString(it->first)] = it->second;
-    }
+    private:
+      ServerIndex&                  index_;
+      const BulkContentProjection&  projection_;
+      std::list<std::string>        remaining_;
+      size_t                        pageSize_;
+      bool                          started_;
+      bool                          done_;
+      bool                          isEmpty_;
+      std::string                   chunk_;
+
+    public:
+      BulkContentStream(ServerIndex& index,
+                        const BulkContentProjection& projection,
+                        std::list<std::string>& resources /* will be emptied */,
+                        size_t pageSize) :
+        index_(index),
+        projection_(projection),
+        pageSize_(pageSize),
+        started_(false),
+        done_(false),
+        isEmpty_(true)
+      {
+        remaining_.swap(resources);
+      }
+
+      virtual HttpCompression SetupHttpCompression(bool gzipAllowed,
+                                                   bool deflateAllowed) ORTHANC_OVERRIDE
+      {
+        // This function is not called by HttpOutput::AnswerWithoutBuffering()
+        throw OrthancException(ErrorCode_InternalError);
+      }
+
+      virtual bool HasContentFilename(std::string& filename) ORTHANC_OVERRIDE
+      {
+        return false;
+      }
+
+      virtual std::string GetContentType() ORTHANC_OVERRIDE
+      {
+        return EnumerationToString(MimeType_Json);
+      }
+
+      virtual uint64_t GetContentLength() ORTHANC_OVERRIDE
+      {
+        throw OrthancException(ErrorCode_InternalError);
+      }
+
+      virtual bool ReadNextChunk() ORTHANC_OVERRIDE
+      {
+        if (done_)
+        {
+          return false;
+        }
+
+        chunk_.clear();
+
+        if (!started_)
+        {
+          chunk_ = "[";
+          started_ = true;
+        }
+
+        if (remaining_.empty())
+        {
+          chunk_ += "]";
+          done_ = true;
+          return true;
+        }
+
+        std::list<std::string> page;
+
+        while (page.size() < pageSize_ &&
+               !remaining_.empty())
+        {
+          page.splice(page.end(), remaining_, remaining_.begin());
+        }
+
+        Json::Value items;
+
+        {
+          BulkContentVisitor visitor(projection_, items);
+          index_.ExpandResources(visitor, page, std::set<DicomTag>(), projection_.GetExpandFlags());
+        }
+
+        for (Json::Value::ArrayIndex i = 0; i < items.size(); i++)
+        {
+          if (!isEmpty_)
+          {
+            chunk_ += ",";
+          }
+
+          std::string s;
+          Toolbox::WriteFastJson(s, items[i]);
+          chunk_ += s;
+          isEmpty_ = false;
+        }
+
+        return true;
+      }
+
+      virtual const char* GetChunkContent() ORTHANC_OVERRIDE
+      {
+        return (chunk_.empty() ? NULL : chunk_.c_str());
+      }
+
+      virtual size_t GetChunkSize() ORTHANC_OVERRIDE
+      {
+        return chunk_.size();
+      }
+    };
   }
 
 
@@ -3510,6 +4087,11 @@ namespace Orthanc
   {
     static const char* const LEVEL = "Level";
     static const char* const METADATA = "Metadata";
+    static const char* const MAIN_DICOM_TAGS = "MainDicomTags";
+    static const char* const CHILDREN = "Children";
+
+    // Number of resources that are expanded in one single transaction
+    static const size_t PAGE_SIZE = 256;
 
     if (call.IsDocumentation())
     {
@@ -3525,9 +4107,17 @@ namespace Orthanc
                          "`Instance`). Orthanc will loop over the items inside `Resources`, and explore upward or "
                          "downward in the DICOM hierarchy in order to find the level of interest.", false)
         .SetRequestField(METADATA, RestApiCallDocumentation::Type_Boolean,
-                         "If set to `true` (default value), the metadata associated with the resources will also be retrieved.", false)
+                         "If set to `true` (default value), the metadata associated with the resources will also be retrieved. "
+                         "This field can also contain the list of the names of the metadata of interest.", false)
+        .SetRequestField(MAIN_DICOM_TAGS, RestApiCallDocumentation::Type_Boolean,
+                         "If set to `true` (default value), the main DICOM tags will be retrieved. This field can also "
+                         "contain the list of the main DICOM tags of interest (new in Orthanc 1.11.0).", false)
+        .SetRequestField(CHILDREN, RestApiCallDocumentation::Type_Boolean,
+                         "If set to `true` (default value), the list of the child resources will be retrieved "
+                         "(new in Orthanc 1.11.0).", false)
         .SetDescription("Get the content all the DICOM patients, studies, series or instances "
-                        "whose identifiers are provided in the `Resources` field, in one single call.");
+                        "whose identifiers are provided in the `Resources` field, in one single call. "
+                        "Large answers are streamed.");
       return;
     }
 
@@ -3541,152 +4131,50 @@ namespace Orthanc
     else
     {
       const DicomToJsonFormat format = OrthancRestApi::GetDicomFormat(request, DicomToJsonFormat_Human);
-
-      bool metadata = true;
-      if (request.isMember(METADATA))
-      {
-        metadata = SerializationToolbox::ReadBoolean(request, METADATA);
-      }
+      const BulkContentProjection projection(request, format);
 
       ServerIndex& index = OrthancRestApi::GetIndex(call);
-      
-      Json::Value answer = Json::arrayValue;
+
+      std::list<std::string> resources;
 
       if (request.isMember(LEVEL))
       {
         // Complex case: Need to explore the DICOM hierarchy
         ResourceType level = StringToResourceType(SerializationToolbox::ReadString(request, LEVEL).c_str());
 
-        std::set<std::string> resources;
-        SerializationToolbox::ReadSetOfStrings(resources, request, "Resources");
+        std::set<std::string> source;
+        SerializationToolbox::ReadSetOfStrings(source, request, "Resources");
 
         std::set<std::string> interest;
+        index.LookupResourcesAtLevel(interest, source, level);
 
-        assert(ResourceType_Patient < ResourceType_Study &&
-               ResourceType_Study < ResourceType_Series &&
-               ResourceType_Series < ResourceType_Instance);
-
-        for (std::set<std::string>::const_iterator
-               it = resources.begin(); it != resources.end(); ++it)
-        {
-          ResourceType type;
-          if (index.LookupResourceType(type, *it))
-          {
-            if (type == level)
-            {
-              // This resource is already from the level of interest
-              interest.insert(*it);
-            }
-            else if (type < level)
-            {
-              // Need to explore children
-              std::set<std::string> current;
-              current.insert(*it);
-              
-              for (;;)
-              {
-                std::set<std::string> children;
-                GetBulkChildren(children, index, current);
-
-                type = GetChildResourceType(type);
-                if (type == level)
-                {
-                  for (std::set<std::string>::const_iterator
-                         it2 = children.begin(); it2 != children.end(); ++it2)
-                  {
-                    interest.insert(*it2);
-                  }
-
-                  break;  // done
-                }
-                else
-                {
-                  current.swap(children);
-                }
-              }
-            }
-            else
-            {
-              // Need to explore parents
-              std::string current = *it;
-              
-              for (;;)
-              {
-                std::string parent;
-                if (index.LookupParent(parent, current))
-                {
-                  type = GetParentResourceType(type);
-                  if (type == level)
-                  {
-                    interest.insert(parent);
-                    break;  // done
-                  }
-                  else
-                  {
-                    current = parent;
-                  }
-                }
-                else
-                {
-                  break;  // The resource has been deleted during the exploration
-                }
-              }
-            }
-          }
-          else
-          {
-            CLOG(INFO, HTTP) << "Unknown resource during a bulk content retrieval: " << *it;
-          }
-        }
-        
-        for (std::set<std::string>::const_iterator
-               it = interest.begin(); it != interest.end(); ++it)
-        {
-          Json::Value item;
-          std::set<DicomTag> emptyRequestedTags;  // not supported for bulk content
-
-          if (OrthancRestApi::GetContext(call).ExpandResource(item, *it, level, format, emptyRequestedTags))
-          {
-            if (metadata)
-            {
-              AddMetadata(item[METADATA], index, *it, level);
-            }
-
-            answer.append(item);
-          }
-        }
+        resources.insert(resources.end(), interest.begin(), interest.end());
       }
       else
       {
         // Simple case: We return the queried resources as such
-        std::list<std::string> resources;
         SerializationToolbox::ReadListOfStrings(resources, request, "Resources");
+      }
 
-        for (std::list<std::string>::const_iterator
-               it = resources.begin(); it != resources.end(); ++it)
-        {
-          ResourceType level;
-          Json::Value item;
-          std::set<DicomTag> emptyRequestedTags;  // not supported for bulk content
-
-          if (index.LookupResourceType(level, *it) &&
-              OrthancRestApi::GetContext(call).ExpandResource(item, *it, level, format, emptyRequestedTags))
-          {
-            if (metadata)
-            {
-              AddMetadata(item[METADATA], index, *it, level);
-            }
+      if (resources.size() <= PAGE_SIZE ||
+          call.GetOutput().IsConvertJsonToXml())
+      {
+        // Small answer: One single transaction, no streaming (which
+        // notably preserves HTTP keep-alive)
+        Json::Value answer;
 
-            answer.append(item);
-          }
-          else
-          {
-            CLOG(INFO, HTTP) << "Unknown resource during a bulk content retrieval: " << *it;
-          }
+        {
+          BulkContentVisitor visitor(projection, answer);
+          index.ExpandResources(visitor, resources, std::set<DicomTag>(), projection.GetExpandFlags());
         }
-      }
 
-      call.GetOutput().AnswerJson(answer);
+        call.GetOutput().AnswerJson(answer);
+      }
+      else
+      {
+        BulkContentStream stream(index, projection, resources, PAGE_SIZE);
+        call.GetOutput().AnswerWithoutBuffering(stream);
+      }
     }
   }
 
@@ -3830,6 +4318,7 @@ namespace Orthanc
     Register("/tools/invalidate-tags", InvalidateTags);
     Register("/tools/lookup", Lookup);
     Register("/tools/find", Find);
+    Register("/tools/group-by", GroupBy);  // New in Orthanc 1.11.0
 
     Register("/patients/{id}/studies", GetChildResources<ResourceType_Patient, ResourceType_Study>);
     Register("/patients/{id}/series", GetChildResources<ResourceType_Patient, ResourceType_Series>);
@@ -25,6 +25,7 @@
 
 #include "../../../OrthancFramework/Sources/DicomParsing/FromDcmtkBridge.h"
 #include "../../../OrthancFramework/Sources/MetricsRegistry.h"
+#include "../../../OrthancFramework/Sources/MultiThreading/BufferArena.h"
 #include "../../Plugins/Engine/OrthancPlugins.h"
 #include "../../Plugins/Engine/PluginsManager.h"
 #include "../OrthancConfiguration.h"
@@ -853,6 +854,63 @@ namespace Orthanc
     registry.SetValue("orthanc_jobs_completed", jobsSuccess + jobsFailed);
     registry.SetValue("orthanc_jobs_success", jobsSuccess);
     registry.SetValue("orthanc_jobs_failed", jobsFailed);
+
+    {
+      // New in Orthanc 1.11.0: Time spent by the jobs in the pending
+      // state, for each job type
+      JobsRegistry& jobs = context.GetJobsEngine().GetRegistry();
+
+      std::set<std::string> types;
+      jobs.ListJobTypes(types);
+
+      for (std::set<std::string>::const_iterator it = types.begin(); it != types.end(); ++it)
+      {
+        uint64_t average, maximum;
+        if (jobs.GetJobTypeWaitTime(average, maximum, *it))
+        {
+          std::string name;
+          name.reserve(it->size());
+
+          for (size_t i = 0; i < it->size(); i++)
+          {
+            // Sanitize the job type to get a valid Prometheus metric name
+            const char c = (*it) [i];
+            name.push_back(isalnum(c) ? static_cast<char>(tolower(c)) : '_');
+          }
+
+          registry.SetValue("orthanc_jobs_" + name + "_wait_average_ms", static_cast<float>(average));
+          registry.SetValue("orthanc_jobs_" + name + "_wait_max_ms", static_cast<float>(maximum));
+        }
+      }
+    }
+
+    {
+      // New in Orthanc 1.11.0: Reuse of the temporary buffers
+      uint64_t acquired, reused, retained;
+      BufferArena::GetStatistics(acquired, reused, retained);
+      registry.SetValue("orthanc_buffer_arena_acquired_count", static_cast<float>(acquired));
+      registry.SetValue("orthanc_buffer_arena_reused_count", static_cast<float>(reused));
+      registry.SetValue("orthanc_buffer_arena_retained_mb", static_cast<float>(retained) / MEGA_BYTES);
+    }
+
+    {
+      // New in Orthanc 1.11.0: Concurrent identical loads that were collapsed
+      uint64_t storageReads, dicomParsings;
+      context.GetCollapsedLoadsCount(storageReads, dicomParsings);
+      registry.SetValue("orthanc_storage_collapsed_reads_count", static_cast<float>(storageReads));
+      registry.SetValue("orthanc_dicom_cache_collapsed_loads_count", static_cast<float>(dicomParsings));
+    }
+
+    {
+      // New in Orthanc 1.11.0: Efficiency of the read-ahead (the hit
+      // rate is the percentage of prefetched instances that were used)
+      uint64_t prefetched, hits;
+      context.GetReadAheadStatistics(prefetched, hits);
+      registry.SetValue("orthanc_read_ahead_prefetched_count", static_cast<float>(prefetched));
+      registry.SetValue("orthanc_read_ahead_hits_count", static_cast<float>(hits));
+      registry.SetValue("orthanc_read_ahead_hit_rate", (prefetched == 0 ? 0.0f :
+                                                        100.0f * static_cast<float>(hits) / static_cast<float>(prefetched)));
+    }
     
     std::string s;
     registry.ExportPrometheusText(s);
@@ -0,0 +1,254 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+#include "PrecompiledHeadersServer.h"
+#include "ReadAheadTracker.h"
+
+#include "../../OrthancFramework/Sources/Compatibility.h"
+#include "../../OrthancFramework/Sources/OrthancException.h"
+
+#include <cassert>
+
+
+namespace Orthanc
+{
+  // Maximum distance between two successive accesses that are
+  // considered as sequential (viewers might skip some slices when
+  // scrolling fast)
+  static const size_t MAX_STRIDE = 2;
+
+
+  class ReadAheadTracker::Series : public boost::noncopyable
+  {
+  private:
+    std::vector<std::string>       instances_;
+    std::map<std::string, size_t>  positions_;
+    bool                           hasLast_;
+    size_t                         last_;
+    bool                           forward_;
+    unsigned int                   sequential_;
+
+  public:
+    explicit Series(const std::vector<std::string>& instances) :
+      instances_(instances),
+      hasLast_(false),
+      last_(0),
+      forward_(true),
+      sequential_(0)
+    {
+      for (size_t i = 0; i < instances.size(); i++)
+      {
+        positions_[instances[i]] = i;
+      }
+    }
+
+    // Returns "true" iff. the access is part of a sequential access
+    bool SignalAccess(size_t& position,
+                      bool& forward,
+                      const std::string& instanceId)
+    {
+      std::map<std::string, size_t>::const_iterator found = positions_.find(instanceId);
+      if (found == positions_.end())
+      {
+        return false;  // The instance was added after the sorting of the series
+      }
+
+      position = found->second;
+
+      if (hasLast_ &&
+          position == last_)
+      {
+        // Another frame of the same instance: Nothing has changed
+        forward = forward_;
+        return (sequential_ > 0);
+      }
+
+      if (hasLast_ &&
+          position > last_ &&
+          position - last_ <= MAX_STRIDE)
+      {
+        sequential_ = (forward_ ? sequential_ + 1 : 1);
+        forward_ = true;
+      }
+      else if (hasLast_ &&
+               position < last_ &&
+               last_ - position <= MAX_STRIDE)
+      {
+        sequential_ = (forward_ ? 1 : sequential_ + 1);
+        forward_ = false;
+      }
+      else
+      {
+        // Random access
+        sequential_ = 0;
+      }
+
+      hasLast_ = true;
+      last_ = position;
+      forward = forward_;
+      return (sequential_ > 0);
+    }
+
+    size_t GetInstancesCount() const
+    {
+      return instances_.size();
+    }
+
+    const std::string& GetInstance(size_t position) const
+    {
+      assert(position < instances_.size());
+      return instances_[position];
+    }
+  };
+
+
+  ReadAheadTracker::ReadAheadTracker(unsigned int maxSeries,
+                                     size_t maxPrefetched) :
+    maxSeries_(maxSeries),
+    maxPrefetched_(maxPrefetched),
+    countPrefetched_(0),
+    countHits_(0)
+  {
+    if (maxSeries == 0 ||
+        maxPrefetched == 0)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+  }
+
+
+  ReadAheadTracker::~ReadAheadTracker()
+  {
+    while (!series_.IsEmpty())
+    {
+      Series* series = NULL;
+      series_.RemoveOldest(series);
+      delete series;
+    }
+  }
+
+
+  bool ReadAheadTracker::HasSeries(const std::string& seriesId)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return series_.Contains(seriesId);
+  }
+
+
+  void ReadAheadTracker::SetSeries(const std::string& seriesId,
+                                   const std::vector<std::string>& orderedInstances)
+  {
+    std::unique_ptr<Series> series(new Series(orderedInstances));
+
+    boost::mutex::scoped_lock lock(mutex_);
+
+    if (series_.Contains(seriesId))
+    {
+      delete series_.Invalidate(seriesId);
+    }
+
+    series_.Add(seriesId, series.release());
+
+    while (series_.GetSize() > maxSeries_)
+    {
+      Series* oldest = NULL;
+      series_.RemoveOldest(oldest);
+      delete oldest;
+    }
+  }
+
+
+  void ReadAheadTracker::SignalAccess(std::vector<std::string>& next,
+                                      const std::string& seriesId,
+                                      const std::string& instanceId,
+                                      unsigned int count)
+  {
+    next.clear();
+
+    boost::mutex::scoped_lock lock(mutex_);
+
+    if (prefetched_.Contains(instanceId))
+    {
+      prefetched_.Invalidate(instanceId);
+      countHits_++;
+    }
+
+    Series* series = NULL;
+    if (!series_.Contains(seriesId, series))
+    {
+      return;
+    }
+
+    assert(series != NULL);
+    series_.MakeMostRecent(seriesId);
+
+    size_t position;
+    bool forward;
+    if (series->SignalAccess(position, forward, instanceId))
+    {
+      for (unsigned int i = 1; i <= count; i++)
+      {
+        if (forward &&
+            position + i >= series->GetInstancesCount())
+        {
+          break;
+        }
+        else if (!forward &&
+                 i > position)
+        {
+          break;
+        }
+
+        const std::string& candidate = series->GetInstance(forward ? position + i : position - i);
+        if (!prefetched_.Contains(candidate))
+        {
+          next.push_back(candidate);
+        }
+      }
+    }
+  }
+
+
+  void ReadAheadTracker::SignalPrefetched(const std::string& instanceId)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    prefetched_.AddOrMakeMostRecent(instanceId);
+    countPrefetched_++;
+
+    // The oldest prefetched instances that were never accessed are forgotten
+    while (prefetched_.GetSize() > maxPrefetched_)
+    {
+      prefetched_.RemoveOldest();
+    }
+  }
+
+
+  void ReadAheadTracker::GetStatistics(uint64_t& countPrefetched,
+                                       uint64_t& countHits)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    countPrefetched = countPrefetched_;
+    countHits = countHits_;
+  }
+}
@@ -0,0 +1,87 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+#pragma once
+
+#include "../../OrthancFramework/Sources/Cache/LeastRecentlyUsedIndex.h"
+
+#include <boost/thread/mutex.hpp>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace Orthanc
+{
+  /**
+   * New in Orthanc 1.11.0: Detects the sequential accesses to the
+   * instances of a series (typically, a viewer that scrolls through
+   * the slices), in order to predict the instances that will be
+   * accessed next. The order of the instances in each series must be
+   * provided by the caller (cf. "SliceOrdering").
+   *
+   * Note: this class is thread safe
+   **/
+  class ReadAheadTracker : public boost::noncopyable
+  {
+  private:
+    class Series;
+
+    typedef LeastRecentlyUsedIndex<std::string, Series*>  SeriesIndex;
+    typedef LeastRecentlyUsedIndex<std::string>           PrefetchedIndex;
+
+    boost::mutex     mutex_;
+    unsigned int     maxSeries_;
+    size_t           maxPrefetched_;
+    SeriesIndex      series_;
+    PrefetchedIndex  prefetched_;     // Prefetched instances that were not accessed yet
+    uint64_t         countPrefetched_;
+    uint64_t         countHits_;
+
+  public:
+    ReadAheadTracker(unsigned int maxSeries,
+                     size_t maxPrefetched);
+
+    ~ReadAheadTracker();
+
+    bool HasSeries(const std::string& seriesId);
+
+    void SetSeries(const std::string& seriesId,
+                   const std::vector<std::string>& orderedInstances);
+
+    // Registers the access to one instance of the series, and returns
+    // the (at most "count") next instances in the direction of the
+    // sequential access, if any, that are not prefetched yet
+    void SignalAccess(std::vector<std::string>& next,
+                      const std::string& seriesId,
+                      const std::string& instanceId,
+                      unsigned int count);
+
+    // To be called once the prefetching of one of the instances
+    // returned by "SignalAccess()" has been scheduled
+    void SignalPrefetched(const std::string& instanceId);
+
+    void GetStatistics(uint64_t& countPrefetched,
+                       uint64_t& countHits);
+  };
+}
@@ -0,0 +1,721 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+#include "../PrecompiledHeadersServer.h"
+#include "ColumnarIndex.h"
+
+#include "../../../OrthancFramework/Sources/OrthancException.h"
+#include "DatabaseLookup.h"
+
+#include <algorithm>
+#include <cassert>
+
+
+namespace Orthanc
+{
+  static const uint32_t NO_ROW = 0xffffffffu;
+
+  // Below this number of removed rows, a level is never compacted
+  static const size_t MIN_ROWS_BEFORE_COMPACTION = 1024;
+
+
+  static size_t GetLevelIndex(ResourceType level)
+  {
+    switch (level)
+    {
+      case ResourceType_Patient:
+        return 0;
+
+      case ResourceType_Study:
+        return 1;
+
+      case ResourceType_Series:
+        return 2;
+
+      case ResourceType_Instance:
+        return 3;
+
+      default:
+        throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+  }
+
+
+  /**
+   * One main DICOM tag at one level. The code "0" stands for a
+   * missing (or empty) value.
+   **/
+  class ColumnarIndex::Column : public boost::noncopyable
+  {
+  private:
+    typedef std::map<std::string, uint32_t>  Codes;
+
+    std::vector<std::string>  dictionary_;
+    Codes                     codes_;
+    std::vector<uint32_t>     values_;  // One code per row of the level
+
+  public:
+    Column()
+    {
+      dictionary_.push_back("");
+    }
+
+    void Set(size_t row,
+             const std::string& value)
+    {
+      uint32_t code = 0;
+
+      if (!value.empty())
+      {
+        Codes::const_iterator found = codes_.find(value);
+        if (found == codes_.end())
+        {
+          code = static_cast<uint32_t>(dictionary_.size());
+          dictionary_.push_back(value);
+          codes_[value] = code;
+        }
+        else
+        {
+          code = found->second;
+        }
+      }
+
+      if (row >= values_.size())
+      {
+        if (code == 0)
+        {
+          return;  // The rows that are not covered by "values_" are missing
+        }
+        else
+        {
+          values_.resize(row + 1, 0);
+        }
+      }
+
+      values_[row] = code;
+    }
+
+    uint32_t GetCode(size_t row) const
+    {
+      return (row < values_.size() ? values_[row] : 0);
+    }
+
+    size_t GetDictionarySize() const
+    {
+      return dictionary_.size();
+    }
+
+    const std::string& GetValue(uint32_t code) const
+    {
+      assert(code < dictionary_.size());
+      return dictionary_[code];
+    }
+
+    const std::vector<uint32_t>& GetCodes() const
+    {
+      return values_;
+    }
+
+    void Compact(const std::vector<uint32_t>& mapping,
+                 size_t countRows)
+    {
+      std::vector<uint32_t> compacted(countRows, 0);
+
+      for (size_t row = 0; row < values_.size(); row++)
+      {
+        if (mapping[row] != NO_ROW)
+        {
+          compacted[mapping[row]] = values_[row];
+        }
+      }
+
+      values_.swap(compacted);
+    }
+  };
+
+
+  class ColumnarIndex::Level : public boost::noncopyable
+  {
+  public:
+    typedef std::map<DicomTag, Column*>  Columns;
+    typedef std::map<std::string, uint32_t>  Rows;
+
+    std::vector<std::string>  ids_;
+    std::vector<uint32_t>     parents_;  // Row in the parent level, or "NO_ROW"
+    std::vector<uint8_t>      alive_;
+    std::vector<uint64_t>     sizes_;
+    Rows                      rows_;
+    Columns                   columns_;
+    size_t                    countRemoved_;
+
+    Level() :
+      countRemoved_(0)
+    {
+    }
+
+    ~Level()
+    {
+      for (Columns::iterator it = columns_.begin(); it != columns_.end(); ++it)
+      {
+        assert(it->second != NULL);
+        delete it->second;
+      }
+    }
+
+    const Column* LookupColumn(const DicomTag& tag) const
+    {
+      Columns::const_iterator found = columns_.find(tag);
+      if (found == columns_.end())
+      {
+        return NULL;
+      }
+      else
+      {
+        assert(found->second != NULL);
+        return found->second;
+      }
+    }
+
+    size_t GetResourcesCount() const
+    {
+      assert(ids_.size() >= countRemoved_);
+      return ids_.size() - countRemoved_;
+    }
+  };
+
+
+  /**
+   * Aggregated values of one group while scanning a level
+   **/
+  class ColumnarIndex::Accumulator
+  {
+  public:
+    uint64_t            count_;
+    uint64_t            totalSize_;
+    std::set<uint32_t>  distinct_;  // Rows at the counting level, if distinct from the scanned level
+
+    Accumulator() :
+      count_(0),
+      totalSize_(0)
+    {
+    }
+  };
+
+
+  ColumnarIndex::Level& ColumnarIndex::GetLevel(ResourceType level) const
+  {
+    Level* result = levels_[GetLevelIndex(level)];
+    assert(result != NULL);
+    return *result;
+  }
+
+
+  bool ColumnarIndex::StoreInternal(ResourceType level,
+                                    const std::string& publicId,
+                                    const std::string& parentId,
+                                    const DicomMap& mainDicomTags,
+                                    uint64_t size)
+  {
+    uint32_t parentRow = NO_ROW;
+
+    if (level != ResourceType_Patient)
+    {
+      const Level& parentLevel = GetLevel(GetParentResourceType(level));
+
+      Level::Rows::const_iterator found = parentLevel.rows_.find(parentId);
+      if (found == parentLevel.rows_.end())
+      {
+        return false;
+      }
+      else
+      {
+        parentRow = found->second;
+      }
+    }
+
+    Level& target = GetLevel(level);
+
+    uint32_t row;
+
+    Level::Rows::const_iterator found = target.rows_.find(publicId);
+    if (found == target.rows_.end())
+    {
+      if (target.ids_.size() >= static_cast<size_t>(NO_ROW))
+      {
+        throw OrthancException(ErrorCode_NotEnoughMemory);
+      }
+
+      row = static_cast<uint32_t>(target.ids_.size());
+      target.ids_.push_back(publicId);
+      target.parents_.push_back(parentRow);
+      target.alive_.push_back(1);
+      target.sizes_.push_back(size);
+      target.rows_[publicId] = row;
+    }
+    else
+    {
+      row = found->second;
+      target.parents_[row] = parentRow;
+      target.sizes_[row] = size;
+    }
+
+    // Update the columns that are already known at this level
+    for (Level::Columns::iterator it = target.columns_.begin(); it != target.columns_.end(); ++it)
+    {
+      std::string value;
+      if (!mainDicomTags.LookupStringValue(value, it->first, false))
+      {
+        value.clear();
+      }
+
+      it->second->Set(row, value);
+    }
+
+    // Create the columns for the new tags
+    std::set<DicomTag> tags;
+    mainDicomTags.GetTags(tags);
+
+    for (std::set<DicomTag>::const_iterator it = tags.begin(); it != tags.end(); ++it)
+    {
+      std::string value;
+      if (target.columns_.find(*it) == target.columns_.end() &&
+          mainDicomTags.LookupStringValue(value, *it, false))
+      {
+        std::unique_ptr<Column> column(new Column);
+        column->Set(row, value);
+        target.columns_[*it] = column.release();
+      }
+    }
+
+    return true;
+  }
+
+
+  void ColumnarIndex::Compact(size_t levelIndex)
+  {
+    Level& level = *levels_[levelIndex];
+
+    std::vector<uint32_t> mapping(level.ids_.size(), NO_ROW);
+
+    uint32_t count = 0;
+    for (size_t row = 0; row < level.ids_.size(); row++)
+    {
+      if (level.alive_[row])
+      {
+        mapping[row] = count;
+
+        level.ids_[count] = level.ids_[row];
+        level.parents_[count] = level.parents_[row];
+        level.alive_[count] = 1;
+        level.sizes_[count] = level.sizes_[row];
+        level.rows_[level.ids_[count]] = count;
+
+        count++;
+      }
+    }
+
+    level.ids_.resize(count);
+    level.parents_.resize(count);
+    level.alive_.resize(count);
+    level.sizes_.resize(count);
+    level.countRemoved_ = 0;
+
+    for (Level::Columns::iterator it = level.columns_.begin(); it != level.columns_.end(); ++it)
+    {
+      it->second->Compact(mapping, count);
+    }
+
+    if (levelIndex + 1 < 4)
+    {
+      // The children of the removed rows become orphans, until
+      // they are removed in turn
+      std::vector<uint32_t>& parents = levels_[levelIndex + 1]->parents_;
+      for (size_t row = 0; row < parents.size(); row++)
+      {
+        if (parents[row] != NO_ROW)
+        {
+          parents[row] = mapping[parents[row]];
+        }
+      }
+    }
+  }
+
+
+  ColumnarIndex::ColumnarIndex() :
+    isLoaded_(false)
+  {
+    for (size_t i = 0; i < 4; i++)
+    {
+      levels_[i] = new Level;
+    }
+  }
+
+
+  ColumnarIndex::~ColumnarIndex()
+  {
+    for (size_t i = 0; i < 4; i++)
+    {
+      delete levels_[i];
+    }
+  }
+
+
+  bool ColumnarIndex::Store(ResourceType level,
+                            const std::string& publicId,
+                            const std::string& parentId,
+                            const DicomMap& mainDicomTags,
+                            uint64_t size)
+  {
+    boost::unique_lock<boost::shared_mutex> lock(mutex_);
+    removedWhileLoading_.erase(publicId);
+    return StoreInternal(level, publicId, parentId, mainDicomTags, size);
+  }
+
+
+  bool ColumnarIndex::Load(ResourceType level,
+                           const std::string& publicId,
+                           const std::string& parentId,
+                           const DicomMap& mainDicomTags,
+                           uint64_t size)
+  {
+    boost::unique_lock<boost::shared_mutex> lock(mutex_);
+
+    if (removedWhileLoading_.find(publicId) != removedWhileLoading_.end())
+    {
+      return true;  // Ignore the resources that have been removed in the meantime
+    }
+    else
+    {
+      const Level& target = GetLevel(level);
+      if (target.rows_.find(publicId) != target.rows_.end())
+      {
+        return true;  // Already stored while handling a change, which is more recent
+      }
+      else
+      {
+        return StoreInternal(level, publicId, parentId, mainDicomTags, size);
+      }
+    }
+  }
+
+
+  void ColumnarIndex::Remove(ResourceType level,
+                             const std::string& publicId)
+  {
+    boost::unique_lock<boost::shared_mutex> lock(mutex_);
+
+    if (!isLoaded_)
+    {
+      removedWhileLoading_.insert(publicId);
+    }
+
+    const size_t levelIndex = GetLevelIndex(level);
+    Level& target = *levels_[levelIndex];
+
+    Level::Rows::iterator found = target.rows_.find(publicId);
+    if (found != target.rows_.end())
+    {
+      const uint32_t row = found->second;
+      target.rows_.erase(found);
+      target.ids_[row].clear();
+      target.alive_[row] = 0;
+      target.sizes_[row] = 0;
+      target.countRemoved_++;
+
+      if (target.countRemoved_ >= MIN_ROWS_BEFORE_COMPACTION &&
+          target.countRemoved_ > target.GetResourcesCount())
+      {
+        Compact(levelIndex);
+      }
+    }
+  }
+
+
+  void ColumnarIndex::MarkAsLoaded()
+  {
+    boost::unique_lock<boost::shared_mutex> lock(mutex_);
+    isLoaded_ = true;
+    removedWhileLoading_.clear();
+  }
+
+
+  bool ColumnarIndex::IsLoaded() const
+  {
+    boost::shared_lock<boost::shared_mutex> lock(mutex_);
+    return isLoaded_;
+  }
+
+
+  bool ColumnarIndex::HasResource(ResourceType level,
+                                  const std::string& publicId) const
+  {
+    boost::shared_lock<boost::shared_mutex> lock(mutex_);
+    const Level& target = GetLevel(level);
+    return (target.rows_.find(publicId) != target.rows_.end());
+  }
+
+
+  size_t ColumnarIndex::GetResourcesCount(ResourceType level) const
+  {
+    boost::shared_lock<boost::shared_mutex> lock(mutex_);
+    return GetLevel(level).GetResourcesCount();
+  }
+
+
+  namespace
+  {
+    struct SortedGroup
+    {
+      std::vector<std::string>  values_;
+      uint64_t                  count_;
+      uint64_t                  totalSize_;
+
+      bool operator< (const SortedGroup& other) const
+      {
+        return values_ < other.values_;
+      }
+    };
+  }
+
+
+  void ColumnarIndex::GroupBy(std::list<Group>& target,
+                              ResourceType level,
+                              const std::vector<DicomTag>& groupBy,
+                              const DatabaseLookup& filter,
+                              ResourceType countLevel,
+                              uint64_t minimumCount) const
+  {
+    target.clear();
+
+    const size_t levelIndex = GetLevelIndex(level);
+    const size_t countLevelIndex = GetLevelIndex(countLevel);
+
+    if (countLevelIndex > levelIndex)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange,
+                             "The counting level must be the same as the level of the query, or one of its ancestors");
+    }
+
+    const size_t countDepth = levelIndex - countLevelIndex;
+
+    boost::shared_lock<boost::shared_mutex> lock(mutex_);
+
+    size_t maxDepth = countDepth;
+
+    // Locate the columns, looking for the tags from the level of
+    // interest up to the patient level
+    std::vector<const Column*> groupColumns(groupBy.size(), NULL);
+    std::vector<size_t> groupDepths(groupBy.size(), 0);
+
+    for (size_t i = 0; i < groupBy.size(); i++)
+    {
+      for (size_t depth = 0; depth <= levelIndex; depth++)
+      {
+        const Column* column = levels_[levelIndex - depth]->LookupColumn(groupBy[i]);
+        if (column != NULL)
+        {
+          groupColumns[i] = column;
+          groupDepths[i] = depth;
+          maxDepth = std::max(maxDepth, depth);
+          break;
+        }
+      }
+    }
+
+    // Evaluate each constraint once against the dictionary of its
+    // column, so that filtering a row only consists in a table lookup
+    std::vector<const Column*> filterColumns(filter.GetConstraintsCount(), NULL);
+    std::vector<size_t> filterDepths(filter.GetConstraintsCount(), 0);
+    std::vector< std::vector<uint8_t> > accepted(filter.GetConstraintsCount());
+
+    for (size_t i = 0; i < filter.GetConstraintsCount(); i++)
+    {
+      const DicomTagConstraint& constraint = filter.GetConstraint(i);
+
+      for (size_t depth = 0; depth <= levelIndex; depth++)
+      {
+        const Column* column = levels_[levelIndex - depth]->LookupColumn(constraint.GetTag());
+        if (column != NULL)
+        {
+          filterColumns[i] = column;
+          filterDepths[i] = depth;
+          maxDepth = std::max(maxDepth, depth);
+          break;
+        }
+      }
+
+      if (filterColumns[i] == NULL)
+      {
+        if (constraint.IsMandatory())
+        {
+          return;  // The tag is not stored, no resource can match
+        }
+        else
+        {
+          continue;
+        }
+      }
+
+      accepted[i].resize(filterColumns[i]->GetDictionarySize());
+      accepted[i][0] = (constraint.IsMandatory() ? 0 : 1);
+
+      for (uint32_t code = 1; code < accepted[i].size(); code++)
+      {
+        accepted[i][code] = (constraint.IsMatch(filterColumns[i]->GetValue(code)) ? 1 : 0);
+      }
+    }
+
+    const Level& scanned = *levels_[levelIndex];
+    const size_t countRows = scanned.ids_.size();
+
+    typedef std::map<std::vector<uint32_t>, Accumulator>  Groups;
+    Groups groups;
+
+    if (groupBy.size() == 1 &&
+        groupDepths[0] == 0 &&
+        groupColumns[0] != NULL &&
+        filter.GetConstraintsCount() == 0 &&
+        countDepth == 0)
+    {
+      // Fast path for the most common case: Histogram of the codes
+      // of one single column of the scanned level
+      const std::vector<uint32_t>& codes = groupColumns[0]->GetCodes();
+      std::vector<uint64_t> histogram(groupColumns[0]->GetDictionarySize(), 0);
+      std::vector<uint64_t> sizes(histogram.size(), 0);
+
+      const size_t covered = std::min(codes.size(), countRows);
+      for (size_t row = 0; row < covered; row++)
+      {
+        histogram[codes[row]] += scanned.alive_[row];
+        sizes[codes[row]] += scanned.sizes_[row];  // The size of removed rows is zero
+      }
+
+      for (size_t row = covered; row < countRows; row++)
+      {
+        histogram[0] += scanned.alive_[row];
+        sizes[0] += scanned.sizes_[row];
+      }
+
+      std::vector<uint32_t> key(1);
+      for (uint32_t code = 0; code < histogram.size(); code++)
+      {
+        if (histogram[code] > 0)
+        {
+          key[0] = code;
+          Accumulator& accumulator = groups[key];
+          accumulator.count_ = histogram[code];
+          accumulator.totalSize_ = sizes[code];
+        }
+      }
+    }
+    else
+    {
+      std::vector<uint32_t> ancestors(maxDepth + 1);
+      std::vector<uint32_t> key(groupBy.size());
+
+      for (size_t row = 0; row < countRows; row++)
+      {
+        if (!scanned.alive_[row])
+        {
+          continue;
+        }
+
+        // Walk up the hierarchy, skipping the orphan resources
+        ancestors[0] = static_cast<uint32_t>(row);
+
+        bool ok = true;
+        for (size_t depth = 1; depth <= maxDepth; depth++)
+        {
+          const uint32_t parent = levels_[levelIndex - depth + 1]->parents_[ancestors[depth - 1]];
+          if (parent == NO_ROW ||
+              !levels_[levelIndex - depth]->alive_[parent])
+          {
+            ok = false;
+            break;
+          }
+          else
+          {
+            ancestors[depth] = parent;
+          }
+        }
+
+        for (size_t i = 0; ok && i < filterColumns.size(); i++)
+        {
+          if (filterColumns[i] != NULL)
+          {
+            const uint32_t code = filterColumns[i]->GetCode(ancestors[filterDepths[i]]);
+            ok = (accepted[i][code] != 0);
+          }
+        }
+
+        if (ok)
+        {
+          for (size_t i = 0; i < groupBy.size(); i++)
+          {
+            key[i] = (groupColumns[i] == NULL ? 0 : groupColumns[i]->GetCode(ancestors[groupDepths[i]]));
+          }
+
+          Accumulator& accumulator = groups[key];
+          accumulator.count_++;
+          accumulator.totalSize_ += scanned.sizes_[row];
+
+          if (countDepth != 0)
+          {
+            accumulator.distinct_.insert(ancestors[countDepth]);
+          }
+        }
+      }
+    }
+
+    std::vector<SortedGroup> sorted;
+    sorted.reserve(groups.size());
+
+    for (Groups::const_iterator it = groups.begin(); it != groups.end(); ++it)
+    {
+      SortedGroup group;
+      group.count_ = (countDepth == 0 ? it->second.count_ : it->second.distinct_.size());
+      group.totalSize_ = it->second.totalSize_;
+
+      if (group.count_ >= minimumCount)
+      {
+        group.values_.resize(groupBy.size());
+        for (size_t i = 0; i < groupBy.size(); i++)
+        {
+          if (groupColumns[i] != NULL)
+          {
+            group.values_[i] = groupColumns[i]->GetValue(it->first[i]);
+          }
+        }
+
+        sorted.push_back(group);
+      }
+    }
+
+    std::sort(sorted.begin(), sorted.end());
+
+    for (size_t i = 0; i < sorted.size(); i++)
+    {
+      target.push_back(Group(sorted[i].values_, sorted[i].count_, sorted[i].totalSize_));
+    }
+  }
+}
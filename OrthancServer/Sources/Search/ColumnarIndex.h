@@ -0,0 +1,155 @@
+/**
+ * Orthanc - A Lightweight, RESTful DICOM Store
+ * Copyright (C) 2012-2016 Sebastien Jodogne, Medical Physics
+ * Department, University Hospital of Liege, Belgium
+ * Copyright (C) 2017-2022 Osimis S.A., Belgium
+ * Copyright (C) 2021-2022 Sebastien Jodogne, ICTEAM UCLouvain, Belgium
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+
+
+#pragma once
+
+#include "../../../OrthancFramework/Sources/DicomFormat/DicomMap.h"
+
+#include <boost/thread/shared_mutex.hpp>
+#include <list>
+#include <set>
+
+namespace Orthanc
+{
+  class DatabaseLookup;
+
+  /**
+   * New in Orthanc 1.11.0: In-memory, column-oriented replica of the
+   * main DICOM tags that are stored in the index. At each level of
+   * the DICOM hierarchy, each main DICOM tag is dictionary-encoded:
+   * The distinct values of the tag are stored once, and the resources
+   * of the level are associated with a contiguous array of integer
+   * codes. Aggregates (group-by/count) are computed by scanning these
+   * arrays, without accessing the database.
+   **/
+  class ColumnarIndex : public boost::noncopyable
+  {
+  public:
+    class Group
+    {
+    private:
+      std::vector<std::string>  values_;
+      uint64_t                  count_;
+      uint64_t                  totalSize_;
+
+    public:
+      Group(const std::vector<std::string>& values,
+            uint64_t count,
+            uint64_t totalSize) :
+        values_(values),
+        count_(count),
+        totalSize_(totalSize)
+      {
+      }
+
+      // The values follow the order of the "groupBy" tags, an
+      // empty string corresponds to a missing tag
+      const std::vector<std::string>& GetValues() const
+      {
+        return values_;
+      }
+
+      uint64_t GetCount() const
+      {
+        return count_;
+      }
+
+      // Sum of the sizes of the resources (only meaningful at the
+      // instance level, where it corresponds to the size of the DICOM files)
+      uint64_t GetTotalSize() const
+      {
+        return totalSize_;
+      }
+    };
+
+  private:
+    class Column;
+    class Level;
+    class Accumulator;
+
+    mutable boost::shared_mutex  mutex_;
+    Level*                       levels_[4];
+    bool                         isLoaded_;
+    std::set<std::string>        removedWhileLoading_;
+
+    Level& GetLevel(ResourceType level) const;
+
+    bool StoreInternal(ResourceType level,
+                       const std::string& publicId,
+                       const std::string& parentId,
+                       const DicomMap& mainDicomTags,
+                       uint64_t size);
+
+    void Compact(size_t levelIndex);
+
+  public:
+    ColumnarIndex();
+
+    ~ColumnarIndex();
+
+    // Inserts or updates one resource. Returns "false" if its parent
+    // is not part of the index yet.
+    bool Store(ResourceType level,
+               const std::string& publicId,
+               const std::string& parentId,
+               const DicomMap& mainDicomTags,
+               uint64_t size);
+
+    // Same as "Store()", but used while loading the index from the
+    // database: The resources that have been removed in the meantime
+    // are ignored, and the resources that are already known are kept
+    bool Load(ResourceType level,
+              const std::string& publicId,
+              const std::string& parentId,
+              const DicomMap& mainDicomTags,
+              uint64_t size);
+
+    void Remove(ResourceType level,
+                const std::string& publicId);
+
+    void MarkAsLoaded();
+
+    bool IsLoaded() const;
+
+    bool HasResource(ResourceType level,
+                     const std::string& publicId) const;
+
+    size_t GetResourcesCount(ResourceType level) const;
+
+    /**
+     * Groups the resources at level "level" that match "filter" by
+     * the values of the "groupBy" tags. Each of these tags can be
+     * stored at "level" or at one of its ancestors. The count of a
+     * group is the number of distinct resources at "countLevel"
+     * (which must be "level" or one of its ancestors), and the groups
+     * whose count is below "minimumCount" are discarded. The groups
+     * are sorted by their values.
+     **/
+    void GroupBy(std::list<Group>& target,
+                 ResourceType level,
+                 const std::vector<DicomTag>& groupBy,
+                 const DatabaseLookup& filter,
+                 ResourceType countLevel,
+                 uint64_t minimumCount) const;
+  };
+}
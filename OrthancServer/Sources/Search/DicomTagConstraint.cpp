@@ -31,24 +31,47 @@
 #include "../../../OrthancFramework/Sources/Toolbox.h"
 #include "DatabaseConstraint.h"
 
-#include <boost/regex.hpp>
+#include <cassert>
 
 namespace Orthanc
 {
+  // Tells whether "value" is left unchanged by
+  // "Toolbox::ToUpperCaseWithAccents()", which is the case of most
+  // DICOM values (dates, times, UIDs, code strings...). This is
+  // independent of the global locale, as only ASCII characters that
+  // are not lowercase letters are accepted.
+  static bool IsAlreadyNormalized(const std::string& value)
+  {
+    for (size_t i = 0; i < value.size(); i++)
+    {
+      const uint8_t c = static_cast<uint8_t>(value[i]);
+      if (c >= 128 ||
+          (c >= 'a' && c <= 'z'))
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+
   class DicomTagConstraint::NormalizedString : public boost::noncopyable
   {
   private:
     const std::string&  source_;
-    bool                caseSensitive_;
+    bool                isSource_;
     std::string         upper_;
 
   public:
     NormalizedString(const std::string& source,
                      bool caseSensitive) :
       source_(source),
-      caseSensitive_(caseSensitive)
+      isSource_(caseSensitive || IsAlreadyNormalized(source))
     {
-      if (!caseSensitive_)
+      // Fast path: Avoid the conversion to/from wide strings if
+      // normalization would not modify the source
+      if (!isSource_)
       {
         upper_ = Toolbox::ToUpperCaseWithAccents(source);
       }
@@ -56,7 +79,7 @@ namespace Orthanc
 
     const std::string& GetValue() const
     {
-      if (caseSensitive_)
+      if (isSource_)
       {
         return source_;
       }
@@ -68,26 +91,172 @@ namespace Orthanc
   };
 
 
-  class DicomTagConstraint::RegularExpression : public boost::noncopyable
+  /**
+   * New in Orthanc 1.11.0: Immutable query plan of one constraint,
+   * that is compiled once and then reused across all the candidate
+   * values (possibly by several threads). The reference values are
+   * normalized once, and wildcards are matched without regular
+   * expressions.
+   **/
+  class DicomTagConstraint::CompiledMatcher : public boost::noncopyable
   {
   private:
-    boost::regex  regex_;
+    ConstraintType            type_;
+    bool                      caseSensitive_;
+    std::string               reference_;   // For "Equal", "SmallerOrEqual" and "GreaterOrEqual"
+    std::set<std::string>     references_;  // For "List"
+    std::vector<std::string>  segments_;    // For "Wildcard": The pattern split at each '*'
+
+    static std::string Normalize(const std::string& source,
+                                 bool caseSensitive)
+    {
+      NormalizedString normalized(source, caseSensitive);
+      return normalized.GetValue();
+    }
+
+    // Character '?' of the segment matches any byte, just like the
+    // '.' of "Toolbox::WildcardToRegularExpression()"
+    static bool IsSegmentAt(const std::string& value,
+                            size_t position,
+                            const std::string& segment)
+    {
+      assert(position + segment.size() <= value.size());
+
+      for (size_t i = 0; i < segment.size(); i++)
+      {
+        if (segment[i] != '?' &&
+            segment[i] != value[position + i])
+        {
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+    bool IsWildcardMatch(const std::string& value) const
+    {
+      assert(!segments_.empty());
+
+      if (segments_.size() == 1)
+      {
+        // No '*' in the pattern
+        return (value.size() == segments_[0].size() &&
+                IsSegmentAt(value, 0, segments_[0]));
+      }
+
+      const std::string& prefix = segments_.front();
+      const std::string& suffix = segments_.back();
+
+      if (value.size() < prefix.size() + suffix.size() ||
+          !IsSegmentAt(value, 0, prefix) ||
+          !IsSegmentAt(value, value.size() - suffix.size(), suffix))
+      {
+        return false;
+      }
+
+      /**
+       * Each segment between two '*' is matched at its leftmost
+       * possible position: Leaving more room to the next segments
+       * can only help, so there is never a need to backtrack, and
+       * the complexity is bounded by (value size * pattern size).
+       **/
+      size_t position = prefix.size();
+      const size_t end = value.size() - suffix.size();
+
+      for (size_t i = 1; i + 1 < segments_.size(); i++)
+      {
+        const std::string& segment = segments_[i];
+
+        for (;;)
+        {
+          if (position + segment.size() > end)
+          {
+            return false;
+          }
+          else if (IsSegmentAt(value, position, segment))
+          {
+            break;
+          }
+          else
+          {
+            position++;
+          }
+        }
+
+        position += segment.size();
+      }
+
+      return true;
+    }
 
   public:
-    RegularExpression(const std::string& source,
-                      bool caseSensitive)
+    explicit CompiledMatcher(const DicomTagConstraint& constraint) :
+      type_(constraint.GetConstraintType()),
+      caseSensitive_(constraint.IsCaseSensitive())
     {
-      NormalizedString normalized(source, caseSensitive);
-      regex_ = boost::regex(Toolbox::WildcardToRegularExpression(normalized.GetValue()));
+      switch (type_)
+      {
+        case ConstraintType_Equal:
+        case ConstraintType_SmallerOrEqual:
+        case ConstraintType_GreaterOrEqual:
+          reference_ = Normalize(constraint.GetValue(), caseSensitive_);
+          break;
+
+        case ConstraintType_Wildcard:
+          Toolbox::TokenizeString(segments_, Normalize(constraint.GetValue(), caseSensitive_), '*');
+          break;
+
+        case ConstraintType_List:
+          for (std::set<std::string>::const_iterator it = constraint.GetValues().begin();
+               it != constraint.GetValues().end(); ++it)
+          {
+            references_.insert(Normalize(*it, caseSensitive_));
+          }
+          break;
+
+        default:
+          throw OrthancException(ErrorCode_InternalError);
+      }
     }
 
-    const boost::regex& GetValue() const
+    bool IsMatch(const std::string& value) const
     {
-      return regex_;
+      // For dates and times, the normalized value is the source
+      // value itself, so range matching involves no copy
+      NormalizedString source(value, caseSensitive_);
+
+      switch (type_)
+      {
+        case ConstraintType_Equal:
+          return source.GetValue() == reference_;
+
+        case ConstraintType_SmallerOrEqual:
+          return source.GetValue() <= reference_;
+
+        case ConstraintType_GreaterOrEqual:
+          return source.GetValue() >= reference_;
+
+        case ConstraintType_Wildcard:
+          return IsWildcardMatch(source.GetValue());
+
+        case ConstraintType_List:
+          return references_.find(source.GetValue()) != references_.end();
+
+        default:
+          throw OrthancException(ErrorCode_InternalError);
+      }
     }
   };
 
 
+  void DicomTagConstraint::InvalidateMatcher()
+  {
+    boost::mutex::scoped_lock lock(matcherMutex_);
+    matcher_.reset();
+  }
+
+
   void DicomTagConstraint::AssignSingleValue(const std::string& value)
   {
     if (constraintType_ != ConstraintType_Wildcard &&
@@ -150,6 +319,9 @@ namespace Orthanc
     caseSensitive_(other.caseSensitive_),
     mandatory_(other.mandatory_)
   {
+    // The compiled matcher is immutable, so it can be shared
+    boost::mutex::scoped_lock lock(other.matcherMutex_);
+    matcher_ = other.matcher_;
   }
     
 
@@ -193,10 +365,18 @@ namespace Orthanc
     else
     {
       values_.insert(value);
+      InvalidateMatcher();
     }
   }
 
 
+  void DicomTagConstraint::SetCaseSensitive(bool caseSensitive)
+  {
+    caseSensitive_ = caseSensitive;
+    InvalidateMatcher();
+  }
+
+
   const std::string& DicomTagConstraint::GetValue() const
   {
     if (constraintType_ == ConstraintType_List)
@@ -216,56 +396,20 @@ namespace Orthanc
 
   bool DicomTagConstraint::IsMatch(const std::string& value) const
   {
-    NormalizedString source(value, caseSensitive_);
+    boost::shared_ptr<CompiledMatcher> matcher;
 
-    switch (constraintType_)
     {
-      case ConstraintType_Equal:
-      {
-        NormalizedString reference(GetValue(), caseSensitive_);
-        return source.GetValue() == reference.GetValue();
-      }
-
-      case ConstraintType_SmallerOrEqual:
+      boost::mutex::scoped_lock lock(matcherMutex_);
+      if (matcher_.get() == NULL)
       {
-        NormalizedString reference(GetValue(), caseSensitive_);
-        return source.GetValue() <= reference.GetValue();
+        matcher_.reset(new CompiledMatcher(*this));
       }
 
-      case ConstraintType_GreaterOrEqual:
-      {
-        NormalizedString reference(GetValue(), caseSensitive_);
-        return source.GetValue() >= reference.GetValue();
-      }
-
-      case ConstraintType_Wildcard:
-      {
-        if (regex_.get() == NULL)
-        {
-          regex_.reset(new RegularExpression(GetValue(), caseSensitive_));
-        }
-
-        return boost::regex_match(source.GetValue(), regex_->GetValue());
-      }
-
-      case ConstraintType_List:
-      {
-        for (std::set<std::string>::const_iterator
-               it = values_.begin(); it != values_.end(); ++it)
-        {
-          NormalizedString reference(*it, caseSensitive_);
-          if (source.GetValue() == reference.GetValue())
-          {
-            return true;
-          }
-        }
-
-        return false;
-      }
-
-      default:
-        throw OrthancException(ErrorCode_InternalError);
+      matcher = matcher_;
     }
+
+    // Using a "const CompiledMatcher" is thread-safe
+    return matcher->IsMatch(value);
   }
 
 
@@ -27,6 +27,7 @@
 #include "DatabaseConstraint.h"
 
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 
 namespace Orthanc
 {
@@ -34,7 +35,7 @@ namespace Orthanc
   {
   private:
     class NormalizedString;
-    class RegularExpression;
+    class CompiledMatcher;
 
     DicomTag                tag_;
     ConstraintType          constraintType_;
@@ -42,10 +43,13 @@ namespace Orthanc
     bool                    caseSensitive_;
     bool                    mandatory_;
 
-    mutable boost::shared_ptr<RegularExpression>  regex_;  // mutable because the regex is an internal object created only when required (in IsMatch const method)
+    mutable boost::shared_ptr<CompiledMatcher>  matcher_;  // mutable because the matcher is an internal object created only when required (in IsMatch const method)
+    mutable boost::mutex                        matcherMutex_;  // New in Orthanc 1.11.0, as lookups can be filtered by several threads
 
     void AssignSingleValue(const std::string& value);
 
+    void InvalidateMatcher();
+
   public:
     DicomTagConstraint(const DicomTag& tag,
                        ConstraintType type,
@@ -83,10 +87,7 @@ namespace Orthanc
       return caseSensitive_;
     }
 
-    void SetCaseSensitive(bool caseSensitive)
-    {
-      caseSensitive_ = caseSensitive;
-    }
+    void SetCaseSensitive(bool caseSensitive);
 
     bool IsMandatory() const
     {
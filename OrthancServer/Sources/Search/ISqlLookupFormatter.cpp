@@ -65,6 +65,143 @@ namespace Orthanc
   }      
   
 
+  static bool GetPrefixUpperBound(std::string& target,
+                                  const std::string& prefix)
+  {
+    // Smallest string that is greater than all the strings starting
+    // with "prefix", in the bytewise order. Returns "false" if there
+    // is no such string (i.e. if "prefix" only contains 0xff bytes).
+    target = prefix;
+
+    while (!target.empty())
+    {
+      const size_t last = target.size() - 1;
+      const unsigned char c = static_cast<unsigned char>(target[last]);
+      
+      if (c == 0xff)
+      {
+        target.resize(last);
+      }
+      else
+      {
+        target[last] = static_cast<char>(c + 1);
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+
+  static void FormatPrefixRange(std::string& target,
+                                ISqlLookupFormatter& formatter,
+                                const std::string& column,
+                                const std::string& prefix)
+  {
+    assert(!prefix.empty());
+
+    target = column + " >= " + formatter.GenerateParameter(prefix);
+
+    std::string upperBound;
+    if (GetPrefixUpperBound(upperBound, prefix))
+    {
+      target += " AND " + column + " < " + formatter.GenerateParameter(upperBound);
+    }
+  }
+
+
+  /**
+   * New in Orthanc 1.11.0: Turn the literal prefix of a wildcard
+   * constraint (i.e. the characters before the first "*" or "?")
+   * into a range scan that can use an index of the database. Returns
+   * "true" iff the range is exactly equivalent to the wildcard, in
+   * which case the "LIKE" comparison can be skipped.
+   **/
+  static bool FormatWildcardRange(std::string& target,
+                                  ISqlLookupFormatter& formatter,
+                                  const DatabaseConstraint& constraint,
+                                  const std::string& tag)
+  {
+    target.clear();
+
+    const std::string& value = constraint.GetSingleValue();
+
+    const size_t wildcard = value.find_first_of("*?");
+    if (wildcard == 0 ||
+        wildcard == std::string::npos)
+    {
+      return false;
+    }
+
+    const std::string prefix = value.substr(0, wildcard);
+    const bool isPrefixOnly = (wildcard + 1 == value.size() &&
+                               value[wildcard] == '*');
+
+    if (constraint.IsIdentifier())
+    {
+      // The values of the identifiers are already normalized, and
+      // are indexed by "DicomIdentifiersIndexValues"
+      assert(constraint.IsCaseSensitive());
+      FormatPrefixRange(target, formatter, tag + ".value", prefix);
+      return isPrefixOnly;
+    }
+    else
+    {
+      /**
+       * The normalized keys are computed by the "upper()" function of
+       * SQLite, that only converts the ASCII characters. The prefix
+       * is truncated before its first non-ASCII character, then
+       * converted the same way: The normalized key of a value that
+       * matches the wildcard (be it case-sensitive or not, as "LIKE"
+       * and "lower()" also only fold the ASCII characters) always
+       * starts with the normalized prefix. This range is thus a
+       * superset of the matching values, that can use the index on
+       * the normalized keys.
+       **/
+      std::string normalizedPrefix;
+      for (size_t i = 0; i < prefix.size() &&
+             static_cast<unsigned char>(prefix[i]) < 0x80; i++)
+      {
+        if (prefix[i] >= 'a' &&
+            prefix[i] <= 'z')
+        {
+          normalizedPrefix.push_back(prefix[i] - 'a' + 'A');
+        }
+        else
+        {
+          normalizedPrefix.push_back(prefix[i]);
+        }
+      }
+
+      if (normalizedPrefix.empty())
+      {
+        return false;
+      }
+
+      std::string range;
+      FormatPrefixRange(range, formatter, "normalizedValue", normalizedPrefix);
+
+      target = (tag + ".id IN (SELECT id FROM MainDicomTagsNormalized WHERE tagGroup = " +
+                boost::lexical_cast<std::string>(constraint.GetTag().GetGroup()) +
+                " AND tagElement = " +
+                boost::lexical_cast<std::string>(constraint.GetTag().GetElement()) +
+                " AND " + range + ")");
+
+      if (constraint.IsCaseSensitive())
+      {
+        std::string exact;
+        FormatPrefixRange(exact, formatter, tag + ".value", prefix);
+        target += " AND " + exact;
+        return isPrefixOnly;
+      }
+      else
+      {
+        return false;
+      }
+    }
+  }
+
+
   static bool FormatComparison(std::string& target,
                                ISqlLookupFormatter& formatter,
                                const DatabaseConstraint& constraint,
@@ -200,17 +337,32 @@ namespace Orthanc
             }               
           }
 
-          std::string parameter = formatter.GenerateParameter(escaped);
-
-          if (constraint.IsCaseSensitive())
+          std::string range;
+          if (formatter.HasNormalizedKeys() &&
+              FormatWildcardRange(range, formatter, constraint, tag))
           {
-            comparison = (tag + ".value LIKE " + parameter + " " +
-                          formatter.FormatWildcardEscape());
+            // The range is equivalent to the wildcard, no need for "LIKE"
+            comparison = range;
           }
           else
           {
-            comparison = ("lower(" + tag + ".value) LIKE lower(" +
-                          parameter + ") " + formatter.FormatWildcardEscape());
+            std::string parameter = formatter.GenerateParameter(escaped);
+
+            if (constraint.IsCaseSensitive())
+            {
+              comparison = (tag + ".value LIKE " + parameter + " " +
+                            formatter.FormatWildcardEscape());
+            }
+            else
+            {
+              comparison = ("lower(" + tag + ".value) LIKE lower(" +
+                            parameter + ") " + formatter.FormatWildcardEscape());
+            }
+
+            if (!range.empty())
+            {
+              comparison = range + " AND " + comparison;
+            }
           }
         }
           
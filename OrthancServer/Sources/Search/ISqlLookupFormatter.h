@@ -56,6 +56,21 @@ namespace Orthanc
      **/
     virtual bool IsEscapeBrackets() const = 0;
 
+    /**
+     * Whether the database has a complete "MainDicomTagsNormalized"
+     * table, with the same primary key as "MainDicomTags" and whose
+     * "normalizedValue" column contains the value converted to upper
+     * case in ASCII (as the "upper()" function of SQLite), and whether
+     * the database compares strings bytewise (as "COLLATE BINARY" in
+     * SQLite). If so, the literal prefix of the wildcard constraints
+     * is turned into a range scan. New in Orthanc 1.11.0, this method
+     * is not pure so as not to break the "orthanc-databases" project.
+     **/
+    virtual bool HasNormalizedKeys() const
+    {
+      return false;
+    }
+
     static void Apply(std::string& sql,
                       ISqlLookupFormatter& formatter,
                       const std::vector<DatabaseConstraint>& lookup,
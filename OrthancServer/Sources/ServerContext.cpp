@@ -25,6 +25,8 @@
 
 #include "../../OrthancFramework/Sources/Cache/SharedArchive.h"
 #include "../../OrthancFramework/Sources/DicomFormat/DicomElement.h"
+#include "../../OrthancFramework/Sources/DicomFormat/DicomFrameOffsetTable.h"
+#include "../../OrthancFramework/Sources/DicomFormat/DicomImageInformation.h"
 #include "../../OrthancFramework/Sources/DicomFormat/DicomStreamReader.h"
 #include "../../OrthancFramework/Sources/DicomParsing/DcmtkTranscoder.h"
 #include "../../OrthancFramework/Sources/DicomParsing/DicomModification.h"
@@ -37,11 +39,14 @@
 #include "../../OrthancFramework/Sources/Logging.h"
 #include "../../OrthancFramework/Sources/MallocMemoryBuffer.h"
 #include "../../OrthancFramework/Sources/MetricsRegistry.h"
+#include "../../OrthancFramework/Sources/MultiThreading/BufferArena.h"
+#include "../../OrthancFramework/Sources/SerializationToolbox.h"
 #include "../Plugins/Engine/OrthancPlugins.h"
 
 #include "OrthancConfiguration.h"
 #include "OrthancRestApi/OrthancRestApi.h"
 #include "Search/DatabaseLookup.h"
+#include "SliceOrdering.h"
 #include "ServerJobs/OrthancJobUnserializer.h"
 #include "ServerToolbox.h"
 #include "StorageCommitmentReports.h"
@@ -98,6 +103,84 @@ namespace Orthanc
   }
 
 
+  static bool ComputeFrameOffsets(std::string& target,
+                                  const DicomInstanceToStore& dicom,
+                                  const DicomMap& summary,
+                                  DicomTransferSyntax transferSyntax,
+                                  uint64_t pixelDataOffset)
+  {
+    if (!IsTranscodableTransferSyntax(transferSyntax))
+    {
+      // DICOM videos are considered as one single frame by "ParsedDicomFile"
+      return false;
+    }
+
+    try
+    {
+      DicomImageInformation info(summary);
+
+      size_t frameSize = 0;
+      if (IsUncompressedTransferSyntax(transferSyntax))
+      {
+        if (info.GetBitsAllocated() % 8 != 0)
+        {
+          return false;  // Frames might not be aligned on bytes
+        }
+        else
+        {
+          frameSize = info.GetFrameSize();
+        }
+      }
+
+      DicomFrameOffsetTable table;
+      if (table.Compute(dicom.GetBufferData(), dicom.GetBufferSize(), pixelDataOffset,
+                        transferSyntax, info.GetNumberOfFrames(), frameSize))
+      {
+        table.Format(target);
+        return true;
+      }
+      else
+      {
+        return false;
+      }
+    }
+    catch (OrthancException&)
+    {
+      // Not an image, or unsupported layout of the pixel data
+      return false;
+    }
+  }
+
+
+  namespace
+  {
+    class DeferredTranscodingItem : public IDynamicObject
+    {
+    private:
+      std::string          instancePublicId_;
+      DicomInstanceOrigin  origin_;
+
+    public:
+      DeferredTranscodingItem(const std::string& instancePublicId,
+                              const DicomInstanceOrigin& origin) :
+        instancePublicId_(instancePublicId),
+        origin_(origin)
+      {
+      }
+
+      const std::string& GetInstancePublicId() const
+      {
+        return instancePublicId_;
+      }
+
+      const DicomInstanceOrigin& GetOrigin() const
+      {
+        return origin_;
+      }
+    };
+  }
+
+
   ServerContext::StoreResult::StoreResult() :
     status_(StoreStatus_Failure),
     cstoreStatusCode_(0)
@@ -116,6 +199,19 @@ namespace Orthanc
       {
         const ServerIndexChange& change = dynamic_cast<const ServerIndexChange&>(*obj.get());
 
+        if (that->columnarIndex_.get() != NULL)
+        {
+          // New in Orthanc 1.11.0: Keep the columnar index up-to-date
+          try
+          {
+            that->SignalColumnarIndexChange(change);
+          }
+          catch (OrthancException& e)
+          {
+            LOG(ERROR) << "Cannot update the columnar index: " << e.What();
+          }
+        }
+
         boost::shared_lock<boost::shared_mutex> lock(that->listenersMutex_);
         for (ServerListeners::iterator it = that->listeners_.begin(); 
              it != that->listeners_.end(); ++it)
@@ -243,6 +339,45 @@ namespace Orthanc
       LOG(INFO) << "Not reloading the jobs from the last execution of Orthanc";
     }
 
+    {
+      // New configuration options in Orthanc 1.11.0. They are applied
+      // after the unserialization, as the latter replaces the registry.
+      static const char* const JOBS_TYPES = "JobsTypes";
+      static const char* const MAX_RUNNING = "MaxRunning";
+      static const char* const WEIGHT = "Weight";
+
+      OrthancConfiguration::ReaderLock lock;
+
+      JobsRegistry& registry = jobsEngine_.GetRegistry();
+      registry.SetFairScheduling(lock.GetConfiguration().GetBooleanParameter("JobsFairScheduling", false));
+      registry.SetAgingDelay(lock.GetConfiguration().GetUnsignedIntegerParameter("JobsAgingDelay", 0));
+
+      if (lock.GetJson().isMember(JOBS_TYPES))
+      {
+        const Json::Value& types = lock.GetJson()[JOBS_TYPES];
+        if (types.type() != Json::objectValue)
+        {
+          throw OrthancException(ErrorCode_BadFileFormat,
+                                 "The configuration option \"" + std::string(JOBS_TYPES) +
+                                 "\" must be an object");
+        }
+
+        Json::Value::Members members = types.getMemberNames();
+        for (size_t i = 0; i < members.size(); i++)
+        {
+          const Json::Value& type = types[members[i]];
+          if (type.type() != Json::objectValue)
+          {
+            throw OrthancException(ErrorCode_BadFileFormat,
+                                   "Bad configuration for job type: " + members[i]);
+          }
+
+          registry.SetJobTypeMaxRunning(members[i], SerializationToolbox::ReadUnsignedInteger(type, MAX_RUNNING, 0));
+          registry.SetJobTypeWeight(members[i], SerializationToolbox::ReadUnsignedInteger(type, WEIGHT, 1));
+        }
+      }
+    }
+
     jobsEngine_.GetRegistry().SetObserver(*this);
     jobsEngine_.Start();
     isJobsEngineUnserialized_ = true;
@@ -251,6 +386,330 @@ namespace Orthanc
   }
 
 
+  void ServerContext::DeferredTranscodingThread(ServerContext* that,
+                                                unsigned int sleepDelay,
+                                                bool recoverPending)
+  {
+    if (recoverPending)
+    {
+      try
+      {
+        that->RecoverPendingTranscodings();
+      }
+      catch (OrthancException& e)
+      {
+        LOG(ERROR) << "Cannot recover the instances waiting for their ingest transcoding: " << e.What();
+      }
+    }
+
+    while (!that->done_)
+    {
+      std::unique_ptr<IDynamicObject> obj(that->deferredTranscodingQueue_.Dequeue(sleepDelay));
+
+      if (obj.get() != NULL)
+      {
+        that->PublishDeferredTranscodingMetrics();
+
+        const DeferredTranscodingItem& item = dynamic_cast<const DeferredTranscodingItem&>(*obj);
+
+        try
+        {
+          that->ApplyDeferredTranscoding(item.GetInstancePublicId(), item.GetOrigin());
+        }
+        catch (OrthancException& e)
+        {
+          LOG(ERROR) << "Error while transcoding instance " << item.GetInstancePublicId()
+                     << " in the background, keeping its original transfer syntax: " << e.What();
+          that->ClearPendingTranscoding(item.GetInstancePublicId());
+        }
+      }
+    }
+  }
+
+
+  void ServerContext::ReadAheadDispatcherThread(ServerContext* that,
+                                                unsigned int sleepDelay)
+  {
+    while (!that->done_)
+    {
+      std::unique_ptr<IDynamicObject> obj(that->readAheadAccesses_.Dequeue(sleepDelay));
+
+      if (obj.get() != NULL)
+      {
+        const std::string& instanceId = dynamic_cast<const SingleValueObject<std::string>&>(*obj).GetValue();
+
+        try
+        {
+          std::string seriesId;
+          if (!that->index_.LookupParent(seriesId, instanceId))
+          {
+            continue;  // The instance was deleted in the meantime
+          }
+
+          if (!that->readAheadTracker_.HasSeries(seriesId))
+          {
+            // First access to this series: Sort its instances
+            std::vector<std::string> instances;
+
+            try
+            {
+              SliceOrdering ordering(that->index_, seriesId);
+
+              instances.reserve(ordering.GetInstancesCount());
+
+              for (size_t i = 0; i < ordering.GetInstancesCount(); i++)
+              {
+                instances.push_back(ordering.GetInstanceId(i));
+              }
+            }
+            catch (OrthancException& e)
+            {
+              // The slices cannot be sorted: Fall back to the order of
+              // the instances in the index, which is recorded in the
+              // tracker, so that the sorting is not retried at each access
+              LOG(INFO) << "Using the index order for the read-ahead in series "
+                        << seriesId << ": " << e.What();
+
+              std::list<std::string> children;
+              that->index_.GetChildren(children, seriesId);
+
+              instances.assign(children.begin(), children.end());
+            }
+
+            that->readAheadTracker_.SetSeries(seriesId, instances);
+          }
+
+          std::vector<std::string> next;
+          that->readAheadTracker_.SignalAccess(next, seriesId, instanceId, that->readAheadCount_);
+
+          // Only prefetch the instances that fit in the memory budget,
+          // so that the read-ahead cannot evict the whole DICOM cache
+          uint64_t size = 0;
+
+          for (size_t i = 0; i < next.size(); i++)
+          {
+            FileInfo attachment;
+            int64_t revision;
+            if (that->index_.LookupAttachment(attachment, revision, next[i], FileContentType_Dicom))
+            {
+              size += attachment.GetUncompressedSize();
+              if (size > that->readAheadMemoryBudget_)
+              {
+                break;
+              }
+
+              that->readAheadTracker_.SignalPrefetched(next[i]);
+              that->readAheadQueue_.Enqueue(new SingleValueObject<std::string>(next[i]));
+            }
+          }
+        }
+        catch (OrthancException& e)
+        {
+          LOG(INFO) << "Cannot schedule the read-ahead after instance " << instanceId << ": " << e.What();
+        }
+      }
+    }
+  }
+
+
+  void ServerContext::ReadAheadWorkerThread(ServerContext* that,
+                                            unsigned int sleepDelay)
+  {
+    while (!that->done_)
+    {
+      std::unique_ptr<IDynamicObject> obj(that->readAheadQueue_.Dequeue(sleepDelay));
+
+      if (obj.get() != NULL)
+      {
+        const std::string& instanceId = dynamic_cast<const SingleValueObject<std::string>&>(*obj).GetValue();
+
+        try
+        {
+          // Loading the instance is sufficient to store it into the
+          // cache of parsed DICOM files. If the viewer requests this
+          // instance while it is still being loaded, its request waits
+          // for this load to complete (cf. "pendingDicomLoads_").
+          DicomCacheLocker locker(*that, instanceId);
+        }
+        catch (OrthancException& e)
+        {
+          LOG(INFO) << "Cannot read ahead instance " << instanceId << ": " << e.What();
+        }
+      }
+    }
+  }
+
+
+  void ServerContext::DatabaseCompactionThread(ServerContext* that,
+                                               unsigned int sleepDelay)
+  {
+    // Interval between two slices of the compaction
+    static const unsigned int COMPACTION_INTERVAL_MS = 1000;
+
+    boost::posix_time::ptime lastCompaction = boost::posix_time::microsec_clock::universal_time();
+    boost::posix_time::ptime lastOptimize = lastCompaction;
+
+    while (!that->done_)
+    {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(sleepDelay));
+
+      const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+      try
+      {
+        if (that->databaseCompactionPages_ != 0 &&
+            (now - lastCompaction).total_milliseconds() >= COMPACTION_INTERVAL_MS)
+        {
+          lastCompaction = now;
+
+          uint64_t totalPages, freePages;
+          that->index_.GetDatabasePagesCount(totalPages, freePages);
+
+          if (freePages > 0)
+          {
+            bool done;
+
+            {
+              MetricsRegistry::Timer timer(that->GetMetricsRegistry(), "orthanc_index_compaction_duration_ms");
+              done = that->index_.CompactDatabaseIncrementally(that->databaseCompactionPages_,
+                                                               that->databaseCompactionIdleDelay_);
+            }
+
+            if (done)
+            {
+              uint64_t totalPagesAfter, freePagesAfter;
+              that->index_.GetDatabasePagesCount(totalPagesAfter, freePagesAfter);
+
+              LOG(TRACE) << "Incremental compaction of the database: " << totalPages << " pages ("
+                         << freePages << " free) before, " << totalPagesAfter << " pages ("
+                         << freePagesAfter << " free) after";
+
+              totalPages = totalPagesAfter;
+              freePages = freePagesAfter;
+            }
+          }
+
+          that->GetMetricsRegistry().SetValue("orthanc_index_pages_count", static_cast<float>(totalPages));
+          that->GetMetricsRegistry().SetValue("orthanc_index_free_pages_count", static_cast<float>(freePages));
+        }
+
+        if (that->databaseOptimizeInterval_ != 0 &&
+            (now - lastOptimize).total_seconds() >= static_cast<int>(that->databaseOptimizeInterval_))
+        {
+          lastOptimize = now;
+
+          LOG(INFO) << "Optimizing the database";
+          MetricsRegistry::Timer timer(that->GetMetricsRegistry(), "orthanc_index_optimize_duration_ms");
+          that->index_.OptimizeDatabase();
+        }
+      }
+      catch (OrthancException& e)
+      {
+        LOG(ERROR) << "Error during the compaction of the database: " << e.What();
+      }
+    }
+  }
+
+
+  void ServerContext::StorageVerificationThread(ServerContext* that,
+                                                unsigned int sleepDelay)
+  {
+    // Number of instances that are read from the index at once
+    static const size_t PAGE_SIZE = 1000;
+
+    // The pass walks the instances by increasing public ID, so that
+    // the instances that are stored or deleted during the pass don't
+    // shift the pages (which would skip some instances)
+    StatelessDatabaseOperations::UuidsPager pager(that->index_, ResourceType_Instance, PAGE_SIZE);
+    std::list<std::string> pending;
+    bool isFirstPage = true;
+    uint64_t countVerified = 0;
+    uint64_t countCorrupted = 0;
+    float credit = 0;
+
+    while (!that->done_)
+    {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(sleepDelay));
+
+      // Rate limiting: Accumulate the number of instances that can be
+      // verified during the elapsed time, without bursts after idle periods
+      credit = std::min(credit + static_cast<float>(that->storageVerificationRate_ * sleepDelay) / 1000.0f,
+                        static_cast<float>(that->storageVerificationRate_));
+
+      try
+      {
+        while (!that->done_ &&
+               credit >= 1.0f)
+        {
+          if (pending.empty())
+          {
+            if (!pager.GetNextPage(pending))
+            {
+              if (!isFirstPage)
+              {
+                LOG(INFO) << "Verification of the storage area is complete: " << countVerified
+                          << " attachment(s) verified, " << countCorrupted << " corrupted";
+              }
+
+              // The pager restarts from the beginning of the index at the next iteration
+              isFirstPage = true;
+              break;
+            }
+
+            isFirstPage = false;
+          }
+
+          const std::string instanceId = pending.front();
+          pending.pop_front();
+          credit -= 1.0f;
+
+          std::set<FileContentType> attachments;
+          try
+          {
+            that->index_.ListAvailableAttachments(attachments, instanceId, ResourceType_Instance);
+          }
+          catch (OrthancException&)
+          {
+            continue;  // The instance was deleted in the meantime
+          }
+
+          StorageAccessor accessor(that->area_, that->storageCache_, that->GetMetricsRegistry());
+
+          for (std::set<FileContentType>::const_iterator it = attachments.begin(); it != attachments.end(); ++it)
+          {
+            FileInfo info;
+            int64_t revision;
+            if (that->index_.LookupAttachment(info, revision, instanceId, *it))
+            {
+              countVerified++;
+
+              if (!accessor.Verify(info))
+              {
+                // Make sure the attachment was not removed during the verification
+                FileInfo info2;
+                if (that->index_.LookupAttachment(info2, revision, instanceId, *it) &&
+                    info2.GetUuid() == info.GetUuid())
+                {
+                  countCorrupted++;
+                  LOG(ERROR) << "Corrupted attachment " << info.GetUuid() << " (content type "
+                             << static_cast<int>(*it) << ") in instance " << instanceId;
+                }
+              }
+            }
+          }
+
+          that->GetMetricsRegistry().SetValue("orthanc_storage_verified_count", static_cast<float>(countVerified));
+          that->GetMetricsRegistry().SetValue("orthanc_storage_corrupted_count", static_cast<float>(countCorrupted));
+        }
+      }
+      catch (OrthancException& e)
+      {
+        LOG(ERROR) << "Error during the verification of the storage area: " << e.What();
+      }
+    }
+  }
+
+
   void ServerContext::SaveJobsEngine()
   {
     if (saveJobs_)
@@ -275,12 +734,257 @@ namespace Orthanc
   }
 
 
-  void ServerContext::PublishDicomCacheMetrics()
+  void ServerContext::PublishDicomCacheMetrics()
+  {
+    metricsRegistry_->SetValue("orthanc_dicom_cache_size",
+                               static_cast<float>(dicomCache_.GetCurrentSize()) / static_cast<float>(1024 * 1024));
+    metricsRegistry_->SetValue("orthanc_dicom_cache_count",
+                               static_cast<float>(dicomCache_.GetNumberOfItems()));
+  }
+
+
+  void ServerContext::PublishDeferredTranscodingMetrics()
+  {
+    metricsRegistry_->SetValue("orthanc_ingest_transcoding_backlog_count",
+                               static_cast<float>(deferredTranscodingQueue_.GetSize()));
+  }
+
+
+  void ServerContext::PublishDicomConnectionPoolMetrics()
+  {
+    uint64_t countCreated, countReused, countUnhealthy;
+    unsigned int countIdle;
+    dicomConnectionPool_.GetStatistics(countCreated, countReused, countUnhealthy, countIdle);
+
+    metricsRegistry_->SetValue("orthanc_dicom_associations_created_count", static_cast<float>(countCreated));
+    metricsRegistry_->SetValue("orthanc_dicom_associations_reused_count", static_cast<float>(countReused));
+    metricsRegistry_->SetValue("orthanc_dicom_associations_unhealthy_count", static_cast<float>(countUnhealthy));
+    metricsRegistry_->SetValue("orthanc_dicom_associations_idle_count", static_cast<float>(countIdle));
+  }
+
+
+  void ServerContext::DicomConnectionPoolThread(ServerContext* that,
+                                                unsigned int sleepDelay)
+  {
+    while (!that->done_)
+    {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(sleepDelay));
+
+      try
+      {
+        that->dicomConnectionPool_.CloseIfInactive();
+        that->PublishDicomConnectionPoolMetrics();
+      }
+      catch (OrthancException& e)
+      {
+        LOG(ERROR) << "Error while closing the inactive DICOM associations: " << e.What();
+      }
+    }
+  }
+
+
+  namespace
+  {
+    class ColumnarIndexVisitor : public StatelessDatabaseOperations::IExpandedResourceVisitor
+    {
+    private:
+      ColumnarIndex&          index_;
+      bool                    isLoading_;
+      std::list<std::string>  orphans_;
+
+    public:
+      ColumnarIndexVisitor(ColumnarIndex& index,
+                           bool isLoading) :
+        index_(index),
+        isLoading_(isLoading)
+      {
+      }
+
+      virtual void Visit(ExpandedResource& resource) ORTHANC_OVERRIDE
+      {
+        // The size of the DICOM files is only available at the instance level
+        const uint64_t size = (resource.type_ == ResourceType_Instance ? resource.fileSize_ : 0);
+
+        bool success;
+        if (isLoading_)
+        {
+          success = index_.Load(resource.type_, resource.id_, resource.parentId_, resource.tags_, size);
+        }
+        else
+        {
+          success = index_.Store(resource.type_, resource.id_, resource.parentId_, resource.tags_, size);
+        }
+
+        if (!success)
+        {
+          orphans_.push_back(resource.parentId_);
+        }
+      }
+
+      // Parents of the resources that could not be stored, because
+      // these parents are not part of the columnar index yet
+      const std::list<std::string>& GetOrphans() const
+      {
+        return orphans_;
+      }
+    };
+  }
+
+
+  static ExpandResourceDbFlags GetColumnarIndexFlags(ResourceType level)
+  {
+    if (level == ResourceType_Instance)
+    {
+      // The metadata are needed to get the size of the DICOM file
+      return static_cast<ExpandResourceDbFlags>(ExpandResourceDbFlags_IncludeMainDicomTags |
+                                                ExpandResourceDbFlags_IncludeMetadata);
+    }
+    else
+    {
+      return ExpandResourceDbFlags_IncludeMainDicomTags;
+    }
+  }
+
+
+  void ServerContext::StoreInColumnarIndex(ResourceType level,
+                                           const std::string& publicId)
+  {
+    assert(columnarIndex_.get() != NULL);
+
+    std::list<std::string> ids;
+    ids.push_back(publicId);
+
+    for (unsigned int retry = 0; retry < 2; retry++)
+    {
+      ColumnarIndexVisitor visitor(*columnarIndex_, false /* not loading */);
+      index_.ExpandResources(visitor, ids, std::set<DicomTag>(), GetColumnarIndexFlags(level));
+
+      if (visitor.GetOrphans().empty() ||
+          level == ResourceType_Patient ||
+          retry == 1)
+      {
+        return;
+      }
+      else
+      {
+        // The change about the parent has not been received yet (or
+        // the index is still being loaded): Store the parent first
+        StoreInColumnarIndex(GetParentResourceType(level), visitor.GetOrphans().front());
+      }
+    }
+  }
+
+
+  void ServerContext::SignalColumnarIndexChange(const ServerIndexChange& change)
+  {
+    assert(columnarIndex_.get() != NULL);
+
+    switch (change.GetChangeType())
+    {
+      case ChangeType_NewPatient:
+      case ChangeType_NewStudy:
+      case ChangeType_NewSeries:
+      case ChangeType_NewInstance:
+        StoreInColumnarIndex(change.GetResourceType(), change.GetPublicId());
+        break;
+
+      case ChangeType_Deleted:
+        columnarIndex_->Remove(change.GetResourceType(), change.GetPublicId());
+        break;
+
+      default:
+        break;
+    }
+  }
+
+
+  void ServerContext::ColumnarIndexThread(ServerContext* that)
+  {
+    // Number of resources that are read from the index at once
+    static const size_t PAGE_SIZE = 1000;
+
+    static const ResourceType LEVELS[] = {
+      ResourceType_Patient,
+      ResourceType_Study,
+      ResourceType_Series,
+      ResourceType_Instance
+    };
+
+    assert(that->columnarIndex_.get() != NULL);
+
+    LOG(WARNING) << "Loading the columnar index from the database";
+
+    try
+    {
+      // Load the levels from the top of the hierarchy, so that the
+      // parent of each resource is already known when it is stored.
+      // The resources are read by increasing public ID, so that the
+      // deletions that occur during the loading don't shift the
+      // pages. The resources that are created or deleted meanwhile
+      // are handled by "SignalColumnarIndexChange()".
+      for (size_t i = 0; i < sizeof(LEVELS) / sizeof(ResourceType); i++)
+      {
+        StatelessDatabaseOperations::UuidsPager pager(that->index_, LEVELS[i], PAGE_SIZE);
+
+        for (;;)
+        {
+          if (that->done_)
+          {
+            return;
+          }
+
+          std::list<std::string> page;
+          if (!pager.GetNextPage(page))
+          {
+            break;
+          }
+
+          ColumnarIndexVisitor visitor(*that->columnarIndex_, true /* loading */);
+          that->index_.ExpandResources(visitor, page, std::set<DicomTag>(), GetColumnarIndexFlags(LEVELS[i]));
+
+          if (!visitor.GetOrphans().empty())
+          {
+            // Some resources were created during the loading: Their
+            // ancestors are stored first by the call below
+            assert(LEVELS[i] != ResourceType_Patient);
+            
+            for (std::list<std::string>::const_iterator it = visitor.GetOrphans().begin();
+                 it != visitor.GetOrphans().end(); ++it)
+            {
+              that->StoreInColumnarIndex(GetParentResourceType(LEVELS[i]), *it);
+            }
+
+            that->index_.ExpandResources(visitor, page, std::set<DicomTag>(), GetColumnarIndexFlags(LEVELS[i]));
+          }
+        }
+      }
+
+      that->columnarIndex_->MarkAsLoaded();
+
+      LOG(WARNING) << "The columnar index is loaded: "
+                   << that->columnarIndex_->GetResourcesCount(ResourceType_Patient) << " patient(s), "
+                   << that->columnarIndex_->GetResourcesCount(ResourceType_Study) << " study(ies), "
+                   << that->columnarIndex_->GetResourcesCount(ResourceType_Series) << " series, "
+                   << that->columnarIndex_->GetResourcesCount(ResourceType_Instance) << " instance(s)";
+    }
+    catch (OrthancException& e)
+    {
+      LOG(ERROR) << "Cannot load the columnar index, \"/tools/group-by\" will not be available: " << e.What();
+    }
+  }
+
+
+  ColumnarIndex& ServerContext::GetColumnarIndex()
   {
-    metricsRegistry_->SetValue("orthanc_dicom_cache_size",
-                               static_cast<float>(dicomCache_.GetCurrentSize()) / static_cast<float>(1024 * 1024));
-    metricsRegistry_->SetValue("orthanc_dicom_cache_count",
-                               static_cast<float>(dicomCache_.GetNumberOfItems()));
+    if (columnarIndex_.get() == NULL)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls,
+                             "The columnar index is disabled, set configuration option \"ColumnarIndex\" to \"true\"");
+    }
+    else
+    {
+      return *columnarIndex_;
+    }
   }
 
 
@@ -312,12 +1016,27 @@ namespace Orthanc
     isIngestTranscoding_(false),
     ingestTranscodingOfUncompressed_(true),
     ingestTranscodingOfCompressed_(true),
+    deferredTranscodingMaxBacklog_(0),
+    isPendingTranscodingSignaled_(false),
+    isPendingTranscodingRecovered_(true),
+    databaseCompactionPages_(0),
+    databaseCompactionIdleDelay_(0),
+    databaseOptimizeInterval_(0),
+    storageVerificationRate_(0),
+    lookupThreadsCount_(0),
+    readAheadCount_(0),
+    readAheadMemoryBudget_(0),
+    readAheadTracker_(32 /* series */, 10000 /* prefetched instances */),
+    readAheadAccesses_(1000),
+    readAheadQueue_(1000),
     preferredTransferSyntax_(DicomTransferSyntax_LittleEndianExplicit),
     deidentifyLogs_(false)
   {
     try
     {
       unsigned int lossyQuality;
+      unsigned int deferredTranscodingThreads = 0;
+      unsigned int readAheadThreads = 0;
 
       {
         OrthancConfiguration::ReaderLock lock;
@@ -336,6 +1055,29 @@ namespace Orthanc
         limitFindInstances_ = lock.GetConfiguration().GetUnsignedIntegerParameter("LimitFindInstances", 0);
         limitFindResults_ = lock.GetConfiguration().GetUnsignedIntegerParameter("LimitFindResults", 0);
 
+        // New configuration option in Orthanc 1.11.0
+        lookupThreadsCount_ = lock.GetConfiguration().GetUnsignedIntegerParameter("FindThreadsCount", 4);
+
+        // New configuration option in Orthanc 1.11.0. The index must
+        // be created before "ChangeThread" is started.
+        if (lock.GetConfiguration().GetBooleanParameter("ColumnarIndex", false))
+        {
+          columnarIndex_.reset(new ColumnarIndex);
+        }
+
+        // New configuration options in Orthanc 1.11.0
+        readAheadCount_ = lock.GetConfiguration().GetUnsignedIntegerParameter("ReadAheadInstancesCount", 0);
+        if (readAheadCount_ > 0)
+        {
+          readAheadThreads = std::max(1u, lock.GetConfiguration().GetUnsignedIntegerParameter("ReadAheadThreadsCount", 2));
+          readAheadMemoryBudget_ = std::min(
+            static_cast<uint64_t>(lock.GetConfiguration().GetUnsignedIntegerParameter("ReadAheadMemoryBudget", 64)) * 1024 * 1024,
+            static_cast<uint64_t>(DICOM_CACHE_SIZE / 2));
+
+          LOG(WARNING) << "Read-ahead of up to " << readAheadCount_ << " instance(s) is enabled for "
+                       << "sequential accesses to the series, using " << readAheadThreads << " thread(s)";
+        }
+
         // New configuration option in Orthanc 1.6.0
         storageCommitmentReports_.reset(new StorageCommitmentReports(lock.GetConfiguration().GetUnsignedIntegerParameter("StorageCommitmentReportsSize", 100)));
 
@@ -364,6 +1106,16 @@ namespace Orthanc
             LOG(WARNING) << "  Ingest transcoding will "
                          << (ingestTranscodingOfCompressed_ ? "be applied" : "*not* be applied")
                          << " to compressed transfer syntaxes";
+
+            // New options in Orthanc 1.11.0
+            deferredTranscodingThreads = lock.GetConfiguration().GetUnsignedIntegerParameter("IngestTranscodingThreadsCount", 0);
+            deferredTranscodingMaxBacklog_ = lock.GetConfiguration().GetUnsignedIntegerParameter("IngestTranscodingMaxBacklog", 1000);
+
+            if (deferredTranscodingThreads > 0)
+            {
+              LOG(WARNING) << "  Ingest transcoding is deferred to " << deferredTranscodingThreads
+                           << " background thread(s)";
+            }
           }
           else
           {
@@ -377,6 +1129,22 @@ namespace Orthanc
           LOG(INFO) << "Automated transcoding of incoming DICOM instances is disabled";
         }
 
+        // New options in Orthanc 1.11.0
+        databaseCompactionPages_ = lock.GetConfiguration().GetUnsignedIntegerParameter("IndexCompactionPages", 1000);
+        databaseCompactionIdleDelay_ = lock.GetConfiguration().GetUnsignedIntegerParameter("IndexCompactionIdleDelay", 1000);
+        databaseOptimizeInterval_ = lock.GetConfiguration().GetUnsignedIntegerParameter("IndexOptimizeInterval", 86400);
+        storageVerificationRate_ = lock.GetConfiguration().GetUnsignedIntegerParameter("StorageVerificationRate", 0);
+        BufferArena::SetMaxRetainedSizeTotal(static_cast<size_t>(
+          lock.GetConfiguration().GetUnsignedIntegerParameter("BufferArenaMaxSize", 256)) * 1024 * 1024);
+        BufferArena::SetMaxRetainedSizePerThread(static_cast<size_t>(
+          lock.GetConfiguration().GetUnsignedIntegerParameter("BufferArenaSizePerThread", 0)) * 1024 * 1024);
+
+        // The inactivity timeout was only used by Lua in Orthanc <= 1.10.1
+        dicomConnectionPool_.SetInactivityTimeout(
+          lock.GetConfiguration().GetUnsignedIntegerParameter("DicomAssociationCloseDelay", 5) * 1000);
+        dicomConnectionPool_.SetMaxConnectionsPerRemote(
+          lock.GetConfiguration().GetUnsignedIntegerParameter("DicomScuMaxAssociationsPerModality", 0));
+
         // New options in Orthanc 1.8.2
         if (lock.GetConfiguration().GetBooleanParameter("DeidentifyLogs", true))
         {
@@ -416,6 +1184,72 @@ namespace Orthanc
 
       listeners_.push_back(ServerListener(luaListener_, "Lua"));
       changeThread_ = boost::thread(ChangeThread, this, (unitTesting ? 20 : 100));
+
+      {
+        // Check whether the previous execution of Orthanc has left
+        // instances that are waiting for their ingest transcoding
+        std::string value;
+        isPendingTranscodingSignaled_ = (index_.LookupGlobalProperty(value, GlobalProperty_PendingTranscoding, false /* not shared */) &&
+                                         value == "1");
+      }
+
+      if (isPendingTranscodingSignaled_)
+      {
+        if (isIngestTranscoding_ &&
+            deferredTranscodingThreads > 0)
+        {
+          isPendingTranscodingRecovered_ = false;
+        }
+        else
+        {
+          LOG(WARNING) << "Some instances are still waiting for their deferred ingest transcoding, "
+                       << "set \"IngestTranscodingThreadsCount\" to a non-zero value to transcode them";
+        }
+      }
+
+      deferredTranscodingThreads_.resize(deferredTranscodingThreads);
+      for (size_t i = 0; i < deferredTranscodingThreads_.size(); i++)
+      {
+        // The first thread looks for the instances that were not
+        // transcoded during the previous execution of Orthanc
+        deferredTranscodingThreads_[i] = new boost::thread(DeferredTranscodingThread, this, (unitTesting ? 20 : 100),
+                                                           (i == 0 && !isPendingTranscodingRecovered_));
+      }
+
+      if (readAheadCount_ > 0)
+      {
+        readAheadDispatcherThread_ = boost::thread(ReadAheadDispatcherThread, this, (unitTesting ? 20 : 100));
+
+        readAheadWorkers_.resize(readAheadThreads);
+        for (size_t i = 0; i < readAheadWorkers_.size(); i++)
+        {
+          readAheadWorkers_[i] = new boost::thread(ReadAheadWorkerThread, this, (unitTesting ? 20 : 100));
+        }
+      }
+
+      if (index_.HasIncrementalCompaction() &&
+          (databaseCompactionPages_ != 0 ||
+           databaseOptimizeInterval_ != 0))
+      {
+        databaseCompactionThread_ = boost::thread(DatabaseCompactionThread, this, (unitTesting ? 20 : 100));
+      }
+
+      if (storageVerificationRate_ != 0)
+      {
+        storageVerificationThread_ = boost::thread(StorageVerificationThread, this, (unitTesting ? 20 : 100));
+      }
+
+      dicomConnectionPoolThread_ = boost::thread(DicomConnectionPoolThread, this, (unitTesting ? 20 : 100));
+
+      if (lookupThreadsCount_ > 1)
+      {
+        lookupWorkers_.reset(new RunnableWorkersPool(lookupThreadsCount_));
+      }
+
+      if (columnarIndex_.get() != NULL)
+      {
+        columnarIndexThread_ = boost::thread(ColumnarIndexThread, this);
+      }
     
       dynamic_cast<DcmtkTranscoder&>(*dcmtkTranscoder_).SetLossyQuality(lossyQuality);
     }
@@ -459,6 +1293,79 @@ namespace Orthanc
         saveJobsThread_.join();
       }
 
+      for (size_t i = 0; i < deferredTranscodingThreads_.size(); i++)
+      {
+        if (deferredTranscodingThreads_[i] != NULL)
+        {
+          if (deferredTranscodingThreads_[i]->joinable())
+          {
+            deferredTranscodingThreads_[i]->join();
+          }
+
+          delete deferredTranscodingThreads_[i];
+          deferredTranscodingThreads_[i] = NULL;
+        }
+      }
+
+      if (readAheadDispatcherThread_.joinable())
+      {
+        readAheadDispatcherThread_.join();
+      }
+
+      for (size_t i = 0; i < readAheadWorkers_.size(); i++)
+      {
+        if (readAheadWorkers_[i] != NULL)
+        {
+          if (readAheadWorkers_[i]->joinable())
+          {
+            readAheadWorkers_[i]->join();
+          }
+
+          delete readAheadWorkers_[i];
+          readAheadWorkers_[i] = NULL;
+        }
+      }
+
+      if (databaseCompactionThread_.joinable())
+      {
+        databaseCompactionThread_.join();
+      }
+
+      if (storageVerificationThread_.joinable())
+      {
+        storageVerificationThread_.join();
+      }
+
+      if (dicomConnectionPoolThread_.joinable())
+      {
+        dicomConnectionPoolThread_.join();
+      }
+
+      if (columnarIndexThread_.joinable())
+      {
+        columnarIndexThread_.join();
+      }
+
+      lookupWorkers_.reset(NULL);
+
+      if (deferredTranscodingQueue_.GetSize() > 0)
+      {
+        LOG(WARNING) << deferredTranscodingQueue_.GetSize() << " instance(s) were not transcoded before "
+                     << "stopping Orthanc, they will be transcoded at the next startup";
+      }
+      else
+      {
+        boost::mutex::scoped_lock lock(pendingTranscodingMutex_);
+        if (isPendingTranscodingSignaled_ &&
+            isPendingTranscodingRecovered_ &&
+            !deferredTranscodingThreads_.empty())
+        {
+          // All the deferred transcodings are over
+          index_.SetGlobalProperty(GlobalProperty_PendingTranscoding, false /* not shared */, "0");
+          isPendingTranscodingSignaled_ = false;
+        }
+      }
+
       jobsEngine_.GetRegistry().ResetObserver();
 
       if (isJobsEngineUnserialized_)
@@ -470,6 +1377,8 @@ namespace Orthanc
       // Do not change the order below!
       jobsEngine_.Stop();
       index_.Stop();
+
+      dicomConnectionPool_.Close();
     }
   }
 
@@ -496,7 +1405,8 @@ namespace Orthanc
   ServerContext::StoreResult ServerContext::StoreAfterTranscoding(std::string& resultPublicId,
                                                                   DicomInstanceToStore& dicom,
                                                                   StoreInstanceMode mode,
-                                                                  bool isReconstruct)
+                                                                  bool isReconstruct,
+                                                                  const std::string& expectedDicomUuid)
   {
     bool overwrite;
     switch (mode)
@@ -519,8 +1429,7 @@ namespace Orthanc
 
     bool hasPixelDataOffset;
     uint64_t pixelDataOffset;
-    hasPixelDataOffset = DicomStreamReader::LookupPixelDataOffset(
-      pixelDataOffset, dicom.GetBufferData(), dicom.GetBufferSize());
+    hasPixelDataOffset = dicom.LookupPixelDataOffset(pixelDataOffset);
 
     DicomTransferSyntax transferSyntax;
     bool hasTransferSyntax = dicom.LookupTransferSyntax(transferSyntax);
@@ -528,6 +1437,27 @@ namespace Orthanc
     DicomMap summary;
     dicom.GetSummary(summary);
 
+    /**
+     * New in Orthanc 1.11.0: Locate the frames inside the DICOM file,
+     * so that individual frames can be read using ranges. This is
+     * only useful if the DICOM file is stored without compression.
+     **/
+    std::string frameOffsets;
+    bool hasFrameOffsets = (hasPixelDataOffset &&
+                            hasTransferSyntax &&
+                            !compressionEnabled_ &&
+                            area_.HasReadRange() &&
+                            ComputeFrameOffsets(frameOffsets, dicom, summary, transferSyntax, pixelDataOffset));
+
+    // Never keep the frame offsets of a previous version of the file
+    // (e.g. during a reconstruction or after a modification)
+    dicom.RemoveMetadata(ResourceType_Instance, MetadataType_Instance_FrameOffsets);
+
+    if (hasFrameOffsets)
+    {
+      dicom.AddMetadata(ResourceType_Instance, MetadataType_Instance_FrameOffsets, frameOffsets);
+    }
+
     try
     {
       MetricsRegistry::Timer timer(GetMetricsRegistry(), "orthanc_store_dicom_duration_ms");
@@ -617,7 +1547,8 @@ namespace Orthanc
       InstanceMetadata  instanceMetadata;
       result.SetStatus(index_.Store(
         instanceMetadata, summary, attachments, dicom.GetMetadata(), dicom.GetOrigin(), overwrite,
-        hasTransferSyntax, transferSyntax, hasPixelDataOffset, pixelDataOffset, isReconstruct));
+        hasTransferSyntax, transferSyntax, hasPixelDataOffset, pixelDataOffset, isReconstruct,
+        expectedDicomUuid));
 
       // Only keep the metadata for the "instance" level
       dicom.ClearMetadata();
@@ -762,7 +1693,7 @@ namespace Orthanc
     if (!isIngestTranscoding_)
     {
       // No automated transcoding. This was the only path in Orthanc <= 1.6.1.
-      return StoreAfterTranscoding(resultPublicId, *dicom, mode, isReconstruct);
+      return StoreAfterTranscoding(resultPublicId, *dicom, mode, isReconstruct, "");
     }
     else
     {
@@ -791,49 +1722,318 @@ namespace Orthanc
       }
       else
       {
-        // This is an compressed transfer syntax (new in Orthanc 1.8.2)
-        transcode = ingestTranscodingOfCompressed_;
+        // This is an compressed transfer syntax (new in Orthanc 1.8.2)
+        transcode = ingestTranscodingOfCompressed_;
+      }
+
+      if (!transcode)
+      {
+        // No transcoding
+        return StoreAfterTranscoding(resultPublicId, *dicom, mode, isReconstruct, "");
+      }
+      else
+      {
+        StoreResult deferred;
+        if (!isReconstruct &&
+            TryDeferIngestTranscoding(resultPublicId, deferred, *dicom, mode))
+        {
+          // The instance is stored as received, and will be transcoded
+          // by a background thread (new in Orthanc 1.11.0)
+          return deferred;
+        }
+
+        // Trancoding
+        std::set<DicomTransferSyntax> syntaxes;
+        syntaxes.insert(ingestTransferSyntax_);
+        
+        IDicomTranscoder::DicomImage source;
+        source.SetExternalBuffer(dicom->GetBufferData(), dicom->GetBufferSize());
+        
+        IDicomTranscoder::DicomImage transcoded;
+        if (Transcode(transcoded, source, syntaxes, true /* allow new SOP instance UID */))
+        {
+          std::unique_ptr<ParsedDicomFile> tmp(transcoded.ReleaseAsParsedDicomFile());
+
+          std::unique_ptr<DicomInstanceToStore> toStore(DicomInstanceToStore::CreateFromParsedDicomFile(*tmp));
+          toStore->SetOrigin(dicom->GetOrigin());
+
+          if (isReconstruct) // the initial instance to store already has its own metadata
+          {
+            toStore->CopyMetadata(dicom->GetMetadata());
+          }
+
+          StoreResult result = StoreAfterTranscoding(resultPublicId, *toStore, mode, isReconstruct, "");
+          assert(resultPublicId == tmp->GetHasher().HashInstance());
+
+          return result;
+        }
+        else
+        {
+          // Cannot transcode => store the original file
+          return StoreAfterTranscoding(resultPublicId, *dicom, mode, isReconstruct, "");
+        }
+      }
+    }
+  }
+
+  
+  void ServerContext::SignalInstanceAccessed(const std::string& instancePublicId)
+  {
+    if (readAheadCount_ > 0)
+    {
+      // The queue drops the oldest accesses if the dispatcher cannot
+      // keep up, which is fine as the read-ahead is best-effort
+      readAheadAccesses_.Enqueue(new SingleValueObject<std::string>(instancePublicId));
+    }
+  }
+
+  
+  bool ServerContext::TryDeferIngestTranscoding(std::string& resultPublicId,
+                                                StoreResult& result,
+                                                DicomInstanceToStore& dicom,
+                                                StoreInstanceMode mode)
+  {
+    if (deferredTranscodingThreads_.empty())
+    {
+      return false;
+    }
+
+    if (deferredTranscodingMaxBacklog_ != 0 &&
+        deferredTranscodingQueue_.GetSize() >= deferredTranscodingMaxBacklog_)
+    {
+      // Throttling: Transcode synchronously, which slows down the senders
+      LOG(INFO) << "Too many instances are waiting for their ingest transcoding, "
+                << "transcoding synchronously";
+      return false;
+    }
+
+    {
+      // Make sure the pending instances are looked for at the next
+      // startup, in the case Orthanc stops before transcoding them
+      boost::mutex::scoped_lock lock(pendingTranscodingMutex_);
+      if (!isPendingTranscodingSignaled_)
+      {
+        index_.SetGlobalProperty(GlobalProperty_PendingTranscoding, false /* not shared */, "1");
+        isPendingTranscodingSignaled_ = true;
+      }
+    }
+
+    {
+      // Flag the instance as waiting for its transcoding, in the same
+      // transaction as the one that stores the instance
+      Json::Value origin;
+      dicom.GetOrigin().Serialize(origin);
+
+      std::string serialized;
+      Toolbox::WriteFastJson(serialized, origin);
+      dicom.AddMetadata(ResourceType_Instance, MetadataType_Instance_PendingTranscoding, serialized);
+    }
+
+    result = StoreAfterTranscoding(resultPublicId, dicom, mode, false /* not a reconstruction */, "");
+
+    if (result.GetStatus() == StoreStatus_Success)
+    {
+      deferredTranscodingQueue_.Enqueue(new DeferredTranscodingItem(resultPublicId, dicom.GetOrigin()));
+      PublishDeferredTranscodingMetrics();
+    }
+
+    return true;
+  }
+
+
+  void ServerContext::ApplyDeferredTranscoding(const std::string& instancePublicId,
+                                               const DicomInstanceOrigin& origin)
+  {
+    MetricsRegistry::Timer timer(GetMetricsRegistry(), "orthanc_ingest_transcoding_duration_ms");
+
+    std::string pending;
+    FileInfo attachment;
+    int64_t revision;
+
+    try
+    {
+      if (!index_.LookupMetadata(pending, revision, instancePublicId, ResourceType_Instance,
+                                 MetadataType_Instance_PendingTranscoding) ||
+          !index_.LookupAttachment(attachment, revision, instancePublicId, FileContentType_Dicom))
+      {
+        LOG(INFO) << "Instance " << instancePublicId << " is not waiting for its deferred transcoding anymore";
+        return;
+      }
+    }
+    catch (OrthancException& e)
+    {
+      if (e.GetErrorCode() == ErrorCode_UnknownResource)
+      {
+        LOG(INFO) << "Instance " << instancePublicId << " was removed before its deferred transcoding";
+        return;
+      }
+      else
+      {
+        throw;
+      }
+    }
+
+    // The source buffer is only needed during the transcoding
+    BufferArena::Buffer dicom;
+
+    {
+      StorageAccessor accessor(area_, storageCache_, GetMetricsRegistry());
+      accessor.Read(dicom.GetContent(), attachment);
+    }
+
+    std::set<DicomTransferSyntax> syntaxes;
+    syntaxes.insert(ingestTransferSyntax_);
+
+    IDicomTranscoder::DicomImage source;
+    source.SetExternalBuffer(dicom.GetContent());
+
+    // The SOP instance UID must be kept, as the identifiers of the
+    // instance have already been published to the sender
+    IDicomTranscoder::DicomImage transcoded;
+    if (!Transcode(transcoded, source, syntaxes, false /* don't allow new SOP instance UID */))
+    {
+      LOG(WARNING) << "Cannot transcode instance " << instancePublicId << " to transfer syntax "
+                   << GetTransferSyntaxUid(ingestTransferSyntax_) << ", keeping its original transfer syntax";
+      ClearPendingTranscoding(instancePublicId);
+      return;
+    }
+
+    std::unique_ptr<ParsedDicomFile> parsed(transcoded.ReleaseAsParsedDicomFile());
+
+    std::unique_ptr<DicomInstanceToStore> toStore(DicomInstanceToStore::CreateFromParsedDicomFile(*parsed));
+    toStore->SetOrigin(origin);
+
+    /**
+     * Keep the metadata of the instance and of its parents, as the
+     * parent resources are removed from the index if the instance is
+     * their only child. The metadata describing the file itself are
+     * recomputed from the transcoded file, and the transcoded
+     * instance is not pending anymore.
+     **/
+    std::string currentId = instancePublicId;
+    ResourceType currentLevel = ResourceType_Instance;
+
+    for (;;)
+    {
+      typedef std::map<MetadataType, std::string>  Metadata;
+      Metadata metadata;
+      index_.GetAllMetadata(metadata, currentId, currentLevel);
+
+      for (Metadata::const_iterator it = metadata.begin(); it != metadata.end(); ++it)
+      {
+        if (currentLevel != ResourceType_Instance ||
+            (it->first != MetadataType_Instance_TransferSyntax &&
+             it->first != MetadataType_Instance_PixelDataOffset &&
+             it->first != MetadataType_Instance_PendingTranscoding))
+        {
+          toStore->AddMetadata(currentLevel, it->first, it->second);
+        }
+      }
+
+      std::string parentId;
+      if (currentLevel == ResourceType_Patient ||
+          !index_.LookupParent(parentId, currentId))
+      {
+        break;
+      }
+
+      currentId = parentId;
+      currentLevel = GetParentResourceType(currentLevel);
+    }
+
+    /**
+     * Overwrite the instance in one single transaction, without
+     * signaling a new instance to the listeners. The overwrite only
+     * occurs if the DICOM file that was transcoded is still the one
+     * of the instance, as checked inside the same transaction: The
+     * instance must not be resurrected if it was removed meanwhile,
+     * and a newer version of the instance must not be lost.
+     **/
+    std::string resultPublicId;
+    StoreResult result = StoreAfterTranscoding(resultPublicId, *toStore, StoreInstanceMode_OverwriteDuplicate,
+                                               true /* isReconstruct */, attachment.GetUuid());
+
+    if (result.GetStatus() == StoreStatus_AlreadyStored)
+    {
+      LOG(INFO) << "Instance " << instancePublicId << " was changed or removed before the end of its deferred transcoding";
+    }
+    else if (result.GetStatus() != StoreStatus_Success ||
+             resultPublicId != instancePublicId)
+    {
+      throw OrthancException(ErrorCode_InternalError,
+                             "Cannot replace instance " + instancePublicId + " by its transcoded version");
+    }
+  }
+
+
+  void ServerContext::ClearPendingTranscoding(const std::string& instancePublicId)
+  {
+    try
+    {
+      index_.DeleteMetadata(instancePublicId, MetadataType_Instance_PendingTranscoding, false, -1, "");
+    }
+    catch (OrthancException&)
+    {
+      // The instance was removed in the meantime
+    }
+  }
+
+
+  void ServerContext::RecoverPendingTranscodings()
+  {
+    // Number of instances that are read from the index at once
+    static const size_t PAGE_SIZE = 1000;
+
+    LOG(WARNING) << "Looking for the instances that were not transcoded during the previous execution of Orthanc";
+
+    unsigned int count = 0;
+    StatelessDatabaseOperations::UuidsPager pager(index_, ResourceType_Instance, PAGE_SIZE);
+
+    for (;;)
+    {
+      if (done_)
+      {
+        // Stopping before the end: The scan will be done again at the next startup
+        return;
       }
 
-      if (!transcode)
+      std::list<std::string> page;
+      if (!pager.GetNextPage(page))
       {
-        // No transcoding
-        return StoreAfterTranscoding(resultPublicId, *dicom, mode, isReconstruct);
+        break;
       }
-      else
-      {
-        // Trancoding
-        std::set<DicomTransferSyntax> syntaxes;
-        syntaxes.insert(ingestTransferSyntax_);
-        
-        IDicomTranscoder::DicomImage source;
-        source.SetExternalBuffer(dicom->GetBufferData(), dicom->GetBufferSize());
-        
-        IDicomTranscoder::DicomImage transcoded;
-        if (Transcode(transcoded, source, syntaxes, true /* allow new SOP instance UID */))
-        {
-          std::unique_ptr<ParsedDicomFile> tmp(transcoded.ReleaseAsParsedDicomFile());
 
-          std::unique_ptr<DicomInstanceToStore> toStore(DicomInstanceToStore::CreateFromParsedDicomFile(*tmp));
-          toStore->SetOrigin(dicom->GetOrigin());
+      for (std::list<std::string>::const_iterator it = page.begin(); it != page.end(); ++it)
+      {
+        std::string serialized;
+        int64_t revision;
+        Json::Value origin;
 
-          if (isReconstruct) // the initial instance to store already has its own metadata
+        try
+        {
+          if (index_.LookupMetadata(serialized, revision, *it, ResourceType_Instance,
+                                    MetadataType_Instance_PendingTranscoding) &&
+              Toolbox::ReadJson(origin, serialized))
           {
-            toStore->CopyMetadata(dicom->GetMetadata());
+            deferredTranscodingQueue_.Enqueue(new DeferredTranscodingItem(*it, DicomInstanceOrigin(origin)));
+            count++;
           }
-
-          StoreResult result = StoreAfterTranscoding(resultPublicId, *toStore, mode, isReconstruct);
-          assert(resultPublicId == tmp->GetHasher().HashInstance());
-
-          return result;
         }
-        else
+        catch (OrthancException&)
         {
-          // Cannot transcode => store the original file
-          return StoreAfterTranscoding(resultPublicId, *dicom, mode, isReconstruct);
+          // The instance was removed in the meantime, or its origin is corrupted
         }
       }
+
+      PublishDeferredTranscodingMetrics();
     }
+
+    {
+      boost::mutex::scoped_lock lock(pendingTranscodingMutex_);
+      isPendingTranscodingRecovered_ = true;
+    }
+
+    LOG(WARNING) << count << " instance(s) are waiting for their deferred ingest transcoding";
   }
 
   
@@ -849,12 +2049,19 @@ namespace Orthanc
     }
     else
     {
-      StorageAccessor accessor(area_, storageCache_, GetMetricsRegistry());
-      accessor.AnswerFile(output, attachment, GetFileContentMime(content));
+      AnswerAttachment(output, attachment);
     }
   }
 
 
+  void ServerContext::AnswerAttachment(RestApiOutput& output,
+                                       const FileInfo& attachment)
+  {
+    StorageAccessor accessor(area_, storageCache_, GetMetricsRegistry());
+    accessor.AnswerFile(output, attachment, GetFileContentMime(attachment.GetContentType()));
+  }
+
+
   void ServerContext::ChangeAttachmentCompression(const std::string& resourceId,
                                                   FileContentType attachmentType,
                                                   CompressionType compression)
@@ -904,21 +2111,28 @@ namespace Orthanc
   }
 
 
-  static void InjectEmptyPixelData(Json::Value& dicomAsJson)
+  static bool LookupDicomAttachment(FileInfo& target,
+                                    ServerIndex& index,
+                                    const std::string& instancePublicId,
+                                    const FileInfo* knownAttachment)
   {
-    // This is for backward compatibility with Orthanc <= 1.9.0
-    Json::Value pixelData = Json::objectValue;
-    pixelData["Name"] = "PixelData";
-    pixelData["Type"] = "Null";
-    pixelData["Value"] = Json::nullValue;
-
-    dicomAsJson["7fe0,0010"] = pixelData;
+    if (knownAttachment != NULL)
+    {
+      target = *knownAttachment;
+      return true;
+    }
+    else
+    {
+      int64_t revision;  // Ignored
+      return index.LookupAttachment(target, revision, instancePublicId, FileContentType_Dicom);
+    }
   }
 
-  
-  void ServerContext::ReadDicomAsJson(Json::Value& result,
-                                      const std::string& instancePublicId,
-                                      const std::set<DicomTag>& ignoreTagLength)
+
+  void ServerContext::ReadDicomAsJsonInternal(Json::Value& result,
+                                              const std::string& instancePublicId,
+                                              const FileInfo* dicomAttachment,
+                                              const std::set<DicomTag>& ignoreTagLength)
   {
     /**
      * CASE 1: The DICOM file, truncated at pixel data, is available
@@ -932,16 +2146,16 @@ namespace Orthanc
 
     if (index_.LookupAttachment(attachment, revision, instancePublicId, FileContentType_DicomUntilPixelData))
     {
-      std::string dicom;
+      BufferArena::Buffer dicom;
 
       {
         StorageAccessor accessor(area_, storageCache_, GetMetricsRegistry());
-        accessor.Read(dicom, attachment);
+        accessor.Read(dicom.GetContent(), attachment);
       }
 
-      ParsedDicomFile parsed(dicom);
+      ParsedDicomFile parsed(dicom.GetContent());
       OrthancConfiguration::DefaultDicomDatasetToJson(result, parsed, ignoreTagLength);
-      InjectEmptyPixelData(result);
+      ServerToolbox::InjectEmptyPixelData(result);
     }
     else
     {
@@ -988,7 +2202,7 @@ namespace Orthanc
 
       if (hasPixelDataOffset &&
           area_.HasReadRange() &&
-          index_.LookupAttachment(attachment, revision, instancePublicId, FileContentType_Dicom) &&
+          LookupDicomAttachment(attachment, index_, instancePublicId, dicomAttachment) &&
           attachment.GetCompressionType() == CompressionType_None)
       {
         /**
@@ -998,17 +2212,17 @@ namespace Orthanc
          * "true".
          **/
       
-        std::string dicom;
+        BufferArena::Buffer dicom;
         
         {
           StorageAccessor accessor(area_, storageCache_, GetMetricsRegistry());
-          accessor.ReadStartRange(dicom, attachment.GetUuid(), FileContentType_Dicom, pixelDataOffset);
+          accessor.ReadStartRange(dicom.GetContent(), attachment.GetUuid(), FileContentType_Dicom, pixelDataOffset);
         }
         
-        assert(dicom.size() == pixelDataOffset);
-        ParsedDicomFile parsed(dicom);
+        assert(dicom.GetContent().size() == pixelDataOffset);
+        ParsedDicomFile parsed(dicom.GetContent());
         OrthancConfiguration::DefaultDicomDatasetToJson(result, parsed, ignoreTagLength);
-        InjectEmptyPixelData(result);
+        ServerToolbox::InjectEmptyPixelData(result);
       }
       else if (ignoreTagLength.empty() &&
                index_.LookupAttachment(attachment, revision, instancePublicId, FileContentType_DicomAsJson))
@@ -1043,7 +2257,16 @@ namespace Orthanc
          **/
 
         std::string dicom;
-        ReadDicom(dicom, instancePublicId);
+
+        if (dicomAttachment == NULL)
+        {
+          ReadDicom(dicom, instancePublicId);
+        }
+        else
+        {
+          StorageAccessor accessor(area_, storageCache_, GetMetricsRegistry());
+          accessor.Read(dicom, *dicomAttachment);
+        }
 
         ParsedDicomFile parsed(dicom);
         OrthancConfiguration::DefaultDicomDatasetToJson(result, parsed, ignoreTagLength);
@@ -1079,6 +2302,14 @@ namespace Orthanc
   }
 
 
+  void ServerContext::ReadDicomAsJson(Json::Value& result,
+                                      const std::string& instancePublicId,
+                                      const std::set<DicomTag>& ignoreTagLength)
+  {
+    ReadDicomAsJsonInternal(result, instancePublicId, NULL, ignoreTagLength);
+  }
+
+
   void ServerContext::ReadDicomAsJson(Json::Value& result,
                                       const std::string& instancePublicId)
   {
@@ -1087,6 +2318,20 @@ namespace Orthanc
   }
 
 
+  void ServerContext::ReadDicomAsJson(Json::Value& result,
+                                      const std::string& instancePublicId,
+                                      const FileInfo& dicomAttachment,
+                                      const std::set<DicomTag>& ignoreTagLength)
+  {
+    if (dicomAttachment.GetContentType() != FileContentType_Dicom)
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange);
+    }
+
+    ReadDicomAsJsonInternal(result, instancePublicId, &dicomAttachment, ignoreTagLength);
+  }
+
+
   void ServerContext::ReadDicom(std::string& dicom,
                                 const std::string& instancePublicId)
   {
@@ -1094,6 +2339,20 @@ namespace Orthanc
     ReadAttachment(dicom, revision, instancePublicId, FileContentType_Dicom, true /* uncompress */);
   }
 
+  IMemoryBuffer* ServerContext::ReadDicom(const std::string& instancePublicId)
+  {
+    FileInfo attachment;
+    int64_t revision;  // Ignored
+    if (!index_.LookupAttachment(attachment, revision, instancePublicId, FileContentType_Dicom))
+    {
+      throw OrthancException(ErrorCode_UnknownResource,
+                             "Unable to read the DICOM file of instance " + instancePublicId);
+    }
+
+    StorageAccessor accessor(area_, storageCache_, GetMetricsRegistry());
+    return accessor.Read(attachment);
+  }
+
   void ServerContext::ReadDicomForHeader(std::string& dicom,
                                          const std::string& instancePublicId)
   {
@@ -1145,8 +2404,153 @@ namespace Orthanc
 
     return false;
   }
+
+
+  namespace
+  {
+    /**
+     * Retrieves, in one single read-only transaction, the DICOM
+     * attachment of an instance together with the metadata that are
+     * needed to extract one frame by reading a range of this file.
+     **/
+    class RawFrameOperations : public ServerIndex::IReadOnlyOperations
+    {
+    private:
+      ServerContext::RawFrameSource&  target_;
+      const std::string&              instancePublicId_;
+      bool                            found_;
+
+    public:
+      RawFrameOperations(ServerContext::RawFrameSource& target,
+                         const std::string& instancePublicId) :
+        target_(target),
+        instancePublicId_(instancePublicId),
+        found_(false)
+      {
+      }
+
+      virtual void Apply(ServerIndex::ReadOnlyTransaction& transaction) ORTHANC_OVERRIDE
+      {
+        int64_t internalId;
+        ResourceType level;
+        int64_t revision;  // Ignored
+        FileInfo attachment;
+
+        found_ = (transaction.LookupResource(internalId, level, instancePublicId_) &&
+                  level == ResourceType_Instance &&
+                  transaction.LookupAttachment(attachment, revision, internalId, FileContentType_Dicom));
+
+        if (found_)
+        {
+          target_.SetAttachment(attachment);
+
+          std::string offsets, transferSyntaxUid;
+          if (transaction.LookupMetadata(offsets, revision, internalId, MetadataType_Instance_FrameOffsets) &&
+              transaction.LookupMetadata(transferSyntaxUid, revision, internalId, MetadataType_Instance_TransferSyntax))
+          {
+            target_.SetMetadata(offsets, transferSyntaxUid);
+          }
+        }
+      }
+
+      bool IsFound() const
+      {
+        return found_;
+      }
+    };
+  }
+
+
+  bool ServerContext::LookupRawFrameSource(RawFrameSource& target,
+                                           const std::string& instancePublicId)
+  {
+    RawFrameOperations operations(target, instancePublicId);
+    index_.Apply(operations);
+    return operations.IsFound();
+  }
+
+
+  bool ServerContext::ReadRawFrame(std::string& frame,
+                                   MimeType& mime,
+                                   const std::string& instancePublicId,
+                                   const RawFrameSource& source,
+                                   unsigned int frameIndex)
+  {
+    if (!area_.HasReadRange())
+    {
+      return false;
+    }
+
+    {
+      // If the instance is already parsed in the cache, use it
+      ParsedDicomCache::Accessor accessor(dicomCache_, instancePublicId);
+      if (accessor.IsValid())
+      {
+        return false;
+      }
+    }
+
+    const FileInfo& attachment = source.GetAttachment();
+    DicomTransferSyntax transferSyntax;
+    DicomFrameOffsetTable table;
+
+    if (attachment.GetCompressionType() != CompressionType_None ||
+        !source.HasMetadata() ||
+        !LookupTransferSyntax(transferSyntax, source.GetTransferSyntaxUid()))
+    {
+      return false;
+    }
+
+    if (!table.Parse(source.GetFrameOffsets(), attachment.GetUncompressedSize()))
+    {
+      LOG(ERROR) << "Metadata \"FrameOffsets\" is corrupted for instance: " << instancePublicId;
+      return false;
+    }
+
+    if (frameIndex >= table.GetFramesCount())
+    {
+      throw OrthancException(ErrorCode_ParameterOutOfRange,
+                             "Trying to access frame " + boost::lexical_cast<std::string>(frameIndex) +
+                             " while instance " + instancePublicId + " has " +
+                             boost::lexical_cast<std::string>(table.GetFramesCount()) + " frames");
+    }
+
+    try
+    {
+      StorageAccessor accessor(area_, storageCache_, GetMetricsRegistry());
+
+      std::unique_ptr<IMemoryBuffer> range(
+        accessor.ReadRange(attachment.GetUuid(), FileContentType_Dicom,
+                           table.GetFrameStart(frameIndex), table.GetFrameEnd(frameIndex)));
+      table.ExtractFrame(frame, frameIndex, range->GetData(), range->GetSize());
+    }
+    catch (OrthancException& e)
+    {
+      LOG(WARNING) << "Cannot use the frame offsets of instance " << instancePublicId
+                   << ", falling back to the parsing of the DICOM file: " << e.What();
+      return false;
+    }
+
+    mime = DicomFrameOffsetTable::GetRawFrameMimeType(transferSyntax);
+    return true;
+  }
   
 
+  IMemoryBuffer* ServerContext::ReadSharedDicom(const std::string& instancePublicId)
+  {
+    FileInfo attachment;
+    int64_t revision;
+    if (!index_.LookupAttachment(attachment, revision, instancePublicId, FileContentType_Dicom))
+    {
+      throw OrthancException(ErrorCode_UnknownResource,
+                             "Unable to read the DICOM file of instance " + instancePublicId);
+    }
+
+    StorageAccessor accessor(area_, storageCache_, GetMetricsRegistry());
+    return accessor.ReadAndCache(attachment);
+  }
+
+
   void ServerContext::ReadAttachment(std::string& result,
                                      int64_t& revision,
                                      const std::string& instancePublicId,
@@ -1180,36 +2584,188 @@ namespace Orthanc
   }
 
 
-  ServerContext::DicomCacheLocker::DicomCacheLocker(ServerContext& context,
-                                                    const std::string& instancePublicId) :
-    context_(context),
-    instancePublicId_(instancePublicId)
+  void ServerContext::DicomCacheLocker::Load()
+  {
+    // Throttle to avoid loading several large DICOM files simultaneously
+    largeDicomLocker_.reset(new Semaphore::Locker(context_.largeDicomThrottler_));
+      
+    if (!hasAttachment_)
+    {
+      int64_t revision;  // Ignored
+      if (!context_.index_.LookupAttachment(attachment_, revision, instancePublicId_, FileContentType_Dicom))
+      {
+        throw OrthancException(ErrorCode_InternalError,
+                               "Unable to read the DICOM file of instance " + instancePublicId_);
+      }
+
+      hasAttachment_ = true;
+    }
+
+    // Parse the buffer of the storage area without copying it (new
+    // in Orthanc 1.11.0), which matters if it is memory-mapped
+    std::unique_ptr<IMemoryBuffer> content;
+
+    {
+      StorageAccessor accessor(context_.area_, context_.storageCache_, context_.GetMetricsRegistry());
+      content.reset(accessor.Read(attachment_));
+    }
+
+    // Release the throttle if loading "small" DICOM files (under
+    // 50MB, which is an arbitrary value)
+    if (content->GetSize() < 50 * 1024 * 1024)
+    {
+      largeDicomLocker_.reset(NULL);
+    }
+      
+    dicom_.reset(new ParsedDicomFile(content->GetData(), content->GetSize()));
+    dicomSize_ = content->GetSize();
+  }
+
+
+  /**
+   * New in Orthanc 1.11.0: Parsed DICOM file that is shared by the
+   * leader of a collapsed load with its followers, without holding
+   * the cache-wide mutex of "ParsedDicomCache". The lockers on the
+   * same instance use the file one after the other, as DCMTK doesn't
+   * guarantee concurrent reads to be thread-safe. Once the last
+   * locker is done, the file is moved into the cache.
+   **/
+  class ServerContext::DicomCacheLocker::SharedDicom : public boost::noncopyable
+  {
+  private:
+    ServerContext&                    context_;
+    std::string                       instancePublicId_;
+    boost::mutex                      mutex_;
+    std::unique_ptr<ParsedDicomFile>  dicom_;
+    size_t                            dicomSize_;
+
+  public:
+    SharedDicom(ServerContext& context,
+                const std::string& instancePublicId,
+                ParsedDicomFile* dicom,  // Takes ownership
+                size_t dicomSize) :
+      context_(context),
+      instancePublicId_(instancePublicId),
+      dicom_(dicom),
+      dicomSize_(dicomSize)
+    {
+      if (dicom == NULL)
+      {
+        throw OrthancException(ErrorCode_NullPointer);
+      }
+    }
+
+    ~SharedDicom()
+    {
+      try
+      {
+        context_.dicomCache_.Acquire(instancePublicId_, dicom_.release(), dicomSize_);
+        context_.PublishDicomCacheMetrics();
+      }
+      catch (OrthancException&)
+      {
+      }
+    }
+
+    boost::mutex& GetMutex()
+    {
+      return mutex_;
+    }
+
+    // The mutex must be locked
+    ParsedDicomFile& GetDicom() const
+    {
+      return *dicom_;
+    }
+  };
+
+
+  // Result that is published by the leader to its followers
+  class ServerContext::DicomCacheLocker::SharedDicomHandle : public IDynamicObject
+  {
+  private:
+    boost::shared_ptr<SharedDicom>  shared_;
+
+  public:
+    explicit SharedDicomHandle(const boost::shared_ptr<SharedDicom>& shared) :
+      shared_(shared)
+    {
+    }
+
+    const boost::shared_ptr<SharedDicom>& GetShared() const
+    {
+      return shared_;
+    }
+  };
+
+
+  void ServerContext::DicomCacheLocker::Setup()
   {
-    accessor_.reset(new ParsedDicomCache::Accessor(context_.dicomCache_, instancePublicId));
+    accessor_.reset(new ParsedDicomCache::Accessor(context_.dicomCache_, instancePublicId_));
     
     if (!accessor_->IsValid())
     {
       accessor_.reset(NULL);
 
-      // Throttle to avoid loading several large DICOM files simultaneously
-      largeDicomLocker_.reset(new Semaphore::Locker(context.largeDicomThrottler_));
-      
-      std::string content;
-      context_.ReadDicom(content, instancePublicId);
+      /**
+       * New in Orthanc 1.11.0: If another thread is already loading
+       * the same instance, wait for it to share the parsed file,
+       * instead of reading and parsing the file once again. If the
+       * other thread fails, the instance is loaded by this thread.
+       **/
+      SingleFlight::Accessor flight(context_.pendingDicomLoads_, instancePublicId_);
 
-      // Release the throttle if loading "small" DICOM files (under
-      // 50MB, which is an arbitrary value)
-      if (content.size() < 50 * 1024 * 1024)
+      boost::shared_ptr<IDynamicObject> result;
+      if (!flight.IsLeader() &&
+          flight.WaitForLeader(result) &&
+          result.get() != NULL)
       {
-        largeDicomLocker_.reset(NULL);
+        shared_ = dynamic_cast<const SharedDicomHandle&>(*result).GetShared();
+      }
+      else
+      {
+        Load();
+
+        if (flight.IsLeader() &&
+            flight.GetFollowersCount() > 0)
+        {
+          // Share the parsed file with the followers
+          shared_.reset(new SharedDicom(context_, instancePublicId_, dicom_.release(), dicomSize_));
+          flight.Publish(new SharedDicomHandle(shared_));
+        }
+      }
+
+      if (shared_.get() != NULL)
+      {
+        sharedLock_.reset(new boost::mutex::scoped_lock(shared_->GetMutex()));
       }
-      
-      dicom_.reset(new ParsedDicomFile(content));
-      dicomSize_ = content.size();
     }
 
-    assert(accessor_.get() != NULL ||
-           dicom_.get() != NULL);
+    assert(accessor_.get() != NULL ||
+           dicom_.get() != NULL ||
+           sharedLock_.get() != NULL);
+  }
+
+
+  ServerContext::DicomCacheLocker::DicomCacheLocker(ServerContext& context,
+                                                    const std::string& instancePublicId) :
+    context_(context),
+    instancePublicId_(instancePublicId),
+    hasAttachment_(false)
+  {
+    Setup();
+  }
+
+
+  ServerContext::DicomCacheLocker::DicomCacheLocker(ServerContext& context,
+                                                    const std::string& instancePublicId,
+                                                    const FileInfo& attachment) :
+    context_(context),
+    instancePublicId_(instancePublicId),
+    hasAttachment_(true),
+    attachment_(attachment)
+  {
+    Setup();
   }
 
 
@@ -1235,6 +2791,11 @@ namespace Orthanc
     {
       return *dicom_;
     }
+    else if (sharedLock_.get() != NULL)
+    {
+      assert(shared_.get() != NULL);
+      return shared_->GetDicom();
+    }
     else
     {
       assert(accessor_.get() != NULL);
@@ -1381,181 +2942,464 @@ namespace Orthanc
   }
 
 
-  void ServerContext::Apply(ILookupVisitor& visitor,
-                            const DatabaseLookup& lookup,
-                            ResourceType queryLevel,
-                            size_t since,
-                            size_t limit)
-  {    
-    unsigned int databaseLimit = (queryLevel == ResourceType_Instance ?
-                                  limitFindInstances_ : limitFindResults_);
-      
-    std::vector<std::string> resources, instances;
-    const DicomTagConstraint* dicomModalitiesConstraint = NULL;
-
-    bool hasModalitiesInStudyLookup = (queryLevel == ResourceType_Study &&
-          lookup.GetConstraint(dicomModalitiesConstraint, DICOM_TAG_MODALITIES_IN_STUDY) &&
-          ((dicomModalitiesConstraint->GetConstraintType() == ConstraintType_Equal && !dicomModalitiesConstraint->GetValue().empty()) ||
-          (dicomModalitiesConstraint->GetConstraintType() == ConstraintType_List && !dicomModalitiesConstraint->GetValues().empty())));
-
-    std::unique_ptr<DatabaseLookup> fastLookup(lookup.Clone());
-    
-    if (hasModalitiesInStudyLookup)
-    {
-      fastLookup->RemoveConstraint(DICOM_TAG_MODALITIES_IN_STUDY);
-    }
-
+  /**
+   * New in Orthanc 1.11.0: One candidate resource of a lookup,
+   * together with the result of its filtering.
+   **/
+  class ServerContext::LookupCandidate : public boost::noncopyable
+  {
+  public:
+    std::string                   resourceId_;
+    std::string                   instanceId_;
+    bool                          isMatch_;
+    bool                          hasOnlyMainDicomTags_;
+    DicomMap                      dicom_;
+    DicomMap                      allMainDicomTagsFromDB_;
+    std::unique_ptr<Json::Value>  dicomAsJson_;
+
+    LookupCandidate(const std::string& resourceId,
+                    const std::string& instanceId) :
+      resourceId_(resourceId),
+      instanceId_(instanceId),
+      isMatch_(false),
+      hasOnlyMainDicomTags_(false)
     {
-      const size_t lookupLimit = (databaseLimit == 0 ? 0 : databaseLimit + 1);      
-      GetIndex().ApplyLookupResources(resources, &instances, *fastLookup, queryLevel, lookupLimit);
     }
+  };
 
-    bool complete = (databaseLimit == 0 ||
-                     resources.size() <= databaseLimit);
-
-    LOG(INFO) << "Number of candidate resources after fast DB filtering on main DICOM tags: " << resources.size();
-
-    /**
-     * "resources" contains the Orthanc ID of the resource at level
-     * "queryLevel", "instances" contains one the Orthanc ID of one
-     * sample instance from this resource.
-     **/
-    assert(resources.size() == instances.size());
-
-    size_t countResults = 0;
-    size_t skipped = 0;
 
-    const bool isDicomAsJsonNeeded = visitor.IsDicomAsJsonNeeded();
-    
-    for (size_t i = 0; i < instances.size(); i++)
+  /**
+   * Shared state of one batch of candidates that are processed by
+   * the threads of "lookupWorkers_". The workers only read the
+   * parameters of the lookup, and each of them writes to a distinct
+   * candidate.
+   **/
+  class ServerContext::LookupBatch : public boost::noncopyable
+  {
+  public:
+    enum Phase
+    {
+      Phase_Filter,
+      Phase_Answer
+    };
+
+  private:
+    ServerContext&                     context_;
+    const DatabaseLookup&              fastLookup_;
+    ResourceType                       queryLevel_;
+    const DicomTagConstraint*          modalitiesInStudy_;  // NULL iff no lookup on "ModalitiesInStudy"
+    Phase                              phase_;
+    boost::mutex                       mutex_;
+    boost::condition_variable          done_;
+    size_t                             pending_;
+    std::unique_ptr<OrthancException>  error_;
+
+    void Filter(LookupCandidate& candidate) const
     {
       // Optimization in Orthanc 1.5.1 - Don't read the full JSON from
       // the disk if only "main DICOM tags" are to be returned
 
-      std::unique_ptr<Json::Value> dicomAsJson;
-
-      bool hasOnlyMainDicomTags;
-      DicomMap dicom;
-      DicomMap allMainDicomTagsFromDB;
-      
-      if (findStorageAccessMode_ == FindStorageAccessMode_DatabaseOnly ||
-          findStorageAccessMode_ == FindStorageAccessMode_DiskOnAnswer ||
-          fastLookup->HasOnlyMainDicomTags())
+      if (context_.findStorageAccessMode_ == FindStorageAccessMode_DatabaseOnly ||
+          context_.findStorageAccessMode_ == FindStorageAccessMode_DiskOnAnswer ||
+          fastLookup_.HasOnlyMainDicomTags())
       {
         // Case (1): The main DICOM tags, as stored in the database,
         // are sufficient to look for match
 
-        if (!GetIndex().GetAllMainDicomTags(allMainDicomTagsFromDB, instances[i]))
+        if (!context_.GetIndex().GetAllMainDicomTags(candidate.allMainDicomTagsFromDB_, candidate.instanceId_))
         {
           // The instance has been removed during the execution of the
           // lookup, ignore it
-          continue;
+          return;
         }
 
         // New in Orthanc 1.6.0: Only keep the main DICOM tags at the
         // level of interest for the query
-        switch (queryLevel)
+        switch (queryLevel_)
         {
           // WARNING: Don't reorder cases below, and don't add "break"
           case ResourceType_Instance:
-            dicom.MergeMainDicomTags(allMainDicomTagsFromDB, ResourceType_Instance);
+            candidate.dicom_.MergeMainDicomTags(candidate.allMainDicomTagsFromDB_, ResourceType_Instance);
 
           case ResourceType_Series:
-            dicom.MergeMainDicomTags(allMainDicomTagsFromDB, ResourceType_Series);
+            candidate.dicom_.MergeMainDicomTags(candidate.allMainDicomTagsFromDB_, ResourceType_Series);
 
           case ResourceType_Study:
-            dicom.MergeMainDicomTags(allMainDicomTagsFromDB, ResourceType_Study);
+            candidate.dicom_.MergeMainDicomTags(candidate.allMainDicomTagsFromDB_, ResourceType_Study);
             
           case ResourceType_Patient:
-            dicom.MergeMainDicomTags(allMainDicomTagsFromDB, ResourceType_Patient);
+            candidate.dicom_.MergeMainDicomTags(candidate.allMainDicomTagsFromDB_, ResourceType_Patient);
             break;
 
           default:
             throw OrthancException(ErrorCode_InternalError);
         }
         
-        hasOnlyMainDicomTags = true;
+        candidate.hasOnlyMainDicomTags_ = true;
       }
       else
       {
         // Case (2): Need to read the "DICOM-as-JSON" attachment from
         // the storage area
-        dicomAsJson.reset(new Json::Value);
-        ReadDicomAsJson(*dicomAsJson, instances[i]);
+        candidate.dicomAsJson_.reset(new Json::Value);
+        context_.ReadDicomAsJson(*candidate.dicomAsJson_, candidate.instanceId_);
 
-        dicom.FromDicomAsJson(*dicomAsJson);
+        candidate.dicom_.FromDicomAsJson(*candidate.dicomAsJson_);
 
         // This map contains the entire JSON, i.e. more than the main DICOM tags
-        hasOnlyMainDicomTags = false;   
+        candidate.hasOnlyMainDicomTags_ = false;   
       }
-      
-      if (fastLookup->IsMatch(dicom))
-      {
-        bool isMatch = true;
 
-        if (hasModalitiesInStudyLookup)
+      if (fastLookup_.IsMatch(candidate.dicom_))
+      {
+        if (modalitiesInStudy_ == NULL)
+        {
+          candidate.isMatch_ = true;
+        }
+        else
         {
           std::set<DicomTag> requestedTags;
           requestedTags.insert(DICOM_TAG_MODALITIES_IN_STUDY);
           ExpandedResource resource;
-          ComputeStudyTags(resource, *this, resources[i], requestedTags);
+          ComputeStudyTags(resource, context_, candidate.resourceId_, requestedTags);
 
           std::vector<std::string> modalities;
           Toolbox::TokenizeString(modalities, resource.tags_.GetValue(DICOM_TAG_MODALITIES_IN_STUDY).GetContent(), '\\');
           bool hasAtLeastOneModalityMatching = false;
           for (size_t m = 0; m < modalities.size(); m++)
           {
-            hasAtLeastOneModalityMatching |= dicomModalitiesConstraint->IsMatch(modalities[m]);
+            hasAtLeastOneModalityMatching |= modalitiesInStudy_->IsMatch(modalities[m]);
           }
 
-          isMatch = isMatch && hasAtLeastOneModalityMatching;
+          candidate.isMatch_ = hasAtLeastOneModalityMatching;
           // copy the value of ModalitiesInStudy such that it can be reused to build the answer
-          allMainDicomTagsFromDB.SetValue(DICOM_TAG_MODALITIES_IN_STUDY, resource.tags_.GetValue(DICOM_TAG_MODALITIES_IN_STUDY));
+          candidate.allMainDicomTagsFromDB_.SetValue(DICOM_TAG_MODALITIES_IN_STUDY, resource.tags_.GetValue(DICOM_TAG_MODALITIES_IN_STUDY));
+        }
+      }
+    }
+
+    void SignalDone(size_t count,
+                    const OrthancException* error)
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      if (error != NULL &&
+          error_.get() == NULL)
+      {
+        error_.reset(new OrthancException(*error));
+      }
+
+      assert(pending_ >= count);
+      pending_ -= count;
+
+      // Notify while holding the mutex, as "Wait()" might destroy the batch
+      done_.notify_all();
+    }
+
+  public:
+    LookupBatch(ServerContext& context,
+                const DatabaseLookup& fastLookup,
+                ResourceType queryLevel,
+                const DicomTagConstraint* modalitiesInStudy) :
+      context_(context),
+      fastLookup_(fastLookup),
+      queryLevel_(queryLevel),
+      modalitiesInStudy_(modalitiesInStudy),
+      phase_(Phase_Filter),
+      pending_(0)
+    {
+    }
+
+    // Must only be called when no worker is using the batch
+    void SetPhase(Phase phase)
+    {
+      phase_ = phase;
+    }
+
+    // Must be called before giving the candidates to the workers
+    void Prepare(size_t countCandidates)
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      assert(pending_ == 0);
+      pending_ = countCandidates;
+      error_.reset(NULL);
+    }
+
+    void Process(LookupCandidate& candidate) const
+    {
+      switch (phase_)
+      {
+        case Phase_Filter:
+          Filter(candidate);
+          break;
+
+        case Phase_Answer:
+          if (candidate.dicomAsJson_.get() == NULL)
+          {
+            candidate.dicomAsJson_.reset(new Json::Value);
+            context_.ReadDicomAsJson(*candidate.dicomAsJson_, candidate.instanceId_);
+          }
+          break;
+
+        default:
+          throw OrthancException(ErrorCode_InternalError);
+      }
+    }
+
+    // Invoked from the worker threads
+    void ProcessFromWorker(LookupCandidate& candidate)
+    {
+      try
+      {
+        Process(candidate);
+        SignalDone(1, NULL);
+      }
+      catch (OrthancException& e)
+      {
+        SignalDone(1, &e);
+      }
+      catch (std::bad_alloc&)
+      {
+        OrthancException e(ErrorCode_NotEnoughMemory);
+        SignalDone(1, &e);
+      }
+      catch (std::exception& e)
+      {
+        OrthancException error(ErrorCode_InternalError, e.what());
+        SignalDone(1, &error);
+      }
+    }
+
+    // Used if some candidates could not be given to the workers
+    void Abort(size_t countCandidates,
+               const OrthancException& error)
+    {
+      SignalDone(countCandidates, &error);
+    }
+
+    // Waits for all the candidates to be processed, then rethrows
+    // the first error that was reported by the workers, if any
+    void Wait()
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      while (pending_ > 0)
+      {
+        done_.wait(lock);
+      }
+
+      if (error_.get() != NULL)
+      {
+        throw OrthancException(*error_);
+      }
+    }
+  };
+
+
+  class ServerContext::LookupTask : public IRunnableBySteps
+  {
+  private:
+    LookupBatch&      batch_;
+    LookupCandidate&  candidate_;
+
+  public:
+    LookupTask(LookupBatch& batch,
+               LookupCandidate& candidate) :
+      batch_(batch),
+      candidate_(candidate)
+    {
+    }
+
+    virtual bool Step() ORTHANC_OVERRIDE
+    {
+      batch_.ProcessFromWorker(candidate_);
+      return false;  // Done
+    }
+  };
+
+
+  void ServerContext::RunLookupBatch(LookupBatch& batch,
+                                     const std::vector<LookupCandidate*>& candidates)
+  {
+    if (lookupWorkers_.get() == NULL ||
+        candidates.size() <= 1)
+    {
+      for (size_t i = 0; i < candidates.size(); i++)
+      {
+        assert(candidates[i] != NULL);
+        batch.Process(*candidates[i]);
+      }
+    }
+    else
+    {
+      batch.Prepare(candidates.size());
+
+      size_t i = 0;
+
+      try
+      {
+        for (; i < candidates.size(); i++)
+        {
+          assert(candidates[i] != NULL);
+          lookupWorkers_->Add(new LookupTask(batch, *candidates[i]));
         }
+      }
+      catch (OrthancException& e)
+      {
+        // Don't leave before the already-queued tasks are over, as
+        // they reference the batch and the candidates
+        batch.Abort(candidates.size() - i, e);
+      }
+
+      batch.Wait();
+    }
+  }
+
+
+  void ServerContext::Apply(ILookupVisitor& visitor,
+                            const DatabaseLookup& lookup,
+                            ResourceType queryLevel,
+                            size_t since,
+                            size_t limit)
+  {    
+    unsigned int databaseLimit = (queryLevel == ResourceType_Instance ?
+                                  limitFindInstances_ : limitFindResults_);
+      
+    std::vector<std::string> resources, instances;
+    const DicomTagConstraint* dicomModalitiesConstraint = NULL;
+
+    bool hasModalitiesInStudyLookup = (queryLevel == ResourceType_Study &&
+          lookup.GetConstraint(dicomModalitiesConstraint, DICOM_TAG_MODALITIES_IN_STUDY) &&
+          ((dicomModalitiesConstraint->GetConstraintType() == ConstraintType_Equal && !dicomModalitiesConstraint->GetValue().empty()) ||
+          (dicomModalitiesConstraint->GetConstraintType() == ConstraintType_List && !dicomModalitiesConstraint->GetValues().empty())));
+
+    std::unique_ptr<DatabaseLookup> fastLookup(lookup.Clone());
+    
+    if (hasModalitiesInStudyLookup)
+    {
+      fastLookup->RemoveConstraint(DICOM_TAG_MODALITIES_IN_STUDY);
+    }
+
+    {
+      const size_t lookupLimit = (databaseLimit == 0 ? 0 : databaseLimit + 1);      
+      GetIndex().ApplyLookupResources(resources, &instances, *fastLookup, queryLevel, lookupLimit);
+    }
+
+    bool complete = (databaseLimit == 0 ||
+                     resources.size() <= databaseLimit);
+
+    LOG(INFO) << "Number of candidate resources after fast DB filtering on main DICOM tags: " << resources.size();
+
+    /**
+     * "resources" contains the Orthanc ID of the resource at level
+     * "queryLevel", "instances" contains one the Orthanc ID of one
+     * sample instance from this resource.
+     **/
+    assert(resources.size() == instances.size());
+
+    size_t countResults = 0;
+    size_t skipped = 0;
+
+    const bool isDicomAsJsonNeeded = visitor.IsDicomAsJsonNeeded();
+
+    const bool isDiskAccessOnLookup = !(findStorageAccessMode_ == FindStorageAccessMode_DatabaseOnly ||
+                                        findStorageAccessMode_ == FindStorageAccessMode_DiskOnAnswer ||
+                                        fastLookup->HasOnlyMainDicomTags());
+
+    const bool isDiskAccessOnAnswer = ((findStorageAccessMode_ == FindStorageAccessMode_DiskOnLookupAndAnswer ||
+                                        findStorageAccessMode_ == FindStorageAccessMode_DiskOnAnswer) &&
+                                       isDicomAsJsonNeeded);
+
+    /**
+     * New in Orthanc 1.11.0: If filtering the candidates requires an
+     * access to the storage area or to compute "ModalitiesInStudy",
+     * the candidates are processed by windows that are filtered in
+     * parallel by "lookupWorkers_". The answers are still visited in
+     * the order of the candidates, and no new window is started once
+     * "limit" matches are found.
+     **/
+    size_t windowSize = 1;
+    if (lookupWorkers_.get() != NULL &&
+        (isDiskAccessOnLookup || isDiskAccessOnAnswer || hasModalitiesInStudyLookup))
+    {
+      windowSize = 4 * lookupThreadsCount_;
+    }
+
+    LookupBatch batch(*this, *fastLookup, queryLevel,
+                      hasModalitiesInStudyLookup ? dicomModalitiesConstraint : NULL);
+
+    bool isDone = false;
+
+    for (size_t start = 0; start < instances.size() && !isDone; start += windowSize)
+    {
+      const size_t end = std::min(start + windowSize, instances.size());
+
+      std::vector< boost::shared_ptr<LookupCandidate> >  window;
+      std::vector<LookupCandidate*>  candidates;
+      window.reserve(end - start);
+      candidates.reserve(end - start);
+
+      for (size_t i = start; i < end; i++)
+      {
+        window.push_back(boost::shared_ptr<LookupCandidate>(new LookupCandidate(resources[i], instances[i])));
+        candidates.push_back(window.back().get());
+      }
+
+      batch.SetPhase(LookupBatch::Phase_Filter);
+      RunLookupBatch(batch, candidates);
+
+      // Apply "since" and "limit" in the order of the candidates
+      std::vector<LookupCandidate*> answers;
 
-        if (isMatch)
+      for (size_t i = 0; i < window.size(); i++)
+      {
+        if (window[i]->isMatch_)
         {
           if (skipped < since)
           {
             skipped++;
           }
           else if (limit != 0 &&
-                  countResults >= limit)
+                   countResults >= limit)
           {
             // Too many results, don't mark as complete
             complete = false;
+            isDone = true;
             break;
           }
           else
           {
-            if ((findStorageAccessMode_ == FindStorageAccessMode_DiskOnLookupAndAnswer ||
-                findStorageAccessMode_ == FindStorageAccessMode_DiskOnAnswer) &&
-                dicomAsJson.get() == NULL &&
-                isDicomAsJsonNeeded)
-            {
-              dicomAsJson.reset(new Json::Value);
-              ReadDicomAsJson(*dicomAsJson, instances[i]);
-            }
-
-            if (hasOnlyMainDicomTags)
-            {
-              // This is Case (1): The variable "dicom" only contains the main DICOM tags
-              visitor.Visit(resources[i], instances[i], allMainDicomTagsFromDB, dicomAsJson.get());
-            }
-            else
-            {
-              // Remove the non-main DICOM tags from "dicom" if Case (2)
-              // was used, for consistency with Case (1)
-
-              DicomMap mainDicomTags;
-              mainDicomTags.ExtractMainDicomTags(dicom);
-              visitor.Visit(resources[i], instances[i], mainDicomTags, dicomAsJson.get());            
-            }
-              
+            answers.push_back(window[i].get());
             countResults ++;
           }
         }
       }
+
+      if (isDiskAccessOnAnswer)
+      {
+        batch.SetPhase(LookupBatch::Phase_Answer);
+        RunLookupBatch(batch, answers);
+      }
+
+      for (size_t i = 0; i < answers.size(); i++)
+      {
+        const LookupCandidate& answer = *answers[i];
+
+        if (answer.hasOnlyMainDicomTags_)
+        {
+          // This is Case (1): The variable "dicom" only contains the main DICOM tags
+          visitor.Visit(answer.resourceId_, answer.instanceId_, answer.allMainDicomTagsFromDB_, answer.dicomAsJson_.get());
+        }
+        else
+        {
+          // Remove the non-main DICOM tags from "dicom" if Case (2)
+          // was used, for consistency with Case (1)
+
+          DicomMap mainDicomTags;
+          mainDicomTags.ExtractMainDicomTags(answer.dicom_);
+          visitor.Visit(answer.resourceId_, answer.instanceId_, mainDicomTags, answer.dicomAsJson_.get());
+        }
+      }
     }
 
     if (complete)
@@ -1698,8 +3542,9 @@ namespace Orthanc
   }
 
 
-  ImageAccessor* ServerContext::DecodeDicomFrame(const std::string& publicId,
-                                                 unsigned int frameIndex)
+  ImageAccessor* ServerContext::DecodeDicomFrameInternal(const std::string& publicId,
+                                                         const FileInfo* attachment,
+                                                         unsigned int frameIndex)
   {
     if (builtinDecoderTranscoderOrder_ == BuiltinDecoderTranscoderOrder_Before)
     {
@@ -1709,8 +3554,11 @@ namespace Orthanc
       std::unique_ptr<ImageAccessor> decoded;
       try
       {
-        ServerContext::DicomCacheLocker locker(*this, publicId);
-        decoded.reset(locker.GetDicom().DecodeFrame(frameIndex));
+        std::unique_ptr<DicomCacheLocker> locker(
+          attachment == NULL ?
+          new DicomCacheLocker(*this, publicId) :
+          new DicomCacheLocker(*this, publicId, *attachment));
+        decoded.reset(locker->GetDicom().DecodeFrame(frameIndex));
       }
       catch (OrthancException& e)
       {
@@ -1727,13 +3575,23 @@ namespace Orthanc
         GetPlugins().HasCustomImageDecoder())
     {
       // TODO: Store the raw buffer in the DicomCacheLocker
-      std::string dicomContent;
-      ReadDicom(dicomContent, publicId);
+      BufferArena::Buffer dicomContent;
+
+      if (attachment == NULL)
+      {
+        ReadDicom(dicomContent.GetContent(), publicId);
+      }
+      else
+      {
+        StorageAccessor accessor(area_, storageCache_, GetMetricsRegistry());
+        accessor.Read(dicomContent.GetContent(), *attachment);
+      }
       
       std::unique_ptr<ImageAccessor> decoded;
       try
       {
-        decoded.reset(GetPlugins().Decode(dicomContent.c_str(), dicomContent.size(), frameIndex));
+        decoded.reset(GetPlugins().Decode(dicomContent.GetContent().c_str(),
+                                          dicomContent.GetContent().size(), frameIndex));
       }
       catch (OrthancException& e)
       {
@@ -1753,8 +3611,11 @@ namespace Orthanc
 
     if (builtinDecoderTranscoderOrder_ == BuiltinDecoderTranscoderOrder_After)
     {
-      ServerContext::DicomCacheLocker locker(*this, publicId);        
-      return locker.GetDicom().DecodeFrame(frameIndex);
+      std::unique_ptr<DicomCacheLocker> locker(
+        attachment == NULL ?
+        new DicomCacheLocker(*this, publicId) :
+        new DicomCacheLocker(*this, publicId, *attachment));
+      return locker->GetDicom().DecodeFrame(frameIndex);
     }
     else
     {
@@ -1763,6 +3624,21 @@ namespace Orthanc
   }
 
 
+  ImageAccessor* ServerContext::DecodeDicomFrame(const std::string& publicId,
+                                                 unsigned int frameIndex)
+  {
+    return DecodeDicomFrameInternal(publicId, NULL, frameIndex);
+  }
+
+
+  ImageAccessor* ServerContext::DecodeDicomFrame(const std::string& publicId,
+                                                 const FileInfo& attachment,
+                                                 unsigned int frameIndex)
+  {
+    return DecodeDicomFrameInternal(publicId, &attachment, frameIndex);
+  }
+
+
   ImageAccessor* ServerContext::DecodeDicomFrame(const DicomInstanceToStore& dicom,
                                                  unsigned int frameIndex)
   {
@@ -1937,10 +3813,10 @@ namespace Orthanc
   }
 
 
-  static void SerializeExpandedResource(Json::Value& target,
-                                        const ExpandedResource& resource,
-                                        DicomToJsonFormat format,
-                                        const std::set<DicomTag>& requestedTags)
+  void ServerContext::SerializeExpandedResource(Json::Value& target,
+                                                const ExpandedResource& resource,
+                                                DicomToJsonFormat format,
+                                                const std::set<DicomTag>& requestedTags)
   {
     target = Json::objectValue;
 
@@ -25,20 +25,26 @@
 #include "IServerListener.h"
 #include "LuaScripting.h"
 #include "OrthancHttpHandler.h"
+#include "ReadAheadTracker.h"
+#include "Search/ColumnarIndex.h"
 #include "ServerIndex.h"
 #include "ServerJobs/IStorageCommitmentFactory.h"
 
 #include "../../OrthancFramework/Sources/DicomFormat/DicomElement.h"
+#include "../../OrthancFramework/Sources/DicomNetworking/DicomConnectionPool.h"
 #include "../../OrthancFramework/Sources/DicomParsing/DicomModification.h"
 #include "../../OrthancFramework/Sources/DicomParsing/IDicomTranscoder.h"
 #include "../../OrthancFramework/Sources/DicomParsing/ParsedDicomCache.h"
 #include "../../OrthancFramework/Sources/FileStorage/StorageCache.h"
+#include "../../OrthancFramework/Sources/MultiThreading/RunnableWorkersPool.h"
 #include "../../OrthancFramework/Sources/MultiThreading/Semaphore.h"
+#include "../../OrthancFramework/Sources/MultiThreading/SingleFlight.h"
 
 
 namespace Orthanc
 {
   class DicomInstanceToStore;
+  class IMemoryBuffer;
   class IStorageArea;
   class JobsEngine;
   class MetricsRegistry;
@@ -186,6 +192,32 @@ namespace Orthanc
     static void SaveJobsThread(ServerContext* that,
                                unsigned int sleepDelay);
 
+    static void DeferredTranscodingThread(ServerContext* that,
+                                          unsigned int sleepDelay,
+                                          bool recoverPending);
+
+    static void ReadAheadDispatcherThread(ServerContext* that,
+                                          unsigned int sleepDelay);
+
+    static void ReadAheadWorkerThread(ServerContext* that,
+                                      unsigned int sleepDelay);
+
+    static void DatabaseCompactionThread(ServerContext* that,
+                                         unsigned int sleepDelay);
+
+    static void StorageVerificationThread(ServerContext* that,
+                                          unsigned int sleepDelay);
+
+    static void DicomConnectionPoolThread(ServerContext* that,
+                                          unsigned int sleepDelay);
+
+    static void ColumnarIndexThread(ServerContext* that);
+
+    void StoreInColumnarIndex(ResourceType level,
+                              const std::string& publicId);
+
+    void SignalColumnarIndexChange(const ServerIndexChange& change);
+
     void SaveJobsEngine();
 
     virtual void SignalJobSubmitted(const std::string& jobId) ORTHANC_OVERRIDE;
@@ -203,6 +235,13 @@ namespace Orthanc
 
     Semaphore largeDicomThrottler_;  // New in Orthanc 1.9.0 (notably for very large DICOM files in WSI)
     ParsedDicomCache  dicomCache_;
+    SingleFlight      pendingDicomLoads_;  // New in Orthanc 1.11.0
+
+    // New in Orthanc 1.11.0: The pool must be declared before the
+    // Lua engines and "JobsEngine", as the jobs might keep some of
+    // its connections until they are destroyed
+    DicomConnectionPool  dicomConnectionPool_;
+    boost::thread        dicomConnectionPoolThread_;
 
     LuaScripting mainLua_;
     LuaScripting filterLua_;
@@ -253,6 +292,50 @@ namespace Orthanc
     bool ingestTranscodingOfUncompressed_;
     bool ingestTranscodingOfCompressed_;
 
+    // New in Orthanc 1.11.0: Deferred ingest transcoding
+    SharedMessageQueue  deferredTranscodingQueue_;
+    std::vector<boost::thread*>  deferredTranscodingThreads_;
+    unsigned int  deferredTranscodingMaxBacklog_;
+    boost::mutex  pendingTranscodingMutex_;
+    bool  isPendingTranscodingSignaled_;   // Value of "GlobalProperty_PendingTranscoding"
+    bool  isPendingTranscodingRecovered_;  // Whether all the pending instances are in the queue
+
+    // New in Orthanc 1.11.0: Online compaction of the database
+    boost::thread  databaseCompactionThread_;
+    unsigned int   databaseCompactionPages_;
+    unsigned int   databaseCompactionIdleDelay_;
+    unsigned int   databaseOptimizeInterval_;
+
+    // New in Orthanc 1.11.0: Background verification of the MD5 of
+    // the attachments (number of instances per second, 0 to disable)
+    boost::thread  storageVerificationThread_;
+    unsigned int   storageVerificationRate_;
+
+    // New in Orthanc 1.11.0: Pool of threads that filter the
+    // candidate resources of lookups in parallel, if this filtering
+    // requires an access to the storage area (NULL if disabled)
+    class LookupCandidate;
+    class LookupBatch;
+    class LookupTask;
+    std::unique_ptr<RunnableWorkersPool>  lookupWorkers_;
+    unsigned int                          lookupThreadsCount_;
+
+    // New in Orthanc 1.11.0: In-memory columnar replica of the main
+    // DICOM tags, used by "/tools/group-by" (NULL if disabled)
+    std::unique_ptr<ColumnarIndex>  columnarIndex_;
+    boost::thread                   columnarIndexThread_;
+
+    // New in Orthanc 1.11.0: Read-ahead of the next instances of a
+    // series that is sequentially accessed by a viewer, into the
+    // cache of parsed DICOM files (disabled if "readAheadCount_" is 0)
+    unsigned int                 readAheadCount_;
+    uint64_t                     readAheadMemoryBudget_;
+    ReadAheadTracker             readAheadTracker_;
+    SharedMessageQueue           readAheadAccesses_;
+    SharedMessageQueue           readAheadQueue_;
+    boost::thread                readAheadDispatcherThread_;
+    std::vector<boost::thread*>  readAheadWorkers_;
+
     // New in Orthanc 1.9.0
     DicomTransferSyntax preferredTransferSyntax_;
     boost::mutex dynamicOptionsMutex_;
@@ -262,10 +345,30 @@ namespace Orthanc
     StoreResult StoreAfterTranscoding(std::string& resultPublicId,
                                       DicomInstanceToStore& dicom,
                                       StoreInstanceMode mode,
-                                      bool isReconstruct);
+                                      bool isReconstruct,
+                                      const std::string& expectedDicomUuid);
 
     void PublishDicomCacheMetrics();
 
+    void PublishDeferredTranscodingMetrics();
+
+    void PublishDicomConnectionPoolMetrics();
+
+    bool TryDeferIngestTranscoding(std::string& resultPublicId,
+                                   StoreResult& result,
+                                   DicomInstanceToStore& dicom,
+                                   StoreInstanceMode mode);
+
+    void ApplyDeferredTranscoding(const std::string& instancePublicId,
+                                  const DicomInstanceOrigin& origin);
+
+    void ClearPendingTranscoding(const std::string& instancePublicId);
+
+    void RecoverPendingTranscodings();
+
+    void RunLookupBatch(LookupBatch& batch,
+                        const std::vector<LookupCandidate*>& candidates);
+
     // This method must only be called from "ServerIndex"!
     void RemoveFile(const std::string& fileUuid,
                     FileContentType type);
@@ -276,21 +379,101 @@ namespace Orthanc
     DicomModification logsDeidentifierRules_;
     bool              deidentifyLogs_;
 
+    // If "dicomAttachment" is NULL, it is looked up in the index if needed
+    void ReadDicomAsJsonInternal(Json::Value& result,
+                                 const std::string& instancePublicId,
+                                 const FileInfo* dicomAttachment,
+                                 const std::set<DicomTag>& ignoreTagLength);
+
+    ImageAccessor* DecodeDicomFrameInternal(const std::string& publicId,
+                                            const FileInfo* attachment,
+                                            unsigned int frameIndex);
+
   public:
+    /**
+     * New in Orthanc 1.11.0: DICOM attachment of an instance, together
+     * with the metadata that are needed to read its frames directly
+     * from the storage area, cf. "LookupRawFrameSource()".
+     **/
+    class RawFrameSource : public boost::noncopyable
+    {
+    private:
+      FileInfo     attachment_;
+      bool         hasMetadata_;
+      std::string  frameOffsets_;
+      std::string  transferSyntaxUid_;
+
+    public:
+      RawFrameSource() :
+        hasMetadata_(false)
+      {
+      }
+
+      void SetAttachment(const FileInfo& attachment)
+      {
+        attachment_ = attachment;
+      }
+
+      void SetMetadata(const std::string& frameOffsets,
+                       const std::string& transferSyntaxUid)
+      {
+        hasMetadata_ = true;
+        frameOffsets_ = frameOffsets;
+        transferSyntaxUid_ = transferSyntaxUid;
+      }
+
+      const FileInfo& GetAttachment() const
+      {
+        return attachment_;
+      }
+
+      bool HasMetadata() const
+      {
+        return hasMetadata_;
+      }
+
+      const std::string& GetFrameOffsets() const
+      {
+        return frameOffsets_;
+      }
+
+      const std::string& GetTransferSyntaxUid() const
+      {
+        return transferSyntaxUid_;
+      }
+    };
+
     class DicomCacheLocker : public boost::noncopyable
     {
     private:
+      class SharedDicom;
+      class SharedDicomHandle;
+
       ServerContext&                               context_;
       std::string                                  instancePublicId_;
       std::unique_ptr<ParsedDicomCache::Accessor>  accessor_;
       std::unique_ptr<ParsedDicomFile>             dicom_;
       size_t                                       dicomSize_;
       std::unique_ptr<Semaphore::Locker>           largeDicomLocker_;
+      boost::shared_ptr<SharedDicom>               shared_;      // New in Orthanc 1.11.0
+      std::unique_ptr<boost::mutex::scoped_lock>   sharedLock_;  // Must be declared after "shared_"
+      bool                                         hasAttachment_;
+      FileInfo                                     attachment_;
+
+      void Setup();
+
+      void Load();
 
     public:
       DicomCacheLocker(ServerContext& context,
                        const std::string& instancePublicId);
 
+      // New in Orthanc 1.11.0: The DICOM attachment was already looked
+      // up by the caller, and is not looked up again in the index
+      DicomCacheLocker(ServerContext& context,
+                       const std::string& instancePublicId,
+                       const FileInfo& attachment);
+
       ~DicomCacheLocker();
 
       ParsedDicomFile& GetDicom() const;
@@ -316,6 +499,27 @@ namespace Orthanc
       return storageCache_.SetMaximumSize(size);
     }
 
+    // New in Orthanc 1.11.0: Number of concurrent identical reads of
+    // the storage area, and of concurrent parsings of the same DICOM
+    // instance, that were collapsed into a single load
+    void GetCollapsedLoadsCount(uint64_t& storageReads,
+                                uint64_t& dicomParsings)
+    {
+      storageReads = storageCache_.GetPendingReads().GetCollapsedCount();
+      dicomParsings = pendingDicomLoads_.GetCollapsedCount();
+    }
+
+    // New in Orthanc 1.11.0: To be called each time a viewer accesses
+    // the pixel data of an instance, in order to trigger the
+    // read-ahead of the next instances of its series
+    void SignalInstanceAccessed(const std::string& instancePublicId);
+
+    void GetReadAheadStatistics(uint64_t& countPrefetched,
+                                uint64_t& countHits)
+    {
+      readAheadTracker_.GetStatistics(countPrefetched, countHits);
+    }
+
     void SetCompressionEnabled(bool enabled);
 
     bool IsCompressionEnabled() const
@@ -345,6 +549,9 @@ namespace Orthanc
                           const std::string& resourceId,
                           FileContentType content);
 
+    void AnswerAttachment(RestApiOutput& output,
+                          const FileInfo& attachment);
+
     void ChangeAttachmentCompression(const std::string& resourceId,
                                      FileContentType attachmentType,
                                      CompressionType compression);
@@ -356,15 +563,58 @@ namespace Orthanc
     void ReadDicomAsJson(Json::Value& result,
                          const std::string& instancePublicId);
 
+    // New in Orthanc 1.11.0: Same as above, if the DICOM attachment
+    // was already looked up by the caller
+    void ReadDicomAsJson(Json::Value& result,
+                         const std::string& instancePublicId,
+                         const FileInfo& dicomAttachment,
+                         const std::set<DicomTag>& ignoreTagLength);
+
     void ReadDicom(std::string& dicom,
                    const std::string& instancePublicId);
 
+    // New in Orthanc 1.11.0: If the DICOM file is not compressed, the
+    // buffer of the storage area is returned as such (no copy if the
+    // storage area uses memory mapping)
+    IMemoryBuffer* ReadDicom(const std::string& instancePublicId);
+
     void ReadDicomForHeader(std::string& dicom,
                             const std::string& instancePublicId);
 
     bool ReadDicomUntilPixelData(std::string& dicom,
                                  const std::string& instancePublicId);
 
+    /**
+     * New in Orthanc 1.11.0: Look up, in one single transaction, the
+     * DICOM attachment of an instance together with the metadata that
+     * are needed to read its frames using "ReadRawFrame()". Returns
+     * "false" if the instance doesn't exist.
+     **/
+    bool LookupRawFrameSource(RawFrameSource& target,
+                              const std::string& instancePublicId);
+
+    /**
+     * New in Orthanc 1.11.0: Read one single frame from the storage
+     * area, using the frame offsets that were computed when the
+     * instance was stored. Returns "false" if this is not possible,
+     * in which case the full DICOM file must be parsed.
+     **/
+    bool ReadRawFrame(std::string& frame,
+                      MimeType& mime,
+                      const std::string& instancePublicId,
+                      const RawFrameSource& source,
+                      unsigned int frameIndex);
+
+    /**
+     * New in Orthanc 1.11.0: Read the DICOM file of an instance as a
+     * read-only buffer that shares its bytes with the storage cache
+     * (no copy if the file is not compressed). The bytes remain valid
+     * until the buffer is destroyed, even if the cache is flushed.
+     * Throws "ErrorCode_UnknownResource" if the instance has no DICOM
+     * file. Only used by "OrthancPluginLoadDicomInstance()".
+     **/
+    IMemoryBuffer* ReadSharedDicom(const std::string& instancePublicId);
+
     // This method is for low-level operations on "/instances/.../attachments/..."
     void ReadAttachment(std::string& result,
                         int64_t& revision,
@@ -500,7 +750,28 @@ namespace Orthanc
       return *storageCommitmentReports_;
     }
 
+    // New in Orthanc 1.11.0: Pool of the outgoing C-STORE SCU associations
+    DicomConnectionPool& GetDicomConnectionPool()
+    {
+      return dicomConnectionPool_;
+    }
+
+    // New in Orthanc 1.11.0: The columnar index is only available if
+    // the configuration option "ColumnarIndex" is "true"
+    bool HasColumnarIndex() const
+    {
+      return columnarIndex_.get() != NULL;
+    }
+
+    ColumnarIndex& GetColumnarIndex();
+
+    ImageAccessor* DecodeDicomFrame(const std::string& publicId,
+                                    unsigned int frameIndex);
+
+    // New in Orthanc 1.11.0: The DICOM attachment was already looked
+    // up by the caller
     ImageAccessor* DecodeDicomFrame(const std::string& publicId,
+                                    const FileInfo& attachment,
                                     unsigned int frameIndex);
 
     ImageAccessor* DecodeDicomFrame(const DicomInstanceToStore& dicom,
@@ -564,5 +835,10 @@ namespace Orthanc
                         const std::set<DicomTag>& requestedTags,
                         ExpandResourceDbFlags expandFlags);
 
+    // New in Orthanc 1.11.0: Public, for "/tools/bulk-content"
+    static void SerializeExpandedResource(Json::Value& target,
+                                          const ExpandedResource& resource,
+                                          DicomToJsonFormat format,
+                                          const std::set<DicomTag>& requestedTags);
   };
 }
@@ -61,6 +61,8 @@ namespace Orthanc
     dictMetadataType_.Add(MetadataType_Instance_HttpUsername, "HttpUsername");
     dictMetadataType_.Add(MetadataType_Instance_PixelDataOffset, "PixelDataOffset");
     dictMetadataType_.Add(MetadataType_MainDicomTagsSignature, "MainDicomTagsSignature");
+    dictMetadataType_.Add(MetadataType_Instance_FrameOffsets, "FrameOffsets");
+    dictMetadataType_.Add(MetadataType_Instance_PendingTranscoding, "PendingTranscoding");
 
     dictContentType_.Add(FileContentType_Dicom, "dicom");
     dictContentType_.Add(FileContentType_DicomAsJson, "dicom-as-json");
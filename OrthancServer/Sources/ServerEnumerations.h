@@ -118,6 +118,8 @@ namespace Orthanc
     GlobalProperty_AnonymizationSequence = 3,
     GlobalProperty_JobsRegistry = 5,
     GlobalProperty_GetTotalSizeIsFast = 6,      // New in Orthanc 1.5.2
+    GlobalProperty_HasNormalizedKeys = 7,       // New in Orthanc 1.11.0
+    GlobalProperty_PendingTranscoding = 8,      // New in Orthanc 1.11.0
     GlobalProperty_Modalities = 20,             // New in Orthanc 1.5.0
     GlobalProperty_Peers = 21,                  // New in Orthanc 1.5.0
 
@@ -152,6 +154,8 @@ namespace Orthanc
     MetadataType_Instance_HttpUsername = 13,     // New in Orthanc 1.4.0
     MetadataType_Instance_PixelDataOffset = 14,  // New in Orthanc 1.9.0
     MetadataType_MainDicomTagsSignature = 15,    // New in Orthanc 1.11.0
+    MetadataType_Instance_FrameOffsets = 16,     // New in Orthanc 1.11.0
+    MetadataType_Instance_PendingTranscoding = 17,  // New in Orthanc 1.11.0
     
     // Make sure that the value "65535" can be stored into this enumeration
     MetadataType_StartUser = 1024,
@@ -254,13 +254,15 @@ namespace Orthanc
                             const std::string& publicId) : 
       type_(type),
       publicId_(publicId),
-      time_(boost::posix_time::second_clock::local_time())
+      time_(boost::posix_time::microsec_clock::universal_time())
     {
     }
 
-    unsigned int GetAge() const
+    // Time at which the resource becomes stable, if it receives no
+    // new instance in the meantime
+    boost::posix_time::ptime GetDeadline(unsigned int stableAge) const
     {
-      return (boost::posix_time::second_clock::local_time() - time_).total_seconds();
+      return time_ + boost::posix_time::seconds(stableAge);
     }
 
     ResourceType GetResourceType() const
@@ -335,8 +337,7 @@ namespace Orthanc
       flushThread_ = boost::thread(FlushThread, this, threadSleepGranularityMilliseconds);
     }
 
-    unstableResourcesMonitorThread_ = boost::thread
-      (UnstableResourcesMonitorThread, this, threadSleepGranularityMilliseconds);
+    unstableResourcesMonitorThread_ = boost::thread(UnstableResourcesMonitorThread, this);
   }
 
 
@@ -354,7 +355,11 @@ namespace Orthanc
   {
     if (!done_)
     {
-      done_ = true;
+      {
+        boost::mutex::scoped_lock lock(monitoringMutex_);
+        done_ = true;
+        unstableResourcesChanged_.notify_all();
+      }
 
       if (flushThread_.joinable())
       {
@@ -409,9 +414,12 @@ namespace Orthanc
   }
 
 
-  void ServerIndex::UnstableResourcesMonitorThread(ServerIndex* that,
-                                                   unsigned int threadSleepGranularityMilliseconds)
+  void ServerIndex::UnstableResourcesMonitorThread(ServerIndex* that)
   {
+    // Maximum number of stable resources that are logged in one
+    // single transaction, so as to avoid blocking the ingest
+    static const size_t MAX_BATCH_SIZE = 1000;
+
     int stableAge;
     
     {
@@ -426,65 +434,106 @@ namespace Orthanc
 
     LOG(INFO) << "Starting the monitor for stable resources (stable age = " << stableAge << ")";
 
-    while (!that->done_)
+    std::vector<ChangeToLog> changes;
+    changes.reserve(MAX_BATCH_SIZE);
+
+    for (;;)
     {
-      // Check for stable resources each few seconds
-      boost::this_thread::sleep(boost::posix_time::milliseconds(threadSleepGranularityMilliseconds));
+      changes.clear();
 
-      for (;;)
       {
-        UnstableResourcePayload stableResource;
-        int64_t stableId;
-
-        {      
-          boost::mutex::scoped_lock lock(that->monitoringMutex_);
-
-          if (!that->unstableResources_.IsEmpty() &&
-              that->unstableResources_.GetOldestPayload().GetAge() > static_cast<unsigned int>(stableAge))
+        boost::mutex::scoped_lock lock(that->monitoringMutex_);
+
+        /**
+         * Sleep until the oldest unstable resource reaches its
+         * deadline. The monitor is woken up if a resource is added to
+         * an empty set of unstable resources, or if Orthanc stops.
+         **/
+        while (!that->done_)
+        {
+          if (that->unstableResources_.IsEmpty())
           {
-            // This DICOM resource has not received any new instance for
-            // some time. It can be considered as stable.
-            stableId = that->unstableResources_.RemoveOldest(stableResource);
-            //LOG(TRACE) << "Stable resource: " << EnumerationToString(stableResource.GetResourceType()) << " " << stableId;
+            that->unstableResourcesChanged_.wait(lock);
           }
           else
           {
-            // No more stable DICOM resource, leave the internal loop
-            break;
+            const boost::posix_time::ptime deadline =
+              that->unstableResources_.GetOldestPayload().GetDeadline(stableAge);
+
+            if (boost::posix_time::microsec_clock::universal_time() >= deadline)
+            {
+              break;
+            }
+            else
+            {
+              that->unstableResourcesChanged_.timed_wait(lock, deadline);
+            }
           }
         }
 
-        try
+        if (that->done_)
+        {
+          break;
+        }
+
+        const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+        while (changes.size() < MAX_BATCH_SIZE &&
+               !that->unstableResources_.IsEmpty() &&
+               that->unstableResources_.GetOldestPayload().GetDeadline(stableAge) <= now)
         {
-          /**
-           * WARNING: Don't protect the calls to "LogChange()" using
-           * "monitoringMutex_", as this could lead to deadlocks in
-           * other threads (typically, if "Store()" is being running in
-           * another thread, which leads to calls to "MarkAsUnstable()",
-           * which leads to two lockings of "monitoringMutex_").
-           **/
+          // This DICOM resource has not received any new instance for
+          // some time. It can be considered as stable.
+          UnstableResourcePayload stableResource;
+          int64_t stableId = that->unstableResources_.RemoveOldest(stableResource);
+
           switch (stableResource.GetResourceType())
           {
             case ResourceType_Patient:
-              that->LogChange(stableId, ChangeType_StablePatient, stableResource.GetPublicId(), ResourceType_Patient);
+              changes.push_back(ChangeToLog(stableId, ChangeType_StablePatient, stableResource.GetPublicId(), ResourceType_Patient));
               break;
             
             case ResourceType_Study:
-              that->LogChange(stableId, ChangeType_StableStudy, stableResource.GetPublicId(), ResourceType_Study);
+              changes.push_back(ChangeToLog(stableId, ChangeType_StableStudy, stableResource.GetPublicId(), ResourceType_Study));
               break;
             
             case ResourceType_Series:
-              that->LogChange(stableId, ChangeType_StableSeries, stableResource.GetPublicId(), ResourceType_Series);
+              changes.push_back(ChangeToLog(stableId, ChangeType_StableSeries, stableResource.GetPublicId(), ResourceType_Series));
               break;
             
             default:
               throw OrthancException(ErrorCode_InternalError);
           }
         }
-        catch (OrthancException& e)
+      }
+
+      /**
+       * WARNING: Don't protect the calls to "LogChanges()" using
+       * "monitoringMutex_", as this could lead to deadlocks in other
+       * threads (typically, if "Store()" is being running in another
+       * thread, which leads to calls to "MarkAsUnstable()", which
+       * leads to two lockings of "monitoringMutex_").
+       **/
+      try
+      {
+        that->LogChanges(changes);
+      }
+      catch (OrthancException&)
+      {
+        // Fallback to one transaction per resource, so that one bad
+        // resource doesn't prevent the others from being logged
+        for (size_t i = 0; i < changes.size(); i++)
         {
-          LOG(ERROR) << "Cannot log a change about a stable resource into the database";
-        }          
+          try
+          {
+            that->LogChange(changes[i].GetInternalId(), changes[i].GetChangeType(),
+                            changes[i].GetPublicId(), changes[i].GetLevel());
+          }
+          catch (OrthancException& e)
+          {
+            LOG(ERROR) << "Cannot log a change about a stable resource into the database";
+          }
+        }
       }
     }
 
@@ -502,6 +551,13 @@ namespace Orthanc
 
     {
       boost::mutex::scoped_lock lock(monitoringMutex_);
+
+      if (unstableResources_.IsEmpty())
+      {
+        // Wake up the monitor thread that is waiting for a resource
+        unstableResourcesChanged_.notify_one();
+      }
+
       UnstableResourcePayload payload(type, publicId);
       unstableResources_.AddOrMakeMostRecent(id, payload);
       //LOG(INFO) << "Unstable resource: " << EnumerationToString(type) << " " << id;
@@ -519,7 +575,8 @@ namespace Orthanc
                                  DicomTransferSyntax transferSyntax,
                                  bool hasPixelDataOffset,
                                  uint64_t pixelDataOffset,
-                                 bool isReconstruct)
+                                 bool isReconstruct,
+                                 const std::string& expectedDicomUuid)
   {
     uint64_t maximumStorageSize;
     unsigned int maximumPatients;
@@ -532,7 +589,8 @@ namespace Orthanc
 
     return StatelessDatabaseOperations::Store(
       instanceMetadata, dicomSummary, attachments, metadata, origin, overwrite, hasTransferSyntax,
-      transferSyntax, hasPixelDataOffset, pixelDataOffset, maximumStorageSize, maximumPatients, isReconstruct);
+      transferSyntax, hasPixelDataOffset, pixelDataOffset, maximumStorageSize, maximumPatients, isReconstruct,
+      expectedDicomUuid);
   }
 
   
@@ -40,6 +40,7 @@ namespace Orthanc
 
     bool done_;
     boost::mutex monitoringMutex_;
+    boost::condition_variable unstableResourcesChanged_;
     boost::thread flushThread_;
     boost::thread unstableResourcesMonitorThread_;
 
@@ -51,8 +52,7 @@ namespace Orthanc
     static void FlushThread(ServerIndex* that,
                             unsigned int threadSleep);
 
-    static void UnstableResourcesMonitorThread(ServerIndex* that,
-                                               unsigned int threadSleep);
+    static void UnstableResourcesMonitorThread(ServerIndex* that);
 
     void MarkAsUnstable(int64_t id,
                         Orthanc::ResourceType type,
@@ -85,7 +85,8 @@ namespace Orthanc
                       DicomTransferSyntax transferSyntax,
                       bool hasPixelDataOffset,
                       uint64_t pixelDataOffset,
-                      bool isResonstruct);
+                      bool isResonstruct,
+                      const std::string& expectedDicomUuid);
 
     StoreStatus AddAttachment(int64_t& newRevision /*out*/,
                               const FileInfo& attachment,
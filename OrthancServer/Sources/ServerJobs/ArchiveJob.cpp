@@ -27,6 +27,7 @@
 #include "../../../OrthancFramework/Sources/Compression/HierarchicalZipWriter.h"
 #include "../../../OrthancFramework/Sources/DicomParsing/DicomDirWriter.h"
 #include "../../../OrthancFramework/Sources/DicomParsing/FromDcmtkBridge.h"
+#include "../../../OrthancFramework/Sources/IMemoryBuffer.h"
 #include "../../../OrthancFramework/Sources/Logging.h"
 #include "../../../OrthancFramework/Sources/OrthancException.h"
 #include "../../../OrthancFramework/Sources/MultiThreading/Semaphore.h"
@@ -97,7 +98,9 @@ namespace Orthanc
 
     }
 
-    virtual void GetDicom(std::string& dicom, const std::string& instanceId) = 0;
+    // New in Orthanc 1.11.0: The DICOM file is given as the buffer
+    // of the storage area, in order to avoid copying it
+    virtual void GetDicom(boost::shared_ptr<IMemoryBuffer>& dicom, const std::string& instanceId) = 0;
 
     virtual void Clear()
     {
@@ -112,9 +115,9 @@ namespace Orthanc
     {
     }
 
-    virtual void GetDicom(std::string& dicom, const std::string& instanceId) ORTHANC_OVERRIDE
+    virtual void GetDicom(boost::shared_ptr<IMemoryBuffer>& dicom, const std::string& instanceId) ORTHANC_OVERRIDE
     {
-      context_.ReadDicom(dicom, instanceId);
+      dicom.reset(context_.ReadDicom(instanceId));
     }
   };
 
@@ -138,7 +141,7 @@ namespace Orthanc
   class ArchiveJob::ThreadedInstanceLoader : public ArchiveJob::InstanceLoader
   {
     Semaphore                           availableInstancesSemaphore_;
-    std::map<std::string, boost::shared_ptr<std::string> >  availableInstances_;
+    std::map<std::string, boost::shared_ptr<IMemoryBuffer> >  availableInstances_;
     boost::mutex                        availableInstancesMutex_;
     SharedMessageQueue                  instancesToPreload_;
     std::vector<boost::thread*>         threads_;
@@ -192,8 +195,7 @@ namespace Orthanc
 
         try
         {
-          boost::shared_ptr<std::string> dicomContent(new std::string());
-          that->context_.ReadDicom(*dicomContent, instanceId->GetId());
+          boost::shared_ptr<IMemoryBuffer> dicomContent(that->context_.ReadDicom(instanceId->GetId()));
           {
             boost::mutex::scoped_lock lock(that->availableInstancesMutex_);
             that->availableInstances_[instanceId->GetId()] = dicomContent;
@@ -205,7 +207,7 @@ namespace Orthanc
         {
           boost::mutex::scoped_lock lock(that->availableInstancesMutex_);
           // store a NULL result to notify that we could not read the instance
-          that->availableInstances_[instanceId->GetId()] = boost::shared_ptr<std::string>(); 
+          that->availableInstances_[instanceId->GetId()] = boost::shared_ptr<IMemoryBuffer>(); 
           that->availableInstancesSemaphore_.Release();
         }
       }
@@ -216,14 +218,14 @@ namespace Orthanc
       instancesToPreload_.Enqueue(new InstanceId(instanceId));
     }
 
-    virtual void GetDicom(std::string& dicom, const std::string& instanceId) ORTHANC_OVERRIDE
+    virtual void GetDicom(boost::shared_ptr<IMemoryBuffer>& dicom, const std::string& instanceId) ORTHANC_OVERRIDE
     {
       while (true)
       {
         // wait for an instance to be available but this might not be the one we are waiting for !
         availableInstancesSemaphore_.Acquire();
 
-        boost::shared_ptr<std::string> dicomContent;
+        boost::shared_ptr<IMemoryBuffer> dicomContent;
         {
           if (availableInstances_.find(instanceId) != availableInstances_.end())
           {
@@ -235,7 +237,7 @@ namespace Orthanc
             {
               throw OrthancException(ErrorCode_InexistentItem);
             }
-            dicom.swap(*dicomContent);
+            dicom.swap(dicomContent);
 
             if (availableInstances_.size() > 0)
             {
@@ -585,7 +587,7 @@ namespace Orthanc
 
           case Type_WriteInstance:
           {
-            std::string content;
+            boost::shared_ptr<IMemoryBuffer> content;
 
             try
             {
@@ -612,7 +614,7 @@ namespace Orthanc
               syntaxes.insert(transferSyntax);
 
               IDicomTranscoder::DicomImage source, transcoded;
-              source.SetExternalBuffer(content);
+              source.SetExternalBuffer(content->GetData(), content->GetSize());
 
               if (context.Transcode(transcoded, source, syntaxes, true /* allow new SOP instance UID */))
               {
@@ -635,13 +637,13 @@ namespace Orthanc
 
             if (!transcodeSuccess)
             {
-              writer.Write(content);
+              writer.Write(content->GetData(), content->GetSize());
 
               if (dicomDir != NULL)
               {
                 if (parsed.get() == NULL)
                 {
-                  parsed.reset(new ParsedDicomFile(content));
+                  parsed.reset(new ParsedDicomFile(content->GetData(), content->GetSize()));
                 }
 
                 dicomDir->Add(dicomDirFolder, filename_, *parsed);
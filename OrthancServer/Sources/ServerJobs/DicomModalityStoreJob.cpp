@@ -37,7 +37,21 @@ namespace Orthanc
   {
     if (connection_.get() == NULL)
     {
-      connection_.reset(new DicomStoreUserConnection(parameters_));
+      connection_.reset(new DicomConnectionPool::Accessor(context_.GetDicomConnectionPool(), parameters_));
+    }
+  }
+
+
+  void DicomModalityStoreJob::CloseConnection(bool reusable)
+  {
+    if (connection_.get() != NULL)
+    {
+      if (!reusable)
+      {
+        connection_->Discard();
+      }
+
+      connection_.reset(NULL);  // Gives the association back to the pool
     }
   }
 
@@ -63,8 +77,18 @@ namespace Orthanc
     }
 
     std::string sopClassUid, sopInstanceUid;
-    context_.StoreWithTranscoding(sopClassUid, sopInstanceUid, *connection_, dicom,
-                                  HasMoveOriginator(), moveOriginatorAet_, moveOriginatorId_);
+
+    try
+    {
+      context_.StoreWithTranscoding(sopClassUid, sopInstanceUid, connection_->GetConnection(), dicom,
+                                    HasMoveOriginator(), moveOriginatorAet_, moveOriginatorId_);
+    }
+    catch (OrthancException&)
+    {
+      // Never give an association in an unknown state back to the pool
+      CloseConnection(false);
+      throw;
+    }
 
     if (storageCommitment_)
     {
@@ -80,7 +104,10 @@ namespace Orthanc
       if (sopClassUids_.size() == GetInstancesCount())
       {
         assert(IsStarted());
-        connection_.reset(NULL);
+
+        // The remote modality might expect the C-STORE association to
+        // be released before receiving the storage commitment request
+        CloseConnection(false);
         
         const std::string& remoteAet = parameters_.GetRemoteModality().GetApplicationEntityTitle();
         
@@ -205,7 +232,8 @@ namespace Orthanc
 
   void DicomModalityStoreJob::Stop(JobStopReason reason)   // For pausing jobs
   {
-    connection_.reset(NULL);
+    CloseConnection(reason == JobStopReason_Success ||
+                    reason == JobStopReason_Paused);
   }
 
 
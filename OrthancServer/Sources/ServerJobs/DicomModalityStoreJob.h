@@ -24,7 +24,7 @@
 
 #include "../../../OrthancFramework/Sources/Compatibility.h"
 #include "../../../OrthancFramework/Sources/JobsEngine/SetOfInstancesJob.h"
-#include "../../../OrthancFramework/Sources/DicomNetworking/DicomStoreUserConnection.h"
+#include "../../../OrthancFramework/Sources/DicomNetworking/DicomConnectionPool.h"
 
 #include <list>
 
@@ -35,12 +35,12 @@ namespace Orthanc
   class DicomModalityStoreJob : public SetOfInstancesJob
   {
   private:
-    ServerContext&                             context_;
-    DicomAssociationParameters                 parameters_;
-    std::string                                moveOriginatorAet_;
-    uint16_t                                   moveOriginatorId_;
-    std::unique_ptr<DicomStoreUserConnection>  connection_;
-    bool                                       storageCommitment_;
+    ServerContext&                                  context_;
+    DicomAssociationParameters                      parameters_;
+    std::string                                     moveOriginatorAet_;
+    uint16_t                                        moveOriginatorId_;
+    std::unique_ptr<DicomConnectionPool::Accessor>  connection_;  // Taken from the pool of "ServerContext"
+    bool                                            storageCommitment_;
 
     // For storage commitment
     std::string             transactionUid_;
@@ -49,6 +49,8 @@ namespace Orthanc
 
     void OpenConnection();
 
+    void CloseConnection(bool reusable);
+
     void ResetStorageCommitment();
 
   protected:
@@ -23,8 +23,8 @@
 #include "../PrecompiledHeadersServer.h"
 #include "LuaJobManager.h"
 
-#include "../OrthancConfiguration.h"
 #include "../../../OrthancFramework/Sources/Logging.h"
+#include "../../../OrthancFramework/Sources/OrthancException.h"
 
 #include "../../../OrthancFramework/Sources/JobsEngine/Operations/LogJobOperation.h"
 #include "Operations/DeleteResourceOperation.h"
@@ -39,34 +39,123 @@
 
 namespace Orthanc
 {
+  class LuaJobManager::LaneJob : public SequenceOfOperationsJob
+  {
+  private:
+    LuaJobManager&  manager_;
+
+  public:
+    explicit LaneJob(LuaJobManager& manager) :
+      manager_(manager)
+    {
+    }
+
+    virtual JobStepResult Step(const std::string& jobId) ORTHANC_OVERRIDE
+    {
+      if (manager_.IsWaitingForLanes(*this))
+      {
+        // Release the worker of the jobs engine, so that it can
+        // process the other lanes in the meantime
+        return JobStepResult::Retry(100);
+      }
+      else
+      {
+        return SequenceOfOperationsJob::Step(jobId);
+      }
+    }
+  };
+
+
+  void LuaJobManager::ForgetJob(const SequenceOfOperationsJob* job)
+  {
+    // The mutex must be locked
+    runningJobs_.erase(const_cast<SequenceOfOperationsJob*>(job));
+
+    std::list<Barrier>::iterator it = barriers_.begin();
+    while (it != barriers_.end())
+    {
+      if (it->job_ == job)
+      {
+        it = barriers_.erase(it);
+      }
+      else
+      {
+        ++it;
+      }
+    }
+  }
+
+
+  bool LuaJobManager::IsWaitingForLanes(SequenceOfOperationsJob& job)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    std::list<Barrier>::iterator it = barriers_.begin();
+    while (it != barriers_.end())
+    {
+      if (it->job_ != &job)
+      {
+        ++it;
+        continue;
+      }
+
+      {
+        SequenceOfOperationsJob::Lock jobLock(job);
+        if (jobLock.GetProcessedOperationsCount() < it->operation_)
+        {
+          // The barrier is not reached yet. The barriers of one job
+          // are sorted by increasing operation index.
+          return false;
+        }
+      }
+
+      for (std::map<SequenceOfOperationsJob*, size_t>::const_iterator
+             dependency = it->dependencies_.begin(); dependency != it->dependencies_.end(); ++dependency)
+      {
+        // A job that is not running anymore might have been deleted
+        // by the jobs registry, and is drained anyway
+        if (runningJobs_.find(dependency->first) != runningJobs_.end())
+        {
+          SequenceOfOperationsJob::Lock dependencyLock(*dependency->first);
+          if (!dependencyLock.IsDone() &&
+              dependencyLock.GetProcessedOperationsCount() < dependency->second)
+          {
+            return true;
+          }
+        }
+      }
+
+      // All the lanes this barrier depends on have been drained
+      it = barriers_.erase(it);
+    }
+
+    return false;
+  }
+
+
   void LuaJobManager::SignalDone(const SequenceOfOperationsJob& job)
   {
     boost::mutex::scoped_lock lock(mutex_);
 
-    if (&job == currentJob_)
+    ForgetJob(&job);
+
+    for (Lanes::iterator it = lanes_.begin(); it != lanes_.end(); ++it)
     {
-      currentId_.clear();
-      currentJob_ = NULL;
+      if (it->second.job_ == &job)
+      {
+        lanes_.erase(it);
+        return;
+      }
     }
   }
 
 
   LuaJobManager::LuaJobManager() :
-    currentJob_(NULL),
     maxOperations_(1000),
     priority_(0),
-    trailingTimeout_(5000)
+    trailingTimeout_(5000),
+    maxLanes_(0)
   {
-    unsigned int dicomTimeout;
-    
-    {
-      OrthancConfiguration::ReaderLock lock;
-      dicomTimeout = lock.GetConfiguration().GetUnsignedIntegerParameter("DicomAssociationCloseDelay", 5);
-    }
-
-    connectionManager_.SetInactivityTimeout(dicomTimeout * 1000);  // Milliseconds expected
-    CLOG(INFO, LUA) << "Lua: DICOM associations will be closed after "
-                    << dicomTimeout << " seconds of inactivity";
   }
 
 
@@ -77,6 +166,13 @@ namespace Orthanc
   }
 
 
+  void LuaJobManager::SetMaxLanes(unsigned int count)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    maxLanes_ = count;
+  }
+
+
   void LuaJobManager::SetPriority(int priority)
   {
     boost::mutex::scoped_lock lock(mutex_);
@@ -97,94 +193,260 @@ namespace Orthanc
 
     CLOG(INFO, LUA) << "Awaking trailing sleep";
 
-    if (currentJob_ != NULL)
+    for (Lanes::iterator it = lanes_.begin(); it != lanes_.end(); ++it)
     {
-      currentJob_->AwakeTrailingSleep();
+      if (it->second.job_ != NULL)
+      {
+        it->second.job_->AwakeTrailingSleep();
+      }
     }
   }
 
 
+  class LuaJobManager::Lock::LaneLock : public boost::noncopyable
+  {
+  private:
+    LuaJobManager&                                  manager_;
+    Lane&                                           lane_;
+    std::unique_ptr<SequenceOfOperationsJob::Lock>  jobLock_;
+    bool                                            isNewJob_;
+
+  public:
+    LaneLock(LuaJobManager& manager,
+             Lane& lane) :
+      manager_(manager),
+      lane_(lane)
+    {
+      if (lane_.job_ == NULL)
+      {
+        isNewJob_ = true;
+      }
+      else
+      {
+        jobLock_.reset(new SequenceOfOperationsJob::Lock(*lane_.job_));
+
+        if (jobLock_->IsDone() ||
+            jobLock_->GetOperationsCount() >= manager.maxOperations_)
+        {
+          jobLock_.reset(NULL);
+          isNewJob_ = true;
+        }
+        else
+        {
+          isNewJob_ = false;
+        }
+      }
+
+      if (isNewJob_)
+      {
+        // Need to create a new job, as the previous one is either
+        // finished, or is getting too long
+        lane_.id_.clear();
+        lane_.job_ = new LaneJob(manager);
+        lane_.job_->Register(manager);
+        manager.runningJobs_.insert(lane_.job_);
+        lane_.job_->SetDescription("Lua");
+
+        {
+          jobLock_.reset(new SequenceOfOperationsJob::Lock(*lane_.job_));
+          jobLock_->SetTrailingOperationTimeout(manager.trailingTimeout_);
+        }
+      }
+
+      assert(jobLock_.get() != NULL);
+    }
+
+    SequenceOfOperationsJob* GetJob() const
+    {
+      return lane_.job_;
+    }
+
+    SequenceOfOperationsJob::Lock& GetJobLock()
+    {
+      assert(jobLock_.get() != NULL);
+      return *jobLock_;
+    }
+
+    // Returns "false" iff. the lane has become empty
+    bool Release(JobsEngine& engine,
+                 int priority)
+    {
+      assert(jobLock_.get() != NULL);
+      const bool isEmpty = (isNewJob_ &&
+                            jobLock_->GetOperationsCount() == 0);
+
+      jobLock_.reset(NULL);
+
+      if (isNewJob_)
+      {
+        isNewJob_ = false;
+
+        if (isEmpty)
+        {
+          // No operation was added, discard the newly created job
+          manager_.ForgetJob(lane_.job_);
+          delete lane_.job_;
+          lane_.job_ = NULL;
+          return false;
+        }
+        else
+        {
+          try
+          {
+            engine.GetRegistry().Submit(lane_.id_, lane_.job_, priority);
+          }
+          catch (OrthancException&)
+          {
+            // The job has been destroyed by the registry
+            manager_.ForgetJob(lane_.job_);
+            throw;
+          }
+        }
+      }
+
+      return true;
+    }
+  };
+
+
   LuaJobManager::Lock::Lock(LuaJobManager& that,
                             JobsEngine& engine) :
     that_(that),
     lock_(that.mutex_),
-    engine_(engine)
+    engine_(engine),
+    jobLock_(NULL)
   {
-    if (that_.currentJob_ == NULL)
-    {
-      isNewJob_ = true;
-    }
-    else
+    SelectLane("");  // Default lane
+  }
+
+
+  LuaJobManager::Lock::~Lock()
+  {
+    for (LaneLocks::iterator it = laneLocks_.begin(); it != laneLocks_.end(); ++it)
     {
-      jobLock_.reset(new SequenceOfOperationsJob::Lock(*that_.currentJob_));
+      assert(it->second != NULL);
 
-      if (jobLock_->IsDone() ||
-          jobLock_->GetOperationsCount() >= that_.maxOperations_)
+      try
       {
-        jobLock_.reset(NULL);
-        isNewJob_ = true;
+        if (!it->second->Release(engine_, that_.priority_))
+        {
+          that_.lanes_.erase(it->first);
+        }
       }
-      else
+      catch (OrthancException& e)
       {
-        isNewJob_ = false;
+        // The job has been destroyed by the registry
+        LOG(ERROR) << "Cannot submit a Lua job: " << e.What();
+        that_.lanes_.erase(it->first);
       }
+
+      delete it->second;
     }
+  }
 
-    if (isNewJob_)
+
+  void LuaJobManager::Lock::SelectLane(const std::string& destination)
+  {
+    std::string key = destination;
+
+    if (!key.empty() &&
+        that_.lanes_.find(key) == that_.lanes_.end())
     {
-      // Need to create a new job, as the previous one is either
-      // finished, or is getting too long
-      that_.currentJob_ = new SequenceOfOperationsJob;
-      that_.currentJob_->Register(that_);
-      that_.currentJob_->SetDescription("Lua");
+      const size_t countLanes = that_.lanes_.size() - that_.lanes_.count("");
+      if (countLanes >= that_.maxLanes_)
+      {
+        // Too many lanes, fallback to the default lane
+        key.clear();
+      }
+    }
 
+    LaneLocks::iterator found = laneLocks_.find(key);
+
+    if (found == laneLocks_.end())
+    {
+      Lanes::iterator lane = that_.lanes_.find(key);
+      if (lane == that_.lanes_.end())
       {
-        jobLock_.reset(new SequenceOfOperationsJob::Lock(*that_.currentJob_));
-        jobLock_->SetTrailingOperationTimeout(that_.trailingTimeout_);
+        Lane empty;
+        empty.job_ = NULL;
+        lane = that_.lanes_.insert(std::make_pair(key, empty)).first;
       }
+
+      found = laneLocks_.insert(std::make_pair(key, new LaneLock(that_, lane->second))).first;
     }
 
-    assert(jobLock_.get() != NULL);
+    assert(found->second != NULL);
+    jobLock_ = &found->second->GetJobLock();
   }
 
 
-  LuaJobManager::Lock::~Lock()
+  void LuaJobManager::Lock::SelectDefaultLaneAfterOtherLanes()
   {
-    bool isEmpty;
-    
-    assert(jobLock_.get() != NULL);
-    isEmpty = (isNewJob_ &&
-               jobLock_->GetOperationsCount() == 0);
-    
-    jobLock_.reset(NULL);
-
-    if (isNewJob_)
+    SelectLane("");
+
+    if (that_.maxLanes_ == 0)
+    {
+      return;  // All the operations are in the default lane
+    }
+
+    LaneLocks::const_iterator current = laneLocks_.find("");
+    assert(current != laneLocks_.end() &&
+           current->second != NULL &&
+           jobLock_ != NULL);
+
+    Barrier barrier;
+    barrier.job_ = current->second->GetJob();
+    barrier.operation_ = jobLock_->GetOperationsCount();
+
+    for (std::set<SequenceOfOperationsJob*>::const_iterator
+           it = that_.runningJobs_.begin(); it != that_.runningJobs_.end(); ++it)
     {
-      if (isEmpty)
+      if (*it == barrier.job_)
       {
-        // No operation was added, discard the newly created job
-        isNewJob_ = false;
-        delete that_.currentJob_;
-        that_.currentJob_ = NULL;
+        continue;
       }
-      else
+
+      // The lanes that are locked by this object cannot be locked twice
+      SequenceOfOperationsJob::Lock* dependencyLock = NULL;
+      for (LaneLocks::const_iterator lane = laneLocks_.begin(); lane != laneLocks_.end(); ++lane)
+      {
+        if (lane->second->GetJob() == *it)
+        {
+          dependencyLock = &lane->second->GetJobLock();
+        }
+      }
+
+      std::unique_ptr<SequenceOfOperationsJob::Lock> tmp;
+      if (dependencyLock == NULL)
+      {
+        tmp.reset(new SequenceOfOperationsJob::Lock(**it));
+        dependencyLock = tmp.get();
+      }
+
+      if (!dependencyLock->IsDone() &&
+          dependencyLock->GetProcessedOperationsCount() < dependencyLock->GetOperationsCount())
       {
-        engine_.GetRegistry().Submit(that_.currentId_, that_.currentJob_, that_.priority_);
+        barrier.dependencies_[*it] = dependencyLock->GetOperationsCount();
       }
     }
+
+    if (!barrier.dependencies_.empty())
+    {
+      that_.barriers_.push_back(barrier);
+    }
   }
 
 
   size_t LuaJobManager::Lock::AddDeleteResourceOperation(ServerContext& context)
   {
-    assert(jobLock_.get() != NULL);
+    assert(jobLock_ != NULL);
     return jobLock_->AddOperation(new DeleteResourceOperation(context));
   }
 
 
   size_t LuaJobManager::Lock::AddLogOperation()
   {
-    assert(jobLock_.get() != NULL);
+    assert(jobLock_ != NULL);
     return jobLock_->AddOperation(new LogJobOperation);
   }
 
@@ -193,22 +455,21 @@ namespace Orthanc
                                                    const std::string& localAet,
                                                    const RemoteModalityParameters& modality)
   {
-    assert(jobLock_.get() != NULL);
-    return jobLock_->AddOperation(new StoreScuOperation(
-                                    context, that_.connectionManager_, localAet, modality));    
+    assert(jobLock_ != NULL);
+    return jobLock_->AddOperation(new StoreScuOperation(context, localAet, modality));    
   }
 
 
   size_t LuaJobManager::Lock::AddStorePeerOperation(const WebServiceParameters& peer)
   {
-    assert(jobLock_.get() != NULL);
+    assert(jobLock_ != NULL);
     return jobLock_->AddOperation(new StorePeerOperation(peer));    
   }
 
 
   size_t LuaJobManager::Lock::AddSystemCallOperation(const std::string& command)
   {
-    assert(jobLock_.get() != NULL);
+    assert(jobLock_ != NULL);
     return jobLock_->AddOperation(new SystemCallOperation(command));    
   }
  
@@ -218,7 +479,7 @@ namespace Orthanc
    const std::vector<std::string>& preArguments,
    const std::vector<std::string>& postArguments)
   {
-    assert(jobLock_.get() != NULL);
+    assert(jobLock_ != NULL);
     return jobLock_->AddOperation
       (new SystemCallOperation(command, preArguments, postArguments));
   }
@@ -227,7 +488,7 @@ namespace Orthanc
   size_t LuaJobManager::Lock::AddModifyInstanceOperation(ServerContext& context,
                                                          DicomModification* modification)
   {
-    assert(jobLock_.get() != NULL);
+    assert(jobLock_ != NULL);
     return jobLock_->AddOperation
       (new ModifyInstanceOperation(context, RequestOrigin_Lua, modification));
   }
@@ -235,7 +496,7 @@ namespace Orthanc
 
   void LuaJobManager::Lock::AddNullInput(size_t operation)
   {
-    assert(jobLock_.get() != NULL);
+    assert(jobLock_ != NULL);
     NullOperationValue null;
     jobLock_->AddInput(operation, null);
   }
@@ -244,7 +505,7 @@ namespace Orthanc
   void LuaJobManager::Lock::AddStringInput(size_t operation,
                                            const std::string& content)
   {
-    assert(jobLock_.get() != NULL);
+    assert(jobLock_ != NULL);
     StringOperationValue value(content);
     jobLock_->AddInput(operation, value);
   }
@@ -254,7 +515,7 @@ namespace Orthanc
                                                   ServerContext& context,
                                                   const std::string& instanceId)
   {
-    assert(jobLock_.get() != NULL);
+    assert(jobLock_ != NULL);
     DicomInstanceOperationValue value(context, instanceId);
     jobLock_->AddInput(operation, value);
   }
@@ -263,7 +524,7 @@ namespace Orthanc
   void LuaJobManager::Lock::Connect(size_t operation1,
                                     size_t operation2)
   {
-    assert(jobLock_.get() != NULL);
+    assert(jobLock_ != NULL);
     jobLock_->Connect(operation1, operation2);
   }
 }
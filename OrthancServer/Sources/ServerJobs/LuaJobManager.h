@@ -22,12 +22,16 @@
 
 #pragma once
 
-#include "../../../OrthancFramework/Sources/DicomNetworking/TimeoutDicomConnectionManager.h"
+#include "../../../OrthancFramework/Sources/DicomNetworking/RemoteModalityParameters.h"
 #include "../../../OrthancFramework/Sources/DicomParsing/DicomModification.h"
 #include "../../../OrthancFramework/Sources/JobsEngine/JobsEngine.h"
 #include "../../../OrthancFramework/Sources/JobsEngine/Operations/SequenceOfOperationsJob.h"
 #include "../../../OrthancFramework/Sources/WebServiceParameters.h"
 
+#include <list>
+#include <map>
+#include <set>
+
 namespace Orthanc
 {
   class ServerContext;
@@ -35,40 +39,82 @@ namespace Orthanc
   class LuaJobManager : private SequenceOfOperationsJob::IObserver
   {
   private:
-    boost::mutex              mutex_;
-    std::string               currentId_;
-    SequenceOfOperationsJob*  currentJob_;
+    /**
+     * New in Orthanc 1.11.0: Each lane is a distinct job, whose
+     * operations are applied in sequence. The default lane is
+     * identified by the empty string, and the other lanes by the
+     * destination of the operations they contain, which allows to
+     * send to different destinations concurrently.
+     **/
+    struct Lane
+    {
+      std::string               id_;
+      SequenceOfOperationsJob*  job_;
+    };
+
+    typedef std::map<std::string, Lane>  Lanes;
+
+    /**
+     * The operations of a job, starting at index "operation_", are
+     * only applied once the operations that were queued in the other
+     * lanes at the time the barrier was created, have been applied.
+     * This prevents e.g. "Delete()" to be applied before the
+     * "SendToModality()" that were queued by previous scripts.
+     **/
+    struct Barrier
+    {
+      const SequenceOfOperationsJob*                   job_;
+      size_t                                           operation_;
+      std::map<SequenceOfOperationsJob*, size_t>       dependencies_;
+    };
+
+    class LaneJob;
+
+    boost::mutex                          mutex_;
+    Lanes                                 lanes_;
+    std::set<SequenceOfOperationsJob*>    runningJobs_;  // Jobs that have not signaled "done"
+    std::list<Barrier>                    barriers_;
     size_t                    maxOperations_;
     int                       priority_;
     unsigned int              trailingTimeout_;
-    TimeoutDicomConnectionManager  connectionManager_;
+    unsigned int              maxLanes_;
+
+    // The mutex must be locked
+    void ForgetJob(const SequenceOfOperationsJob* job);
 
     virtual void SignalDone(const SequenceOfOperationsJob& job) ORTHANC_OVERRIDE;
 
+    // Returns "true" iff. the next operation of the job must wait for
+    // the other lanes to be drained
+    bool IsWaitingForLanes(SequenceOfOperationsJob& job);
+
   public:
     LuaJobManager();
 
     void SetMaxOperationsPerJob(size_t count);
 
+    // Maximum number of lanes, besides the default lane. A value of
+    // "0" means that all the operations are applied in sequence.
+    void SetMaxLanes(unsigned int count);
+
     void SetPriority(int priority);
 
     void SetTrailingOperationTimeout(unsigned int timeout);
 
     void AwakeTrailingSleep();
 
-    TimeoutDicomConnectionManager& GetDicomConnectionManager()
-    {
-      return connectionManager_;
-    }
-
     class Lock : public boost::noncopyable
     {
     private:
+      class LaneLock;
+
+      typedef std::map<std::string, LaneLock*>  LaneLocks;
+
       LuaJobManager&                                  that_;
       boost::mutex::scoped_lock                       lock_;
       JobsEngine&                                     engine_;
-      std::unique_ptr<SequenceOfOperationsJob::Lock>  jobLock_;
-      bool                                            isNewJob_;
+      LaneLocks                                       laneLocks_;
+      SequenceOfOperationsJob::Lock*                  jobLock_;  // Lock on the selected lane
 
     public:
       Lock(LuaJobManager& that,
@@ -76,6 +122,17 @@ namespace Orthanc
 
       ~Lock();
 
+      // The next operations will be added to the lane associated
+      // with this destination (the empty string corresponds to the
+      // default lane). The indices of the operations are specific
+      // to each lane.
+      void SelectLane(const std::string& destination);
+
+      // Selects the default lane. The operations that are added next
+      // will only be applied once all the operations that are
+      // currently queued in the other lanes have been applied.
+      void SelectDefaultLaneAfterOtherLanes();
+
       size_t AddLogOperation();
 
       size_t AddDeleteResourceOperation(ServerContext& context);
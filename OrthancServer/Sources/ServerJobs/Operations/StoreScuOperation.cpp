@@ -35,8 +35,6 @@ namespace Orthanc
   void StoreScuOperation::Apply(JobOperationValues& outputs,
                                 const IJobOperationValue& input)
   {
-    TimeoutDicomConnectionManager::Lock lock(connectionManager_, localAet_, modality_);
-    
     if (input.GetType() != IJobOperationValue::Type_DicomInstance)
     {
       throw OrthancException(ErrorCode_BadParameterType);
@@ -53,9 +51,20 @@ namespace Orthanc
       std::string dicom;
       instance.ReadDicom(dicom);
 
-      std::string sopClassUid, sopInstanceUid;  // Unused
-      context_.StoreWithTranscoding(sopClassUid, sopInstanceUid, lock.GetConnection(), dicom,
-                                    false /* Not a C-MOVE */, "", 0);
+      DicomConnectionPool::Accessor accessor(context_.GetDicomConnectionPool(),
+                                             DicomAssociationParameters(localAet_, modality_));
+
+      try
+      {
+        std::string sopClassUid, sopInstanceUid;  // Unused
+        context_.StoreWithTranscoding(sopClassUid, sopInstanceUid, accessor.GetConnection(), dicom,
+                                      false /* Not a C-MOVE */, "", 0);
+      }
+      catch (OrthancException&)
+      {
+        accessor.Discard();
+        throw;
+      }
     }
     catch (OrthancException& e)
     {
@@ -77,10 +86,8 @@ namespace Orthanc
 
 
   StoreScuOperation::StoreScuOperation(ServerContext& context,
-                                       TimeoutDicomConnectionManager& connectionManager,
                                        const Json::Value& serialized) :
-    context_(context),
-    connectionManager_(connectionManager)
+    context_(context)
   {
     if (SerializationToolbox::ReadString(serialized, "Type") != "StoreScu" ||
         !serialized.isMember("LocalAET"))
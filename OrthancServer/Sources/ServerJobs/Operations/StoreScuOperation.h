@@ -24,7 +24,7 @@
 
 #include "../../../../OrthancFramework/Sources/Compatibility.h"  // For ORTHANC_OVERRIDE
 #include "../../../../OrthancFramework/Sources/JobsEngine/Operations/IJobOperation.h"
-#include "../../../../OrthancFramework/Sources/DicomNetworking/TimeoutDicomConnectionManager.h"
+#include "../../../../OrthancFramework/Sources/DicomNetworking/RemoteModalityParameters.h"
 
 namespace Orthanc
 {
@@ -33,25 +33,23 @@ namespace Orthanc
   class StoreScuOperation : public IJobOperation
   {
   private:
-    ServerContext&                  context_;
-    TimeoutDicomConnectionManager&  connectionManager_;
-    std::string                     localAet_;
-    RemoteModalityParameters        modality_;
+    ServerContext&            context_;
+    std::string               localAet_;
+    RemoteModalityParameters  modality_;
     
   public:
+    // New in Orthanc 1.11.0: The associations are taken from the
+    // pool of "ServerContext", instead of being specific to Lua
     StoreScuOperation(ServerContext& context,
-                      TimeoutDicomConnectionManager& connectionManager,
                       const std::string& localAet,
                       const RemoteModalityParameters& modality) :
       context_(context),
-      connectionManager_(connectionManager),
       localAet_(localAet),
       modality_(modality)
     {
     }
 
     StoreScuOperation(ServerContext& context,
-                      TimeoutDicomConnectionManager& connectionManager,
                       const Json::Value& serialized);
 
     const std::string& GetLocalAet() const
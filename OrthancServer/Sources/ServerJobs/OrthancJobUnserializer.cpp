@@ -115,8 +115,7 @@ namespace Orthanc
     }
     else if (type == "StoreScu")
     {
-      return new StoreScuOperation(
-        context_, context_.GetLuaScripting().GetDicomConnectionManager(), source);
+      return new StoreScuOperation(context_, source);
     }
     else if (type == "SystemCall")
     {
@@ -30,9 +30,12 @@
 #include "../OrthancConfiguration.h"
 #include "../ServerContext.h"
 
+#include <algorithm>
+
 
 static const char* ANSWER = "Answer";
 static const char* CALLED_AET = "CalledAet";
+static const char* COUNT = "Count";
 static const char* INDEX = "Index";
 static const char* LOOKUP = "Lookup";
 static const char* REMOTE_MODALITY = "RemoteModality";
@@ -42,6 +45,9 @@ static const char* SOP_INSTANCE_UIDS = "SopInstanceUids";
 static const char* TRANSACTION_UID = "TransactionUid";
 static const char* TYPE = "Type";
 
+// Number of SOP instance UIDs that are looked up by one single command
+static const size_t LOOKUP_BATCH_SIZE = 100;
+
 
 
 namespace Orthanc
@@ -83,22 +89,30 @@ namespace Orthanc
   };
 
 
+  // Since Orthanc 1.11.0, one lookup command covers a range of
+  // "count" SOP instances, starting at "index"
   class StorageCommitmentScpJob::LookupCommand : public StorageCommitmentCommand
   {
   private:
-    StorageCommitmentScpJob&        that_;
-    size_t                          index_;
-    bool                            hasFailureReason_;
-    StorageCommitmentFailureReason  failureReason_;
+    StorageCommitmentScpJob&                     that_;
+    size_t                                       index_;
+    size_t                                       count_;
+    bool                                         hasFailureReasons_;
+    std::vector<StorageCommitmentFailureReason>  failureReasons_;
 
   public:
     LookupCommand(StorageCommitmentScpJob&  that,
-                  size_t index) :
+                  size_t index,
+                  size_t count) :
       that_(that),
       index_(index),
-      hasFailureReason_(false),
-      failureReason_(StorageCommitmentFailureReason_Success)
+      count_(count),
+      hasFailureReasons_(false)
     {
+      if (count == 0)
+      {
+        throw OrthancException(ErrorCode_ParameterOutOfRange);
+      }
     }
 
     virtual CommandType GetType() const ORTHANC_OVERRIDE
@@ -108,8 +122,8 @@ namespace Orthanc
     
     virtual bool Execute(const std::string& jobId) ORTHANC_OVERRIDE
     {
-      failureReason_ = that_.Lookup(index_);
-      hasFailureReason_ = true;
+      that_.Lookup(failureReasons_, index_, count_);
+      hasFailureReasons_ = true;
       return true;
     }
 
@@ -118,11 +132,16 @@ namespace Orthanc
       return index_;
     }
 
-    StorageCommitmentFailureReason GetFailureReason() const
+    size_t GetCount() const
     {
-      if (hasFailureReason_)
+      return count_;
+    }
+
+    const std::vector<StorageCommitmentFailureReason>& GetFailureReasons() const
+    {
+      if (hasFailureReasons_)
       {
-        return failureReason_;
+        return failureReasons_;
       }
       else
       {
@@ -135,6 +154,7 @@ namespace Orthanc
       target = Json::objectValue;
       target[TYPE] = LOOKUP;
       target[INDEX] = static_cast<unsigned int>(index_);
+      target[COUNT] = static_cast<unsigned int>(count_);
     }
   };
 
@@ -199,7 +219,9 @@ namespace Orthanc
       }
       else if (type == LOOKUP)
       {
-        return new LookupCommand(that_, SerializationToolbox::ReadUnsignedInteger(source, INDEX));
+        // Jobs serialized by Orthanc <= 1.10.1 have one lookup command per instance
+        return new LookupCommand(that_, SerializationToolbox::ReadUnsignedInteger(source, INDEX),
+                                 source.isMember(COUNT) ? SerializationToolbox::ReadUnsignedInteger(source, COUNT) : 1);
       }
       else if (type == ANSWER)
       {
@@ -221,6 +243,8 @@ namespace Orthanc
     {
       throw OrthancException(ErrorCode_InternalError);
     }
+
+    size_t nextIndex = 0;
     
     for (size_t i = 0; i < n; i++)
     {
@@ -235,13 +259,21 @@ namespace Orthanc
 
       if (type == CommandType_Lookup)
       {
+        // The lookup commands must cover contiguous ranges of instances
         const LookupCommand& lookup = dynamic_cast<const LookupCommand&>(GetCommand(i));
-        if (lookup.GetIndex() != i - 1)
+        if (lookup.GetIndex() != nextIndex)
         {
           throw OrthancException(ErrorCode_InternalError);
         }
+
+        nextIndex += lookup.GetCount();
       }
     }
+
+    if (nextIndex != sopInstanceUids_.size())
+    {
+      throw OrthancException(ErrorCode_InternalError);
+    }
   }
     
 
@@ -255,66 +287,89 @@ namespace Orthanc
   }
 
 
-  StorageCommitmentFailureReason StorageCommitmentScpJob::Lookup(size_t index)
+  void StorageCommitmentScpJob::Lookup(std::vector<StorageCommitmentFailureReason>& target,
+                                     size_t index,
+                                     size_t count)
   {
 #ifndef NDEBUG
     CheckInvariants();
 #endif
 
-    if (index >= sopClassUids_.size())
+    if (index + count > sopClassUids_.size())
     {
       throw OrthancException(ErrorCode_InternalError);
     }
-    else if (lookupHandler_.get() != NULL)
+
+    target.clear();
+    target.reserve(count);
+    
+    if (lookupHandler_.get() != NULL)
     {
-      return lookupHandler_->Lookup(sopClassUids_[index], sopInstanceUids_[index]);
+      for (size_t i = index; i < index + count; i++)
+      {
+        target.push_back(lookupHandler_->Lookup(sopClassUids_[i], sopInstanceUids_[i]));
+      }
     }
     else
     {
       // This is the default implementation of Orthanc (if no storage
-      // commitment plugin is installed)
-      bool success = false;
-      StorageCommitmentFailureReason reason =
-        StorageCommitmentFailureReason_NoSuchObjectInstance /* 0x0112 == 274 */;
-      
+      // commitment plugin is installed). The existence of all the
+      // SOP instance UIDs of the range is checked at once.
+      std::multimap<std::string, std::string> orthancIds;
+
       try
       {
-        std::vector<std::string> orthancId;
-        context_.GetIndex().LookupIdentifierExact(orthancId, ResourceType_Instance, DICOM_TAG_SOP_INSTANCE_UID, sopInstanceUids_[index]);
-
-        if (orthancId.size() == 1)
+        context_.GetIndex().LookupIdentifiersExact(
+          orthancIds, ResourceType_Instance, DICOM_TAG_SOP_INSTANCE_UID,
+          std::set<std::string>(sopInstanceUids_.begin() + index, sopInstanceUids_.begin() + index + count));
+      }
+      catch (OrthancException&)
+      {
+        orthancIds.clear();
+      }
+      
+      for (size_t i = index; i < index + count; i++)
+      {
+        bool success = false;
+        StorageCommitmentFailureReason reason =
+          StorageCommitmentFailureReason_NoSuchObjectInstance /* 0x0112 == 274 */;
+      
+        if (orthancIds.count(sopInstanceUids_[i]) == 1)
         {
-          std::string a, b;
-
-          // Make sure that the DICOM file can be re-read by DCMTK
-          // from the file storage, and that the actual SOP
-          // class/instance UIDs do match
-          ServerContext::DicomCacheLocker locker(context_, orthancId[0]);
-          if (locker.GetDicom().GetTagValue(a, DICOM_TAG_SOP_CLASS_UID) &&
-              locker.GetDicom().GetTagValue(b, DICOM_TAG_SOP_INSTANCE_UID) &&
-              b == sopInstanceUids_[index])
+          try
           {
-            if (a == sopClassUids_[index])
+            std::string a, b;
+
+            // Make sure that the DICOM file can be re-read by DCMTK
+            // from the file storage, and that the actual SOP
+            // class/instance UIDs do match
+            ServerContext::DicomCacheLocker locker(context_, orthancIds.find(sopInstanceUids_[i])->second);
+            if (locker.GetDicom().GetTagValue(a, DICOM_TAG_SOP_CLASS_UID) &&
+                locker.GetDicom().GetTagValue(b, DICOM_TAG_SOP_INSTANCE_UID) &&
+                b == sopInstanceUids_[i])
             {
-              success = true;
-              reason = StorageCommitmentFailureReason_Success;
-            }
-            else
-            {
-              // Mismatch in the SOP class UID
-              reason = StorageCommitmentFailureReason_ClassInstanceConflict /* 0x0119 */;
+              if (a == sopClassUids_[i])
+              {
+                success = true;
+                reason = StorageCommitmentFailureReason_Success;
+              }
+              else
+              {
+                // Mismatch in the SOP class UID
+                reason = StorageCommitmentFailureReason_ClassInstanceConflict /* 0x0119 */;
+              }
             }
           }
+          catch (OrthancException&)
+          {
+          }
         }
-      }
-      catch (OrthancException&)
-      {
-      }
 
-      LOG(INFO) << "  Storage commitment SCP job: " << (success ? "Success" : "Failure")
-                << " while looking for " << sopClassUids_[index] << " / " << sopInstanceUids_[index];
+        LOG(INFO) << "  Storage commitment SCP job: " << (success ? "Success" : "Failure")
+                  << " while looking for " << sopClassUids_[i] << " / " << sopInstanceUids_[i];
 
-      return reason;
+        target.push_back(reason);
+      }
     }
   }
   
@@ -330,7 +385,8 @@ namespace Orthanc
     for (size_t i = 1; i < GetCommandsCount() - 1; i++)
     {
       const LookupCommand& lookup = dynamic_cast<const LookupCommand&>(GetCommand(i));
-      failureReasons.push_back(lookup.GetFailureReason());
+      const std::vector<StorageCommitmentFailureReason>& reasons = lookup.GetFailureReasons();
+      failureReasons.insert(failureReasons.end(), reasons.begin(), reasons.end());
     }
 
     if (failureReasons.size() != sopClassUids_.size())
@@ -389,8 +445,8 @@ namespace Orthanc
     }
     else
     {
+      // The lookup commands are created by "MarkAsReady()"
       assert(sopClassUids_.size() == sopInstanceUids_.size());
-      AddCommand(new LookupCommand(*this, sopClassUids_.size()));
       sopClassUids_.push_back(sopClassUid);
       sopInstanceUids_.push_back(sopInstanceUid);
     }
@@ -399,6 +455,16 @@ namespace Orthanc
 
   void StorageCommitmentScpJob::MarkAsReady()
   {
+    if (ready_)
+    {
+      throw OrthancException(ErrorCode_BadSequenceOfCalls);
+    }
+
+    for (size_t i = 0; i < sopInstanceUids_.size(); i += LOOKUP_BATCH_SIZE)
+    {
+      AddCommand(new LookupCommand(*this, i, std::min(LOOKUP_BATCH_SIZE, sopInstanceUids_.size() - i)));
+    }
+    
     AddCommand(new AnswerCommand(*this));
   }
 
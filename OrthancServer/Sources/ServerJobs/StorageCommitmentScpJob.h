@@ -64,7 +64,9 @@ namespace Orthanc
     
     void Setup(const std::string& jobId);
     
-    StorageCommitmentFailureReason Lookup(size_t index);
+    void Lookup(std::vector<StorageCommitmentFailureReason>& target,
+                size_t index,
+                size_t count);
     
     void Answer();
     
@@ -294,5 +294,17 @@ namespace Orthanc
         }
       }
     }
+
+
+    void InjectEmptyPixelData(Json::Value& dicomAsJson)
+    {
+      // This is for backward compatibility with Orthanc <= 1.9.0
+      Json::Value pixelData = Json::objectValue;
+      pixelData["Name"] = "PixelData";
+      pixelData["Type"] = "Null";
+      pixelData["Value"] = Json::nullValue;
+
+      dicomAsJson["7fe0,0010"] = pixelData;
+    }
   }
 }
@@ -56,5 +56,9 @@ namespace Orthanc
     void ReconstructResource(ServerContext& context,
                              const std::string& resource,
                              bool reconstructFiles);
+
+    // Add the "PixelData" tag to a DICOM-as-JSON that was computed
+    // from a DICOM file truncated at the pixel data
+    void InjectEmptyPixelData(Json::Value& dicomAsJson);
   }
 }
@@ -1029,6 +1029,9 @@ static bool StartHttpServer(ServerContext& context,
       httpServer.SetRemoteAccessAllowed(lock.GetConfiguration().GetBooleanParameter("RemoteAccessAllowed", false));
       httpServer.SetKeepAliveEnabled(lock.GetConfiguration().GetBooleanParameter("KeepAlive", defaultKeepAlive));
       httpServer.SetHttpCompressionEnabled(lock.GetConfiguration().GetBooleanParameter("HttpCompressionEnabled", true));
+      httpServer.SetHttpCompressionMinimumSize(lock.GetConfiguration().GetUnsignedIntegerParameter("HttpCompressionMinimumSize", 1024));
+      httpServer.SetHttpCompressionLevel(lock.GetConfiguration().GetUnsignedIntegerParameter("HttpCompressionLevel", 6));
+      httpServer.SetHttpCompressionStreamingThreshold(lock.GetConfiguration().GetUnsignedIntegerParameter("HttpCompressionStreamingThreshold", 1024 * 1024));
       httpServer.SetTcpNoDelay(lock.GetConfiguration().GetBooleanParameter("TcpNoDelay", true));
       httpServer.SetRequestTimeout(lock.GetConfiguration().GetUnsignedIntegerParameter("HttpRequestTimeout", 30));
 
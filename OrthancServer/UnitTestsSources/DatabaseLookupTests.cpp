@@ -24,9 +24,12 @@
 #include <gtest/gtest.h>
 
 #include "../../OrthancFramework/Sources/OrthancException.h"
+#include "../../OrthancFramework/Sources/Toolbox.h"
 
 #include "../Sources/Search/DatabaseLookup.h"
 
+#include <boost/regex.hpp>
+
 using namespace Orthanc;
 
 
@@ -134,6 +137,113 @@ TEST(DatabaseLookup, SingleConstraint)
 
 
 
+static void GenerateStrings(std::vector<std::string>& target,
+                            const std::string& alphabet,
+                            size_t maxLength)
+{
+  target.clear();
+  target.push_back("");
+
+  size_t start = 0;
+  for (size_t length = 1; length <= maxLength; length++)
+  {
+    const size_t end = target.size();
+    for (size_t i = start; i < end; i++)
+    {
+      for (size_t j = 0; j < alphabet.size(); j++)
+      {
+        target.push_back(target[i] + alphabet[j]);
+      }
+    }
+
+    start = end;
+  }
+}
+
+
+static bool IsRegexWildcardMatch(const std::string& pattern,
+                                 const std::string& value,
+                                 bool caseSensitive)
+{
+  // This is the implementation of wildcard matching in Orthanc <= 1.10.1
+  if (caseSensitive)
+  {
+    boost::regex regex(Toolbox::WildcardToRegularExpression(pattern));
+    return boost::regex_match(value, regex);
+  }
+  else
+  {
+    boost::regex regex(Toolbox::WildcardToRegularExpression(Toolbox::ToUpperCaseWithAccents(pattern)));
+    return boost::regex_match(Toolbox::ToUpperCaseWithAccents(value), regex);
+  }
+}
+
+
+TEST(DatabaseLookup, WildcardEquivalence)
+{
+  std::vector<std::string> patterns, values;
+  GenerateStrings(patterns, "ab?*", 5);
+  GenerateStrings(values, "ab", 6);
+
+  for (size_t i = 0; i < patterns.size(); i++)
+  {
+    if (patterns[i].find('*') != std::string::npos ||
+        patterns[i].find('?') != std::string::npos)
+    {
+      DicomTagConstraint tag(DICOM_TAG_PATIENT_NAME, ConstraintType_Wildcard, patterns[i], true, true);
+
+      for (size_t j = 0; j < values.size(); j++)
+      {
+        ASSERT_EQ(IsRegexWildcardMatch(patterns[i], values[j], true), tag.IsMatch(values[j]))
+          << patterns[i] << " " << values[j];
+      }
+    }
+  }
+
+  const char* const SPECIAL_PATTERNS[] = {
+    "*.*", "a+*", "(*)", "[a]*", "*^$", "*\\*", "a|b*", "{?}", "*/*", "?\n?",
+    "*\xc3\xa9*", "\xc3\xa9?", "*br*", "*ERIC*", "*\xc3\xa9ric", "**a**b**", "*"
+  };
+
+  const char* const SPECIAL_VALUES[] = {
+    "", "a", "a.b", "a+", "a+b", "(x)", "[a]b", "x^$", "\\", "a|b", "{x}", "a/b",
+    "\n\n\n", "a\nb", "\xc3\xa9", "\xc3\xa9t\xc3\xa9", "bRbr", "Eric", "\xc3\xa9ric",
+    "\xc3\x89RIC", "aab", "ab"
+  };
+
+  for (size_t i = 0; i < sizeof(SPECIAL_PATTERNS) / sizeof(const char*); i++)
+  {
+    for (int caseSensitive = 0; caseSensitive < 2; caseSensitive++)
+    {
+      DicomTagConstraint tag(DICOM_TAG_PATIENT_NAME, ConstraintType_Wildcard,
+                             SPECIAL_PATTERNS[i], (caseSensitive != 0), true);
+
+      for (size_t j = 0; j < sizeof(SPECIAL_VALUES) / sizeof(const char*); j++)
+      {
+        ASSERT_EQ(IsRegexWildcardMatch(SPECIAL_PATTERNS[i], SPECIAL_VALUES[j], (caseSensitive != 0)),
+                  tag.IsMatch(SPECIAL_VALUES[j]))
+          << SPECIAL_PATTERNS[i] << " " << SPECIAL_VALUES[j] << " " << caseSensitive;
+      }
+    }
+  }
+
+  {
+    // The compiled matcher is shared by the copies, and recompiled
+    // if the case sensitivity changes
+    DicomTagConstraint tag(DICOM_TAG_PATIENT_NAME, ConstraintType_Wildcard, "h*o", true, true);
+    ASSERT_FALSE(tag.IsMatch("HELLO"));
+
+    DicomTagConstraint copy(tag);
+    ASSERT_TRUE(copy.IsMatch("hello"));
+    ASSERT_FALSE(copy.IsMatch("HELLO"));
+
+    copy.SetCaseSensitive(false);
+    ASSERT_TRUE(copy.IsMatch("HELLO"));
+    ASSERT_FALSE(tag.IsMatch("HELLO"));
+  }
+}
+
+
 TEST(DatabaseLookup, FromDicom)
 {
   {
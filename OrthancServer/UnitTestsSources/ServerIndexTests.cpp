@@ -30,7 +30,10 @@
 #include "../../OrthancFramework/Sources/Logging.h"
 
 #include "../Sources/Database/SQLiteDatabaseWrapper.h"
+#include "../Sources/Database/VoidDatabaseListener.h"
 #include "../Sources/OrthancConfiguration.h"
+#include "../Sources/ReadAheadTracker.h"
+#include "../Sources/Search/ColumnarIndex.h"
 #include "../Sources/Search/DatabaseLookup.h"
 #include "../Sources/ServerContext.h"
 #include "../Sources/ServerToolbox.h"
@@ -190,6 +193,23 @@ namespace
       
       transaction_->ApplyLookupResources(result, NULL, lookup, level, 0 /* no limit */);
     }
+
+    void DoLookupMainTag(std::list<std::string>& result,
+                         ResourceType level,
+                         const DicomTag& tag,
+                         ConstraintType type,
+                         const std::string& value,
+                         bool caseSensitive)
+    {
+      assert(!ServerToolbox::IsIdentifier(tag, level));
+      
+      DicomTagConstraint c(tag, type, value, caseSensitive, true);
+      
+      std::vector<DatabaseConstraint> lookup;
+      lookup.push_back(c.ConvertToDatabaseConstraint(level, DicomTagType_Main));
+      
+      transaction_->ApplyLookupResources(result, NULL, lookup, level, 0 /* no limit */);
+    }
   };
 }
 
@@ -690,6 +710,246 @@ TEST_F(DatabaseWrapperTest, LookupIdentifier)
 }
 
 
+TEST_F(DatabaseWrapperTest, LookupIdentifiersExact)
+{
+  int64_t a[] = {
+    transaction_->CreateResource("a", ResourceType_Study),   // 0
+    transaction_->CreateResource("b", ResourceType_Study),   // 1
+    transaction_->CreateResource("c", ResourceType_Study),   // 2
+    transaction_->CreateResource("d", ResourceType_Series)   // 3
+  };
+
+  transaction_->SetIdentifierTag(a[0], DICOM_TAG_STUDY_INSTANCE_UID, "0");
+  transaction_->SetIdentifierTag(a[1], DICOM_TAG_STUDY_INSTANCE_UID, "1");
+  transaction_->SetIdentifierTag(a[2], DICOM_TAG_STUDY_INSTANCE_UID, "0");
+  transaction_->SetIdentifierTag(a[3], DICOM_TAG_SERIES_INSTANCE_UID, "2");
+
+  std::multimap<std::string, std::string> m;
+  std::set<std::string> values;
+
+  transaction_->LookupIdentifiersExact(m, ResourceType_Study, DICOM_TAG_STUDY_INSTANCE_UID, values);
+  ASSERT_TRUE(m.empty());
+
+  values.insert("0");
+  values.insert("1");
+  values.insert("2");
+  values.insert("3");
+  transaction_->LookupIdentifiersExact(m, ResourceType_Study, DICOM_TAG_STUDY_INSTANCE_UID, values);
+  ASSERT_EQ(3u, m.size());
+  ASSERT_EQ(2u, m.count("0"));
+  ASSERT_EQ(1u, m.count("1"));
+  ASSERT_EQ("b", m.find("1")->second);
+
+  transaction_->LookupIdentifiersExact(m, ResourceType_Series, DICOM_TAG_SERIES_INSTANCE_UID, values);
+  ASSERT_EQ(1u, m.size());
+  ASSERT_EQ("2", m.begin()->first);
+  ASSERT_EQ("d", m.begin()->second);
+
+  // More values than one SQL statement can hold
+  for (unsigned int i = 0; i < 1500; i++)
+  {
+    values.insert("missing-" + boost::lexical_cast<std::string>(i));
+  }
+
+  values.insert("zzz");
+  transaction_->SetIdentifierTag(a[1], DICOM_TAG_STUDY_INSTANCE_UID, "zzz");
+
+  transaction_->LookupIdentifiersExact(m, ResourceType_Study, DICOM_TAG_STUDY_INSTANCE_UID, values);
+  ASSERT_EQ(4u, m.size());
+  ASSERT_EQ(1u, m.count("zzz"));
+  ASSERT_EQ("b", m.find("zzz")->second);
+}
+
+
+TEST_F(DatabaseWrapperTest, GetAllPublicIdsAfter)
+{
+  int64_t a = transaction_->CreateResource("c", ResourceType_Instance);
+  transaction_->CreateResource("a", ResourceType_Instance);
+  transaction_->CreateResource("e", ResourceType_Instance);
+  transaction_->CreateResource("b", ResourceType_Series);
+  transaction_->CreateResource("d", ResourceType_Instance);
+
+  std::list<std::string> l;
+  transaction_->GetAllPublicIdsAfter(l, ResourceType_Instance, "", 0);
+  ASSERT_TRUE(l.empty());
+
+  transaction_->GetAllPublicIdsAfter(l, ResourceType_Instance, "", 2);
+  ASSERT_EQ(2u, l.size());
+  ASSERT_EQ("a", l.front());
+  ASSERT_EQ("c", l.back());
+
+  // Removing an item of the previous page doesn't shift the next page
+  transaction_->DeleteResource(a);
+  transaction_->GetAllPublicIdsAfter(l, ResourceType_Instance, "c", 2);
+  ASSERT_EQ(2u, l.size());
+  ASSERT_EQ("d", l.front());
+  ASSERT_EQ("e", l.back());
+
+  transaction_->GetAllPublicIdsAfter(l, ResourceType_Instance, "e", 2);
+  ASSERT_TRUE(l.empty());
+}
+
+
+namespace
+{
+  // Forces the use of the snapshots, as with the database plugins
+  class NoKeysetDatabaseWrapper : public SQLiteDatabaseWrapper
+  {
+  public:
+    virtual bool HasKeysetPagination() const ORTHANC_OVERRIDE
+    {
+      return false;
+    }
+  };
+}
+
+
+TEST(ServerIndex, UuidsPager)
+{
+  FilesystemStorage storage("UnitTestsStorage");
+
+  for (unsigned int keyset = 0; keyset < 2; keyset++)
+  {
+    std::unique_ptr<SQLiteDatabaseWrapper> db;   // The SQLite DB is in memory
+    if (keyset)
+    {
+      db.reset(new SQLiteDatabaseWrapper);
+    }
+    else
+    {
+      db.reset(new NoKeysetDatabaseWrapper);
+    }
+
+    db->Open();
+    ASSERT_EQ(keyset == 1, db->HasKeysetPagination());
+
+    {
+      VoidDatabaseListener listener;
+      std::unique_ptr<SQLiteDatabaseWrapper::UnitTestsTransaction> transaction(
+        dynamic_cast<SQLiteDatabaseWrapper::UnitTestsTransaction*>(
+          db->StartTransaction(TransactionType_ReadWrite, listener)));
+      transaction->CreateResource("c", ResourceType_Instance);
+      transaction->CreateResource("a", ResourceType_Instance);
+      transaction->CreateResource("e", ResourceType_Instance);
+      transaction->CreateResource("b", ResourceType_Series);
+      transaction->CreateResource("d", ResourceType_Instance);
+      transaction->Commit(0);
+    }
+
+    ServerContext context(*db, storage, true /* running unit tests */, 10);
+    context.SetupJobsEngine(true, false);
+
+    ASSERT_THROW(StatelessDatabaseOperations::UuidsPager(context.GetIndex(), ResourceType_Instance, 0),
+                 OrthancException);
+
+    StatelessDatabaseOperations::UuidsPager pager(context.GetIndex(), ResourceType_Instance, 3);
+
+    for (unsigned int pass = 0; pass < 2; pass++)
+    {
+      std::list<std::string> page;
+      ASSERT_TRUE(pager.GetNextPage(page));
+      ASSERT_EQ(3u, page.size());
+      ASSERT_EQ("a", page.front());
+      ASSERT_EQ("d", page.back());
+
+      ASSERT_TRUE(pager.GetNextPage(page));
+      ASSERT_EQ(1u, page.size());
+      ASSERT_EQ("e", page.front());
+
+      // The next pass starts from the beginning of the index
+      ASSERT_FALSE(pager.GetNextPage(page));
+      ASSERT_TRUE(page.empty());
+    }
+
+    context.Stop();
+    db->Close();
+  }
+}
+
+
+TEST_F(DatabaseWrapperTest, LookupWildcard)
+{
+  int64_t a[] = {
+    transaction_->CreateResource("a", ResourceType_Patient),   // 0
+    transaction_->CreateResource("b", ResourceType_Patient),   // 1
+    transaction_->CreateResource("c", ResourceType_Patient),   // 2
+    transaction_->CreateResource("d", ResourceType_Patient)    // 3
+  };
+
+  transaction_->SetIdentifierTag(a[0], DICOM_TAG_PATIENT_ID, "SMITH");
+  transaction_->SetIdentifierTag(a[1], DICOM_TAG_PATIENT_ID, "SMITHSON");
+  transaction_->SetIdentifierTag(a[2], DICOM_TAG_PATIENT_ID, "SMIT");
+  transaction_->SetIdentifierTag(a[3], DICOM_TAG_PATIENT_ID, "SMJ");
+
+  transaction_->SetMainDicomTag(a[0], DICOM_TAG_PATIENT_NAME, "Smith^John");
+  transaction_->SetMainDicomTag(a[1], DICOM_TAG_PATIENT_NAME, "SMITHSON^Jane");
+  transaction_->SetMainDicomTag(a[2], DICOM_TAG_PATIENT_NAME, "Sm\xc3\xa9th^Jo");  // "Sméth" in UTF-8
+  transaction_->SetMainDicomTag(a[3], DICOM_TAG_PATIENT_NAME, "smith");
+
+  std::list<std::string> s;
+
+  // The prefix wildcards are turned into range scans
+  DoLookupIdentifier(s, ResourceType_Patient, DICOM_TAG_PATIENT_ID, ConstraintType_Wildcard, "SMITH*");
+  ASSERT_EQ(2u, s.size());
+  ASSERT_TRUE(std::find(s.begin(), s.end(), "a") != s.end());
+  ASSERT_TRUE(std::find(s.begin(), s.end(), "b") != s.end());
+
+  DoLookupIdentifier(s, ResourceType_Patient, DICOM_TAG_PATIENT_ID, ConstraintType_Wildcard, "SMIT*");
+  ASSERT_EQ(3u, s.size());
+
+  DoLookupIdentifier(s, ResourceType_Patient, DICOM_TAG_PATIENT_ID, ConstraintType_Wildcard, "SM*");
+  ASSERT_EQ(4u, s.size());
+
+  // Wildcards after the prefix are still matched by "LIKE"
+  DoLookupIdentifier(s, ResourceType_Patient, DICOM_TAG_PATIENT_ID, ConstraintType_Wildcard, "SMIT?");
+  ASSERT_EQ(1u, s.size());
+  ASSERT_TRUE(std::find(s.begin(), s.end(), "a") != s.end());
+
+  DoLookupIdentifier(s, ResourceType_Patient, DICOM_TAG_PATIENT_ID, ConstraintType_Wildcard, "SMITH*N");
+  ASSERT_EQ(1u, s.size());
+  ASSERT_TRUE(std::find(s.begin(), s.end(), "b") != s.end());
+
+  DoLookupIdentifier(s, ResourceType_Patient, DICOM_TAG_PATIENT_ID, ConstraintType_Wildcard, "*N");
+  ASSERT_EQ(1u, s.size());
+
+  // Case-insensitive matching uses the normalized keys
+  DoLookupMainTag(s, ResourceType_Patient, DICOM_TAG_PATIENT_NAME, ConstraintType_Wildcard, "smith*", false);
+  ASSERT_EQ(3u, s.size());
+  ASSERT_TRUE(std::find(s.begin(), s.end(), "c") == s.end());
+
+  DoLookupMainTag(s, ResourceType_Patient, DICOM_TAG_PATIENT_NAME, ConstraintType_Wildcard, "SMITH^*", false);
+  ASSERT_EQ(1u, s.size());
+  ASSERT_TRUE(std::find(s.begin(), s.end(), "a") != s.end());
+
+  DoLookupMainTag(s, ResourceType_Patient, DICOM_TAG_PATIENT_NAME, ConstraintType_Wildcard, "sm\xc3\xa9*", false);
+  ASSERT_EQ(1u, s.size());
+  ASSERT_TRUE(std::find(s.begin(), s.end(), "c") != s.end());
+
+  DoLookupMainTag(s, ResourceType_Patient, DICOM_TAG_PATIENT_NAME, ConstraintType_Wildcard, "smith?", false);
+  ASSERT_EQ(0u, s.size());
+
+  // Case-sensitive matching
+  DoLookupMainTag(s, ResourceType_Patient, DICOM_TAG_PATIENT_NAME, ConstraintType_Wildcard, "Smith*", true);
+  ASSERT_EQ(1u, s.size());
+  ASSERT_TRUE(std::find(s.begin(), s.end(), "a") != s.end());
+
+  DoLookupMainTag(s, ResourceType_Patient, DICOM_TAG_PATIENT_NAME, ConstraintType_Wildcard, "SMITH*", true);
+  ASSERT_EQ(1u, s.size());
+  ASSERT_TRUE(std::find(s.begin(), s.end(), "b") != s.end());
+
+  // The normalized keys are maintained by triggers
+  CheckTableRecordCount(4, "MainDicomTagsNormalized");
+  transaction_->ClearMainDicomTags(a[3]);
+  CheckTableRecordCount(3, "MainDicomTagsNormalized");
+  transaction_->DeleteResource(a[1]);
+  CheckTableRecordCount(2, "MainDicomTagsNormalized");
+
+  DoLookupMainTag(s, ResourceType_Patient, DICOM_TAG_PATIENT_NAME, ConstraintType_Wildcard, "smith*", false);
+  ASSERT_EQ(1u, s.size());
+  ASSERT_TRUE(std::find(s.begin(), s.end(), "a") != s.end());
+}
+
+
 TEST(ServerIndex, AttachmentRecycling)
 {
   const std::string path = "UnitTestsStorage";
@@ -740,7 +1000,7 @@ TEST(ServerIndex, AttachmentRecycling)
       ASSERT_EQ(StoreStatus_Success, index.Store(
                   instanceMetadata, summary, attachments, toStore->GetMetadata(),
                   toStore->GetOrigin(), false /* don't overwrite */,
-                  hasTransferSyntax, transferSyntax, true /* pixel data offset */, 42, false));
+                  hasTransferSyntax, transferSyntax, true /* pixel data offset */, 42, false, ""));
     }
     
     ASSERT_EQ(7u, instanceMetadata.size());
@@ -792,6 +1052,201 @@ TEST(ServerIndex, AttachmentRecycling)
 }
 
 
+namespace
+{
+  class ExpandedResourcesCollector : public StatelessDatabaseOperations::IExpandedResourceVisitor
+  {
+  private:
+    std::vector<std::string>  ids_;
+    std::vector<size_t>       childrenCount_;
+
+  public:
+    virtual void Visit(ExpandedResource& resource) ORTHANC_OVERRIDE
+    {
+      ids_.push_back(resource.id_);
+      childrenCount_.push_back(resource.childrenIds_.size());
+    }
+
+    const std::vector<std::string>& GetIds() const
+    {
+      return ids_;
+    }
+
+    size_t GetChildrenCount(size_t i) const
+    {
+      return childrenCount_[i];
+    }
+  };
+}
+
+
+TEST(ServerIndex, BulkContent)
+{
+  FilesystemStorage storage("UnitTestsStorage");
+  SQLiteDatabaseWrapper db;   // The SQLite DB is in memory
+  db.Open();
+  ServerContext context(db, storage, true /* running unit tests */, 10);
+  context.SetupJobsEngine(true, false);
+  ServerIndex& index = context.GetIndex();
+
+  std::vector<std::string> instances;
+  std::string patient, study, series;
+
+  for (int i = 0; i < 3; i++)
+  {
+    DicomMap instance;
+    instance.SetValue(DICOM_TAG_PATIENT_ID, "patient", false);
+    instance.SetValue(DICOM_TAG_STUDY_INSTANCE_UID, "study", false);
+    instance.SetValue(DICOM_TAG_SERIES_INSTANCE_UID, "series", false);
+    instance.SetValue(DICOM_TAG_SOP_INSTANCE_UID, "instance-" + boost::lexical_cast<std::string>(i), false);
+    instance.SetValue(DICOM_TAG_SOP_CLASS_UID, "1.2.840.10008.5.1.4.1.1.1", false);  // CR image
+
+    ParsedDicomFile dicom(instance, GetDefaultDicomEncoding(), false /* be strict */);
+    std::unique_ptr<DicomInstanceToStore> toStore(DicomInstanceToStore::CreateFromParsedDicomFile(dicom));
+    toStore->SetOrigin(DicomInstanceOrigin::FromPlugins());
+
+    DicomMap summary;
+    OrthancConfiguration::DefaultExtractDicomSummary(summary, toStore->GetParsedDicomFile());
+
+    ServerIndex::Attachments attachments;
+    attachments.push_back(FileInfo(Toolbox::GenerateUuid(), FileContentType_Dicom, 1, "md5"));
+
+    std::map<MetadataType, std::string> instanceMetadata;
+    ASSERT_EQ(StoreStatus_Success, index.Store(
+                instanceMetadata, summary, attachments, toStore->GetMetadata(),
+                toStore->GetOrigin(), false /* don't overwrite */,
+                false, DicomTransferSyntax_LittleEndianExplicit, false /* no pixel data offset */, 0, false, ""));
+
+    DicomInstanceHasher hasher(instance);
+    patient = hasher.HashPatient();
+    study = hasher.HashStudy();
+    series = hasher.HashSeries();
+    instances.push_back(hasher.HashInstance());
+  }
+
+  std::set<std::string> source, target;
+  source.insert(patient);
+  source.insert("nope");
+  index.LookupResourcesAtLevel(target, source, ResourceType_Instance);
+  ASSERT_EQ(3u, target.size());
+  ASSERT_TRUE(target.find(instances[0]) != target.end());
+  ASSERT_TRUE(target.find(instances[2]) != target.end());
+
+  source.clear();
+  source.insert(instances[0]);
+  source.insert(instances[1]);
+  index.LookupResourcesAtLevel(target, source, ResourceType_Study);
+  ASSERT_EQ(1u, target.size());
+  ASSERT_EQ(study, *target.begin());
+
+  index.LookupResourcesAtLevel(target, source, ResourceType_Instance);
+  ASSERT_EQ(2u, target.size());
+
+  std::list<std::string> resources;
+  resources.push_back(series);
+  resources.push_back("nope");
+  resources.push_back(instances[1]);
+
+  {
+    ExpandedResourcesCollector collector;
+    index.ExpandResources(collector, resources, std::set<DicomTag>(), ExpandResourceDbFlags_Default);
+    ASSERT_EQ(2u, collector.GetIds().size());
+    ASSERT_EQ(series, collector.GetIds()[0]);
+    ASSERT_EQ(instances[1], collector.GetIds()[1]);
+    ASSERT_EQ(3u, collector.GetChildrenCount(0));
+  }
+
+  {
+    ExpandedResourcesCollector collector;
+    index.ExpandResources(collector, resources, std::set<DicomTag>(), ExpandResourceDbFlags_IncludeMetadata);
+    ASSERT_EQ(2u, collector.GetIds().size());
+    ASSERT_EQ(0u, collector.GetChildrenCount(0));
+  }
+
+  context.Stop();
+  db.Close();
+}
+
+
+TEST(ServerIndex, CompareAndSwapStore)
+{
+  MemoryStorageArea storage;
+  SQLiteDatabaseWrapper db;   // The SQLite DB is in memory
+  db.Open();
+  ServerContext context(db, storage, true /* running unit tests */, 10);
+  context.SetupJobsEngine(true, false);
+  ServerIndex& index = context.GetIndex();
+
+  DicomMap instance;
+  instance.SetValue(DICOM_TAG_PATIENT_ID, "patient", false);
+  instance.SetValue(DICOM_TAG_STUDY_INSTANCE_UID, "study", false);
+  instance.SetValue(DICOM_TAG_SERIES_INSTANCE_UID, "series", false);
+  instance.SetValue(DICOM_TAG_SOP_INSTANCE_UID, "sop", false);
+  instance.SetValue(DICOM_TAG_SOP_CLASS_UID, "1.2.840.10008.5.1.4.1.1.1", false);  // CR image
+
+  ParsedDicomFile dicom(instance, GetDefaultDicomEncoding(), false /* be strict */);
+  std::unique_ptr<DicomInstanceToStore> toStore(DicomInstanceToStore::CreateFromParsedDicomFile(dicom));
+  toStore->SetOrigin(DicomInstanceOrigin::FromPlugins());
+
+  DicomMap summary;
+  OrthancConfiguration::DefaultExtractDicomSummary(summary, toStore->GetParsedDicomFile());
+
+  const std::string id = DicomInstanceHasher(instance).HashInstance();
+  const std::string original = Toolbox::GenerateUuid();
+  const std::string transcoded = Toolbox::GenerateUuid();
+
+  std::map<MetadataType, std::string> instanceMetadata;
+  FileInfo info;
+  int64_t revision;
+  std::string value;
+
+  {
+    ServerIndex::MetadataMap metadata;
+    metadata[std::make_pair(ResourceType_Instance, MetadataType_Instance_PendingTranscoding)] = "{}";
+
+    ServerIndex::Attachments attachments;
+    attachments.push_back(FileInfo(original, FileContentType_Dicom, 1, "md5"));
+    ASSERT_EQ(StoreStatus_Success, index.Store(
+                instanceMetadata, summary, attachments, metadata, toStore->GetOrigin(), false /* don't overwrite */,
+                false, DicomTransferSyntax_LittleEndianExplicit, false /* no pixel data offset */, 0, false, ""));
+    ASSERT_TRUE(index.LookupMetadata(value, revision, id, ResourceType_Instance, MetadataType_Instance_PendingTranscoding));
+  }
+
+  ServerIndex::Attachments attachments;
+  attachments.push_back(FileInfo(transcoded, FileContentType_Dicom, 1, "md5"));
+
+  // The DICOM file of the instance has changed in the meantime
+  ASSERT_EQ(StoreStatus_AlreadyStored, index.Store(
+              instanceMetadata, summary, attachments, ServerIndex::MetadataMap(), toStore->GetOrigin(),
+              true /* overwrite */, false, DicomTransferSyntax_LittleEndianExplicit, false, 0, true, "nope"));
+  ASSERT_TRUE(index.LookupAttachment(info, revision, id, FileContentType_Dicom));
+  ASSERT_EQ(original, info.GetUuid());
+  ASSERT_TRUE(index.LookupMetadata(value, revision, id, ResourceType_Instance, MetadataType_Instance_PendingTranscoding));
+
+  // The DICOM file is unchanged: The instance is replaced
+  ASSERT_EQ(StoreStatus_Success, index.Store(
+              instanceMetadata, summary, attachments, ServerIndex::MetadataMap(), toStore->GetOrigin(),
+              true /* overwrite */, false, DicomTransferSyntax_LittleEndianExplicit, false, 0, true, original));
+  ASSERT_TRUE(index.LookupAttachment(info, revision, id, FileContentType_Dicom));
+  ASSERT_EQ(transcoded, info.GetUuid());
+  ASSERT_FALSE(index.LookupMetadata(value, revision, id, ResourceType_Instance, MetadataType_Instance_PendingTranscoding));
+
+  // The instance was removed in the meantime: It must not be resurrected
+  Json::Value remaining;
+  ASSERT_TRUE(index.DeleteResource(remaining, id, ResourceType_Instance));
+  ASSERT_EQ(StoreStatus_AlreadyStored, index.Store(
+              instanceMetadata, summary, attachments, ServerIndex::MetadataMap(), toStore->GetOrigin(),
+              true /* overwrite */, false, DicomTransferSyntax_LittleEndianExplicit, false, 0, true, transcoded));
+
+  std::list<std::string> instances;
+  index.GetAllUuids(instances, ResourceType_Instance);
+  ASSERT_TRUE(instances.empty());
+
+  context.Stop();
+  db.Close();
+}
+
+
 TEST(ServerIndex, NormalizeIdentifier)
 {
   ASSERT_EQ("H^L.LO", ServerToolbox::NormalizeIdentifier("   Hé^l.LO  %_  "));
@@ -1038,3 +1493,473 @@ TEST(ServerIndex, DicomUntilPixelData)
     }
   }
 }
+
+
+TEST(ServerIndex, SummaryFromBuffer)
+{
+  Image image(PixelFormat_Grayscale8, 1, 1, false);
+  reinterpret_cast<uint8_t*>(image.GetBuffer()) [0] = 128;
+
+  ParsedDicomFile dicom(true);
+  dicom.ReplacePlainString(DICOM_TAG_PATIENT_NAME, "Hello^World");
+  dicom.EmbedImage(image);
+
+  std::string buffer;
+  dicom.SaveToMemoryBuffer(buffer);
+
+  std::unique_ptr<DicomInstanceToStore> fromParsed(DicomInstanceToStore::CreateFromParsedDicomFile(dicom));
+  std::unique_ptr<DicomInstanceToStore> fromBuffer(DicomInstanceToStore::CreateFromBuffer(buffer));
+
+  uint64_t offset1, offset2;
+  ASSERT_TRUE(fromParsed->LookupPixelDataOffset(offset1));
+  ASSERT_TRUE(fromBuffer->LookupPixelDataOffset(offset2));
+  ASSERT_EQ(offset1, offset2);
+  ASSERT_LT(offset2, buffer.size());
+  ASSERT_TRUE(fromBuffer->HasPixelData());
+
+  // The summary is computed from the dataset truncated at the pixel data
+  DicomMap summary1, summary2;
+  fromParsed->GetSummary(summary1);
+  fromBuffer->GetSummary(summary2);
+  ASSERT_EQ(summary1.GetSize(), summary2.GetSize());
+
+  std::set<DicomTag> tags;
+  summary1.GetTags(tags);
+  for (std::set<DicomTag>::const_iterator it = tags.begin(); it != tags.end(); ++it)
+  {
+    ASSERT_TRUE(summary1.GetValue(*it).IsNull() == summary2.GetValue(*it).IsNull());
+    ASSERT_TRUE(summary1.GetValue(*it).IsNull() ||
+                summary1.GetValue(*it).GetContent() == summary2.GetValue(*it).GetContent());
+  }
+
+  Json::Value json1, json2;
+  fromParsed->GetDicomAsJson(json1);
+  fromBuffer->GetDicomAsJson(json2);
+  ASSERT_EQ(json1.size(), json2.size());
+  ASSERT_EQ("Hello^World", json2["0010,0010"]["Value"].asString());
+  ASSERT_TRUE(json2.isMember("7fe0,0010"));
+
+  // The full parsing is still available if needed
+  ASSERT_EQ(1u, fromBuffer->GetFramesCount());
+}
+
+
+TEST(ServerIndex, IncrementalCompaction)
+{
+  {
+    // No compaction if incremental vacuum is not requested
+    SQLiteDatabaseWrapper db;
+    db.Open();
+    ASSERT_FALSE(db.HasIncrementalCompaction());
+    db.Close();
+  }
+
+  SQLiteDatabaseWrapper db;   // The SQLite DB is in memory
+  db.SetIncrementalVacuum(true);
+  db.Open();
+
+  ASSERT_TRUE(db.HasIncrementalCompaction());
+  ASSERT_THROW(db.SetIncrementalVacuum(false), OrthancException);
+
+  VoidDatabaseListener listener;
+  const std::string padding(1000, 'x');
+  std::vector<int64_t> patients;
+
+  {
+    std::unique_ptr<SQLiteDatabaseWrapper::UnitTestsTransaction> transaction(
+      dynamic_cast<SQLiteDatabaseWrapper::UnitTestsTransaction*>(
+        db.StartTransaction(TransactionType_ReadWrite, listener)));
+
+    for (int i = 0; i < 500; i++)
+    {
+      int64_t patient = transaction->CreateResource("Patient " + boost::lexical_cast<std::string>(i),
+                                                    ResourceType_Patient);
+      transaction->SetMainDicomTag(patient, DICOM_TAG_PATIENT_NAME, padding);
+      patients.push_back(patient);
+    }
+
+    transaction->Commit(0);
+  }
+
+  uint64_t totalPages1, freePages1;
+  db.GetPagesCount(totalPages1, freePages1);
+
+  {
+    std::unique_ptr<IDatabaseWrapper::ITransaction> transaction(
+      db.StartTransaction(TransactionType_ReadWrite, listener));
+
+    for (size_t i = 0; i < patients.size(); i++)
+    {
+      transaction->DeleteResource(patients[i]);
+    }
+
+    transaction->Commit(0);
+  }
+
+  // The file doesn't shrink after the deletion
+  uint64_t totalPages2, freePages2;
+  db.GetPagesCount(totalPages2, freePages2);
+  ASSERT_EQ(totalPages1, totalPages2);
+  ASSERT_GT(freePages2, freePages1 + 10u);
+
+  // Not idle, as a transaction has just been run
+  ASSERT_FALSE(db.CompactIncrementally(10, 3600 * 1000));
+
+  ASSERT_TRUE(db.CompactIncrementally(10, 0));
+
+  uint64_t totalPages3, freePages3;
+  db.GetPagesCount(totalPages3, freePages3);
+  ASSERT_EQ(totalPages2 - 10u, totalPages3);
+  ASSERT_EQ(freePages2 - 10u, freePages3);
+
+  db.Optimize();
+  db.Close();
+}
+
+
+namespace
+{
+  class LookupVisitorCollector : public ServerContext::ILookupVisitor
+  {
+  private:
+    std::vector<std::string>  instances_;
+    bool                      isComplete_;
+    bool                      hasJson_;
+
+  public:
+    LookupVisitorCollector() :
+      isComplete_(false),
+      hasJson_(true)
+    {
+    }
+
+    virtual bool IsDicomAsJsonNeeded() const ORTHANC_OVERRIDE
+    {
+      return true;
+    }
+
+    virtual void MarkAsComplete() ORTHANC_OVERRIDE
+    {
+      isComplete_ = true;
+    }
+
+    virtual void Visit(const std::string& publicId,
+                       const std::string& instanceId,
+                       const DicomMap& mainDicomTags,
+                       const Json::Value* dicomAsJson) ORTHANC_OVERRIDE
+    {
+      instances_.push_back(instanceId);
+      hasJson_ = (hasJson_ && dicomAsJson != NULL);
+    }
+
+    const std::vector<std::string>& GetInstances() const
+    {
+      return instances_;
+    }
+
+    bool IsComplete() const
+    {
+      return isComplete_;
+    }
+
+    bool HasJson() const
+    {
+      return hasJson_;
+    }
+  };
+}
+
+
+TEST(ServerIndex, ParallelLookup)
+{
+  MemoryStorageArea storage;
+  SQLiteDatabaseWrapper db;   // The SQLite DB is in memory
+  db.Open();
+  ServerContext context(db, storage, true /* running unit tests */, 10);
+  context.SetupJobsEngine(true, false);
+
+  // "DerivationDescription" is not a main DICOM tag, which forces
+  // the filtering to read the instances from the storage area
+  const DicomTag derivation(0x0008, 0x2111);
+
+  for (int i = 0; i < 40; i++)
+  {
+    DicomMap instance;
+    instance.SetValue(DICOM_TAG_PATIENT_ID, "patient", false);
+    instance.SetValue(DICOM_TAG_STUDY_INSTANCE_UID, "study", false);
+    instance.SetValue(DICOM_TAG_SERIES_INSTANCE_UID, "series", false);
+    instance.SetValue(DICOM_TAG_SOP_INSTANCE_UID, "sop-" + boost::lexical_cast<std::string>(i), false);
+    instance.SetValue(DICOM_TAG_SOP_CLASS_UID, "1.2.840.10008.5.1.4.1.1.1", false);  // CR image
+    instance.SetValue(derivation, (i % 2 == 0 ? "even" : "odd"), false);
+
+    ParsedDicomFile dicom(instance, GetDefaultDicomEncoding(), false /* be strict */);
+    std::unique_ptr<DicomInstanceToStore> toStore(DicomInstanceToStore::CreateFromParsedDicomFile(dicom));
+    toStore->SetOrigin(DicomInstanceOrigin::FromPlugins());
+
+    std::string id;
+    ASSERT_EQ(StoreStatus_Success, context.Store(id, *toStore, StoreInstanceMode_Default).GetStatus());
+  }
+
+  DatabaseLookup lookup;
+  lookup.AddDicomConstraint(derivation, "even", false, true);
+
+  LookupVisitorCollector all;
+  context.Apply(all, lookup, ResourceType_Instance, 0, 0);
+  ASSERT_TRUE(all.IsComplete());
+  ASSERT_TRUE(all.HasJson());
+  ASSERT_EQ(20u, all.GetInstances().size());
+
+  // The answers must follow the same order, whatever "since" and "limit"
+  LookupVisitorCollector page;
+  context.Apply(page, lookup, ResourceType_Instance, 3, 5);
+  ASSERT_FALSE(page.IsComplete());
+  ASSERT_TRUE(page.HasJson());
+  ASSERT_EQ(5u, page.GetInstances().size());
+
+  for (size_t i = 0; i < 5; i++)
+  {
+    ASSERT_EQ(all.GetInstances()[3 + i], page.GetInstances()[i]);
+  }
+
+  LookupVisitorCollector last;
+  context.Apply(last, lookup, ResourceType_Instance, 15, 5);
+  ASSERT_TRUE(last.IsComplete());
+  ASSERT_EQ(5u, last.GetInstances().size());
+  ASSERT_EQ(all.GetInstances()[19], last.GetInstances()[4]);
+
+  context.Stop();
+  db.Close();
+}
+
+
+TEST(ColumnarIndex, GroupBy)
+{
+  ColumnarIndex index;
+
+  {
+    DicomMap tags;
+    tags.SetValue(DICOM_TAG_PATIENT_ID, "p1", false);
+    ASSERT_TRUE(index.Store(ResourceType_Patient, "patient1", "", tags, 0));
+    tags.SetValue(DICOM_TAG_PATIENT_ID, "p2", false);
+    ASSERT_TRUE(index.Store(ResourceType_Patient, "patient2", "", tags, 0));
+  }
+
+  for (unsigned int i = 0; i < 6; i++)
+  {
+    const std::string s = boost::lexical_cast<std::string>(i);
+
+    DicomMap study;
+    study.SetValue(DICOM_TAG_STUDY_DATE, (i < 4 ? "20200101" : "20200102"), false);
+    study.SetValue(DICOM_TAG_INSTITUTION_NAME, (i % 2 == 0 ? "A" : "B"), false);
+    ASSERT_TRUE(index.Store(ResourceType_Study, "study" + s, (i < 5 ? "patient1" : "patient2"), study, 0));
+
+    DicomMap series;
+    series.SetValue(DICOM_TAG_MODALITY, "CT", false);
+    ASSERT_TRUE(index.Store(ResourceType_Series, "series" + s + "a", "study" + s, series, 0));
+    series.SetValue(DICOM_TAG_MODALITY, (i == 0 ? "CT" : "MR"), false);
+    ASSERT_TRUE(index.Store(ResourceType_Series, "series" + s + "b", "study" + s, series, 0));
+
+    DicomMap instance;
+    ASSERT_TRUE(index.Store(ResourceType_Instance, "instance" + s, "series" + s + "a", instance, 100 + i));
+  }
+
+  // Unknown parent
+  ASSERT_FALSE(index.Store(ResourceType_Study, "nope", "nope", DicomMap(), 0));
+  ASSERT_FALSE(index.HasResource(ResourceType_Study, "nope"));
+
+  ASSERT_EQ(2u, index.GetResourcesCount(ResourceType_Patient));
+  ASSERT_EQ(6u, index.GetResourcesCount(ResourceType_Study));
+  ASSERT_EQ(12u, index.GetResourcesCount(ResourceType_Series));
+  ASSERT_EQ(6u, index.GetResourcesCount(ResourceType_Instance));
+
+  DatabaseLookup noFilter;
+  std::list<ColumnarIndex::Group> groups;
+
+  {
+    // Studies per day
+    std::vector<DicomTag> groupBy;
+    groupBy.push_back(DICOM_TAG_STUDY_DATE);
+    index.GroupBy(groups, ResourceType_Study, groupBy, noFilter, ResourceType_Study, 0);
+    ASSERT_EQ(2u, groups.size());
+    ASSERT_EQ("20200101", groups.front().GetValues()[0]);
+    ASSERT_EQ(4u, groups.front().GetCount());
+    ASSERT_EQ("20200102", groups.back().GetValues()[0]);
+    ASSERT_EQ(2u, groups.back().GetCount());
+  }
+
+  {
+    // Studies per modality per day (the study date is stored at the parent level)
+    std::vector<DicomTag> groupBy;
+    groupBy.push_back(DICOM_TAG_MODALITY);
+    groupBy.push_back(DICOM_TAG_STUDY_DATE);
+    index.GroupBy(groups, ResourceType_Series, groupBy, noFilter, ResourceType_Study, 0);
+    ASSERT_EQ(4u, groups.size());
+
+    std::list<ColumnarIndex::Group>::const_iterator it = groups.begin();
+    ASSERT_EQ("CT", it->GetValues()[0]);  ASSERT_EQ("20200101", it->GetValues()[1]);  ASSERT_EQ(4u, it->GetCount());  ++it;
+    ASSERT_EQ("CT", it->GetValues()[0]);  ASSERT_EQ("20200102", it->GetValues()[1]);  ASSERT_EQ(2u, it->GetCount());  ++it;
+    ASSERT_EQ("MR", it->GetValues()[0]);  ASSERT_EQ("20200101", it->GetValues()[1]);  ASSERT_EQ(3u, it->GetCount());  ++it;
+    ASSERT_EQ("MR", it->GetValues()[0]);  ASSERT_EQ("20200102", it->GetValues()[1]);  ASSERT_EQ(2u, it->GetCount());
+  }
+
+  {
+    // Patients with more than 1 study
+    std::vector<DicomTag> groupBy;
+    groupBy.push_back(DICOM_TAG_PATIENT_ID);
+    index.GroupBy(groups, ResourceType_Study, groupBy, noFilter, ResourceType_Study, 2);
+    ASSERT_EQ(1u, groups.size());
+    ASSERT_EQ("p1", groups.front().GetValues()[0]);
+    ASSERT_EQ(5u, groups.front().GetCount());
+  }
+
+  {
+    // Storage per institution, restricted to one day
+    DatabaseLookup filter;
+    filter.AddRestConstraint(DICOM_TAG_STUDY_DATE, "20200101", false, true);
+
+    std::vector<DicomTag> groupBy;
+    groupBy.push_back(DICOM_TAG_INSTITUTION_NAME);
+    index.GroupBy(groups, ResourceType_Instance, groupBy, filter, ResourceType_Instance, 0);
+    ASSERT_EQ(2u, groups.size());
+    ASSERT_EQ("A", groups.front().GetValues()[0]);
+    ASSERT_EQ(2u, groups.front().GetCount());
+    ASSERT_EQ(100u + 102u, groups.front().GetTotalSize());
+    ASSERT_EQ("B", groups.back().GetValues()[0]);
+    ASSERT_EQ(101u + 103u, groups.back().GetTotalSize());
+  }
+
+  {
+    // Wildcard on a tag that is not stored
+    DatabaseLookup filter;
+    filter.AddRestConstraint(DICOM_TAG_ACCESSION_NUMBER, "A*", false, true);
+
+    std::vector<DicomTag> groupBy;
+    index.GroupBy(groups, ResourceType_Study, groupBy, filter, ResourceType_Study, 0);
+    ASSERT_TRUE(groups.empty());
+  }
+
+  ASSERT_THROW(index.GroupBy(groups, ResourceType_Study, std::vector<DicomTag>(), noFilter,
+                             ResourceType_Series, 0), OrthancException);
+
+  // Removing resources, with enough churn to trigger the compaction
+  index.Remove(ResourceType_Instance, "instance0");
+  index.Remove(ResourceType_Series, "series0a");
+  ASSERT_FALSE(index.HasResource(ResourceType_Instance, "instance0"));
+  ASSERT_EQ(11u, index.GetResourcesCount(ResourceType_Series));
+
+  for (unsigned int i = 0; i < 3000; i++)
+  {
+    const std::string s = "tmp" + boost::lexical_cast<std::string>(i);
+    DicomMap series;
+    series.SetValue(DICOM_TAG_MODALITY, "US", false);
+    ASSERT_TRUE(index.Store(ResourceType_Series, s, "study1", series, 0));
+    index.Remove(ResourceType_Series, s);
+  }
+
+  ASSERT_EQ(11u, index.GetResourcesCount(ResourceType_Series));
+  ASSERT_TRUE(index.HasResource(ResourceType_Instance, "instance5"));
+
+  {
+    std::vector<DicomTag> groupBy;
+    groupBy.push_back(DICOM_TAG_MODALITY);
+    index.GroupBy(groups, ResourceType_Series, groupBy, noFilter, ResourceType_Series, 0);
+    ASSERT_EQ(2u, groups.size());
+    ASSERT_EQ("CT", groups.front().GetValues()[0]);
+    ASSERT_EQ(6u, groups.front().GetCount());  // 7 CT series, minus the removed one
+    ASSERT_EQ("MR", groups.back().GetValues()[0]);
+    ASSERT_EQ(5u, groups.back().GetCount());
+
+    // The instances still point to the right studies after compaction
+    groupBy[0] = DICOM_TAG_STUDY_DATE;
+    index.GroupBy(groups, ResourceType_Instance, groupBy, noFilter, ResourceType_Instance, 0);
+    ASSERT_EQ(2u, groups.size());
+    ASSERT_EQ(3u, groups.front().GetCount());
+    ASSERT_EQ(2u, groups.back().GetCount());
+  }
+
+  // Loading from the database must not resurrect removed resources
+  index.Remove(ResourceType_Instance, "instance1");
+  ASSERT_TRUE(index.Load(ResourceType_Instance, "instance1", "series1a", DicomMap(), 0));
+  ASSERT_FALSE(index.HasResource(ResourceType_Instance, "instance1"));
+  index.MarkAsLoaded();
+  ASSERT_TRUE(index.IsLoaded());
+  ASSERT_TRUE(index.Load(ResourceType_Instance, "instance1", "series1a", DicomMap(), 0));
+  ASSERT_TRUE(index.HasResource(ResourceType_Instance, "instance1"));
+}
+
+
+TEST(ReadAheadTracker, Sequential)
+{
+  ReadAheadTracker tracker(2, 100);
+
+  std::vector<std::string> instances;
+  for (unsigned int i = 0; i < 10; i++)
+  {
+    instances.push_back("i" + boost::lexical_cast<std::string>(i));
+  }
+
+  ASSERT_FALSE(tracker.HasSeries("s1"));
+  tracker.SetSeries("s1", instances);
+  ASSERT_TRUE(tracker.HasSeries("s1"));
+
+  std::vector<std::string> next;
+  tracker.SignalAccess(next, "nope", "i0", 3);
+  ASSERT_TRUE(next.empty());
+
+  // The first access is not sequential
+  tracker.SignalAccess(next, "s1", "i2", 3);
+  ASSERT_TRUE(next.empty());
+
+  // Same instance (e.g. another frame): Still not sequential
+  tracker.SignalAccess(next, "s1", "i2", 3);
+  ASSERT_TRUE(next.empty());
+
+  tracker.SignalAccess(next, "s1", "i3", 3);
+  ASSERT_EQ(3u, next.size());
+  ASSERT_EQ("i4", next[0]);
+  ASSERT_EQ("i5", next[1]);
+  ASSERT_EQ("i6", next[2]);
+
+  tracker.SignalPrefetched("i4");
+  tracker.SignalPrefetched("i5");
+
+  // Skipping one slice is still sequential
+  tracker.SignalAccess(next, "s1", "i5", 3);
+  ASSERT_EQ(3u, next.size());
+  ASSERT_EQ("i6", next[0]);
+  ASSERT_EQ("i7", next[1]);
+  ASSERT_EQ("i8", next[2]);
+
+  // The prefetched instances are not returned again
+  tracker.SignalPrefetched("i7");
+  tracker.SignalAccess(next, "s1", "i6", 3);
+  ASSERT_EQ(2u, next.size());
+  ASSERT_EQ("i8", next[0]);
+  ASSERT_EQ("i9", next[1]);
+
+  tracker.SignalAccess(next, "s1", "i9", 3);  // Too large stride
+  ASSERT_TRUE(next.empty());
+
+  // Backward access
+  tracker.SignalAccess(next, "s1", "i8", 3);
+  ASSERT_EQ(2u, next.size());
+  ASSERT_EQ("i6", next[0]);
+  ASSERT_EQ("i5", next[1]);
+
+  tracker.SignalAccess(next, "s1", "i1", 3);
+  ASSERT_TRUE(next.empty());
+  tracker.SignalAccess(next, "s1", "i0", 3);  // Beginning of the series
+  ASSERT_TRUE(next.empty());
+
+  uint64_t prefetched, hits;
+  tracker.GetStatistics(prefetched, hits);
+  ASSERT_EQ(3u, prefetched);
+  ASSERT_EQ(1u, hits);  // Only "i5" was accessed after its prefetching
+
+  // Only the 2 most recently accessed series are kept
+  tracker.SetSeries("s2", instances);
+  tracker.SetSeries("s3", instances);
+  ASSERT_FALSE(tracker.HasSeries("s1"));
+  ASSERT_TRUE(tracker.HasSeries("s2"));
+  ASSERT_TRUE(tracker.HasSeries("s3"));
+}
@@ -619,8 +619,6 @@ TEST_F(OrthancJobsSerialization, Operations)
   // StoreScuOperation
 
   {
-    TimeoutDicomConnectionManager luaManager;
-    
     {
       RemoteModalityParameters modality;
       modality.SetApplicationEntityTitle("REMOTE");
@@ -628,7 +626,7 @@ TEST_F(OrthancJobsSerialization, Operations)
       modality.SetPortNumber(1000);
       modality.SetManufacturer(ModalityManufacturer_GE);
 
-      StoreScuOperation operation(GetContext(), luaManager, "TEST", modality);
+      StoreScuOperation operation(GetContext(), "TEST", modality);
 
       ASSERT_TRUE(CheckIdempotentSerialization(unserializer, operation));
       operation.Serialize(s);